@@ -0,0 +1,198 @@
+/* #########################################################################
+        Distortion mesh -- the Rift's barrel warp, baked into a mesh
+
+   Eye e's grid spans NDC x in [e - 1, e] and y in [-1, 1], with the
+   texture coordinate barrel.geom handed the shader there: u = (x + 1)
+   / 2, v = (1 - y) / 2. Both eyes share one vertex array, left eye
+   first, so the whole warp is a single draw; that keeps the vertex
+   count well inside 16-bit indices at any grid the constructor takes.
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#include "distortion_mesh.h"
+#include <math.h>
+
+//Windows
+#include <windows.h>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+// Most cells either way; 2 * 161 * 161 vertices still fit 16-bit indices
+#define DISTORTION_MESH_MAX_CELLS 160
+
+void xen_rift::distortion_params_default( distortion_params_t * p ){
+    p->K[0] = 1.0f;
+    p->K[1] = 0.22f;
+    p->K[2] = 0.24f;
+    p->K[3] = 0.0f;
+    p->lens_offset = 0.151976f;
+    p->scale[0] = 0.25f;
+    p->scale[1] = 0.5f;
+    p->scale_in[0] = 4.0f;
+    p->scale_in[1] = 2.0f;
+}
+
+bool xen_rift::distortion_params_equal( const distortion_params_t & a, const distortion_params_t & b ){
+    return memcmp(&a, &b, sizeof(distortion_params_t)) == 0;
+}
+
+/* #########################################################################
+
+                               distortion_warp
+        -HmdWarp about the eye's lens center, then barrel.frag's flip
+            of v and its clamp test, as a distance to the nearest edge
+            of the eye's half of the image.
+
+   ######################################################################### */
+float xen_rift::distortion_warp( const distortion_params_t & p, int eye, float in_u, float in_v,
+                                 float * u, float * v ){
+    const float screen_u = eye ? 0.75f : 0.25f;
+    const float lens_u = eye ? screen_u - p.lens_offset * 0.25f : screen_u + p.lens_offset * 0.25f;
+    const float lens_v = 0.5f;
+
+    float tx = (in_u - lens_u) * p.scale_in[0];
+    float ty = (in_v - lens_v) * p.scale_in[1];
+    float rsq = tx * tx + ty * ty;
+    float r = p.K[0] + p.K[1] * rsq + p.K[2] * rsq * rsq + p.K[3] * rsq * rsq * rsq;
+    *u = lens_u + p.scale[0] * tx * r;
+    *v = 1.0f - (lens_v + p.scale[1] * ty * r);
+
+    float edge = *u - (screen_u - 0.25f);
+    float d = (screen_u + 0.25f) - *u;
+    if (d < edge) edge = d;
+    d = *v;
+    if (d < edge) edge = d;
+    d = 1.0f - *v;
+    if (d < edge) edge = d;
+    return edge;
+}
+
+Distortion_Mesh::Distortion_Mesh( int cells_x, int cells_y ){
+    _cells_x = cells_x < 1 ? 1 : (cells_x > DISTORTION_MESH_MAX_CELLS ? DISTORTION_MESH_MAX_CELLS : cells_x);
+    _cells_y = cells_y < 1 ? 1 : (cells_y > DISTORTION_MESH_MAX_CELLS ? DISTORTION_MESH_MAX_CELLS : cells_y);
+    distortion_params_default(&_params);
+}
+
+/* #########################################################################
+
+                                    build
+        -Warp every grid vertex, then two triangles for each cell with
+            at least one corner inside its eye's image. A cell whose
+            corners are all outside interpolates to outside all over,
+            so dropping it changes nothing.
+
+   ######################################################################### */
+void Distortion_Mesh::build( const distortion_params_t & p ){
+    _params = p;
+    const int vx = _cells_x + 1, vy = _cells_y + 1;
+    _vertices.resize(2 * vx * vy);
+    _indices.clear();
+    _indices.reserve(2 * _cells_x * _cells_y * 6);
+
+    for (int e = 0; e < 2; e++){
+        for (int j = 0; j < vy; j++){
+            for (int i = 0; i < vx; i++){
+                distortion_vertex_t & t = _vertices[vertex_index(e, i, j)];
+                t.x = (float)(e - 1) + (float)i / (float)_cells_x;
+                t.y = -1.0f + 2.0f * (float)j / (float)_cells_y;
+                t.edge = distortion_warp(p, e, (t.x + 1.0f) * 0.5f, (1.0f - t.y) * 0.5f, &t.u, &t.v);
+            }
+        }
+        for (int j = 0; j < _cells_y; j++){
+            for (int i = 0; i < _cells_x; i++){
+                unsigned short a = (unsigned short)vertex_index(e, i, j);
+                unsigned short b = (unsigned short)vertex_index(e, i + 1, j);
+                unsigned short c = (unsigned short)vertex_index(e, i, j + 1);
+                unsigned short d = (unsigned short)vertex_index(e, i + 1, j + 1);
+                if (_vertices[a].edge < 0.0f && _vertices[b].edge < 0.0f &&
+                    _vertices[c].edge < 0.0f && _vertices[d].edge < 0.0f)
+                    continue;
+                _indices.push_back(a); _indices.push_back(b); _indices.push_back(d);
+                _indices.push_back(a); _indices.push_back(d); _indices.push_back(c);
+            }
+        }
+    }
+}
+
+float Distortion_Mesh::sample( float x, float y, float * u, float * v ){
+    int e = x < 0.0f ? 0 : 1;
+    float fx = (x + 1.0f - (float)e) * (float)_cells_x;
+    float fy = (y + 1.0f) * 0.5f * (float)_cells_y;
+    int i = (int)floorf(fx), j = (int)floorf(fy);
+    if (i < 0) i = 0;
+    if (i >= _cells_x) i = _cells_x - 1;
+    if (j < 0) j = 0;
+    if (j >= _cells_y) j = _cells_y - 1;
+    fx -= (float)i;
+    fy -= (float)j;
+
+    const distortion_vertex_t & a = _vertices[vertex_index(e, i, j)];
+    const distortion_vertex_t & b = _vertices[vertex_index(e, i + 1, j)];
+    const distortion_vertex_t & c = _vertices[vertex_index(e, i, j + 1)];
+    const distortion_vertex_t & d = _vertices[vertex_index(e, i + 1, j + 1)];
+    // triangle (a, b, d) below the diagonal, (a, d, c) above it
+    float wb, wc, wd;
+    if (fx >= fy){
+        wb = fx - fy; wd = fy; wc = 0.0f;
+    } else {
+        wc = fy - fx; wd = fx; wb = 0.0f;
+    }
+    float wa = 1.0f - wb - wc - wd;
+    *u = wa * a.u + wb * b.u + wc * c.u + wd * d.u;
+    *v = wa * a.v + wb * b.v + wc * c.v + wd * d.v;
+    return wa * a.edge + wb * b.edge + wc * c.edge + wd * d.edge;
+}
+
+/* #########################################################################
+
+                             distortion_mesh_check
+        -Pixel centers, as the rasterizer samples them. Coordinate
+            error only counts where both agree the pixel is inside.
+
+   ######################################################################### */
+void xen_rift::distortion_mesh_check( int width, int height, int cells_x, int cells_y ){
+    distortion_params_t p;
+    distortion_params_default(&p);
+    Distortion_Mesh mesh(cells_x, cells_y);
+
+    LARGE_INTEGER freq, start, stop;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    mesh.build(p);
+    QueryPerformanceCounter(&stop);
+    double build_ms = ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+
+    double max_err = 0.0, sum_err = 0.0;
+    unsigned int inside = 0, flipped = 0;
+    for (int py = 0; py < height; py++){
+        float y = ((float)py + 0.5f) / (float)height * 2.0f - 1.0f;
+        for (int px = 0; px < width; px++){
+            float x = ((float)px + 0.5f) / (float)width * 2.0f - 1.0f;
+            float ru, rv, mu, mv;
+            float redge = distortion_warp(p, x < 0.0f ? 0 : 1, (x + 1.0f) * 0.5f, (1.0f - y) * 0.5f,
+                                          &ru, &rv);
+            float medge = mesh.sample(x, y, &mu, &mv);
+            if ((redge >= 0.0f) != (medge >= 0.0f)){
+                flipped++;
+                continue;
+            }
+            if (redge < 0.0f)
+                continue;
+            double du = (mu - ru) * width, dv = (mv - rv) * height;
+            double err = sqrt(du * du + dv * dv);
+            if (err > max_err)
+                max_err = err;
+            sum_err += err;
+            inside++;
+        }
+    }
+    printf("Distortion mesh: %d x %d cells per eye, %u vertices, %u triangles, built in %.3f ms\n",
+        mesh.cells_x(), mesh.cells_y(), mesh.num_vertices(), mesh.num_indices() / 3, build_ms);
+    printf("    vs. the per-pixel warp at %d x %d: max %.3f texels, mean %.4f texels over %u pixels; "
+        "%u pixels (%.3f%%) changed inside / outside\n", width, height, max_err,
+        inside ? sum_err / inside : 0.0, inside, flipped, 100.0 * flipped / ((double)width * height));
+}
@@ -0,0 +1,116 @@
+/* #########################################################################
+        Distortion mesh -- the Rift's barrel warp, baked into a mesh
+   Header!
+
+	shaders/barrel.frag used to run the HmdWarp polynomial and a clamp
+	test for every output pixel, every frame, though its answer only
+	depends on a handful of lens parameters. Distortion_Mesh does that
+	math once on the CPU instead: each eye's half of the screen is cut
+	into a grid of cells, and each grid vertex gets the warped texture
+	coordinate the shader would have computed for that spot, plus how
+	far inside its eye's half of the rendered image that coordinate
+	lands (negative where the shader drew black). The warp pass is then
+	a plain textured-mesh draw (shaders/distortion_mesh.*); in between
+	the vertices the warp is linear, which at the default grid is under
+	half a texel off (distortion_mesh_check says by how much).
+
+	Cells that fall wholly outside their eye's image are left out,
+	since the clear already makes them black. Rift rebuilds its mesh
+	only when the parameters it reads from the stereo config change.
+
+	Everything here is plain host code with no GL, so the mesh can be
+	built and checked without a window (particle_swirl_bench -benchwarp).
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#ifndef __XEN_DISTORTION_MESH_H
+#define __XEN_DISTORTION_MESH_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <vector>
+
+namespace xen_rift {
+	// Grid cells across / down each eye, by default
+	#define DISTORTION_MESH_CELLS_X 64
+	#define DISTORTION_MESH_CELLS_Y 80
+
+	// What barrel.frag's uniforms held. Texture coordinates are over
+	// the whole side-by-side image, [0, 1] each way; each eye's lens
+	// center is lens_offset * 0.25 in from the center of its half,
+	// toward the nose.
+	typedef struct _distortion_params_t {
+		float K[4];          // HmdWarpParam
+		float lens_offset;   // DistortionOffset
+		float scale[2];      // Scale
+		float scale_in[2];   // ScaleIn
+	} distortion_params_t;
+
+	// One mesh vertex: screen position in NDC, warped texture coordinate
+	// and its distance inside the eye's half of the image (in texture
+	// units; < 0 is outside, i.e. black)
+	typedef struct _distortion_vertex_t {
+		float x, y;
+		float u, v;
+		float edge;
+	} distortion_vertex_t;
+
+	// barrel.frag's defaults (the DK1 lens)
+	void distortion_params_default( distortion_params_t * p );
+	bool distortion_params_equal( const distortion_params_t & a, const distortion_params_t & b );
+
+	// barrel.frag's math for one spot: in_u / in_v as the shader got
+	// them (eye 0 = left, in_u in [0, 0.5]; eye 1 = right, [0.5, 1]),
+	// the warped coordinate into *u / *v, and the edge distance
+	// returned. The reference the mesh is checked against.
+	float distortion_warp( const distortion_params_t & p, int eye, float in_u, float in_v,
+						   float * u, float * v );
+
+	class Distortion_Mesh {
+		public:
+			Distortion_Mesh( int cells_x = DISTORTION_MESH_CELLS_X, int cells_y = DISTORTION_MESH_CELLS_Y );
+
+			// Regenerate for p; both eyes, one vertex / index array
+			void build( const distortion_params_t & p );
+			// Whatever the last build() was for
+			const distortion_params_t & params( void ) { return _params; }
+			bool built( void ) { return !_vertices.empty(); }
+
+			int cells_x( void ) { return _cells_x; }
+			int cells_y( void ) { return _cells_y; }
+			// Vertex (i, j) of eye e is vertices()[vertex_index(e, i, j)]
+			unsigned int vertex_index( int eye, int i, int j ) {
+				return (unsigned int)((eye * (_cells_y + 1) + j) * (_cells_x + 1) + i); }
+			const distortion_vertex_t * vertices( void ) { return &_vertices[0]; }
+			unsigned int num_vertices( void ) { return (unsigned int)_vertices.size(); }
+			// GL_TRIANGLES, two per kept cell
+			const unsigned short * indices( void ) { return _indices.empty() ? NULL : &_indices[0]; }
+			unsigned int num_indices( void ) { return (unsigned int)_indices.size(); }
+
+			// What the rasterizer would interpolate at NDC (x, y): the
+			// same split of each cell into two triangles as indices()
+			float sample( float x, float y, float * u, float * v );
+
+		protected:
+			int _cells_x;
+			int _cells_y;
+			distortion_params_t _params;
+			std::vector<distortion_vertex_t> _vertices;
+			std::vector<unsigned short> _indices;
+
+		private:
+	};
+
+	// Build a mesh at cells_x x cells_y and compare it against
+	// distortion_warp at every pixel of a width x height screen: print
+	// the build time, the largest and mean texture coordinate error in
+	// texels and the pixels whose inside / outside call changed.
+	void distortion_mesh_check( int width, int height, int cells_x, int cells_y );
+};
+
+#endif //__XEN_DISTORTION_MESH_H
@@ -0,0 +1,738 @@
+/* #########################################################################
+        GL_Command_Buffer -- a frame's scene, recorded once, replayed per eye
+
+   The stream is 32-bit words: a header (op in the low byte, argument
+   words above it) and then the arguments, enums / ints as they are and
+   floats bit for bit. Material / light commands carry their float
+   count first. Calls are an index into a side table, so nothing in the
+   stream depends on pointer size.
+
+   Replay tracks the GL_ARRAY_BUFFER binding the scene expects, since
+   a vertex batch has to bind the frame's VBO for its draw; the
+   interleaved client arrays are left on across batches and only turned
+   off (and the scene's binding put back) before anything that binds
+   buffers, sets attributes, draws or runs a call.
+
+   In replay_stereo, execute routes each command: per-eye ones run
+   through execute again once for each eye (_per_eye set, so they go
+   straight through), instanced draws switch to the whole viewport with
+   both clip distances on. The viewport / projection only change when
+   the eye does, so a run of per-eye commands costs a switch per eye
+   each, not per command. StereoInstanced is flipped only when a draw
+   needs it flipped, and put back to false on every program that had
+   it set once the pass is over, so the same programs still draw right
+   in a multipass frame.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Single-pass instanced stereo replay
+     agent  20261017  Immediate mode counts its draws
+   ######################################################################### */
+
+#include "gl_command_buffer.h"
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+static unsigned int float_bits( float f ){
+    unsigned int u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static float bits_float( unsigned int u ){
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Floats glMaterialfv / glLightfv take for pname
+static int param_count( GLenum pname ){
+    switch (pname){
+        case GL_SHININESS:
+        case GL_SPOT_EXPONENT:
+        case GL_SPOT_CUTOFF:
+        case GL_CONSTANT_ATTENUATION:
+        case GL_LINEAR_ATTENUATION:
+        case GL_QUADRATIC_ATTENUATION:
+            return 1;
+        case GL_SPOT_DIRECTION:
+        case GL_COLOR_INDEXES:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+// Primitives whose batches can simply be appended to each other
+static bool mergeable( GLenum mode ){
+    return mode == GL_POINTS || mode == GL_LINES || mode == GL_TRIANGLES || mode == GL_QUADS;
+}
+
+GL_Command_Buffer::GL_Command_Buffer( bool immediate ) :
+        _immediate(immediate),
+        _num_commands(0),
+        _num_draws(0),
+        _last_op(0),
+        _batch_mode(GL_POINTS),
+        _batch_first(0),
+        _in_batch(false),
+        _vbo(0),
+        _arrays_on(false),
+        _array_buffer(0),
+        _program(0),
+        _replay_draws(0),
+        _stereo(NULL),
+        _stereo_passes(0),
+        _stereo_program(-1),
+        _instanced(-1),
+        _pass_eye(-1),
+        _per_eye(false)
+{
+    begin_record();
+}
+
+/* #########################################################################
+
+                            begin_record / end_record
+        -Current vertex attributes start from GL's defaults, so a frame
+            records the same whatever the last one left behind.
+        -In immediate mode, just starts the draw count over.
+
+   ######################################################################### */
+void GL_Command_Buffer::begin_record( void ){
+    _words.clear();
+    _vertices.clear();
+    _calls.clear();
+    _num_commands = 0;
+    _num_draws = 0;
+    _last_op = 0;
+    _in_batch = false;
+    if (_immediate)
+        _replay_draws = 0;
+    _normal[0] = 0.0f; _normal[1] = 0.0f; _normal[2] = 1.0f;
+    _tex_coord[0] = 0.0f; _tex_coord[1] = 0.0f;
+    _color[0] = 1.0f; _color[1] = 1.0f; _color[2] = 1.0f; _color[3] = 1.0f;
+}
+
+void GL_Command_Buffer::end_record( void ){
+    if (_immediate || _vertices.empty())
+        return;
+    if (!_vbo)
+        glGenBuffers(1, &_vbo);
+    GLint bound;
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &bound);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    // a fresh store every frame, so the driver never waits on the last
+    glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(float), &_vertices[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, (GLuint)bound);
+}
+
+void GL_Command_Buffer::replay( void ){
+    if (_immediate)
+        return;
+    GLint bound;
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &bound);
+    _array_buffer = (GLuint)bound;
+    _arrays_on = false;
+    _replay_draws = 0;
+    size_t pos = 0;
+    while (pos < _words.size())
+        pos = execute(pos);
+    vertex_arrays(false);
+}
+
+/* #########################################################################
+
+                                replay_stereo
+        -Starts on eye 0 with the scene's current program looked up,
+            ends with StereoInstanced back off wherever it was set.
+
+   ######################################################################### */
+void GL_Command_Buffer::replay_stereo( const stereo_pass_t & pass ){
+    if (_immediate)
+        return;
+    GLint bound;
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &bound);
+    _array_buffer = (GLuint)bound;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &bound);
+    _arrays_on = false;
+    _replay_draws = 0;
+    _stereo = &pass;
+    _stereo_passes++;
+    _per_eye = false;
+    _pass_eye = -2;
+    stereo_program((GLuint)bound);
+    stereo_eye(0);
+
+    size_t pos = 0;
+    while (pos < _words.size())
+        pos = execute(pos);
+    vertex_arrays(false);
+
+    stereo_eye(0);
+    glDisable(GL_CLIP_DISTANCE0);
+    glDisable(GL_CLIP_DISTANCE1);
+    for (size_t i = 0; i < _stereo_programs.size(); i++){
+        stereo_program_t & sp = _stereo_programs[i];
+        if (sp.pass != _stereo_passes || sp.instanced < 0)
+            continue;
+        glUseProgram(sp.program);
+        glUniform1i(sp.instanced, 0);
+    }
+    glUseProgram(_program);
+    if (_stereo->set_eye)
+        _stereo->set_eye(-1, _stereo->user);
+    _stereo = NULL;
+}
+
+/* #########################################################################
+
+                               stereo_program
+        -Look program up (once ever) and, the first time this pass,
+            hand it the eyes' matrices.
+
+   ######################################################################### */
+void GL_Command_Buffer::stereo_program( GLuint program ){
+    _program = program;
+    _stereo_program = -1;
+    _instanced = -1;
+    if (program == 0)
+        return;
+    size_t i = 0;
+    while (i < _stereo_programs.size() && _stereo_programs[i].program != program)
+        i++;
+    if (i == _stereo_programs.size()){
+        stereo_program_t sp;
+        sp.program = program;
+        sp.eye_proj = glGetUniformLocation(program, STEREO_EYE_PROJ_UNIFORM);
+        sp.instanced = glGetUniformLocation(program, STEREO_INSTANCED_UNIFORM);
+        if (sp.eye_proj < 0 || sp.instanced < 0)
+            sp.eye_proj = sp.instanced = -1;
+        sp.pass = 0;
+        _stereo_programs.push_back(sp);
+    }
+    stereo_program_t & sp = _stereo_programs[i];
+    if (sp.instanced < 0)
+        return;
+    if (sp.pass != _stereo_passes){
+        glUniformMatrix4fv(sp.eye_proj, 2, GL_FALSE, &_stereo->eye_proj[0][0]);
+        sp.pass = _stereo_passes;
+    }
+    _stereo_program = (int)i;
+}
+
+void GL_Command_Buffer::set_instanced( bool on ){
+    if (_stereo_program < 0 || _instanced == (on ? 1 : 0))
+        return;
+    glUniform1i(_stereo_programs[_stereo_program].instanced, on ? 1 : 0);
+    _instanced = on ? 1 : 0;
+}
+
+void GL_Command_Buffer::stereo_eye( int e ){
+    if (e == _pass_eye)
+        return;
+    const stereo_pass_t & p = *_stereo;
+    if (e < 0){
+        glViewport(p.viewport[0][0], p.viewport[0][1],
+            p.viewport[1][0] + p.viewport[1][2] - p.viewport[0][0], p.viewport[0][3]);
+        glEnable(GL_CLIP_DISTANCE0);
+        glEnable(GL_CLIP_DISTANCE1);
+    } else {
+        if (_pass_eye < 0){
+            glDisable(GL_CLIP_DISTANCE0);
+            glDisable(GL_CLIP_DISTANCE1);
+        }
+        glViewport(p.viewport[e][0], p.viewport[e][1], p.viewport[e][2], p.viewport[e][3]);
+        glMatrixMode(GL_PROJECTION);
+        glLoadMatrixf(p.eye_proj[e]);
+        glMatrixMode(GL_MODELVIEW);
+    }
+    if (p.set_eye)
+        p.set_eye(e, p.user);
+    _pass_eye = e;
+}
+
+/* #########################################################################
+
+                                recording
+        -Each call appends its command; in immediate mode done() runs
+            it and takes it straight back off.
+
+   ######################################################################### */
+void GL_Command_Buffer::op( gl_command_op_t op, int num_args ){
+    _last_op = _words.size();
+    _words.push_back((unsigned int)op | ((unsigned int)num_args << 8));
+    _num_commands++;
+}
+
+void GL_Command_Buffer::argf( float f ){
+    _words.push_back(float_bits(f));
+}
+
+void GL_Command_Buffer::done( void ){
+    if (!_immediate)
+        return;
+    execute(_last_op);
+    _words.resize(_last_op);
+    _calls.clear();
+    _num_commands = 0;
+}
+
+void GL_Command_Buffer::begin( GLenum mode ){
+    if (_immediate){
+        glBegin(mode);
+        return;
+    }
+    _batch_mode = mode;
+    _batch_first = num_vertices();
+    _in_batch = true;
+}
+
+/* #########################################################################
+
+                                    end
+        -A batch right behind one of the same independent primitive,
+            with no command in between, just extends that one's draw.
+
+   ######################################################################### */
+void GL_Command_Buffer::end( void ){
+    if (_immediate){
+        glEnd();
+        _replay_draws++;
+        return;
+    }
+    if (!_in_batch)
+        return;
+    _in_batch = false;
+    unsigned int count = num_vertices() - _batch_first;
+    if (count == 0)
+        return;
+    if (_num_commands > 0 && (_words[_last_op] & 0xff) == GLCMD_DRAW_VERTICES &&
+        mergeable(_batch_mode) && _words[_last_op + 1] == _batch_mode &&
+        _words[_last_op + 2] + _words[_last_op + 3] == _batch_first){
+        _words[_last_op + 3] += count;
+        return;
+    }
+    op(GLCMD_DRAW_VERTICES, 3);
+    arg(_batch_mode);
+    arg(_batch_first);
+    arg(count);
+    _num_draws++;
+}
+
+void GL_Command_Buffer::vertex( float x, float y, float z ){
+    if (_immediate){
+        glVertex3f(x, y, z);
+        return;
+    }
+    if (!_in_batch)
+        return;
+    _vertices.push_back(x);
+    _vertices.push_back(y);
+    _vertices.push_back(z);
+    _vertices.insert(_vertices.end(), _normal, _normal + 3);
+    _vertices.insert(_vertices.end(), _tex_coord, _tex_coord + 2);
+    _vertices.insert(_vertices.end(), _color, _color + 4);
+}
+
+void GL_Command_Buffer::normal( float x, float y, float z ){
+    if (_immediate){
+        glNormal3f(x, y, z);
+        return;
+    }
+    _normal[0] = x; _normal[1] = y; _normal[2] = z;
+}
+
+void GL_Command_Buffer::tex_coord( float s, float t ){
+    if (_immediate){
+        glTexCoord2f(s, t);
+        return;
+    }
+    _tex_coord[0] = s; _tex_coord[1] = t;
+}
+
+void GL_Command_Buffer::color( float r, float g, float b, float a ){
+    if (_immediate){
+        glColor4f(r, g, b, a);
+        return;
+    }
+    _color[0] = r; _color[1] = g; _color[2] = b; _color[3] = a;
+}
+
+void GL_Command_Buffer::enable( GLenum cap ){
+    op(GLCMD_ENABLE, 1); arg(cap); done();
+}
+
+void GL_Command_Buffer::disable( GLenum cap ){
+    op(GLCMD_DISABLE, 1); arg(cap); done();
+}
+
+void GL_Command_Buffer::active_texture( GLenum unit ){
+    op(GLCMD_ACTIVE_TEXTURE, 1); arg(unit); done();
+}
+
+void GL_Command_Buffer::bind_texture( GLenum target, GLuint texture ){
+    op(GLCMD_BIND_TEXTURE, 2); arg(target); arg(texture); done();
+}
+
+void GL_Command_Buffer::tex_env( GLenum mode ){
+    op(GLCMD_TEX_ENV, 1); arg(mode); done();
+}
+
+void GL_Command_Buffer::material( GLenum face, GLenum pname, const float * params ){
+    int n = param_count(pname);
+    op(GLCMD_MATERIAL, 3 + n); arg(face); arg(pname); arg(n);
+    for (int i = 0; i < n; i++)
+        argf(params[i]);
+    done();
+}
+
+void GL_Command_Buffer::light( GLenum light, GLenum pname, const float * params ){
+    int n = param_count(pname);
+    op(GLCMD_LIGHT, 3 + n); arg(light); arg(pname); arg(n);
+    for (int i = 0; i < n; i++)
+        argf(params[i]);
+    done();
+}
+
+void GL_Command_Buffer::push_matrix( void ){
+    op(GLCMD_PUSH_MATRIX, 0); done();
+}
+
+void GL_Command_Buffer::pop_matrix( void ){
+    op(GLCMD_POP_MATRIX, 0); done();
+}
+
+void GL_Command_Buffer::translate( float x, float y, float z ){
+    op(GLCMD_TRANSLATE, 3); argf(x); argf(y); argf(z); done();
+}
+
+void GL_Command_Buffer::rotate( float angle, float x, float y, float z ){
+    op(GLCMD_ROTATE, 4); argf(angle); argf(x); argf(y); argf(z); done();
+}
+
+void GL_Command_Buffer::scale( float x, float y, float z ){
+    op(GLCMD_SCALE, 3); argf(x); argf(y); argf(z); done();
+}
+
+void GL_Command_Buffer::mult_matrix( const float * m ){
+    op(GLCMD_MULT_MATRIX, 16);
+    for (int i = 0; i < 16; i++)
+        argf(m[i]);
+    done();
+}
+
+void GL_Command_Buffer::use_program( GLuint program ){
+    op(GLCMD_USE_PROGRAM, 1); arg(program); done();
+}
+
+void GL_Command_Buffer::uniform1f( GLint location, float v ){
+    op(GLCMD_UNIFORM_1F, 2); arg((unsigned int)location); argf(v); done();
+}
+
+void GL_Command_Buffer::uniform1i( GLint location, int v ){
+    op(GLCMD_UNIFORM_1I, 2); arg((unsigned int)location); arg((unsigned int)v); done();
+}
+
+void GL_Command_Buffer::bind_buffer( GLenum target, GLuint buffer ){
+    op(GLCMD_BIND_BUFFER, 2); arg(target); arg(buffer); done();
+}
+
+void GL_Command_Buffer::enable_attrib( GLuint index ){
+    op(GLCMD_ENABLE_ATTRIB, 1); arg(index); done();
+}
+
+void GL_Command_Buffer::disable_attrib( GLuint index ){
+    op(GLCMD_DISABLE_ATTRIB, 1); arg(index); done();
+}
+
+void GL_Command_Buffer::attrib_pointer( GLuint index, GLint size, GLenum type, bool normalized,
+                                        GLsizei stride, size_t offset ){
+    op(GLCMD_ATTRIB_POINTER, 6);
+    arg(index); arg((unsigned int)size); arg(type); arg(normalized ? 1 : 0);
+    arg((unsigned int)stride); arg((unsigned int)offset);
+    done();
+}
+
+void GL_Command_Buffer::draw_arrays( GLenum mode, GLint first, GLsizei count ){
+    op(GLCMD_DRAW_ARRAYS, 3); arg(mode); arg((unsigned int)first); arg((unsigned int)count);
+    _num_draws++;
+    done();
+}
+
+void GL_Command_Buffer::draw_elements( GLenum mode, GLsizei count, GLenum type, size_t offset,
+                                       GLint base_vertex ){
+    op(GLCMD_DRAW_ELEMENTS, 5);
+    arg(mode); arg((unsigned int)count); arg(type); arg((unsigned int)offset);
+    arg((unsigned int)base_vertex);
+    _num_draws++;
+    done();
+}
+
+void GL_Command_Buffer::call( void (*fn)(void * user), void * user ){
+    call_t c;
+    c.fn = fn;
+    c.user = user;
+    op(GLCMD_CALL, 1); arg((unsigned int)_calls.size());
+    _calls.push_back(c);
+    done();
+}
+
+/* #########################################################################
+
+                                vertex_arrays
+        -The frame's VBO and its four interleaved client arrays, or
+            back to the scene's own array buffer.
+
+   ######################################################################### */
+void GL_Command_Buffer::vertex_arrays( bool on ){
+    if (on == _arrays_on)
+        return;
+    _arrays_on = on;
+    if (on){
+        const GLsizei stride = GL_COMMAND_VERTEX_FLOATS * sizeof(float);
+        glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, stride, (const GLvoid*)0);
+        glNormalPointer(GL_FLOAT, stride, (const GLvoid*)(3 * sizeof(float)));
+        glTexCoordPointer(2, GL_FLOAT, stride, (const GLvoid*)(6 * sizeof(float)));
+        glColorPointer(4, GL_FLOAT, stride, (const GLvoid*)(8 * sizeof(float)));
+    } else {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glBindBuffer(GL_ARRAY_BUFFER, _array_buffer);
+    }
+}
+
+/* #########################################################################
+
+                                    execute
+        -Everything from GLCMD_USE_PROGRAM on (buffers, attributes,
+            draws, calls) needs the vertex batches' arrays off first.
+        -In replay_stereo, anything drawn that can't be instanced runs
+            once per eye.
+
+   ######################################################################### */
+size_t GL_Command_Buffer::execute( size_t pos ){
+    const unsigned int * a = &_words[pos];
+    gl_command_op_t op = (gl_command_op_t)(a[0] & 0xff);
+    size_t next = pos + 1 + (a[0] >> 8);
+    a++;
+    bool draw = op == GLCMD_DRAW_ARRAYS || op == GLCMD_DRAW_ELEMENTS;
+    bool instance = false;
+    if (_stereo && !_per_eye){
+        if (op == GLCMD_DRAW_VERTICES || op == GLCMD_CALL || (draw && !stereo_aware())){
+            _per_eye = true;
+            for (int e = 0; e < 2; e++){
+                stereo_eye(e);
+                execute(pos);
+            }
+            _per_eye = false;
+            return next;
+        }
+        if (draw){
+            stereo_eye(-1);
+            set_instanced(true);
+            instance = true;
+        }
+    } else if (_stereo && (draw || op == GLCMD_CALL)){
+        set_instanced(false);
+    }
+    if (op >= GLCMD_USE_PROGRAM && op != GLCMD_DRAW_VERTICES)
+        vertex_arrays(false);
+
+    float f[16];
+    switch (op){
+        case GLCMD_ENABLE:
+            glEnable(a[0]);
+            break;
+        case GLCMD_DISABLE:
+            glDisable(a[0]);
+            break;
+        case GLCMD_ACTIVE_TEXTURE:
+            glActiveTexture(a[0]);
+            break;
+        case GLCMD_BIND_TEXTURE:
+            glBindTexture(a[0], a[1]);
+            break;
+        case GLCMD_TEX_ENV:
+            glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, (float)a[0]);
+            break;
+        case GLCMD_MATERIAL:
+        case GLCMD_LIGHT:
+            for (unsigned int i = 0; i < a[2]; i++)
+                f[i] = bits_float(a[3 + i]);
+            if (op == GLCMD_MATERIAL)
+                glMaterialfv(a[0], a[1], f);
+            else
+                glLightfv(a[0], a[1], f);
+            break;
+        case GLCMD_PUSH_MATRIX:
+            glPushMatrix();
+            break;
+        case GLCMD_POP_MATRIX:
+            glPopMatrix();
+            break;
+        case GLCMD_TRANSLATE:
+            glTranslatef(bits_float(a[0]), bits_float(a[1]), bits_float(a[2]));
+            break;
+        case GLCMD_ROTATE:
+            glRotatef(bits_float(a[0]), bits_float(a[1]), bits_float(a[2]), bits_float(a[3]));
+            break;
+        case GLCMD_SCALE:
+            glScalef(bits_float(a[0]), bits_float(a[1]), bits_float(a[2]));
+            break;
+        case GLCMD_MULT_MATRIX:
+            for (int i = 0; i < 16; i++)
+                f[i] = bits_float(a[i]);
+            glMultMatrixf(f);
+            break;
+        case GLCMD_USE_PROGRAM:
+            glUseProgram(a[0]);
+            if (_stereo)
+                stereo_program(a[0]);
+            else
+                _program = a[0];
+            break;
+        case GLCMD_UNIFORM_1F:
+            glUniform1f((GLint)a[0], bits_float(a[1]));
+            break;
+        case GLCMD_UNIFORM_1I:
+            glUniform1i((GLint)a[0], (GLint)a[1]);
+            break;
+        case GLCMD_BIND_BUFFER:
+            if (a[0] == GL_ARRAY_BUFFER)
+                _array_buffer = a[1];
+            glBindBuffer(a[0], a[1]);
+            break;
+        case GLCMD_ENABLE_ATTRIB:
+            glEnableVertexAttribArray(a[0]);
+            break;
+        case GLCMD_DISABLE_ATTRIB:
+            glDisableVertexAttribArray(a[0]);
+            break;
+        case GLCMD_ATTRIB_POINTER:
+            glVertexAttribPointer(a[0], (GLint)a[1], a[2], a[3] ? GL_TRUE : GL_FALSE, (GLsizei)a[4],
+                (void*)(size_t)a[5]);
+            break;
+        case GLCMD_DRAW_ARRAYS:
+            if (instance)
+                glDrawArraysInstanced(a[0], (GLint)a[1], (GLsizei)a[2], 2);
+            else
+                glDrawArrays(a[0], (GLint)a[1], (GLsizei)a[2]);
+            _replay_draws++;
+            break;
+        case GLCMD_DRAW_ELEMENTS:
+            if (instance && a[4])
+                glDrawElementsInstancedBaseVertex(a[0], (GLsizei)a[1], a[2], (void*)(size_t)a[3], 2,
+                    (GLint)a[4]);
+            else if (instance)
+                glDrawElementsInstanced(a[0], (GLsizei)a[1], a[2], (void*)(size_t)a[3], 2);
+            else if (a[4])
+                glDrawElementsBaseVertex(a[0], (GLsizei)a[1], a[2], (void*)(size_t)a[3],
+                    (GLint)a[4]);
+            else
+                glDrawElements(a[0], (GLsizei)a[1], a[2], (void*)(size_t)a[3]);
+            _replay_draws++;
+            break;
+        case GLCMD_DRAW_VERTICES:
+            vertex_arrays(true);
+            glDrawArrays(a[0], (GLint)a[1], (GLsizei)a[2]);
+            _replay_draws++;
+            break;
+        case GLCMD_CALL:
+            _calls[a[0]].fn(_calls[a[0]].user);
+            break;
+        default:
+            break;
+    }
+    return next;
+}
+
+/* #########################################################################
+
+                                    dump
+        -Position in the stream, op and arguments, one command a line
+            (enums in hex, as glew.h lists them); then every vertex.
+
+   ######################################################################### */
+const char * GL_Command_Buffer::op_name( gl_command_op_t op ){
+    static const char * names[GLCMD_COUNT] = {
+        "enable", "disable", "active_texture", "bind_texture", "tex_env", "material", "light",
+        "push_matrix", "pop_matrix", "translate", "rotate", "scale", "mult_matrix",
+        "use_program", "uniform1f", "uniform1i", "bind_buffer", "enable_attrib",
+        "disable_attrib", "attrib_pointer", "draw_arrays", "draw_elements", "draw_vertices",
+        "call"
+    };
+    return op < GLCMD_COUNT ? names[op] : "?";
+}
+
+void GL_Command_Buffer::dump( FILE * f ){
+    fprintf(f, "# %u commands, %u draws, %u vertices, %u bytes\n", _num_commands, _num_draws,
+        num_vertices(), (unsigned int)size_bytes());
+    size_t pos = 0;
+    while (pos < _words.size()){
+        const unsigned int * a = &_words[pos];
+        gl_command_op_t op = (gl_command_op_t)(a[0] & 0xff);
+        unsigned int n = a[0] >> 8;
+        fprintf(f, "%6u  %-16s", (unsigned int)pos, op_name(op));
+        a++;
+        switch (op){
+            // all floats
+            case GLCMD_TRANSLATE:
+            case GLCMD_ROTATE:
+            case GLCMD_SCALE:
+            case GLCMD_MULT_MATRIX:
+                for (unsigned int i = 0; i < n; i++)
+                    fprintf(f, " %g", bits_float(a[i]));
+                break;
+            // two enums, a count, floats
+            case GLCMD_MATERIAL:
+            case GLCMD_LIGHT:
+                fprintf(f, " 0x%04x 0x%04x", a[0], a[1]);
+                for (unsigned int i = 0; i < a[2]; i++)
+                    fprintf(f, " %g", bits_float(a[3 + i]));
+                break;
+            case GLCMD_UNIFORM_1F:
+                fprintf(f, " %d %g", (int)a[0], bits_float(a[1]));
+                break;
+            case GLCMD_CALL:
+                fprintf(f, " %p(%p)", (void*)_calls[a[0]].fn, _calls[a[0]].user);
+                break;
+            case GLCMD_DRAW_VERTICES:
+                fprintf(f, " 0x%04x first %u count %u", a[0], a[1], a[2]);
+                break;
+            // enums / ints as they are
+            default:
+                for (unsigned int i = 0; i < n; i++)
+                    fprintf(f, a[i] >= 0x100 ? " 0x%04x" : " %u", a[i]);
+                break;
+        }
+        fprintf(f, "\n");
+        pos += 1 + n;
+    }
+    fprintf(f, "# vertices: x y z  nx ny nz  s t  r g b a\n");
+    for (unsigned int v = 0; v < num_vertices(); v++){
+        const float * p = &_vertices[v * GL_COMMAND_VERTEX_FLOATS];
+        fprintf(f, "%6u  %g %g %g  %g %g %g  %g %g  %g %g %g %g\n", v, p[0], p[1], p[2],
+            p[3], p[4], p[5], p[6], p[7], p[8], p[9], p[10], p[11]);
+    }
+}
+
+int GL_Command_Buffer::dump( const char * path ){
+    FILE * f = fopen(path, "w");
+    if (!f){
+        printf("Couldn't open %s for writing.\n", path);
+        return -1;
+    }
+    dump(f);
+    fclose(f);
+    return 0;
+}
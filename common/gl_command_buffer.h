@@ -0,0 +1,268 @@
+/* #########################################################################
+        GL_Command_Buffer -- a frame's scene, recorded once, replayed per eye
+   Header!
+
+	Rift::render used to call the scene's draw function once per eye,
+	so every glBegin / glVertex / glMaterial of it was issued twice a
+	frame though only the projection and view differ between eyes. A
+	scene written against this class instead (Rift::render_recorded)
+	is recorded once a frame into a compact command stream -- state
+	changes, buffer binds, draws -- and replayed for each eye after
+	Rift has loaded that eye's matrices. Matrix commands are replayed as
+	relative ones (push / translate / mult ...) and light positions are
+	set at replay, so everything still lands in the eye's view.
+
+	Immediate-mode geometry is what gets cheaper: begin / vertex / end
+	don't go to GL at all while recording, but into one interleaved
+	vertex array for the frame (position, normal, texture coordinate,
+	color; the current normal / texture coordinate / color carried over
+	like GL does, starting from GL's defaults each frame). end_record
+	uploads it once into a streaming VBO, and each batch replays as a
+	single glDrawArrays -- back-to-back batches of independent
+	primitives (points, lines, triangles, quads) with nothing in between
+	are merged into one. A 400-quad floor is one draw per eye instead of
+	400 glBegin / glEnd pairs.
+
+	Whatever can't be recorded -- GLUT stroke text, code in other
+	classes, anything that depends on which eye is being drawn -- goes
+	in as call(): a function run at that point of every replay, like the
+	old per-eye path.
+
+	Made with immediate = true, the same interface just issues every
+	call to GL as it comes (and runs calls on the spot), which is the old
+	per-eye path for the same scene code. It still counts its draws
+	(every begin / end pair is one), so the two can be compared.
+
+	dump() writes a recorded frame out as text, one command a line and
+	then the vertex array, for looking at offline.
+
+	replay_stereo() is single-pass stereo: one replay for both eyes
+	instead of one each, so every state change goes down once. Draws
+	with a stereo-aware program bound (one declaring StereoEyeProj and
+	StereoInstanced, like shaders/particle.vert) go down once as two
+	instances over the whole side-by-side viewport; the shader takes
+	its eye from the instance, projects with that eye's matrix and
+	squeezes the result into the eye's half, clipped to it. Everything
+	else -- fixed-function batches, other programs, calls -- is issued
+	twice in a row, with each eye's viewport and projection loaded
+	around it. Eyes are the modelview's view with each eye's offset
+	folded into its projection, so fixed-function lighting happens in
+	the space between the eyes. An instanced draw is projected by the
+	shader with eye_proj rather than by GL's matrix stack, so it can
+	round a pixel apart from replay(); fixed-function draws match it
+	exactly. The particle scene goes from 46 draws a frame under
+	replay() to 30, the particles and trails each going down once.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Single-pass instanced stereo replay
+     agent  20261017  Immediate mode counts its draws
+     agent  20261017  Note where single-pass stereo differs from replay()
+   ######################################################################### */
+
+#ifndef __XEN_GL_COMMAND_BUFFER_H
+#define __XEN_GL_COMMAND_BUFFER_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <vector>
+
+#include "../include/GL/glew.h"
+#include <gl/gl.h>
+
+namespace xen_rift {
+	// Floats per recorded vertex: x y z, nx ny nz, s t, r g b a
+	#define GL_COMMAND_VERTEX_FLOATS 12
+	// What a program has to declare to be drawn instanced by
+	// replay_stereo: mat4[2] of the eyes' matrices, and a bool that's
+	// true only while a draw is instanced
+	#define STEREO_EYE_PROJ_UNIFORM "StereoEyeProj"
+	#define STEREO_INSTANCED_UNIFORM "StereoInstanced"
+
+	// One single-pass stereo replay: per eye (0 left, 1 right), its
+	// viewport and its projection * view adjust, column-major.
+	// set_eye(eye, user) hears which eye things are being drawn for, -1
+	// while both are.
+	typedef struct _stereo_pass_t {
+		int viewport[2][4];
+		float eye_proj[2][16];
+		void (*set_eye)(int eye, void * user);
+		void * user;
+	} stereo_pass_t;
+
+	typedef enum _gl_command_op_t {
+		GLCMD_ENABLE,
+		GLCMD_DISABLE,
+		GLCMD_ACTIVE_TEXTURE,
+		GLCMD_BIND_TEXTURE,
+		GLCMD_TEX_ENV,
+		GLCMD_MATERIAL,
+		GLCMD_LIGHT,
+		GLCMD_PUSH_MATRIX,
+		GLCMD_POP_MATRIX,
+		GLCMD_TRANSLATE,
+		GLCMD_ROTATE,
+		GLCMD_SCALE,
+		GLCMD_MULT_MATRIX,
+		GLCMD_USE_PROGRAM,
+		GLCMD_UNIFORM_1F,
+		GLCMD_UNIFORM_1I,
+		GLCMD_BIND_BUFFER,
+		GLCMD_ENABLE_ATTRIB,
+		GLCMD_DISABLE_ATTRIB,
+		GLCMD_ATTRIB_POINTER,
+		GLCMD_DRAW_ARRAYS,
+		GLCMD_DRAW_ELEMENTS,
+		GLCMD_DRAW_VERTICES,
+		GLCMD_CALL,
+		GLCMD_COUNT
+	} gl_command_op_t;
+
+	class GL_Command_Buffer {
+		public:
+			GL_Command_Buffer( bool immediate = false );
+
+			// Start a frame over (drops the last one), and finish it:
+			// uploads the frame's vertices, so needs the GL context
+			void begin_record( void );
+			void end_record( void );
+			// Issue the recorded frame with whatever matrices are loaded
+			void replay( void );
+			// Issue it once for both eyes, with the view in the modelview
+			void replay_stereo( const stereo_pass_t & pass );
+			// GL draws the last replay issued; in immediate mode, the
+			// draws issued since begin_record
+			unsigned int replay_draws( void ) { return _replay_draws; }
+			bool immediate( void ) { return _immediate; }
+
+			// Immediate-mode geometry
+			void begin( GLenum mode );
+			void end( void );
+			void vertex( float x, float y, float z );
+			void normal( float x, float y, float z );
+			void tex_coord( float s, float t );
+			void color( float r, float g, float b, float a = 1.0f );
+
+			// State; params are copied (1, 3 or 4 floats by pname)
+			void enable( GLenum cap );
+			void disable( GLenum cap );
+			void active_texture( GLenum unit );
+			void bind_texture( GLenum target, GLuint texture );
+			void tex_env( GLenum mode );
+			void material( GLenum face, GLenum pname, const float * params );
+			void light( GLenum light, GLenum pname, const float * params );
+
+			// Modelview matrix stack
+			void push_matrix( void );
+			void pop_matrix( void );
+			void translate( float x, float y, float z );
+			void rotate( float angle, float x, float y, float z );
+			void scale( float x, float y, float z );
+			void mult_matrix( const float * m );
+
+			// Shaders and buffers; offsets are into the bound buffer
+			void use_program( GLuint program );
+			void uniform1f( GLint location, float v );
+			void uniform1i( GLint location, int v );
+			void bind_buffer( GLenum target, GLuint buffer );
+			void enable_attrib( GLuint index );
+			void disable_attrib( GLuint index );
+			void attrib_pointer( GLuint index, GLint size, GLenum type, bool normalized,
+								 GLsizei stride, size_t offset );
+			void draw_arrays( GLenum mode, GLint first, GLsizei count );
+			// base_vertex != 0 draws with glDrawElementsBaseVertex
+			void draw_elements( GLenum mode, GLsizei count, GLenum type, size_t offset,
+								GLint base_vertex = 0 );
+
+			// fn(user) at this point of every replay
+			void call( void (*fn)(void * user), void * user );
+
+			// What the last recorded frame holds: commands, GL draws per
+			// replay, vertices, and bytes of commands + vertices
+			unsigned int num_commands( void ) { return _num_commands; }
+			unsigned int num_draws( void ) { return _num_draws; }
+			unsigned int num_vertices( void ) {
+				return (unsigned int)(_vertices.size() / GL_COMMAND_VERTEX_FLOATS); }
+			size_t size_bytes( void ) {
+				return _words.size() * sizeof(unsigned int) + _vertices.size() * sizeof(float); }
+
+			// The last recorded frame as text. Return -1 if fail, 0 if
+			// success.
+			void dump( FILE * f );
+			int dump( const char * path );
+
+			static const char * op_name( gl_command_op_t op );
+
+		protected:
+			typedef struct _call_t {
+				void (*fn)(void * user);
+				void * user;
+			} call_t;
+
+			// Append a command's header / arguments; done() runs it right
+			// away in immediate mode
+			void op( gl_command_op_t op, int num_args );
+			void arg( unsigned int u ) { _words.push_back(u); }
+			void argf( float f );
+			void done( void );
+			// Run the command at _words[pos]; return the next one's
+			// position
+			size_t execute( size_t pos );
+			// Interleaved arrays on / off for GLCMD_DRAW_VERTICES
+			void vertex_arrays( bool on );
+
+			// stereo-aware programs seen so far (uniform locations -1 if
+			// not), and the one bound during replay_stereo
+			typedef struct _stereo_program_t {
+				GLuint program;
+				GLint eye_proj;
+				GLint instanced;
+				unsigned int pass;
+			} stereo_program_t;
+			void stereo_program( GLuint program );
+			bool stereo_aware( void ) { return _stereo_program >= 0; }
+			void set_instanced( bool on );
+			// viewport / projection / clip planes for eye e, or both (-1)
+			void stereo_eye( int e );
+
+			bool _immediate;
+			std::vector<unsigned int> _words;
+			std::vector<float> _vertices;
+			std::vector<call_t> _calls;
+			unsigned int _num_commands;
+			unsigned int _num_draws;
+			// header position of the last command, for merging batches
+			size_t _last_op;
+
+			// current vertex attributes and the open batch
+			float _normal[3];
+			float _tex_coord[2];
+			float _color[4];
+			GLenum _batch_mode;
+			unsigned int _batch_first;
+			bool _in_batch;
+
+			// the frame's vertices on the GPU, and replay state
+			GLuint _vbo;
+			bool _arrays_on;
+			GLuint _array_buffer;
+			GLuint _program;
+			unsigned int _replay_draws;
+
+			// the replay_stereo going on, if any
+			const stereo_pass_t * _stereo;
+			unsigned int _stereo_passes;
+			std::vector<stereo_program_t> _stereo_programs;
+			int _stereo_program;
+			int _instanced;
+			int _pass_eye;
+			bool _per_eye;
+
+		private:
+	};
+};
+
+#endif //__XEN_GL_COMMAND_BUFFER_H
@@ -0,0 +1,336 @@
+/* #########################################################################
+        Profiler -- scoped timing zones, per-thread rings, trace export
+
+   A thread's ring is found through a pthread key, made on its first
+   zone and registered in the ring list under the list's mutex; that
+   list (and the rings, which are never freed -- there are only ever a
+   handful of threads) is all that's shared. The ring's count only
+   ever goes up: event i lives in slot i % PROFILER_RING_EVENTS, and
+   the owner writes it before bumping the count past it.
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#include "profiler.h"
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+typedef struct _profile_event_t {
+    const char * name;
+    unsigned long long begin;
+    unsigned long long end;
+    int depth;
+} profile_event_t;
+
+typedef struct _profile_ring_t {
+    profile_event_t * events;
+    volatile LONG count;
+    int depth;
+    int tid;
+    char name[32];
+} profile_ring_t;
+
+static LARGE_INTEGER perf_freq;
+static LARGE_INTEGER perf_start;
+static volatile bool zones_on = false;
+static bool key_made = false;
+static pthread_key_t ring_key;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static vector<profile_ring_t *> rings;
+
+// frame times (ms) and when each frame ended, oldest at frame_next
+//  once the window is full
+static double frame_ms[PROFILER_FRAME_WINDOW];
+static unsigned long long frame_end[PROFILER_FRAME_WINDOW];
+static unsigned int frame_count = 0;
+static unsigned int frame_next = 0;
+static unsigned long long last_frame = 0;
+
+int xen_rift::profiler_init( bool enabled ){
+    if (!QueryPerformanceFrequency(&perf_freq)){
+        printf("QueryPerformanceFrequency failed!\n");
+        return -1;
+    }
+    QueryPerformanceCounter(&perf_start);
+    if (!key_made){
+        if (pthread_key_create(&ring_key, NULL)){
+            printf("Profiler couldn't make its thread key.\n");
+            return -1;
+        }
+        key_made = true;
+    }
+    profiler_thread_name("main");
+    zones_on = enabled;
+    return 0;
+}
+
+void xen_rift::profiler_set_enabled( bool enabled ){
+    zones_on = enabled && key_made;
+}
+
+bool xen_rift::profiler_enabled( void ){
+    return zones_on;
+}
+
+// Split so ticks * 1e9 can't overflow however long it's been running
+unsigned long long xen_rift::profiler_now_ns( void ){
+    if (perf_freq.QuadPart == 0)
+        return 0;
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    unsigned long long ticks = (unsigned long long)(now.QuadPart - perf_start.QuadPart);
+    unsigned long long freq = (unsigned long long)perf_freq.QuadPart;
+    return (ticks / freq) * 1000000000ULL + (ticks % freq) * 1000000000ULL / freq;
+}
+
+/* #########################################################################
+
+                                  thread_ring
+        -The calling thread's ring, made and registered the first time.
+            NULL without profiler_init, or if out of memory.
+
+   ######################################################################### */
+static profile_ring_t * thread_ring( void ){
+    if (!key_made)
+        return NULL;
+    profile_ring_t * r = (profile_ring_t *)pthread_getspecific(ring_key);
+    if (r)
+        return r;
+    r = (profile_ring_t *)malloc(sizeof(profile_ring_t));
+    if (!r)
+        return NULL;
+    r->events = (profile_event_t *)malloc(PROFILER_RING_EVENTS * sizeof(profile_event_t));
+    if (!r->events){
+        free(r);
+        return NULL;
+    }
+    r->count = 0;
+    r->depth = 0;
+    pthread_mutex_lock( &rings_mutex );
+    r->tid = (int)rings.size();
+    sprintf(r->name, "thread %d", r->tid);
+    rings.push_back(r);
+    pthread_mutex_unlock( &rings_mutex );
+    pthread_setspecific(ring_key, r);
+    return r;
+}
+
+void xen_rift::profiler_thread_name( const char * name ){
+    profile_ring_t * r = thread_ring();
+    if (!r)
+        return;
+    pthread_mutex_lock( &rings_mutex );
+    strncpy(r->name, name, sizeof(r->name) - 1);
+    r->name[sizeof(r->name) - 1] = '\0';
+    pthread_mutex_unlock( &rings_mutex );
+}
+
+int xen_rift::profiler_enter( void ){
+    profile_ring_t * r = thread_ring();
+    return r ? r->depth++ : 0;
+}
+
+void xen_rift::profiler_leave( void ){
+    profile_ring_t * r = thread_ring();
+    if (r && r->depth > 0)
+        r->depth--;
+}
+
+void xen_rift::profiler_record( const char * name, unsigned long long begin_ns,
+                                unsigned long long end_ns, int depth ){
+    profile_ring_t * r = thread_ring();
+    if (!r)
+        return;
+    profile_event_t & e = r->events[(unsigned long)r->count & (PROFILER_RING_EVENTS - 1)];
+    e.name = name;
+    e.begin = begin_ns;
+    e.end = end_ns;
+    e.depth = depth;
+    // full barrier: the event is in before the count says so
+    InterlockedIncrement(&r->count);
+}
+
+/* #########################################################################
+
+                                ring_snapshot
+        -Copy what r holds, then drop anything its thread could have
+            written over while we copied: with the count at h, slot
+            h % N (event h - N) may be mid-write.
+
+   ######################################################################### */
+static void ring_snapshot( profile_ring_t * r, vector<profile_event_t> & out ){
+    out.clear();
+    unsigned long h1 = (unsigned long)r->count;
+    MemoryBarrier();
+    unsigned long first = h1 > PROFILER_RING_EVENTS ? h1 - PROFILER_RING_EVENTS : 0;
+    vector<profile_event_t> copy;
+    copy.reserve(h1 - first);
+    for (unsigned long i = first; i < h1; i++)
+        copy.push_back(r->events[i & (PROFILER_RING_EVENTS - 1)]);
+    MemoryBarrier();
+    unsigned long h2 = (unsigned long)r->count;
+    unsigned long safe = h2 + 1 > PROFILER_RING_EVENTS ? h2 + 1 - PROFILER_RING_EVENTS : 0;
+    for (unsigned long i = first; i < h1; i++)
+        if (i >= safe)
+            out.push_back(copy[i - first]);
+}
+
+/* #########################################################################
+
+                                profiler_frame
+        -With zones on, the frame also goes into the render thread's
+            ring, as a "frame" zone spanning it.
+
+   ######################################################################### */
+void xen_rift::profiler_frame( void ){
+    unsigned long long now = profiler_now_ns();
+    if (last_frame){
+        frame_ms[frame_next] = (double)(now - last_frame) / 1000000.0;
+        frame_end[frame_next] = now;
+        frame_next = (frame_next + 1) % PROFILER_FRAME_WINDOW;
+        if (frame_count < PROFILER_FRAME_WINDOW)
+            frame_count++;
+        if (zones_on)
+            profiler_record("frame", last_frame, now, 0);
+    }
+    last_frame = now;
+}
+
+unsigned int xen_rift::profiler_frame_stats( frame_stats_t * stats ){
+    memset(stats, 0, sizeof(frame_stats_t));
+    if (frame_count == 0)
+        return 0;
+    vector<double> sorted(frame_ms, frame_ms + frame_count);
+    sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (unsigned int i = 0; i < frame_count; i++)
+        sum += sorted[i];
+    // nearest rank
+    const double pct[3] = { 0.50, 0.95, 0.99 };
+    double * out[3] = { &stats->p50, &stats->p95, &stats->p99 };
+    for (int k = 0; k < 3; k++){
+        unsigned int rank = (unsigned int)ceil(pct[k] * frame_count);
+        *out[k] = sorted[rank > 0 ? rank - 1 : 0];
+    }
+    stats->frames = frame_count;
+    stats->mean = sum / frame_count;
+    stats->max = sorted[frame_count - 1];
+    return frame_count;
+}
+
+/* #########################################################################
+
+                             profiler_print_stats
+        -Zones count toward the window if they ended inside it; nested
+            zones count toward their own name and their parents' both.
+
+   ######################################################################### */
+void xen_rift::profiler_print_stats( void ){
+    frame_stats_t fs;
+    if (!profiler_frame_stats(&fs))
+        return;
+    printf("frame time over %u frames: mean %.3f ms, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+        fs.frames, fs.mean, fs.p50, fs.p95, fs.p99, fs.max);
+    if (!zones_on)
+        return;
+
+    unsigned int oldest = frame_count < PROFILER_FRAME_WINDOW ? 0 : frame_next;
+    unsigned long long window_start = frame_end[oldest] -
+        (unsigned long long)(frame_ms[oldest] * 1000000.0);
+    unsigned long long window_end = last_frame;
+
+    vector<profile_event_t> events;
+    pthread_mutex_lock( &rings_mutex );
+    vector<profile_ring_t *> snapshot_rings = rings;
+    pthread_mutex_unlock( &rings_mutex );
+    for (size_t t = 0; t < snapshot_rings.size(); t++){
+        ring_snapshot(snapshot_rings[t], events);
+        vector<const char *> names;
+        vector<double> total_ms;
+        vector<unsigned int> calls;
+        for (size_t i = 0; i < events.size(); i++){
+            const profile_event_t & e = events[i];
+            if (e.end <= window_start || e.end > window_end || strcmp(e.name, "frame") == 0)
+                continue;
+            size_t n = 0;
+            while (n < names.size() && names[n] != e.name && strcmp(names[n], e.name) != 0)
+                n++;
+            if (n == names.size()){
+                names.push_back(e.name);
+                total_ms.push_back(0.0);
+                calls.push_back(0);
+            }
+            total_ms[n] += (double)(e.end - e.begin) / 1000000.0;
+            calls[n]++;
+        }
+        for (size_t n = 0; n < names.size(); n++)
+            printf("    [%s] %s: %.3f ms / frame (%.1f a frame)\n", snapshot_rings[t]->name, names[n],
+                total_ms[n] / fs.frames, (double)calls[n] / fs.frames);
+    }
+}
+
+/* #########################################################################
+
+                             profiler_write_trace
+        -Chrome's trace event format: a thread_name record per ring,
+            then every zone as a complete ("X") event, in microseconds.
+
+   ######################################################################### */
+static void write_json_string( FILE * f, const char * s ){
+    fputc('"', f);
+    for (; *s; s++){
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        if ((unsigned char)*s >= 0x20)
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+int xen_rift::profiler_write_trace( const char * path ){
+    FILE * f = fopen(path, "w");
+    if (!f){
+        printf("Couldn't open %s for writing.\n", path);
+        return -1;
+    }
+    pthread_mutex_lock( &rings_mutex );
+    vector<profile_ring_t *> snapshot_rings = rings;
+    vector<string> thread_names;
+    for (size_t t = 0; t < rings.size(); t++)
+        thread_names.push_back(string(rings[t]->name));
+    pthread_mutex_unlock( &rings_mutex );
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    unsigned int written = 0;
+    vector<profile_event_t> events;
+    for (size_t t = 0; t < snapshot_rings.size(); t++){
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+            first ? "" : ",\n", snapshot_rings[t]->tid);
+        write_json_string(f, thread_names[t].c_str());
+        fprintf(f, "}}");
+        first = false;
+        ring_snapshot(snapshot_rings[t], events);
+        for (size_t i = 0; i < events.size(); i++){
+            const profile_event_t & e = events[i];
+            fprintf(f, ",\n{\"name\":");
+            write_json_string(f, e.name);
+            fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"depth\":%d}}",
+                snapshot_rings[t]->tid, (double)e.begin / 1000.0, (double)(e.end - e.begin) / 1000.0,
+                e.depth);
+            written++;
+        }
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    fclose(f);
+    printf("Profile: %u zones from %u threads written to %s.\n", written,
+        (unsigned int)snapshot_rings.size(), path);
+    return 0;
+}
@@ -0,0 +1,125 @@
+/* #########################################################################
+        Profiler -- scoped timing zones, per-thread rings, trace export
+   Header!
+
+	get_elapsed (xen_utils.h) gives millisecond deltas between calls on
+	a fixed index; enough for a framerate, not for seeing where a
+	frame's 11-13 ms go. Here any stretch of code can be a zone:
+
+		{
+			PROFILE_ZONE("warp");
+			...
+		}
+
+	times the block to the nanosecond (QueryPerformanceCounter, from
+	profiler_init) and records it, with its nesting depth, in the
+	calling thread's ring. Each thread gets its own ring the first time
+	it records anything: a fixed array of the last PROFILER_RING_EVENTS
+	zones, written only by its thread with no locks -- the event goes in,
+	then the ring's count is bumped -- so a zone costs two timer reads
+	and a store. Readers (the trace export, the zone breakdown) copy a
+	ring and then check the count again, dropping whatever the thread may
+	have overwritten meanwhile. Old zones just fall off the end.
+
+	Zones are off unless profiler_set_enabled(true); off, a zone is a
+	flag test. Zone names have to outlive the profiler (string literals).
+
+	profiler_frame(), once a frame from the render thread, keeps the
+	last PROFILER_FRAME_WINDOW frame times whether zones are on or not;
+	profiler_frame_stats gives their p50 / p95 / p99. profiler_write_trace
+	writes every ring out as Chrome trace JSON (chrome://tracing,
+	ui.perfetto.dev), one track per thread.
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#ifndef __XEN_PROFILER_H
+#define __XEN_PROFILER_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Windows
+#include <windows.h>
+
+//pthread for the per-thread rings
+#include <pthread.h>
+
+namespace xen_rift {
+	// Zones each thread's ring holds (a power of two), and frames the
+	// frame-time statistics are over
+	#define PROFILER_RING_EVENTS 16384
+	#define PROFILER_FRAME_WINDOW 600
+
+	// Frame times over the window, in ms
+	typedef struct _frame_stats_t {
+		unsigned int frames;
+		double mean;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+	} frame_stats_t;
+
+	// Start the clock and name the calling thread "main". Return -1 if
+	// fail, 0 if success.
+	int profiler_init( bool enabled );
+	void profiler_set_enabled( bool enabled );
+	bool profiler_enabled( void );
+	// Name the calling thread's track (before its first zone, ideally)
+	void profiler_thread_name( const char * name );
+	// Since profiler_init
+	unsigned long long profiler_now_ns( void );
+
+	// Record a zone [begin_ns, end_ns) on the calling thread; what
+	// Profile_Zone does
+	void profiler_record( const char * name, unsigned long long begin_ns,
+						  unsigned long long end_ns, int depth );
+	// The calling thread's nesting depth, and changing it
+	int profiler_enter( void );
+	void profiler_leave( void );
+
+	// Once a frame, render thread only
+	void profiler_frame( void );
+	// Return the frames counted (0 = no stats yet)
+	unsigned int profiler_frame_stats( frame_stats_t * stats );
+	// Frame stats, then every zone name's ms a frame, per thread, over
+	// the frames in the window
+	void profiler_print_stats( void );
+	// Return -1 if fail, 0 if success.
+	int profiler_write_trace( const char * path );
+
+	class Profile_Zone {
+		public:
+			Profile_Zone( const char * name ) : _name(NULL) {
+				if (profiler_enabled()){
+					_name = name;
+					_depth = profiler_enter();
+					_begin = profiler_now_ns();
+				}
+			}
+			~Profile_Zone() {
+				if (_name){
+					profiler_record(_name, _begin, profiler_now_ns(), _depth);
+					profiler_leave();
+				}
+			}
+
+		protected:
+			const char * _name;
+			unsigned long long _begin;
+			int _depth;
+
+		private:
+	};
+
+	// A zone from here to the end of the enclosing block
+	#define PROFILE_ZONE_JOIN2(a, b) a##b
+	#define PROFILE_ZONE_JOIN(a, b) PROFILE_ZONE_JOIN2(a, b)
+	#define PROFILE_ZONE(name) xen_rift::Profile_Zone PROFILE_ZONE_JOIN(_profile_zone_, __LINE__)(name)
+};
+
+#endif //__XEN_PROFILER_H
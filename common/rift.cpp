@@ -18,6 +18,13 @@
      Gregory Izatt  20130721  Init revision
      Gregory Izatt  201308**  Various revisions, fleshing this out to base
                                 functionality and squashing bugs.
+     agent  20261017  Remember each eye's view-projection matrix
+     agent  20261017  Warp pass draws a precomputed distortion mesh
+     agent  20261017  P captures the warp against the CPU reference
+     agent  20261017  render_recorded: scene recorded once, replayed per eye
+     agent  20261017  F4: single-pass instanced stereo for recorded scenes
+     agent  20261017  Profiler zones; J toggles zones / writes the trace
+     agent  20261017  -norecord frames count their draws too
    ######################################################################### */    
 
 #include "rift.h"
@@ -26,6 +33,14 @@ using namespace xen_rift;
 using namespace OVR;
 using namespace OVR::Util::Render;
 
+// 0 / 1 / 2 for the left / right / center eye
+static int eye_slot(char eye);
+
+// Distortion mesh shader attributes
+#define WARP_ATTRIB_POS 0
+#define WARP_ATTRIB_TC 1
+#define WARP_ATTRIB_EDGE 2
+
 Rift::Rift(int inputWidth, int inputHeight, bool verbose) :
             // Stereo config helper
             _SConfig(),
@@ -35,9 +50,18 @@ Rift::Rift(int inputWidth, int inputHeight, bool verbose) :
             _mouseButtons(0),
             _c_down(false),
             _have_rift(false),
-            _which_eye('n')
+            _which_eye('n'),
+            _record_scene(NULL),
+            _scene_immediate(true),
+            _scene_recording(true),
+            _single_pass(false),
+            _scene_submit_ms(0.0),
+            _scene_draws(0),
+            _warp_mesh_stale(true)
             {
     _verbose = verbose;
+    for (int i = 0; i < 3; i++)
+        _eye_drawn[i] = false;
 
      // Position and look. The following apply:
      _EyePos = Vector3f();
@@ -177,15 +201,19 @@ Rift::Rift(int inputWidth, int inputHeight, bool verbose) :
         printf("Loading warp shaders\n");
     }
 
-    // set up warp shaders (these are def. in use!)
+    // set up warp shaders (these are def. in use!): a textured draw of
+    // the distortion mesh, which update_warp_mesh fills in
     _warpShaderID = glCreateProgram();
-    load_shaders("../shaders/empty.shdr", &_barrel_vert,
-                "../shaders/barrel.frag", &_barrel_frag, 
-                "../shaders/barrel.geom", &_barrel_geom);
-    glAttachShader( _warpShaderID, _barrel_frag);
-    glAttachShader( _warpShaderID, _barrel_geom);
-    glAttachShader( _warpShaderID, _barrel_vert);
+    load_shaders("../shaders/distortion_mesh.vert", &_warp_vert,
+                "../shaders/distortion_mesh.frag", &_warp_frag);
+    glAttachShader( _warpShaderID, _warp_frag);
+    glAttachShader( _warpShaderID, _warp_vert);
+    glBindAttribLocation( _warpShaderID, WARP_ATTRIB_POS, "pos");
+    glBindAttribLocation( _warpShaderID, WARP_ATTRIB_TC, "tc");
+    glBindAttribLocation( _warpShaderID, WARP_ATTRIB_EDGE, "edge");
     glLinkProgram( _warpShaderID);
+    glGenBuffers(1, &_warp_vbo);
+    glGenBuffers(1, &_warp_ibo);
 
     // And set up fbos and textures for render-to-texture steps in pipeline
     // fbo that the regular scene render goes to:
@@ -252,6 +280,7 @@ int Rift::set_resolution(int width, int height)
     if (!_have_rift){
         _height = height;
         _width = width;
+        _warp_mesh_stale = true;
         return 0;
     } else {
         return 1;
@@ -286,13 +315,31 @@ void Rift::normal_key_handler(unsigned char key, int x, int y){
         case 'R':
             _SFusion.Reset();
             break;
+        case 'P':
+            capture_warp("warp_capture");
+            break;
+        case 'X':
+            dump_scene("scene_commands.txt");
+            break;
+        case 'J':
+            // first press starts zones, the next writes them out
+            if (!profiler_enabled()){
+                profiler_set_enabled(true);
+                printf("Profiler zones on; J again to write profile_trace.json.\n");
+            } else {
+                profiler_write_trace("profile_trace.json");
+                profiler_print_stats();
+            }
+            break;
         case '+':
         case '=':
             _SConfig.SetIPD(_SConfig.GetIPD() + 0.0005f);
+            _warp_mesh_stale = true;
             break;
         case '-':
         case '_':
             _SConfig.SetIPD(_SConfig.GetIPD() - 0.0005f);  
+            _warp_mesh_stale = true;
             break;     
         case 'c':
             _c_down = true;
@@ -313,14 +360,25 @@ void Rift::special_key_handler(int key, int x, int y){
         case GLUT_KEY_F1:
             _SConfig.SetStereoMode(Stereo_None);
             _PostProcess = PostProcess_None;
+            _single_pass = false;
             break;
         case GLUT_KEY_F2:
             _SConfig.SetStereoMode(Stereo_LeftRight_Multipass);
             _PostProcess = PostProcess_None;
+            _single_pass = false;
             break;
         case GLUT_KEY_F3:
             _SConfig.SetStereoMode(Stereo_LeftRight_Multipass);
             _PostProcess = PostProcess_Distortion;
+            _single_pass = false;
+            break;
+        // as F3, both eyes in one pass
+        case GLUT_KEY_F4:
+            _SConfig.SetStereoMode(Stereo_LeftRight_Multipass);
+            _PostProcess = PostProcess_Distortion;
+            _single_pass = true;
+            if (_verbose)
+                printf("Single-pass stereo (recorded scenes only).\n");
             break;
     }
 }
@@ -385,9 +443,50 @@ void Rift::onIdle() {
     }    
 }
 
+/* #########################################################################
+    
+                          current_distortion_params
+        -The lens's K and center offset as the stereo config has them
+            (the left eye's; the right mirrors it). Scale / ScaleIn
+            stay what barrel.frag always used.
+                              
+   ######################################################################### */
+void Rift::current_distortion_params(distortion_params_t * p){
+    distortion_params_default(p);
+    const DistortionConfig * d = _SConfig.GetEyeRenderParams(StereoEye_Left).pDistortion;
+    if (!d)
+        return;
+    for (int i = 0; i < 4; i++)
+        p->K[i] = d->K[i];
+    p->lens_offset = d->XCenterOffset;
+}
+
+void Rift::update_warp_mesh(){
+    distortion_params_t p;
+    current_distortion_params(&p);
+    _warp_mesh_stale = false;
+    if (_warp_mesh.built() && distortion_params_equal(p, _warp_mesh.params()))
+        return;
+    _warp_mesh.build(p);
+    glBindBuffer(GL_ARRAY_BUFFER, _warp_vbo);
+    glBufferData(GL_ARRAY_BUFFER, _warp_mesh.num_vertices() * sizeof(distortion_vertex_t),
+                 _warp_mesh.vertices(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _warp_ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, _warp_mesh.num_indices() * sizeof(unsigned short),
+                 _warp_mesh.indices(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    if (_verbose){
+        printf("Distortion mesh rebuilt: %u vertices, %u triangles\n", _warp_mesh.num_vertices(),
+               _warp_mesh.num_indices() / 3);
+    }
+}
+
 void Rift::stereoWarp(GLuint outFBO, GLuint inTexture)
 {
     int tLoc;
+    if (_warp_mesh_stale)
+        update_warp_mesh();
     // Draw final fbo to screen
     glEnable(GL_TEXTURE_2D);
     glDisable(GL_LIGHTING);
@@ -404,12 +503,25 @@ void Rift::stereoWarp(GLuint outFBO, GLuint inTexture)
     glUniform1i(tLoc,0);
 
     glViewport(0,0,_width,_height);
-    // render a single triangle, coords don't matter
-    glBegin(GL_TRIANGLES);
-        glVertex3f(0, 0, 0);
-        glVertex3f(1, 0, 0);
-        glVertex3f(0, 1, 0);
-    glEnd(); 
+    // both eyes' meshes in one draw
+    glBindBuffer(GL_ARRAY_BUFFER, _warp_vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _warp_ibo);
+    glEnableVertexAttribArray(WARP_ATTRIB_POS);
+    glEnableVertexAttribArray(WARP_ATTRIB_TC);
+    glEnableVertexAttribArray(WARP_ATTRIB_EDGE);
+    glVertexAttribPointer(WARP_ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, sizeof(distortion_vertex_t),
+                          (void*)offsetof(distortion_vertex_t, x));
+    glVertexAttribPointer(WARP_ATTRIB_TC, 2, GL_FLOAT, GL_FALSE, sizeof(distortion_vertex_t),
+                          (void*)offsetof(distortion_vertex_t, u));
+    glVertexAttribPointer(WARP_ATTRIB_EDGE, 1, GL_FLOAT, GL_FALSE, sizeof(distortion_vertex_t),
+                          (void*)offsetof(distortion_vertex_t, edge));
+    glDrawElements(GL_TRIANGLES, _warp_mesh.num_indices(), GL_UNSIGNED_SHORT, 0);
+    glDisableVertexAttribArray(WARP_ATTRIB_POS);
+    glDisableVertexAttribArray(WARP_ATTRIB_TC);
+    glDisableVertexAttribArray(WARP_ATTRIB_EDGE);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
 
     // But make sure we get back to normal afterwards.
     glEnable(GL_DEPTH_TEST);
@@ -468,6 +580,9 @@ void Rift::render(Vector3f EyePos, Vector3f EyeRot, OVR::Vector3f EyeOffset,
         View = Matrix4f::LookAtRH(shiftedEyePos, shiftedEyePos + forward, up); 
     }
 
+    for (int i = 0; i < 3; i++)
+        _eye_drawn[i] = false;
+
     const StereoEyeParams& stereo_left = _SConfig.GetEyeRenderParams(StereoEye_Left);
     const StereoEyeParams& stereo_right = _SConfig.GetEyeRenderParams(StereoEye_Right);
 
@@ -480,6 +595,21 @@ void Rift::render(Vector3f EyePos, Vector3f EyeRot, OVR::Vector3f EyeOffset,
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glUseProgram(0);
 
+    // a recorded scene goes down once, before either eye
+    _scene_submit_ms = 0.0;
+    _scene_draws = 0;
+    if (_record_scene && _scene_recording){
+        PROFILE_ZONE("scene record");
+        LARGE_INTEGER freq, start, stop;
+        QueryPerformanceFrequency(&freq);
+        QueryPerformanceCounter(&start);
+        _scene_commands.begin_record();
+        _record_scene(&_scene_commands);
+        _scene_commands.end_record();
+        QueryPerformanceCounter(&stop);
+        _scene_submit_ms += ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+    }
+
     switch(_SConfig.GetStereoMode())
     {
     case Stereo_None:
@@ -487,6 +617,11 @@ void Rift::render(Vector3f EyePos, Vector3f EyeRot, OVR::Vector3f EyeOffset,
         break;
 
     case Stereo_LeftRight_Multipass:
+        if (_single_pass && _record_scene && _scene_recording){
+            PROFILE_ZONE("single pass");
+            render_single_pass(stereo_left, stereo_right, View);
+            break;
+        }
         _which_eye = 'l';
         render_one_eye(stereo_left, View, EyePos, draw_scene);
         _which_eye = 'r';
@@ -498,6 +633,7 @@ void Rift::render(Vector3f EyePos, Vector3f EyeRot, OVR::Vector3f EyeOffset,
 
     // Apply stereowarp, mapping it out to second framebuffer
     if (_PostProcess == PostProcess_Distortion){
+        PROFILE_ZONE("warp");
         stereoWarp(_fbo_spare, _render_texture);
         // Draw final fbo to screen
         glEnable(GL_TEXTURE_2D);
@@ -516,7 +652,11 @@ void Rift::render(Vector3f EyePos, Vector3f EyeRot, OVR::Vector3f EyeOffset,
         glDisable(GL_TEXTURE_2D);
     }
 
-    glutSwapBuffers();  
+    {
+        // where the wait on the GPU (and vsync) shows up
+        PROFILE_ZONE("swap");
+        glutSwapBuffers();  
+    }
 
 }
 
@@ -524,6 +664,7 @@ void Rift::render(Vector3f EyePos, Vector3f EyeRot, OVR::Vector3f EyeOffset,
 void Rift::render_one_eye(const StereoEyeParams& stereo, 
                             Matrix4f view_mat, Vector3f EyePos, void (*draw_scene)(void))
 {
+    PROFILE_ZONE(_which_eye == 'l' ? "eye l" : _which_eye == 'r' ? "eye r" : "eye center");
     float renderScale = _SConfig.GetDistortionScale();
     Viewport VP = stereo.VP;
     Matrix4f proj = stereo.Projection;
@@ -569,9 +710,193 @@ void Rift::render_one_eye(const StereoEyeParams& stereo,
     }
     glLoadMatrixf(tmp);
 
+    // keep proj * modelview around for whoever wants this eye's frustum
+    Matrix4f view_proj = proj * real_mv;
+    int slot = eye_slot(_which_eye);
+    for (int i=0; i<4; i++)
+        for (int j=0; j<4; j++)
+            _eye_view_proj[slot][j*4+i] = view_proj.M[i][j];
+    _eye_drawn[slot] = true;
+
     // Call main renderer
     glPushMatrix();
-    draw_scene();
+    if (_record_scene){
+        LARGE_INTEGER freq, start, stop;
+        QueryPerformanceFrequency(&freq);
+        QueryPerformanceCounter(&start);
+        if (_scene_recording){
+            _scene_commands.replay();
+            _scene_draws += _scene_commands.replay_draws();
+        } else {
+            _scene_immediate.begin_record();
+            _record_scene(&_scene_immediate);
+            _scene_draws += _scene_immediate.replay_draws();
+        }
+        QueryPerformanceCounter(&stop);
+        _scene_submit_ms += ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+    } else {
+        draw_scene();
+    }
     glPopMatrix();
 }
 
+/* #########################################################################
+    
+                             render_single_pass
+        -Each eye's projection is its Projection * ViewAdjust, as a
+            single modelview (the head's view) serves both; the eye
+            viewports have to sit side by side (the Rift's always do)
+            for the instanced draws' halves to line up with them.
+                              
+   ######################################################################### */
+void Rift::render_single_pass(const StereoEyeParams& stereo_left, const StereoEyeParams& stereo_right,
+                              Matrix4f view_mat){
+    const StereoEyeParams * eyes[2] = { &stereo_left, &stereo_right };
+    stereo_pass_t pass;
+    for (int e = 0; e < 2; e++){
+        const StereoEyeParams& stereo = *eyes[e];
+        Matrix4f eye_proj = stereo.Projection * stereo.ViewAdjust;
+        Matrix4f view_proj = eye_proj * view_mat;
+        int slot = eye_slot(e ? 'r' : 'l');
+        // transposed, as in render_one_eye
+        for (int i=0; i<4; i++){
+            for (int j=0; j<4; j++){
+                pass.eye_proj[e][j*4+i] = eye_proj.M[i][j];
+                _eye_view_proj[slot][j*4+i] = view_proj.M[i][j];
+            }
+        }
+        _eye_drawn[slot] = true;
+        pass.viewport[e][0] = stereo.VP.x;
+        pass.viewport[e][1] = stereo.VP.y;
+        pass.viewport[e][2] = stereo.VP.w;
+        pass.viewport[e][3] = stereo.VP.h;
+    }
+    pass.set_eye = single_pass_eye;
+    pass.user = this;
+
+    GLfloat tmp[16];
+    for (int i=0; i<4; i++)
+        for (int j=0; j<4; j++)
+            tmp[j*4+i] = view_mat.M[i][j];
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(tmp);
+
+    LARGE_INTEGER freq, start, stop;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    glPushMatrix();
+    _scene_commands.replay_stereo(pass);
+    glPopMatrix();
+    QueryPerformanceCounter(&stop);
+    _scene_submit_ms += ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+    _scene_draws += _scene_commands.replay_draws();
+}
+
+void Rift::single_pass_eye(int eye, void * user){
+    ((Rift*)user)->_which_eye = eye == 0 ? 'l' : (eye == 1 ? 'r' : 'n');
+}
+
+/* #########################################################################
+    
+                               render_recorded
+        -render() with the scene coming from record_scene; render()
+            and render_one_eye pick it up from _record_scene.
+                              
+   ######################################################################### */
+void Rift::render_recorded(Vector3f EyePos, Vector3f EyeRot, OVR::Vector3f EyeOffset, 
+                  bool use_EyeOffset, void (*record_scene)(GL_Command_Buffer * commands)){
+    _record_scene = record_scene;
+    render(EyePos, EyeRot, EyeOffset, use_EyeOffset, NULL);
+    _record_scene = NULL;
+}
+
+/* #########################################################################
+    
+                                 dump_scene
+                              
+   ######################################################################### */
+int Rift::dump_scene(const char * path){
+    if (!_scene_recording || _scene_commands.num_commands() == 0){
+        printf("No recorded scene to dump (render_recorded, with scene recording on).\n");
+        return -1;
+    }
+    if (_scene_commands.dump(path))
+        return -1;
+    printf("Scene: %u commands, %u draws, %u vertices (%u bytes) dumped to %s.\n",
+        _scene_commands.num_commands(), _scene_commands.num_draws(), _scene_commands.num_vertices(),
+        (unsigned int)_scene_commands.size_bytes(), path);
+    return 0;
+}
+
+/* #########################################################################
+    
+                                eye_view_proj
+                              
+   ######################################################################### */
+bool Rift::eye_view_proj(char eye, float * m){
+    int slot = eye_slot(eye);
+    if (!_eye_drawn[slot])
+        return false;
+    memcpy(m, _eye_view_proj[slot], 16*sizeof(float));
+    return true;
+}
+
+/* #########################################################################
+    
+                                capture_warp
+        -Both FBO textures still hold the last frame, so this can run
+            from a key handler, between frames.
+                              
+   ######################################################################### */
+int Rift::capture_warp(const char * prefix){
+    PROFILE_ZONE("warp capture");
+    if (_PostProcess != PostProcess_Distortion){
+        printf("Warp capture needs the distortion pass (F3).\n");
+        return -1;
+    }
+    rgb_image_t scene, gpu, cpu;
+    memset(&gpu, 0, sizeof(gpu));
+    memset(&cpu, 0, sizeof(cpu));
+    if (rgb_image_alloc(&scene, _width, _height) || rgb_image_alloc(&gpu, _width, _height) ||
+        rgb_image_alloc(&cpu, _width, _height)){
+        printf("Memory alloc error.\n");
+        rgb_image_free(&scene); rgb_image_free(&gpu); rgb_image_free(&cpu);
+        return -1;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, _render_texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, scene.pixels);
+    glBindTexture(GL_TEXTURE_2D, _render_texture_spare);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, gpu.pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    distortion_params_t p;
+    current_distortion_params(&p);
+    {
+        Thread_Pool pool;
+        stereo_warp_cpu(p, scene, &cpu, &pool);
+    }
+
+    char path[MAX_PATH];
+    int ret = 0;
+    sprintf(path, "%s_scene.ppm", prefix);
+    ret |= rgb_image_write_ppm(path, scene);
+    sprintf(path, "%s_gpu.ppm", prefix);
+    ret |= rgb_image_write_ppm(path, gpu);
+    sprintf(path, "%s_cpu.ppm", prefix);
+    ret |= rgb_image_write_ppm(path, cpu);
+
+    warp_diff_t d;
+    stereo_warp_compare(cpu, gpu, STEREO_WARP_TOLERANCE, &d);
+    printf("Warp captured to %s_*.ppm: GPU vs. CPU max diff %d, mean %.4f, %u pixels (%.3f%%) over %d\n",
+        prefix, d.max_diff, d.mean_diff, d.over, 100.0 * d.over / ((double)_width * _height),
+        STEREO_WARP_TOLERANCE);
+
+    rgb_image_free(&scene); rgb_image_free(&gpu); rgb_image_free(&cpu);
+    return ret ? -1 : 0;
+}
+
+static int eye_slot(char eye){
+    return eye == 'l' ? 0 : (eye == 'r' ? 1 : 2);
+}
@@ -3,6 +3,12 @@
 
    Rev history:
      Gregory Izatt  20130721  Init revision
+     agent  20261017  Per-eye view-projection matrices for culling
+     agent  20261017  Precomputed distortion mesh for the warp pass
+     agent  20261017  Capture the warp and check it against the CPU reference
+     agent  20261017  Record the scene once a frame and replay it per eye
+     agent  20261017  Single-pass instanced stereo (F4)
+     agent  20261017  Profiler zones around the eyes, warp and swap
    ######################################################################### */    
 
 #ifndef __XEN_RIFT_H
@@ -24,6 +30,10 @@
 
 #include "OVR.h"
 #include "xen_utils.h"
+#include "distortion_mesh.h"
+#include "stereo_warp_cpu.h"
+#include "gl_command_buffer.h"
+#include "profiler.h"
 
 #include <windows.h>
 
@@ -60,12 +70,69 @@ namespace xen_rift {
 			void stereoWarp(GLuint outFBO, GLuint inTexture);
 			void render(OVR::Vector3f EyePos, OVR::Vector3f EyeRot, OVR::Vector3f EyeOffset, 
 						bool use_EyeOffset, void (*draw_scene)(void));
+			// Same, for a scene written against GL_Command_Buffer: recorded
+			// once a frame and replayed for each eye, or (with scene
+			// recording off) drawn per eye straight to GL like render()
+			void render_recorded(OVR::Vector3f EyePos, OVR::Vector3f EyeRot, OVR::Vector3f EyeOffset, 
+						bool use_EyeOffset, void (*record_scene)(GL_Command_Buffer * commands));
 			void render_one_eye(const OVR::Util::Render::StereoEyeParams& stereo, 
                             OVR::Matrix4f view_mat, OVR::Vector3f EyePos, void (*draw_scene)(void));
+			void set_scene_recording( bool on ) { _scene_recording = on; }
+			bool scene_recording( void ) { return _scene_recording; }
+			// Single-pass stereo (F4; F1-F3 go back to multipass): a
+			// recorded scene is replayed once for both eyes, instanced
+			// where its programs allow (GL_Command_Buffer::replay_stereo).
+			// Scenes drawn through render() stay multipass.
+			void set_single_pass( bool on ) { _single_pass = on; }
+			bool single_pass( void ) { return _single_pass; }
+			// The last render_recorded()'s scene: CPU time spent issuing
+			// it (recording and every eye's replay, or every eye's
+			// immediate draw), the GL draws that issued, and what was
+			// recorded
+			double scene_submit_ms( void ) { return _scene_submit_ms; }
+			unsigned int scene_draws( void ) { return _scene_draws; }
+			GL_Command_Buffer & scene_commands( void ) { return _scene_commands; }
+			// Write the last recorded frame out (GL_Command_Buffer::dump;
+			// X writes scene_commands.txt).
+			// Return -1 if fail, 0 if success.
+			int dump_scene( const char * path );
 			char which_eye( void ) { return _which_eye; }
+			// Projection * modelview the last render() drew eye 'l', 'r'
+			// or 'n' (no stereo) with, column-major like glLoadMatrixf.
+			// Return false if that eye wasn't drawn last frame.
+			bool eye_view_proj( char eye, float * m );
+			// Read back the last frame's scene and warp, warp the scene
+			// on the CPU as well (stereo_warp_cpu.h), write all three to
+			// prefix_scene.ppm, prefix_gpu.ppm and prefix_cpu.ppm, and
+			// print how far the GPU's warp is off the CPU's. Needs the
+			// distortion pass on (F3). Return -1 if fail, 0 if success.
+			int capture_warp( const char * prefix );
 
 		protected:
+			// Warp parameters out of the stereo config; rebuild and
+			// re-upload the distortion mesh if they changed
+			void current_distortion_params( distortion_params_t * p );
+			void update_warp_mesh( void );
+			// Both eyes of a recorded scene in one replay, and the
+			// replay's eye hook (user is the Rift)
+			void render_single_pass( const OVR::Util::Render::StereoEyeParams& stereo_left,
+									 const OVR::Util::Render::StereoEyeParams& stereo_right,
+									 OVR::Matrix4f view_mat );
+			static void single_pass_eye( int eye, void * user );
+
 			char _which_eye;
+			// render_recorded's scene, while it's drawing: one buffer it
+			// is recorded into, one that passes it straight through
+			void (*_record_scene)(GL_Command_Buffer * commands);
+			GL_Command_Buffer _scene_commands;
+			GL_Command_Buffer _scene_immediate;
+			bool _scene_recording;
+			bool _single_pass;
+			double _scene_submit_ms;
+			unsigned int _scene_draws;
+			// per eye (left, right, center): what render_one_eye loaded
+			float _eye_view_proj[3][16];
+			bool _eye_drawn[3];
 			bool _have_rift;
 		    // *** Rendering Variables
 		    int                 _width;
@@ -98,13 +165,19 @@ namespace xen_rift {
 		    // distortion shader nums
 		    GLuint _vshader_num;
 		    GLuint _fshader_num;
-		    GLuint _barrel_frag;
-		    GLuint _barrel_geom;
-		    GLuint _barrel_vert;
+		    GLuint _warp_vert;
+		    GLuint _warp_frag;
 
 		    // and programs
 		    GLuint _program_num;
 		    GLuint _warpShaderID;
+
+		    // the warp, baked: mesh, its buffers, and whether the lens
+		    // parameters may have changed since it was built
+		    Distortion_Mesh _warp_mesh;
+		    GLuint _warp_vbo;
+		    GLuint _warp_ibo;
+		    bool _warp_mesh_stale;
 		    
 		    // framebuffer
 		    GLuint _fbo;
@@ -0,0 +1,148 @@
+/* #########################################################################
+        Sim thread -- a simulation loop running on its own thread
+
+        The thread only takes the mutex between ticks, to check for a
+    pause or quit; the tick itself runs unlocked, so pause() waits for
+    at most one tick (plus whatever sleep is left). The system timer is
+    asked for 1 ms resolution while a Sim_Thread exists, or a sleep of
+    a few ms could take a whole 15.6 ms scheduler tick.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Ticks are profiler zones on a "sim" track
+   ######################################################################### */
+
+#include "sim_thread.h"
+
+using namespace std;
+using namespace xen_rift;
+
+Sim_Thread::Sim_Thread( sim_tick_func_t tick, void * user ) :
+        _tick(tick),
+        _user(user),
+        _pause_requests(0),
+        _paused(false),
+        _quit(false),
+        _window_start(0.0),
+        _window_steps(0),
+        _window_ticks(0),
+        _steps_per_s(0.0),
+        _ticks_per_s(0.0)
+{
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    _ms_per_count = 1000.0 / ((double)freq.QuadPart);
+
+    pthread_mutex_init( &_mutex, NULL );
+    pthread_cond_init( &_wake, NULL );
+    pthread_cond_init( &_parked, NULL );
+
+    timeBeginPeriod(1);
+    if (pthread_create(&_thread, NULL, thread_main, this)){
+        printf("Couldn't start the simulation thread.\n");
+        exit(1);
+    }
+}
+
+Sim_Thread::~Sim_Thread(){
+    pthread_mutex_lock( &_mutex );
+    _quit = true;
+    pthread_cond_broadcast( &_wake );
+    pthread_mutex_unlock( &_mutex );
+    pthread_join(_thread, NULL);
+    timeEndPeriod(1);
+
+    pthread_cond_destroy( &_parked );
+    pthread_cond_destroy( &_wake );
+    pthread_mutex_destroy( &_mutex );
+}
+
+void Sim_Thread::pause(){
+    pthread_mutex_lock( &_mutex );
+    _pause_requests++;
+    while (!_paused)
+        pthread_cond_wait( &_parked, &_mutex );
+    pthread_mutex_unlock( &_mutex );
+}
+
+void Sim_Thread::resume(){
+    pthread_mutex_lock( &_mutex );
+    if (_pause_requests > 0 && --_pause_requests == 0)
+        pthread_cond_broadcast( &_wake );
+    pthread_mutex_unlock( &_mutex );
+}
+
+double Sim_Thread::now_ms(){
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return ((double)now.QuadPart) * _ms_per_count;
+}
+
+void * Sim_Thread::thread_main( void * arg ){
+    ((Sim_Thread *)arg)->run();
+    return NULL;
+}
+
+/* #########################################################################
+
+                                     run
+        -Tick, sleep until the next step is due, repeat. Sleep() only
+            does whole ms, so the last fraction of one is spent
+            yielding instead.
+
+   ######################################################################### */
+void Sim_Thread::run(){
+    profiler_thread_name("sim");
+    double last = now_ms();
+    _window_start = last;
+    pthread_mutex_lock( &_mutex );
+    while (1){
+        if (_pause_requests > 0 && !_quit){
+            _paused = true;
+            pthread_cond_broadcast( &_parked );
+            while (_pause_requests > 0 && !_quit)
+                pthread_cond_wait( &_wake, &_mutex );
+            _paused = false;
+            // the time spent parked doesn't count as sim time, or toward
+            //  the rates
+            last = _window_start = now_ms();
+            _window_steps = _window_ticks = 0;
+        }
+        if (_quit)
+            break;
+        pthread_mutex_unlock( &_mutex );
+
+        double now = now_ms();
+        double wait_ms = 0.0;
+        int steps;
+        {
+            PROFILE_ZONE("sim tick");
+            steps = _tick(now - last, &wait_ms, _user);
+        }
+        last = now;
+        count(steps, now);
+        if (wait_ms >= 1.0)
+            Sleep((DWORD)wait_ms);
+        else if (wait_ms > 0.0)
+            SwitchToThread();
+
+        pthread_mutex_lock( &_mutex );
+    }
+    _paused = true;
+    pthread_cond_broadcast( &_parked );
+    pthread_mutex_unlock( &_mutex );
+}
+
+// Roll the rate window over once it's a second long
+void Sim_Thread::count( int steps, double now ){
+    _window_steps += steps;
+    if (steps > 0)
+        _window_ticks++;
+    double window_ms = now - _window_start;
+    if (window_ms >= 1000.0){
+        _steps_per_s = _window_steps * 1000.0 / window_ms;
+        _ticks_per_s = _window_ticks * 1000.0 / window_ms;
+        _window_start = now;
+        _window_steps = _window_ticks = 0;
+    }
+}
@@ -0,0 +1,92 @@
+/* #########################################################################
+        Sim thread -- a simulation loop running on its own thread
+
+	Calls a tick function over and over on a dedicated thread, passing
+	it the wall time since its last tick; the tick takes whatever fixed
+	steps that time buys, hands the result to the render thread however
+	it likes (see triple_buffer.h), and says how long until its next
+	step is due, which the thread sleeps off. So the simulation keeps
+	its own rate no matter how long frames take, and the other way
+	around.
+
+	pause() parks the thread between ticks (for anything that has to
+	touch the simulation's state from outside: resets, snapshots...)
+	and resume() lets it go again; the first tick after a pause gets
+	no time, so the pause isn't made up for with a burst of steps.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Profiler zones per tick
+   ######################################################################### */
+
+#ifndef __XEN_SIM_THREAD_H
+#define __XEN_SIM_THREAD_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Windows
+#include <windows.h>
+
+//pthread for the thread itself
+#include <pthread.h>
+
+#include "profiler.h"
+
+namespace xen_rift {
+
+	// One turn of the loop, given frame_ms of wall time since the last
+	// one. Returns the steps taken and sets *wait_ms to the time until
+	// the next step is due.
+	typedef int (*sim_tick_func_t)(double frame_ms, double * wait_ms, void * user);
+
+	class Sim_Thread {
+		public:
+			// Starts ticking right away
+			Sim_Thread( sim_tick_func_t tick, void * user );
+			~Sim_Thread();
+
+			// Block until the thread is parked between ticks, and let
+			// it go again. They nest: it runs once every pause() has
+			// had its resume(). Not from inside the tick.
+			void pause( void );
+			void resume( void );
+
+			// Measured over the last whole second of ticking: steps
+			// taken, and ticks that took any (= states produced)
+			double steps_per_second( void ) { return _steps_per_s; }
+			double ticks_per_second( void ) { return _ticks_per_s; }
+
+		protected:
+			static void * thread_main( void * arg );
+			void run( void );
+			double now_ms( void );
+			void count( int steps, double now );
+
+			sim_tick_func_t _tick;
+			void * _user;
+			pthread_t _thread;
+			double _ms_per_count;
+
+			// pause / quit signalling
+			pthread_mutex_t _mutex;
+			pthread_cond_t _wake;
+			pthread_cond_t _parked;
+			int _pause_requests;
+			bool _paused;
+			bool _quit;
+
+			// rate window
+			double _window_start;
+			unsigned int _window_steps;
+			unsigned int _window_ticks;
+			volatile double _steps_per_s;
+			volatile double _ticks_per_s;
+
+		private:
+	};
+}
+
+#endif //__XEN_SIM_THREAD_H
@@ -0,0 +1,439 @@
+/* #########################################################################
+        Stereo warp on the CPU -- the Rift's barrel warp, as a reference
+
+   Output pixel (px, py) is sampled at its center, NDC x = (px + 0.5) /
+   width * 2 - 1 (and the same for y), which is where the rasterizer
+   evaluates barrel.frag; left of x = 0 is the left eye. The lookup is
+   GL_LINEAR's: texel centers at half-integers, the four around the
+   warped coordinate blended across then up, and GL_REPEAT's wrap for
+   the ones off the edge of the image.
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#include "stereo_warp_cpu.h"
+#include <math.h>
+#include <emmintrin.h>
+#include <vector>
+#include <algorithm>
+
+//Windows
+#include <windows.h>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+// Rows per parallel chunk
+#define WARP_CHUNK_ROWS 8
+
+typedef struct _warp_job_t {
+    const distortion_params_t * p;
+    const rgb_image_t * src;
+    rgb_image_t * dst;
+    Distortion_Mesh * mesh;
+    bool simd;
+} warp_job_t;
+
+int xen_rift::rgb_image_alloc( rgb_image_t * img, int width, int height ){
+    img->width = width;
+    img->height = height;
+    img->pixels = (unsigned char *)malloc((size_t)width * height * 3);
+    if (!img->pixels){
+        img->width = img->height = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void xen_rift::rgb_image_free( rgb_image_t * img ){
+    free(img->pixels);
+    img->pixels = NULL;
+    img->width = img->height = 0;
+}
+
+int xen_rift::rgb_image_write_ppm( const char * path, const rgb_image_t & img ){
+    FILE * f = fopen(path, "wb");
+    if (!f){
+        printf("Couldn't open %s for writing.\n", path);
+        return -1;
+    }
+    const size_t row_bytes = (size_t)img.width * 3;
+    bool ok = fprintf(f, "P6\n%d %d\n255\n", img.width, img.height) > 0;
+    for (int y = img.height - 1; ok && y >= 0; y--)
+        ok = fwrite(img.pixels + y * row_bytes, 1, row_bytes, f) == row_bytes;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok){
+        printf("Couldn't write %s.\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Next header number of a PPM, past whitespace and # comments
+static int ppm_field( FILE * f ){
+    int c = fgetc(f);
+    while (c != EOF){
+        if (c == '#'){
+            while (c != EOF && c != '\n')
+                c = fgetc(f);
+        } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n'){
+            break;
+        }
+        c = fgetc(f);
+    }
+    int v = -1;
+    if (c >= '0' && c <= '9'){
+        v = 0;
+        while (c >= '0' && c <= '9' && v < 100000){
+            v = v * 10 + (c - '0');
+            c = fgetc(f);
+        }
+    }
+    // c is the single whitespace that ends the field
+    return v;
+}
+
+int xen_rift::rgb_image_read_ppm( const char * path, rgb_image_t * img ){
+    memset(img, 0, sizeof(rgb_image_t));
+    FILE * f = fopen(path, "rb");
+    if (!f){
+        printf("Couldn't open %s.\n", path);
+        return -1;
+    }
+    int width = -1, height = -1, maxval = -1;
+    if (fgetc(f) == 'P' && fgetc(f) == '6'){
+        width = ppm_field(f);
+        height = ppm_field(f);
+        maxval = ppm_field(f);
+    }
+    if (width <= 0 || height <= 0 || maxval != 255){
+        printf("%s isn't an 8-bit binary PPM.\n", path);
+        fclose(f);
+        return -1;
+    }
+    if (rgb_image_alloc(img, width, height)){
+        printf("Memory alloc error.\n");
+        fclose(f);
+        return -1;
+    }
+    const size_t row_bytes = (size_t)width * 3;
+    bool ok = true;
+    for (int y = height - 1; ok && y >= 0; y--)
+        ok = fread(img->pixels + y * row_bytes, 1, row_bytes, f) == row_bytes;
+    fclose(f);
+    if (!ok){
+        printf("%s is truncated.\n", path);
+        rgb_image_free(img);
+        return -1;
+    }
+    return 0;
+}
+
+void xen_rift::rgb_image_test_pattern( rgb_image_t * img ){
+    const int w = img->width, h = img->height;
+    for (int y = 0; y < h; y++){
+        unsigned char * row = img->pixels + (size_t)y * w * 3;
+        for (int x = 0; x < w; x++){
+            bool line = (x % 97) == 0 || (y % 89) == 0;
+            row[3*x] = line ? 255 : (((x / 32 + y / 32) & 1) ? 220 : 30);
+            row[3*x + 1] = line ? 255 : (unsigned char)(x * 255 / (w > 1 ? w - 1 : 1));
+            row[3*x + 2] = line ? 255 : (unsigned char)((x ^ y) * 7);
+        }
+    }
+}
+
+int xen_rift::stereo_warp_compare( const rgb_image_t & a, const rgb_image_t & b, int tolerance,
+                                   warp_diff_t * diff ){
+    memset(diff, 0, sizeof(warp_diff_t));
+    if (a.width != b.width || a.height != b.height){
+        printf("Can't compare a %d x %d image to a %d x %d one.\n", a.width, a.height, b.width, b.height);
+        return -1;
+    }
+    const size_t n = (size_t)a.width * a.height;
+    unsigned long long sum = 0;
+    for (size_t i = 0; i < n; i++){
+        int worst = 0;
+        for (int c = 0; c < 3; c++){
+            int d = abs((int)a.pixels[3*i + c] - (int)b.pixels[3*i + c]);
+            sum += d;
+            if (d > worst)
+                worst = d;
+        }
+        if (worst > diff->max_diff)
+            diff->max_diff = worst;
+        if (worst > tolerance)
+            diff->over++;
+    }
+    diff->mean_diff = n ? (double)sum / (3.0 * n) : 0.0;
+    return 0;
+}
+
+// GL_REPEAT
+static inline int wrap( int i, int n ){
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+/* #########################################################################
+
+                                sample_scalar
+        -GL_LINEAR at (u, v), each channel blended across the bottom
+            pair, across the top pair, then between the two.
+
+   ######################################################################### */
+static inline void sample_scalar( const rgb_image_t & src, float u, float v, unsigned char * out ){
+    float s = u * (float)src.width - 0.5f;
+    float t = v * (float)src.height - 0.5f;
+    float fs = floorf(s), ft = floorf(t);
+    float a = s - fs, b = t - ft;
+    int x0 = wrap((int)fs, src.width), x1 = wrap((int)fs + 1, src.width);
+    int y0 = wrap((int)ft, src.height), y1 = wrap((int)ft + 1, src.height);
+    const unsigned char * r0 = src.pixels + (size_t)y0 * src.width * 3;
+    const unsigned char * r1 = src.pixels + (size_t)y1 * src.width * 3;
+    for (int c = 0; c < 3; c++){
+        float p00 = (float)r0[3*x0 + c], p10 = (float)r0[3*x1 + c];
+        float p01 = (float)r1[3*x0 + c], p11 = (float)r1[3*x1 + c];
+        float bottom = p00 + (p10 - p00) * a;
+        float top = p01 + (p11 - p01) * a;
+        out[c] = (unsigned char)(bottom + (top - bottom) * b + 0.5f);
+    }
+}
+
+// NDC of pixel center i of n
+static inline float pixel_ndc( int i, int n ){
+    return ((float)i + 0.5f) / (float)n * 2.0f - 1.0f;
+}
+
+// The reference: distortion_warp, then the lookup or black
+static inline void warp_pixel_scalar( const warp_job_t & j, int px, float y, unsigned char * out ){
+    float x = pixel_ndc(px, j.dst->width);
+    float u, v;
+    if (distortion_warp(*j.p, x < 0.0f ? 0 : 1, (x + 1.0f) * 0.5f, (1.0f - y) * 0.5f, &u, &v) < 0.0f){
+        out[0] = out[1] = out[2] = 0;
+    } else {
+        sample_scalar(*j.src, u, v, out);
+    }
+}
+
+/* #########################################################################
+
+                                 warp_row_sse
+        -distortion_warp and sample_scalar's coordinate math for four
+            pixels a lane each, operation for operation; then per
+            pixel, the four texels' channels blended a lane each. The
+            eye (and so the lens and clamp) is picked per lane, so a
+            group straddling the middle is fine. Leftover pixels at the
+            end of the row go through the reference.
+
+   ######################################################################### */
+static void warp_row_sse( const warp_job_t & j, int py ){
+    const distortion_params_t & p = *j.p;
+    const rgb_image_t & src = *j.src;
+    const int width = j.dst->width;
+    unsigned char * row = j.dst->pixels + (size_t)py * width * 3;
+    const float y = pixel_ndc(py, j.dst->height);
+    const float ty = ((1.0f - y) * 0.5f - 0.5f) * p.scale_in[1];
+    const float lens_l = 0.25f + p.lens_offset * 0.25f;
+    const float lens_r = 0.75f - p.lens_offset * 0.25f;
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 w = _mm_set1_ps((float)width);
+    const __m128 ty_sq = _mm_set1_ps(ty * ty);
+    const __m128 scale_ty = _mm_set1_ps(p.scale[1] * ty);
+    const __m128 scale_in_x = _mm_set1_ps(p.scale_in[0]);
+    const __m128 scale_x = _mm_set1_ps(p.scale[0]);
+    const __m128 k0 = _mm_set1_ps(p.K[0]), k1 = _mm_set1_ps(p.K[1]);
+    const __m128 k2 = _mm_set1_ps(p.K[2]), k3 = _mm_set1_ps(p.K[3]);
+    const __m128 src_w = _mm_set1_ps((float)src.width);
+    const __m128 src_h = _mm_set1_ps((float)src.height);
+
+    float edge[4], fx[4], fy[4];
+    int ix[4], iy[4];
+
+    int px = 0;
+    for (; px + 4 <= width; px += 4){
+        __m128 pxf = _mm_cvtepi32_ps(_mm_setr_epi32(px, px + 1, px + 2, px + 3));
+        __m128 x = _mm_sub_ps(_mm_mul_ps(_mm_div_ps(_mm_add_ps(pxf, half), w), two), one);
+        __m128 left = _mm_cmplt_ps(x, zero);
+        __m128 lens_u = _mm_or_ps(_mm_and_ps(left, _mm_set1_ps(lens_l)),
+                                  _mm_andnot_ps(left, _mm_set1_ps(lens_r)));
+        __m128 lo = _mm_andnot_ps(left, half);
+        __m128 hi = _mm_or_ps(_mm_and_ps(left, half), _mm_andnot_ps(left, one));
+
+        __m128 in_u = _mm_mul_ps(_mm_add_ps(x, one), half);
+        __m128 tx = _mm_mul_ps(_mm_sub_ps(in_u, lens_u), scale_in_x);
+        __m128 rsq = _mm_add_ps(_mm_mul_ps(tx, tx), ty_sq);
+        __m128 r = _mm_add_ps(k0, _mm_mul_ps(k1, rsq));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(k2, rsq), rsq));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(k3, rsq), rsq), rsq));
+        __m128 u = _mm_add_ps(lens_u, _mm_mul_ps(_mm_mul_ps(scale_x, tx), r));
+        __m128 v = _mm_sub_ps(one, _mm_add_ps(half, _mm_mul_ps(scale_ty, r)));
+
+        __m128 e = _mm_sub_ps(u, lo);
+        e = _mm_min_ps(_mm_sub_ps(hi, u), e);
+        e = _mm_min_ps(v, e);
+        e = _mm_min_ps(_mm_sub_ps(one, v), e);
+        _mm_storeu_ps(edge, e);
+
+        // floor by truncating, then a step down wherever that went up
+        __m128 s = _mm_sub_ps(_mm_mul_ps(u, src_w), half);
+        __m128 t = _mm_sub_ps(_mm_mul_ps(v, src_h), half);
+        __m128 fs = _mm_cvtepi32_ps(_mm_cvttps_epi32(s));
+        fs = _mm_sub_ps(fs, _mm_and_ps(_mm_cmplt_ps(s, fs), one));
+        __m128 ft = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+        ft = _mm_sub_ps(ft, _mm_and_ps(_mm_cmplt_ps(t, ft), one));
+        _mm_storeu_ps(fx, _mm_sub_ps(s, fs));
+        _mm_storeu_ps(fy, _mm_sub_ps(t, ft));
+        _mm_storeu_si128((__m128i *)ix, _mm_cvttps_epi32(fs));
+        _mm_storeu_si128((__m128i *)iy, _mm_cvttps_epi32(ft));
+
+        for (int k = 0; k < 4; k++){
+            unsigned char * out = row + 3 * (px + k);
+            if (edge[k] < 0.0f){
+                out[0] = out[1] = out[2] = 0;
+                continue;
+            }
+            int x0 = wrap(ix[k], src.width), x1 = wrap(ix[k] + 1, src.width);
+            int y0 = wrap(iy[k], src.height), y1 = wrap(iy[k] + 1, src.height);
+            const unsigned char * a0 = src.pixels + ((size_t)y0 * src.width + x0) * 3;
+            const unsigned char * a1 = src.pixels + ((size_t)y0 * src.width + x1) * 3;
+            const unsigned char * b0 = src.pixels + ((size_t)y1 * src.width + x0) * 3;
+            const unsigned char * b1 = src.pixels + ((size_t)y1 * src.width + x1) * 3;
+            __m128 p00 = _mm_setr_ps((float)a0[0], (float)a0[1], (float)a0[2], 0.0f);
+            __m128 p10 = _mm_setr_ps((float)a1[0], (float)a1[1], (float)a1[2], 0.0f);
+            __m128 p01 = _mm_setr_ps((float)b0[0], (float)b0[1], (float)b0[2], 0.0f);
+            __m128 p11 = _mm_setr_ps((float)b1[0], (float)b1[1], (float)b1[2], 0.0f);
+            __m128 wa = _mm_set1_ps(fx[k]), wb = _mm_set1_ps(fy[k]);
+            __m128 bottom = _mm_add_ps(p00, _mm_mul_ps(_mm_sub_ps(p10, p00), wa));
+            __m128 top = _mm_add_ps(p01, _mm_mul_ps(_mm_sub_ps(p11, p01), wa));
+            __m128 c = _mm_add_ps(_mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(top, bottom), wb)), half);
+            int rgb[4];
+            _mm_storeu_si128((__m128i *)rgb, _mm_cvttps_epi32(c));
+            out[0] = (unsigned char)rgb[0];
+            out[1] = (unsigned char)rgb[1];
+            out[2] = (unsigned char)rgb[2];
+        }
+    }
+    for (; px < width; px++)
+        warp_pixel_scalar(j, px, y, row + 3 * px);
+}
+
+static void warp_rows( unsigned int begin, unsigned int end, int worker, void * user ){
+    const warp_job_t & j = *(const warp_job_t *)user;
+    const int width = j.dst->width;
+    for (unsigned int py = begin; py < end; py++){
+        unsigned char * row = j.dst->pixels + (size_t)py * width * 3;
+        float y = pixel_ndc((int)py, j.dst->height);
+        if (j.mesh){
+            for (int px = 0; px < width; px++){
+                float u, v;
+                if (j.mesh->sample(pixel_ndc(px, width), y, &u, &v) < 0.0f){
+                    row[3*px] = row[3*px + 1] = row[3*px + 2] = 0;
+                } else {
+                    sample_scalar(*j.src, u, v, row + 3*px);
+                }
+            }
+        } else if (j.simd){
+            warp_row_sse(j, (int)py);
+        } else {
+            for (int px = 0; px < width; px++)
+                warp_pixel_scalar(j, px, y, row + 3*px);
+        }
+    }
+}
+
+static void run_warp( warp_job_t * j, Thread_Pool * pool ){
+    if (pool)
+        pool->parallel_for((unsigned int)j->dst->height, WARP_CHUNK_ROWS, warp_rows, j);
+    else
+        warp_rows(0, (unsigned int)j->dst->height, 0, j);
+}
+
+void xen_rift::stereo_warp_cpu( const distortion_params_t & p, const rgb_image_t & src, rgb_image_t * dst,
+                                Thread_Pool * pool, bool simd ){
+    warp_job_t j;
+    j.p = &p; j.src = &src; j.dst = dst; j.mesh = NULL; j.simd = simd;
+    run_warp(&j, pool);
+}
+
+void xen_rift::stereo_warp_cpu_mesh( Distortion_Mesh & mesh, const rgb_image_t & src, rgb_image_t * dst,
+                                     Thread_Pool * pool ){
+    warp_job_t j;
+    j.p = &mesh.params(); j.src = &src; j.dst = dst; j.mesh = &mesh; j.simd = false;
+    run_warp(&j, pool);
+}
+
+/* #########################################################################
+
+                            stereo_warp_benchmark
+        -Medians of `reps` warps each. The SSE2 path has to match the
+            reference exactly; the mesh only to STEREO_WARP_TOLERANCE,
+            and its pixels over that are reported, not failed.
+
+   ######################################################################### */
+static double time_warp( const distortion_params_t & p, const rgb_image_t & src, rgb_image_t * dst,
+                         Thread_Pool * pool, bool simd, int reps ){
+    std::vector<double> ms(reps);
+    LARGE_INTEGER freq, start, stop;
+    QueryPerformanceFrequency(&freq);
+    for (int i = 0; i < reps; i++){
+        QueryPerformanceCounter(&start);
+        stereo_warp_cpu(p, src, dst, pool, simd);
+        QueryPerformanceCounter(&stop);
+        ms[i] = ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+    }
+    std::sort(ms.begin(), ms.end());
+    return ms[reps/2];
+}
+
+unsigned int xen_rift::stereo_warp_benchmark( int width, int height, int threads ){
+    const int reps = 11;
+    if (threads <= 0)
+        threads = Thread_Pool::num_processors();
+    Thread_Pool pool(threads);
+    distortion_params_t p;
+    distortion_params_default(&p);
+
+    rgb_image_t src, ref, fast, meshed;
+    if (rgb_image_alloc(&src, width, height) || rgb_image_alloc(&ref, width, height) ||
+        rgb_image_alloc(&fast, width, height) || rgb_image_alloc(&meshed, width, height)){
+        printf("Memory alloc error.\n");
+        return (unsigned int)-1;
+    }
+    rgb_image_test_pattern(&src);
+    printf("CPU stereo warp: %d x %d, %d threads\n", width, height, threads);
+
+    double scalar_ms = time_warp(p, src, &ref, NULL, false, reps);
+    double sse_ms = time_warp(p, src, &fast, NULL, true, reps);
+    double pool_ms = time_warp(p, src, &fast, &pool, true, reps);
+    printf("    reference %8.3f ms   SSE2 %8.3f ms (%.1fx)   SSE2 x %d threads %8.3f ms (%.1fx)\n",
+        scalar_ms, sse_ms, scalar_ms / sse_ms, threads, pool_ms, scalar_ms / pool_ms);
+
+    warp_diff_t d;
+    stereo_warp_compare(ref, fast, 0, &d);
+    if (d.over)
+        printf("    SSE2 vs. reference: %u pixels differ (max %d)\n", d.over, d.max_diff);
+    else
+        printf("    SSE2 vs. reference: bit-exact\n");
+    unsigned int mismatched = d.over;
+
+    Distortion_Mesh mesh;
+    mesh.build(p);
+    stereo_warp_cpu_mesh(mesh, src, &meshed, &pool);
+    stereo_warp_compare(ref, meshed, STEREO_WARP_TOLERANCE, &d);
+    printf("    %d x %d mesh vs. reference: max diff %d, mean %.4f, %u pixels (%.3f%%) over %d\n",
+        mesh.cells_x(), mesh.cells_y(), d.max_diff, d.mean_diff, d.over,
+        100.0 * d.over / ((double)width * height), STEREO_WARP_TOLERANCE);
+
+    rgb_image_free(&meshed);
+    rgb_image_free(&fast);
+    rgb_image_free(&ref);
+    rgb_image_free(&src);
+    return mismatched;
+}
@@ -0,0 +1,99 @@
+/* #########################################################################
+        Stereo warp on the CPU -- the Rift's barrel warp, as a reference
+   Header!
+
+	What Rift::stereoWarp puts on screen, computed on the host from an
+	RGB framebuffer: barrel.geom's two eye quads and barrel.frag's
+	HmdWarp about each eye's LensCenter, the black clamp to each eye's
+	half around its ScreenCenter, and a bilinear (GL_LINEAR,
+	GL_REPEAT) lookup of the source at the warped coordinate. The math
+	per pixel is distortion_warp (distortion_mesh.h), the same code the
+	warp mesh is baked from. Rounding to 8 bits is to the nearest.
+
+	Images are tightly packed 8-bit RGB with rows bottom to top, the
+	way glReadPixels / glGetTexImage hand them back with a pack
+	alignment of 1.
+
+	Two paths, chosen per call: the scalar reference, one pixel at a
+	time, and SSE2, four pixels' warp at once and each texel's three
+	channels at once. The SSE2 path does the reference's operations in
+	the reference's order, so the two are bit for bit the same (the
+	particle_swirl_bench -benchwarp check holds it to that) -- as long
+	as the reference is built for SSE2 float math too (the Makefile's
+	FPFLAGS); as x87 code its lens polynomial keeps extended
+	intermediates. Either runs its rows on a Thread_Pool if given one.
+
+	The point is a golden image: something to hold the GPU warp, the
+	mesh, or any faster path against pixel by pixel, with no headset
+	(stereo_warp_compare, Rift::capture_warp, -warpimage / -warpcheck).
+	resources/warp_golden_in.ppm is the test pattern at 320 x 200 and
+	warp_golden_out.ppm its reference warp with the default lens;
+	make check warps the one and compares it with the other.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Checked-in golden warp (make check)
+   ######################################################################### */
+
+#ifndef __XEN_STEREO_WARP_CPU_H
+#define __XEN_STEREO_WARP_CPU_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "distortion_mesh.h"
+#include "thread_pool.h"
+
+namespace xen_rift {
+	// Channel difference up to which two warps still count as matching
+	// (the GPU filters with fewer bits of weight than the reference)
+	#define STEREO_WARP_TOLERANCE 2
+
+	// 8-bit RGB, width * 3 bytes a row, bottom row first
+	typedef struct _rgb_image_t {
+		unsigned char * pixels;
+		int width;
+		int height;
+	} rgb_image_t;
+
+	// Return -1 if fail, 0 if success.
+	int rgb_image_alloc( rgb_image_t * img, int width, int height );
+	void rgb_image_free( rgb_image_t * img );
+	// Binary PPM (P6), which is top row first: rows are flipped on the
+	// way in and out. Return -1 if fail, 0 if success.
+	int rgb_image_write_ppm( const char * path, const rgb_image_t & img );
+	int rgb_image_read_ppm( const char * path, rgb_image_t * img );
+	// Something with edges, gradients and detail at every scale to warp
+	void rgb_image_test_pattern( rgb_image_t * img );
+
+	// How far apart two images are: the largest channel difference,
+	// the mean one, and the pixels with a channel more than tolerance off
+	typedef struct _warp_diff_t {
+		int max_diff;
+		double mean_diff;
+		unsigned int over;
+	} warp_diff_t;
+
+	// Return -1 (and print why) if the sizes differ, 0 otherwise.
+	int stereo_warp_compare( const rgb_image_t & a, const rgb_image_t & b, int tolerance,
+							 warp_diff_t * diff );
+
+	// Warp src into dst (already allocated, any size; the warp is over
+	// dst's whole screen) with lens parameters p
+	void stereo_warp_cpu( const distortion_params_t & p, const rgb_image_t & src, rgb_image_t * dst,
+						  Thread_Pool * pool, bool simd = true );
+	// What drawing mesh over src would put in dst: its interpolated
+	// coordinates instead of the per-pixel warp, same sampling
+	void stereo_warp_cpu_mesh( Distortion_Mesh & mesh, const rgb_image_t & src, rgb_image_t * dst,
+							   Thread_Pool * pool );
+
+	// Warp a test pattern at width x height: check the SSE2 path
+	// against the scalar reference, the warp mesh against both, and
+	// time the reference, SSE2 on one thread and SSE2 on `threads`.
+	// Return the number of SSE2 pixels that differ from the reference.
+	unsigned int stereo_warp_benchmark( int width, int height, int threads );
+};
+
+#endif //__XEN_STEREO_WARP_CPU_H
@@ -0,0 +1,184 @@
+/* #########################################################################
+        Thread pool -- chunked, work-stealing parallel-for
+
+        Each job splits [0, n) into ceil(n / chunk) chunks, and hands
+    every worker an even, contiguous slice of chunk indices. A slice is
+    just an atomic "next" counter and an end; the owner claims chunks
+    from it with InterlockedIncrement, and when it runs dry it walks
+    the other workers' slices and claims from those the same way. Since
+    owner and thieves go through the same counter, no chunk runs twice
+    and no locks are taken while work is going on -- the mutex / condvar
+    pair is only for sleeping between jobs.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  No pinning past the affinity mask's width
+   ######################################################################### */
+
+#include "thread_pool.h"
+#include <malloc.h>
+
+using namespace std;
+using namespace xen_rift;
+
+Thread_Pool::Thread_Pool( int num_threads, bool pin_threads ) :
+        _pin_threads(pin_threads),
+        _fn(NULL),
+        _user(NULL),
+        _n(0),
+        _chunk(1),
+        _last_job_ms(0.0),
+        _generation(0),
+        _active(0),
+        _quit(false)
+{
+    if (num_threads <= 0)
+        num_threads = num_processors();
+    _num_threads = num_threads;
+
+    pthread_mutex_init( &_mutex, NULL );
+    pthread_cond_init( &_wake, NULL );
+    pthread_cond_init( &_done, NULL );
+
+    _queues = (chunk_queue_t *)_aligned_malloc(_num_threads*sizeof(chunk_queue_t), 64);
+    _threads = (pthread_t *)malloc(_num_threads*sizeof(pthread_t));
+    _worker_args = (worker_arg_t *)malloc(_num_threads*sizeof(worker_arg_t));
+    if (!_queues || !_threads || !_worker_args){
+        printf("Memory alloc error.\n");
+        exit(1);
+    }
+    memset(_queues, 0, _num_threads*sizeof(chunk_queue_t));
+
+    for (int i = 0; i < _num_threads; i++){
+        _worker_args[i].pool = this;
+        _worker_args[i].index = i;
+        if (pthread_create(&_threads[i], NULL, worker_main, &_worker_args[i])){
+            printf("Couldn't start thread pool worker %d.\n", i);
+            exit(1);
+        }
+    }
+}
+
+Thread_Pool::~Thread_Pool(){
+    wait();
+    pthread_mutex_lock( &_mutex );
+    _quit = true;
+    pthread_cond_broadcast( &_wake );
+    pthread_mutex_unlock( &_mutex );
+    for (int i = 0; i < _num_threads; i++)
+        pthread_join(_threads[i], NULL);
+
+    pthread_cond_destroy( &_done );
+    pthread_cond_destroy( &_wake );
+    pthread_mutex_destroy( &_mutex );
+    _aligned_free(_queues);
+    free(_threads);
+    free(_worker_args);
+}
+
+int Thread_Pool::num_processors(){
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+}
+
+void Thread_Pool::parallel_for_async( unsigned int n, unsigned int chunk, range_func_t fn, void * user ){
+    wait();
+    if (n == 0)
+        return;
+    if (chunk == 0)
+        chunk = 1;
+    unsigned int num_chunks = (n + chunk - 1) / chunk;
+
+    pthread_mutex_lock( &_mutex );
+    _fn = fn;
+    _user = user;
+    _n = n;
+    _chunk = chunk;
+    for (int i = 0; i < _num_threads; i++){
+        _queues[i].next = (LONG)(((ULONGLONG)num_chunks * i) / _num_threads);
+        _queues[i].end = (LONG)(((ULONGLONG)num_chunks * (i+1)) / _num_threads);
+    }
+    _active = _num_threads;
+    QueryPerformanceCounter(&_job_start);
+    _generation++;
+    pthread_cond_broadcast( &_wake );
+    pthread_mutex_unlock( &_mutex );
+}
+
+void Thread_Pool::wait(){
+    pthread_mutex_lock( &_mutex );
+    while (_active > 0)
+        pthread_cond_wait( &_done, &_mutex );
+    pthread_mutex_unlock( &_mutex );
+}
+
+void Thread_Pool::parallel_for( unsigned int n, unsigned int chunk, range_func_t fn, void * user ){
+    parallel_for_async(n, chunk, fn, user);
+    wait();
+}
+
+// Claim one chunk from `queue` and run it. False once that queue is empty.
+bool Thread_Pool::run_chunk( int worker, int queue ){
+    LONG c = InterlockedIncrement(&_queues[queue].next) - 1;
+    if (c >= _queues[queue].end)
+        return false;
+    unsigned int begin = (unsigned int)c * _chunk;
+    unsigned int end = begin + _chunk;
+    if (end > _n || end < begin)
+        end = _n;
+    _fn(begin, end, worker, _user);
+    return true;
+}
+
+// Own slice first, then steal from everyone else, nearest neighbour first.
+void Thread_Pool::run_chunks( int worker ){
+    while (run_chunk(worker, worker))
+        ;
+    for (int k = 1; k < _num_threads; k++){
+        int victim = (worker + k) % _num_threads;
+        while (run_chunk(worker, victim))
+            ;
+    }
+}
+
+void * Thread_Pool::worker_main( void * arg ){
+    worker_arg_t * w = (worker_arg_t *)arg;
+    Thread_Pool * pool = w->pool;
+
+    // one worker per logical processor, so the scheduler doesn't bounce
+    // them (and their cache-resident chunks) around. An affinity mask
+    // only covers the first 32 (64) processors, so workers meant for
+    // any past that are left where the scheduler puts them.
+    int cpu = w->index % num_processors();
+    if (pool->_pin_threads && cpu < (int)(sizeof(DWORD_PTR) * 8))
+        SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR)1) << cpu);
+
+    unsigned int seen = 0;
+    while (1){
+        pthread_mutex_lock( &pool->_mutex );
+        while (pool->_generation == seen && !pool->_quit)
+            pthread_cond_wait( &pool->_wake, &pool->_mutex );
+        if (pool->_quit){
+            pthread_mutex_unlock( &pool->_mutex );
+            break;
+        }
+        seen = pool->_generation;
+        pthread_mutex_unlock( &pool->_mutex );
+
+        pool->run_chunks(w->index);
+
+        // last one out records the time and wakes up wait()
+        if (InterlockedDecrement(&pool->_active) == 0){
+            LARGE_INTEGER now, freq;
+            QueryPerformanceCounter(&now);
+            QueryPerformanceFrequency(&freq);
+            pthread_mutex_lock( &pool->_mutex );
+            pool->_last_job_ms = ((double)(now.QuadPart - pool->_job_start.QuadPart)) * 1000.0 /
+                                 ((double)freq.QuadPart);
+            pthread_cond_broadcast( &pool->_done );
+            pthread_mutex_unlock( &pool->_mutex );
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,98 @@
+/* #########################################################################
+        Thread pool -- chunked, work-stealing parallel-for
+
+	A fixed set of pinned worker threads that split [0, n) into chunks
+	and run a range callback over each. Every worker starts on its own
+	contiguous slice of chunks and, once that runs dry, steals chunks
+	from the other workers' slices. Dispatch is asynchronous: the calling
+	thread (e.g. the GLUT thread) doesn't take part in the work and is
+	free until it calls wait().
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#ifndef __XEN_THREAD_POOL_H
+#define __XEN_THREAD_POOL_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Windows
+#include <windows.h>
+
+//pthread for the workers themselves
+#include <pthread.h>
+
+namespace xen_rift {
+
+	// Callback run over [begin, end) by worker number `worker`.
+	typedef void (*range_func_t)(unsigned int begin, unsigned int end, int worker, void * user);
+
+	class Thread_Pool {
+		public:
+			// num_threads = 0 means one per logical processor
+			Thread_Pool( int num_threads = 0, bool pin_threads = true );
+			~Thread_Pool();
+
+			int num_threads( void ) { return _num_threads; }
+			// Start running fn over [0, n) in chunks of `chunk` items and
+			// return right away. Only one job may be in flight at a time.
+			void parallel_for_async( unsigned int n, unsigned int chunk, range_func_t fn, void * user );
+			// Block until the in-flight job (if any) is done.
+			void wait( void );
+			// parallel_for_async + wait
+			void parallel_for( unsigned int n, unsigned int chunk, range_func_t fn, void * user );
+			bool busy( void ) { return _active > 0; }
+			// Dispatch-to-last-chunk time of the most recent finished job
+			double last_job_ms( void ) { return _last_job_ms; }
+
+			static int num_processors( void );
+
+		protected:
+			// One worker's slice of chunk indices; padded so the counters
+			// different workers hammer don't share a cache line.
+			typedef struct _chunk_queue_t {
+				volatile LONG next;
+				LONG end;
+				char pad[64 - 2*sizeof(LONG)];
+			} chunk_queue_t;
+
+			typedef struct _worker_arg_t {
+				Thread_Pool * pool;
+				int index;
+			} worker_arg_t;
+
+			static void * worker_main( void * arg );
+			void run_chunks( int worker );
+			bool run_chunk( int worker, int queue );
+
+			int _num_threads;
+			bool _pin_threads;
+			pthread_t * _threads;
+			worker_arg_t * _worker_args;
+			chunk_queue_t * _queues;
+
+			// current job
+			range_func_t _fn;
+			void * _user;
+			unsigned int _n;
+			unsigned int _chunk;
+			LARGE_INTEGER _job_start;
+			double _last_job_ms;
+
+			// wake / done signalling
+			pthread_mutex_t _mutex;
+			pthread_cond_t _wake;
+			pthread_cond_t _done;
+			unsigned int _generation;
+			volatile LONG _active;
+			bool _quit;
+
+		private:
+	};
+}
+
+#endif //__XEN_THREAD_POOL_H
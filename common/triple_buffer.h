@@ -0,0 +1,79 @@
+/* #########################################################################
+        Triple buffer -- lock-free handoff of whole states between threads
+
+	One writer thread produces states, one reader thread wants the newest
+	finished one, and neither should ever wait on the other. With three
+	slots that works out with no locks at all: the writer always has a
+	slot of its own to fill (back), the reader always has one of its own
+	to look at (front), and the third sits in between (middle), holding
+	the newest state published and not yet picked up, if any.
+
+		writer: fill back(), publish()   -- back and middle trade places
+		reader: if (acquire()) front()   -- front and middle trade places,
+		                                    but only if middle is new
+
+	Both trades are one InterlockedExchange on a word packing the middle
+	slot's index with a "fresh" bit, so a publish can never be lost and
+	the reader never sees a slot the writer is still filling. States the
+	reader is too slow for are simply overwritten: it skips to the
+	latest. This only hands out slot indices; the slots themselves are
+	whatever the caller keeps in an array of three.
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#ifndef __XEN_TRIPLE_BUFFER_H
+#define __XEN_TRIPLE_BUFFER_H
+
+//Windows
+#include <windows.h>
+
+namespace xen_rift {
+
+	class Triple_Buffer {
+		public:
+			Triple_Buffer() { reset(); }
+
+			// Back to slot 0 for the writer, 2 for the reader and
+			// nothing published. Neither thread may be using it.
+			void reset( void ) {
+				_back = 0;
+				_middle = 1;
+				_front = 2;
+			}
+
+			// Writer: the slot to fill next, and hand it over once it's
+			// filled (the writer gets a different slot back)
+			int back( void ) { return _back; }
+			void publish( void ) {
+				LONG prev = InterlockedExchange(&_middle, _back | FRESH);
+				_back = prev & INDEX;
+			}
+
+			// Reader: pick up the newest published slot, if there's one
+			// it hasn't had yet; false leaves front() as it was
+			bool acquire( void ) {
+				if (!(_middle & FRESH))
+					return false;
+				// only acquire() clears FRESH, so it's still set here
+				LONG prev = InterlockedExchange(&_middle, _front);
+				_front = prev & INDEX;
+				return true;
+			}
+			int front( void ) { return _front; }
+
+		protected:
+			static const LONG INDEX = 3;
+			static const LONG FRESH = 4;
+
+			// each owned by one thread; only _middle is shared
+			int _back;
+			int _front;
+			volatile LONG _middle;
+
+		private:
+	};
+}
+
+#endif //__XEN_TRIPLE_BUFFER_H
@@ -3,6 +3,7 @@
 
    Rev history:
      Gregory Izatt  20130913 Init revision
+     agent  20261017  Frame times to the profiler (J writes the trace)
    ######################################################################### */    
 
 #include "Eigen/Dense"
@@ -115,6 +116,8 @@ int main(int argc, char* argv[]) {
     // set up timer
     if (init_get_elapsed())
         exit(1);
+    if (profiler_init(false))
+        exit(1);
     get_elapsed(GET_ELAPSED_FRAMERATE);
 
     //Go get openGL set up / get the critical glob. variables set up
@@ -265,6 +268,7 @@ void glut_display(){
     // frame was rendered, give the player handler a tick
 
     totalFrames++;
+    profiler_frame();
 }
 
 /* #########################################################################
@@ -0,0 +1,13 @@
+// Distortion mesh fragment shader: one lookup at the interpolated warp,
+// black outside the eye's image. What barrel.frag worked out per pixel.
+#version 120
+
+uniform sampler2D Texture;
+
+varying vec2 TexCoords;
+varying float Edge;
+
+void main()
+{
+    gl_FragColor = step(0.0, Edge) * texture2D(Texture, TexCoords);
+}
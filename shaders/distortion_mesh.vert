@@ -0,0 +1,19 @@
+// Distortion mesh vertex shader: the barrel warp, baked per vertex by
+// common/distortion_mesh.h. pos is already in NDC; tc is the warped
+// coordinate into the side-by-side eye image and edge how far inside
+// its eye's half that lands (< 0 where the warp shows nothing).
+#version 120
+
+attribute vec2 pos;
+attribute vec2 tc;
+attribute float edge;
+
+varying vec2 TexCoords;
+varying float Edge;
+
+void main()
+{
+    gl_Position = vec4(pos, 0.0, 1.0);
+    TexCoords = tc;
+    Edge = edge;
+}
@@ -0,0 +1,40 @@
+// Particle vertex shader: positions come in as separate x / y / z
+// streams (see simple_particle_swirl/particle_store.h), so each is its
+// own single-float attribute. prev_px / py / pz are the positions one
+// fixed step earlier; alpha says how far past that step the frame is.
+#version 130
+#extension GL_ARB_draw_instanced : require
+
+attribute float px;
+attribute float py;
+attribute float pz;
+attribute float prev_px;
+attribute float prev_py;
+attribute float prev_pz;
+attribute vec4 color;
+
+uniform float alpha;
+
+// Single-pass stereo (common/gl_command_buffer.h): with StereoInstanced
+// set, instance i is eye i, projected by StereoEyeProj[i] and squeezed
+// into its half of the viewport, clipped to it.
+uniform mat4 StereoEyeProj[2];
+uniform bool StereoInstanced;
+
+void main()
+{
+    vec3 p = mix(vec3(prev_px, prev_py, prev_pz), vec3(px, py, pz), alpha);
+    vec4 v = vec4(p, 1.0);
+    if (StereoInstanced){
+        vec4 c = StereoEyeProj[gl_InstanceIDARB] * (gl_ModelViewMatrix * v);
+        gl_ClipDistance[0] = c.w - c.x;
+        gl_ClipDistance[1] = c.w + c.x;
+        c.x = 0.5 * c.x + (gl_InstanceIDARB == 0 ? -0.5 : 0.5) * c.w;
+        gl_Position = c;
+    } else {
+        gl_Position = gl_ModelViewProjectionMatrix * v;
+        gl_ClipDistance[0] = 1.0;
+        gl_ClipDistance[1] = 1.0;
+    }
+    gl_FrontColor = color;
+}
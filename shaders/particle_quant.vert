@@ -0,0 +1,45 @@
+// Compact particle vertex shader: like particle.vert, but px / py / pz
+// and prev_px / py / pz come in as raw 16-bit fixed point (see
+// simple_particle_swirl/particle_quant.h). Every 1024 particles share
+// a box in the `boxes` buffer texture -- texel 2b is block b's min,
+// 2b + 1 its scale -- and a position is min + q * scale. The box
+// covers the previous positions too.
+#version 130
+#extension GL_EXT_gpu_shader4 : require
+#extension GL_ARB_draw_instanced : require
+
+attribute float px;
+attribute float py;
+attribute float pz;
+attribute float prev_px;
+attribute float prev_py;
+attribute float prev_pz;
+attribute vec4 color;
+
+uniform float alpha;
+uniform samplerBuffer boxes;
+
+// single-pass stereo, as in particle.vert
+uniform mat4 StereoEyeProj[2];
+uniform bool StereoInstanced;
+
+void main()
+{
+    int block = gl_VertexID / 1024;
+    vec3 lo = texelFetchBuffer(boxes, 2*block).xyz;
+    vec3 scale = texelFetchBuffer(boxes, 2*block + 1).xyz;
+    vec3 q = mix(vec3(prev_px, prev_py, prev_pz), vec3(px, py, pz), alpha);
+    vec4 v = vec4(lo + q * scale, 1.0);
+    if (StereoInstanced){
+        vec4 c = StereoEyeProj[gl_InstanceIDARB] * (gl_ModelViewMatrix * v);
+        gl_ClipDistance[0] = c.w - c.x;
+        gl_ClipDistance[1] = c.w + c.x;
+        c.x = 0.5 * c.x + (gl_InstanceIDARB == 0 ? -0.5 : 0.5) * c.w;
+        gl_Position = c;
+    } else {
+        gl_Position = gl_ModelViewProjectionMatrix * v;
+        gl_ClipDistance[0] = 1.0;
+        gl_ClipDistance[1] = 1.0;
+    }
+    gl_FrontColor = color;
+}
@@ -0,0 +1,33 @@
+// Trail vertex shader: one end of a streak segment, out of the trail
+// ring's x / y / z streams (see simple_particle_swirl/particle_trail.h),
+// each its own single-float attribute like particle.vert's. fade is
+// the segment's opacity, 1 at the particle and falling off with age.
+#version 130
+#extension GL_ARB_draw_instanced : require
+
+attribute float px;
+attribute float py;
+attribute float pz;
+
+uniform float fade;
+
+// single-pass stereo, as in particle.vert
+uniform mat4 StereoEyeProj[2];
+uniform bool StereoInstanced;
+
+void main()
+{
+    vec4 v = vec4(px, py, pz, 1.0);
+    if (StereoInstanced){
+        vec4 c = StereoEyeProj[gl_InstanceIDARB] * (gl_ModelViewMatrix * v);
+        gl_ClipDistance[0] = c.w - c.x;
+        gl_ClipDistance[1] = c.w + c.x;
+        c.x = 0.5 * c.x + (gl_InstanceIDARB == 0 ? -0.5 : 0.5) * c.w;
+        gl_Position = c;
+    } else {
+        gl_Position = gl_ModelViewProjectionMatrix * v;
+        gl_ClipDistance[0] = 1.0;
+        gl_ClipDistance[1] = 1.0;
+    }
+    gl_FrontColor = vec4(0.55, 0.7, 1.0, 0.6 * fade);
+}
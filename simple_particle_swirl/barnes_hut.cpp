@@ -0,0 +1,431 @@
+/* #########################################################################
+        barnes_hut: linear-octree approximate mutual gravity
+
+   Bounds, Morton codes, the Morton-order gather and the force walk all
+   run as parallel_for passes on the pool. The radix sort and node
+   layout are serial: both are O(N) with small constants, next to an
+   O(N log N) walk that does a square root per interaction.
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#include "barnes_hut.h"
+#include "particle_init.h"
+#include <malloc.h>
+#include <float.h>
+#include <algorithm>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+// Particles per parallel chunk in each pass
+#define BH_CHUNK 4096
+
+/* #########################################################################
+
+                            forward declarations
+
+   ######################################################################### */
+static inline unsigned int expand_bits(unsigned int v);
+static void radix_sort(unsigned int * codes, unsigned int * index, unsigned int * codes_tmp,
+        unsigned int * index_tmp, unsigned int n);
+
+Barnes_Hut::Barnes_Hut( float theta, float softening ) :
+        _theta(theta),
+        _eps2(softening*softening),
+        _store(NULL),
+        _n(0),
+        _capacity(0),
+        _particle_mass(0.0f),
+        _kick(0.0f),
+        _last_build_ms(0.0),
+        _last_force_ms(0.0),
+        _side(0.0f),
+        _codes(NULL),
+        _index(NULL),
+        _codes_tmp(NULL),
+        _index_tmp(NULL),
+        _sorted_x(NULL),
+        _sorted_y(NULL),
+        _sorted_z(NULL)
+{
+    _min[0] = _min[1] = _min[2] = 0.0f;
+}
+
+Barnes_Hut::~Barnes_Hut(){
+    reserve(0);
+}
+
+// Size the per-particle arrays for n (0 frees them)
+void Barnes_Hut::reserve( unsigned int n ){
+    if (n != 0 && n <= _capacity)
+        return;
+    _aligned_free(_codes);
+    _aligned_free(_index);
+    _aligned_free(_codes_tmp);
+    _aligned_free(_index_tmp);
+    _aligned_free(_sorted_x);
+    _aligned_free(_sorted_y);
+    _aligned_free(_sorted_z);
+    _capacity = 0;
+    if (n == 0)
+        return;
+    _codes = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+    _index = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+    _codes_tmp = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+    _index_tmp = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+    _sorted_x = (float *)_aligned_malloc(n*sizeof(float), 64);
+    _sorted_y = (float *)_aligned_malloc(n*sizeof(float), 64);
+    _sorted_z = (float *)_aligned_malloc(n*sizeof(float), 64);
+    if (!_codes || !_index || !_codes_tmp || !_index_tmp || !_sorted_x || !_sorted_y || !_sorted_z){
+        printf("Memory alloc error.\n");
+        exit(1);
+    }
+    _capacity = n;
+}
+
+// One pass over [0, n) in BH_CHUNK chunks; on the pool if there is one
+void Barnes_Hut::run( Thread_Pool * pool, unsigned int n, range_func_t fn ){
+    if (pool){
+        pool->parallel_for(n, BH_CHUNK, fn, this);
+        return;
+    }
+    for (unsigned int begin = 0; begin < n; begin += BH_CHUNK)
+        fn(begin, min(begin + BH_CHUNK, n), 0, this);
+}
+
+/* #########################################################################
+
+                                    kick
+
+   ######################################################################### */
+void Barnes_Hut::kick( particle_store_t & s, float gm, float dt_s, Thread_Pool * pool ){
+    if (s.n == 0)
+        return;
+    LARGE_INTEGER start, built, stop, freq;
+    QueryPerformanceCounter(&start);
+
+    reserve(s.n);
+    _store = &s;
+    _n = s.n;
+    _particle_mass = 1.0f / s.n;
+    _kick = gm * dt_s;
+    build(pool);
+    QueryPerformanceCounter(&built);
+
+    run(pool, _n, force_range);
+    _store = NULL;
+
+    QueryPerformanceCounter(&stop);
+    QueryPerformanceFrequency(&freq);
+    _last_build_ms = ((double)(built.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+    _last_force_ms = ((double)(stop.QuadPart - built.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+}
+
+/* #########################################################################
+
+                                    build
+        -Bounding cube -> Morton codes -> sort -> gather -> nodes.
+
+   ######################################################################### */
+void Barnes_Hut::build( Thread_Pool * pool ){
+    unsigned int chunks = (_n + BH_CHUNK - 1) / BH_CHUNK;
+    _chunk_bounds.resize(6*chunks);
+    run(pool, _n, bounds_range);
+    float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (unsigned int c = 0; c < chunks; c++){
+        for (int a = 0; a < 3; a++){
+            if (_chunk_bounds[6*c + a] < lo[a]) lo[a] = _chunk_bounds[6*c + a];
+            if (_chunk_bounds[6*c + 3 + a] > hi[a]) hi[a] = _chunk_bounds[6*c + 3 + a];
+        }
+    }
+    _side = 0.0f;
+    for (int a = 0; a < 3; a++){
+        _min[a] = lo[a];
+        if (hi[a] - lo[a] > _side)
+            _side = hi[a] - lo[a];
+    }
+    // a little slack so the far faces still quantize inside the cube
+    _side = _side * 1.0001f + 1e-6f;
+
+    run(pool, _n, morton_range);
+    radix_sort(_codes, _index, _codes_tmp, _index_tmp, _n);
+    run(pool, _n, gather_range);
+
+    _nodes.clear();
+    _nodes.reserve(2*(_n / BH_LEAF_PARTICLES) + 16);
+    build_node(0, _n, 0, _side);
+}
+
+// Lay out the node for Morton-ordered slots [begin, end) at `level`,
+//  then its children right after it. Returns its index.
+unsigned int Barnes_Hut::build_node( unsigned int begin, unsigned int end, int level, float side ){
+    unsigned int id = (unsigned int)_nodes.size();
+    _nodes.push_back(bh_node_t());
+    bh_node_t node;
+    node.first = begin;
+    node.count = end - begin;
+    node.open2 = (side / _theta) * (side / _theta);
+
+    if (node.count <= BH_LEAF_PARTICLES || level == BH_MORTON_BITS){
+        float x = 0.0f, y = 0.0f, z = 0.0f;
+        for (unsigned int k = begin; k < end; k++){
+            x += _sorted_x[k]; y += _sorted_y[k]; z += _sorted_z[k];
+        }
+        node.leaf = 1;
+        node.mass = node.count * _particle_mass;
+        node.cx = x / node.count; node.cy = y / node.count; node.cz = z / node.count;
+    } else {
+        // codes below this node share everything above this level's
+        //  3-bit digit, so each child is one run of equal digits
+        int shift = 3*(BH_MORTON_BITS - 1 - level);
+        float x = 0.0f, y = 0.0f, z = 0.0f, m = 0.0f;
+        unsigned int c0 = begin;
+        for (unsigned int digit = 0; digit < 8 && c0 < end; digit++){
+            unsigned int lo = c0, hi = end;
+            while (lo < hi){
+                unsigned int mid = lo + (hi - lo)/2;
+                if (((_codes[mid] >> shift) & 7) <= digit)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo > c0){
+                unsigned int child = build_node(c0, lo, level + 1, side * 0.5f);
+                const bh_node_t & c = _nodes[child];
+                x += c.cx * c.mass; y += c.cy * c.mass; z += c.cz * c.mass;
+                m += c.mass;
+            }
+            c0 = lo;
+        }
+        node.leaf = 0;
+        node.mass = m;
+        node.cx = x / m; node.cy = y / m; node.cz = z / m;
+    }
+    node.next = (unsigned int)_nodes.size();
+    _nodes[id] = node;
+    return id;
+}
+
+void Barnes_Hut::bounds_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Barnes_Hut * bh = (Barnes_Hut *)user;
+    const particle_store_t & s = *bh->_store;
+    float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (unsigned int i = begin; i < end; i++){
+        float p[3] = { s.x[i], s.y[i], s.z[i] };
+        for (int a = 0; a < 3; a++){
+            if (p[a] < lo[a]) lo[a] = p[a];
+            if (p[a] > hi[a]) hi[a] = p[a];
+        }
+    }
+    float * out = &bh->_chunk_bounds[6*(begin / BH_CHUNK)];
+    for (int a = 0; a < 3; a++){
+        out[a] = lo[a];
+        out[3 + a] = hi[a];
+    }
+}
+
+void Barnes_Hut::morton_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Barnes_Hut * bh = (Barnes_Hut *)user;
+    const particle_store_t & s = *bh->_store;
+    const float scale = (float)(1 << BH_MORTON_BITS) / bh->_side;
+    const unsigned int top = (1 << BH_MORTON_BITS) - 1;
+    for (unsigned int i = begin; i < end; i++){
+        unsigned int q[3];
+        float p[3] = { s.x[i], s.y[i], s.z[i] };
+        for (int a = 0; a < 3; a++){
+            float f = (p[a] - bh->_min[a]) * scale;
+            q[a] = f <= 0.0f ? 0 : (f >= (float)top ? top : (unsigned int)f);
+        }
+        bh->_codes[i] = (expand_bits(q[0]) << 2) | (expand_bits(q[1]) << 1) | expand_bits(q[2]);
+        bh->_index[i] = i;
+    }
+}
+
+void Barnes_Hut::gather_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Barnes_Hut * bh = (Barnes_Hut *)user;
+    const particle_store_t & s = *bh->_store;
+    for (unsigned int k = begin; k < end; k++){
+        unsigned int i = bh->_index[k];
+        bh->_sorted_x[k] = s.x[i];
+        bh->_sorted_y[k] = s.y[i];
+        bh->_sorted_z[k] = s.z[i];
+    }
+}
+
+/* #########################################################################
+
+                                 force_range
+        -Walks the tree for Morton-ordered slots [begin, end): far
+            enough nodes count as a point mass, close ones get opened,
+            and leaves are summed particle by particle (minus self).
+
+   ######################################################################### */
+void Barnes_Hut::force_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Barnes_Hut * bh = (Barnes_Hut *)user;
+    particle_store_t & s = *bh->_store;
+    const bh_node_t * nodes = &bh->_nodes[0];
+    const unsigned int num_nodes = (unsigned int)bh->_nodes.size();
+    const float eps2 = bh->_eps2;
+    const float pm = bh->_particle_mass;
+    const float * sx = bh->_sorted_x;
+    const float * sy = bh->_sorted_y;
+    const float * sz = bh->_sorted_z;
+
+    for (unsigned int k = begin; k < end; k++){
+        float px = sx[k], py = sy[k], pz = sz[k];
+        float ax = 0.0f, ay = 0.0f, az = 0.0f;
+        unsigned int n = 0;
+        while (n < num_nodes){
+            const bh_node_t & node = nodes[n];
+            if (node.leaf){
+                unsigned int last = node.first + node.count;
+                for (unsigned int j = node.first; j < last; j++){
+                    if (j == k)
+                        continue;
+                    float dx = sx[j] - px, dy = sy[j] - py, dz = sz[j] - pz;
+                    float inv = 1.0f / sqrtf(dx*dx + dy*dy + dz*dz + eps2);
+                    float f = pm * inv*inv*inv;
+                    ax += dx * f; ay += dy * f; az += dz * f;
+                }
+                n = node.next;
+                continue;
+            }
+            float dx = node.cx - px, dy = node.cy - py, dz = node.cz - pz;
+            float d2 = dx*dx + dy*dy + dz*dz;
+            if (d2 > node.open2){
+                float inv = 1.0f / sqrtf(d2 + eps2);
+                float f = node.mass * inv*inv*inv;
+                ax += dx * f; ay += dy * f; az += dz * f;
+                n = node.next;
+            } else {
+                n++;
+            }
+        }
+        unsigned int i = bh->_index[k];
+        s.vx[i] += bh->_kick * ax;
+        s.vy[i] += bh->_kick * ay;
+        s.vz[i] += bh->_kick * az;
+    }
+}
+
+// 10 bits -> every third bit of 30
+static inline unsigned int expand_bits(unsigned int v){
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// LSD radix sort of 30-bit codes (carrying the index along), 3 passes of
+//  10 bits; ends with the result back in codes / index
+static void radix_sort(unsigned int * codes, unsigned int * index, unsigned int * codes_tmp,
+        unsigned int * index_tmp, unsigned int n){
+    const int bits = 10;
+    const unsigned int radix = 1u << bits;
+    std::vector<unsigned int> count(radix);
+    unsigned int * src_c = codes, * src_i = index, * dst_c = codes_tmp, * dst_i = index_tmp;
+    for (int pass = 0; pass < 3; pass++){
+        int shift = pass * bits;
+        std::fill(count.begin(), count.end(), 0u);
+        for (unsigned int k = 0; k < n; k++)
+            count[(src_c[k] >> shift) & (radix - 1)]++;
+        unsigned int total = 0;
+        for (unsigned int d = 0; d < radix; d++){
+            unsigned int c = count[d];
+            count[d] = total;
+            total += c;
+        }
+        for (unsigned int k = 0; k < n; k++){
+            unsigned int slot = count[(src_c[k] >> shift) & (radix - 1)]++;
+            dst_c[slot] = src_c[k];
+            dst_i[slot] = src_i[k];
+        }
+        std::swap(src_c, dst_c);
+        std::swap(src_i, dst_i);
+    }
+    // odd number of passes: result is in the tmp arrays
+    memcpy(codes, src_c, n*sizeof(unsigned int));
+    memcpy(index, src_i, n*sizeof(unsigned int));
+}
+
+/* #########################################################################
+
+                            barnes_hut_benchmark
+        -kick() on the starting swirl at 16K, 32K, ... max_n particles.
+            "vs N log N" is time / (N log2 N), relative to the first
+            row; it stays near 1 if the walk scales as it should.
+        -Accuracy is checked against direct summation for 256 sample
+            particles (RMS error over RMS acceleration).
+
+   ######################################################################### */
+void xen_rift::barnes_hut_benchmark( unsigned int max_n, int threads, float theta ){
+    const int reps = 5;
+    const unsigned int samples = 256;
+    if (threads <= 0)
+        threads = Thread_Pool::num_processors();
+    Thread_Pool pool(threads);
+    Barnes_Hut bh(theta);
+    printf("Barnes-Hut gravity: %d threads, theta %.2f\n", threads, theta);
+
+    double base = 0.0;
+    unsigned int n = 16384;
+    if (n > max_n)
+        n = max_n;
+    while (n <= max_n){
+        particle_store_t s;
+        if (particle_store_alloc(&s, n, false, false)){
+            printf("Memory alloc error.\n");
+            return;
+        }
+        unsigned long long key = particle_init_key(1);
+        for (unsigned int i = 0; i < n; i++)
+            swirl_init_particle(s, i, key);
+
+        // velocities start at zero, so one unit kick leaves the acceleration in them
+        std::vector<double> build_ms(reps), force_ms(reps);
+        for (int r = 0; r < reps; r++){
+            memset(s.vx, 0, particle_store_vel_size(n));
+            bh.kick(s, 1.0f, 1.0f, &pool);
+            build_ms[r] = bh.last_build_ms();
+            force_ms[r] = bh.last_force_ms();
+        }
+        std::sort(build_ms.begin(), build_ms.end());
+        std::sort(force_ms.begin(), force_ms.end());
+        double ms = build_ms[reps/2] + force_ms[reps/2];
+        double nlogn = n * log((double)n) / log(2.0);
+        if (base == 0.0)
+            base = ms / nlogn;
+
+        double err2 = 0.0, mag2 = 0.0;
+        const float eps2 = 0.1f*0.1f;
+        for (unsigned int k = 0; k < samples; k++){
+            unsigned int i = (unsigned int)(((unsigned long long)k * n) / samples);
+            double ax = 0.0, ay = 0.0, az = 0.0;
+            for (unsigned int j = 0; j < n; j++){
+                if (j == i)
+                    continue;
+                double dx = s.x[j] - s.x[i], dy = s.y[j] - s.y[i], dz = s.z[j] - s.z[i];
+                double inv = 1.0 / sqrt(dx*dx + dy*dy + dz*dz + eps2);
+                double f = inv*inv*inv / n;
+                ax += dx * f; ay += dy * f; az += dz * f;
+            }
+            err2 += (s.vx[i] - ax)*(s.vx[i] - ax) + (s.vy[i] - ay)*(s.vy[i] - ay) +
+                    (s.vz[i] - az)*(s.vz[i] - az);
+            mag2 += ax*ax + ay*ay + az*az;
+        }
+
+        printf("    %9u particles: build %8.3f ms  force %9.3f ms  %7u nodes  vs N log N %5.2f  "
+               "rms err %.2e\n", n, build_ms[reps/2], force_ms[reps/2], bh.num_nodes(),
+               ms / nlogn / base, sqrt(err2 / mag2));
+        particle_store_free(&s);
+        if (n == max_n)
+            break;
+        n = (n*2 > max_n || n*2 < n) ? max_n : n*2;
+    }
+}
@@ -0,0 +1,128 @@
+/* #########################################################################
+        barnes_hut: linear-octree approximate mutual gravity
+   Header!
+
+	Every kick() rebuilds a linear octree over the particle store:
+		1. bounding cube of all positions
+		2. a 30-bit Morton code per particle (10 bits per axis)
+		3. radix sort of the codes, and positions gathered into
+		   Morton order
+		4. nodes laid out in pre-order straight off the sorted codes:
+		   a node's particles are one contiguous run, its first child
+		   is the next node, and `next` skips its whole subtree
+	then walks it once per particle, opening a node only if it looks
+	bigger than theta (side / distance) from there. That's O(N log N)
+	per step instead of the O(N^2) of summing every pair. The walk is
+	stackless thanks to `next`, and runs in Morton order on the pool so
+	neighboring particles (and threads' chunks) walk mostly the same
+	nodes.
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#ifndef __XEN_BARNES_HUT_H
+#define __XEN_BARNES_HUT_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+//Windows
+#include <windows.h>
+
+#include "particle_store.h"
+#include "../common/thread_pool.h"
+
+namespace xen_rift {
+	// Particles per leaf; below this, summing them directly beats
+	// splitting further.
+	#define BH_LEAF_PARTICLES 8
+	// Morton code bits per axis, and so the deepest level
+	#define BH_MORTON_BITS 10
+
+	typedef struct _bh_node_t {
+		// center of mass and total mass
+		float cx, cy, cz;
+		float mass;
+		// open the node if closer than this (squared): (side / theta)^2
+		float open2;
+		// particles, as a run of Morton-ordered slots
+		unsigned int first;
+		unsigned int count;
+		// pre-order index of the first node after this subtree; the
+		// first child (if any) is always this node + 1
+		unsigned int next;
+		unsigned int leaf;
+	} bh_node_t;
+
+	class Barnes_Hut {
+		public:
+			Barnes_Hut( float theta = 0.5f, float softening = 0.1f );
+			~Barnes_Hut();
+
+			void set_theta( float theta ) { _theta = theta; }
+			float theta( void ) { return _theta; }
+
+			// Add gm * dt_s * (softened gravity from all other particles)
+			// to every velocity in the store. The store's particles share
+			// a total mass of 1, so gm sets the strength independent of n.
+			// Parallel on the pool if there is one.
+			void kick( particle_store_t & s, float gm, float dt_s, Thread_Pool * pool );
+
+			double last_build_ms( void ) { return _last_build_ms; }
+			double last_force_ms( void ) { return _last_force_ms; }
+			unsigned int num_nodes( void ) { return (unsigned int)_nodes.size(); }
+
+		protected:
+			void reserve( unsigned int n );
+			void build( Thread_Pool * pool );
+			unsigned int build_node( unsigned int begin, unsigned int end, int level, float side );
+			void run( Thread_Pool * pool, unsigned int n, range_func_t fn );
+
+			static void bounds_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void morton_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void gather_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void force_range( unsigned int begin, unsigned int end, int worker, void * user );
+
+			float _theta;
+			float _eps2;
+			particle_store_t * _store;
+			unsigned int _n;
+			unsigned int _capacity;
+			float _particle_mass;
+			float _kick;
+			double _last_build_ms;
+			double _last_force_ms;
+
+			// bounding cube
+			float _min[3];
+			float _side;
+			// per-chunk bounds, reduced after the parallel pass
+			std::vector<float> _chunk_bounds;
+
+			// Morton codes + particle index, and ping-pong space for the sort
+			unsigned int * _codes;
+			unsigned int * _index;
+			unsigned int * _codes_tmp;
+			unsigned int * _index_tmp;
+			// positions in Morton order
+			float * _sorted_x;
+			float * _sorted_y;
+			float * _sorted_z;
+
+			std::vector<bh_node_t> _nodes;
+
+		private:
+	};
+
+	// Time kick() at doubling particle counts up to max_n and print
+	// build / force time, how that grows against N log N, and the RMS
+	// error against direct summation for a sample of particles.
+	void barnes_hut_benchmark( unsigned int max_n, int threads, float theta );
+};
+
+#endif //__XEN_BARNES_HUT_H
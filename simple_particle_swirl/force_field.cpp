@@ -0,0 +1,382 @@
+/* #########################################################################
+        force_field: composable forces acting on the swirl
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  SDF colliders
+   ######################################################################### */
+
+#include "force_field.h"
+#include <string.h>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+/* #########################################################################
+
+                            forward declarations
+
+   ######################################################################### */
+static void normalize(float & x, float & y, float & z);
+
+force_field_t xen_rift::force_field_attractor( float cx, float cy, float cz, float strength,
+                                               float softening ){
+    force_field_t f;
+    memset(&f, 0, sizeof(f));
+    f.type = FORCE_FIELD_ATTRACTOR;
+    f.strength = strength;
+    f.px = f.fx = cx; f.py = f.fy = cy; f.pz = f.fz = cz;
+    f.scale = softening;
+    return f;
+}
+
+force_field_t xen_rift::force_field_vortex( float cx, float cy, float cz, float ax, float ay, float az,
+                                            float strength, float softening ){
+    force_field_t f;
+    memset(&f, 0, sizeof(f));
+    f.type = FORCE_FIELD_VORTEX;
+    f.strength = strength;
+    f.px = cx; f.py = cy; f.pz = cz;
+    normalize(ax, ay, az);
+    f.ax = ax; f.ay = ay; f.az = az;
+    f.scale = softening;
+    return f;
+}
+
+force_field_t xen_rift::force_field_drag( float fraction ){
+    force_field_t f;
+    memset(&f, 0, sizeof(f));
+    f.type = FORCE_FIELD_DRAG;
+    f.strength = fraction;
+    return f;
+}
+
+force_field_t xen_rift::force_field_plane( float px, float py, float pz, float nx, float ny, float nz,
+                                           float strength, float range ){
+    force_field_t f;
+    memset(&f, 0, sizeof(f));
+    f.type = FORCE_FIELD_PLANE;
+    f.strength = strength;
+    f.px = px; f.py = py; f.pz = pz;
+    normalize(nx, ny, nz);
+    f.ax = nx; f.ay = ny; f.az = nz;
+    // zero range would divide by zero in the falloff
+    f.scale = range > 1e-6f ? range : 1e-6f;
+    return f;
+}
+
+force_field_t xen_rift::force_field_noise( float frequency, float strength, float phase_x,
+                                           float phase_y, float phase_z ){
+    force_field_t f;
+    memset(&f, 0, sizeof(f));
+    f.type = FORCE_FIELD_NOISE;
+    f.strength = strength;
+    f.px = phase_x; f.py = phase_y; f.pz = phase_z;
+    f.scale = frequency;
+    return f;
+}
+
+collider_t xen_rift::collider_plane( float px, float py, float pz, float nx, float ny, float nz,
+                                    float bounce, float friction ){
+    collider_t c;
+    memset(&c, 0, sizeof(c));
+    c.type = COLLIDER_PLANE;
+    c.px = px; c.py = py; c.pz = pz;
+    normalize(nx, ny, nz);
+    c.ax = nx; c.ay = ny; c.az = nz;
+    c.bounce = bounce;
+    c.keep = 1.0f - friction;
+    return c;
+}
+
+collider_t xen_rift::collider_sphere( float cx, float cy, float cz, float radius, float bounce,
+                                     float friction ){
+    collider_t c;
+    memset(&c, 0, sizeof(c));
+    c.type = COLLIDER_SPHERE;
+    c.px = cx; c.py = cy; c.pz = cz;
+    c.radius = fabsf(radius);
+    c.bounce = bounce;
+    c.keep = 1.0f - friction;
+    return c;
+}
+
+collider_t xen_rift::collider_box( float cx, float cy, float cz, float hx, float hy, float hz,
+                                  float bounce, float friction ){
+    collider_t c;
+    memset(&c, 0, sizeof(c));
+    c.type = COLLIDER_BOX;
+    c.px = cx; c.py = cy; c.pz = cz;
+    c.ax = fabsf(hx); c.ay = fabsf(hy); c.az = fabsf(hz);
+    c.bounce = bounce;
+    c.keep = 1.0f - friction;
+    return c;
+}
+
+collider_t xen_rift::collider_player_sphere( float ox, float oy, float oz, float radius, float bounce,
+                                            float friction ){
+    collider_t c = collider_sphere(ox, oy, oz, radius, bounce, friction);
+    c.follow = 1;
+    c.ox = ox; c.oy = oy; c.oz = oz;
+    return c;
+}
+
+int xen_rift::force_field_add( force_field_list_t * list, const force_field_t & f ){
+    if (list->count >= MAX_FORCE_FIELDS){
+        printf("Force field list is full (%d fields).\n", MAX_FORCE_FIELDS);
+        return -1;
+    }
+    list->field[list->count++] = f;
+    return 0;
+}
+
+int xen_rift::collider_add( force_field_list_t * list, const collider_t & c ){
+    if (list->num_colliders >= MAX_COLLIDERS){
+        printf("Collider list is full (%d colliders).\n", MAX_COLLIDERS);
+        return -1;
+    }
+    list->collider[list->num_colliders++] = c;
+    collider_bounds(list);
+    return 0;
+}
+
+int xen_rift::force_field_follow_player( force_field_list_t * list, float px, float py, float pz ){
+    int moved = 0;
+    for (int i = 0; i < list->num_colliders; i++){
+        collider_t & c = list->collider[i];
+        if (!c.follow)
+            continue;
+        c.px = px + c.ox; c.py = py + c.oy; c.pz = pz + c.oz;
+        moved++;
+    }
+    if (moved)
+        collider_bounds(list);
+    return moved;
+}
+
+/* #########################################################################
+
+                              collider_bounds
+        -Union of every collider's solid part: the sphere's or box's
+            own box, or for a plane with an axis-aligned normal, the
+            half-space behind it (open on every other side). Any
+            other plane leaves the whole box open.
+        -The inside tests happen in float on positions of up to a few
+            hundred units, so the box gets 1e-3 plus 1e-4 of its
+            coordinate of slack on every closed side.
+
+   ######################################################################### */
+static float pad_out(float v, float dir){
+    return v + dir * (1e-3f + 1e-4f * fabsf(v));
+}
+
+void xen_rift::collider_bounds( force_field_list_t * list ){
+    for (int k = 0; k < 3; k++){
+        list->collide_lo[k] = COLLIDER_FAR;
+        list->collide_hi[k] = -COLLIDER_FAR;
+    }
+    for (int i = 0; i < list->num_colliders; i++){
+        const collider_t & c = list->collider[i];
+        const float p[3] = { c.px, c.py, c.pz };
+        const float a[3] = { c.ax, c.ay, c.az };
+        float lo[3], hi[3];
+        for (int k = 0; k < 3; k++){
+            lo[k] = -COLLIDER_FAR;
+            hi[k] = COLLIDER_FAR;
+        }
+        switch (c.type){
+            case COLLIDER_PLANE:
+                for (int k = 0; k < 3; k++)
+                    if (a[(k + 1) % 3] == 0.0f && a[(k + 2) % 3] == 0.0f){
+                        if (a[k] > 0.0f)
+                            hi[k] = p[k];
+                        else
+                            lo[k] = p[k];
+                    }
+                break;
+            case COLLIDER_SPHERE:
+                for (int k = 0; k < 3; k++){
+                    lo[k] = p[k] - c.radius;
+                    hi[k] = p[k] + c.radius;
+                }
+                break;
+            case COLLIDER_BOX:
+                for (int k = 0; k < 3; k++){
+                    lo[k] = p[k] - a[k];
+                    hi[k] = p[k] + a[k];
+                }
+                break;
+            default:
+                break;
+        }
+        for (int k = 0; k < 3; k++){
+            if (lo[k] > -COLLIDER_FAR)
+                lo[k] = pad_out(lo[k], -1.0f);
+            if (hi[k] < COLLIDER_FAR)
+                hi[k] = pad_out(hi[k], 1.0f);
+            list->collide_lo[k] = lo[k] < list->collide_lo[k] ? lo[k] : list->collide_lo[k];
+            list->collide_hi[k] = hi[k] > list->collide_hi[k] ? hi[k] : list->collide_hi[k];
+        }
+    }
+}
+
+const char * xen_rift::collider_name( int type ){
+    switch (type){
+        case COLLIDER_PLANE:
+            return "plane";
+        case COLLIDER_SPHERE:
+            return "sphere";
+        case COLLIDER_BOX:
+            return "box";
+        default:
+            return "unknown";
+    }
+}
+
+const char * xen_rift::force_field_name( int type ){
+    switch (type){
+        case FORCE_FIELD_ATTRACTOR:
+            return "attractor";
+        case FORCE_FIELD_VORTEX:
+            return "vortex";
+        case FORCE_FIELD_DRAG:
+            return "drag";
+        case FORCE_FIELD_PLANE:
+            return "plane";
+        case FORCE_FIELD_NOISE:
+            return "noise";
+        default:
+            return "unknown";
+    }
+}
+
+/* #########################################################################
+
+                             force_field_preset
+        0: the classic swirl
+        1: swirl, spun up about its own axis
+        2: swirl stirred by noise, with a little drag
+        3: swirl over a springy floor at y = 25
+        -All of them stand on the demo room's floor (y = -0.1), and
+            keep particles out of the player's head (at the eye) and
+            body (1.4 below it).
+
+   ######################################################################### */
+int xen_rift::force_field_preset( int which, force_field_list_t * list ){
+    if (which < 0 || which >= NUM_FORCE_FIELD_PRESETS)
+        return -1;
+    memset(list, 0, sizeof(*list));
+    // the original attractor: distance for the falloff is taken from
+    //  the origin, not from the point it pulls toward
+    force_field_t swirl = force_field_attractor(0.0f, 30.0f, 0.0f, 10.0f);
+    swirl.fy = 0.0f;
+    force_field_add(list, swirl);
+    switch (which){
+        case 1:
+            force_field_add(list, force_field_vortex(0.0f, 30.0f, 0.0f, 0.0f, 1.0f, 0.0f, 2.0f));
+            break;
+        case 2:
+            force_field_add(list, force_field_noise(0.2f, 0.05f, 0.0f, 1.3f, 2.9f));
+            force_field_add(list, force_field_drag(0.001f));
+            break;
+        case 3:
+            force_field_add(list, force_field_plane(0.0f, 25.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.5f, 2.0f));
+            force_field_add(list, force_field_drag(0.0005f));
+            break;
+        default:
+            break;
+    }
+    collider_add(list, collider_plane(0.0f, -0.1f, 0.0f, 0.0f, 1.0f, 0.0f, COLLIDER_BOUNCE,
+        COLLIDER_FRICTION));
+    collider_add(list, collider_player_sphere(0.0f, 0.0f, 0.0f, 0.3f, COLLIDER_BOUNCE,
+        COLLIDER_FRICTION));
+    collider_add(list, collider_player_sphere(0.0f, -1.4f, 0.0f, 0.7f, COLLIDER_BOUNCE,
+        COLLIDER_FRICTION));
+    return 0;
+}
+
+/* #########################################################################
+
+                              load_force_fields
+
+   ######################################################################### */
+int xen_rift::load_force_fields( const char * path, force_field_list_t * list ){
+    FILE * fp = fopen(path, "r");
+    if (!fp){
+        printf("Couldn't open force field file %s.\n", path);
+        return -1;
+    }
+    force_field_list_t fields;
+    memset(&fields, 0, sizeof(fields));
+    char line[512];
+    int line_no = 0;
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), fp)){
+        line_no++;
+        char kind[32];
+        float a[10];
+        if (sscanf(line, " %31s", kind) != 1 || kind[0] == '#')
+            continue;
+        const char * args = strstr(line, kind) + strlen(kind);
+        int got = sscanf(args, "%f %f %f %f %f %f %f %f %f %f", &a[0], &a[1], &a[2], &a[3], &a[4],
+                         &a[5], &a[6], &a[7], &a[8], &a[9]);
+        // colliders take optional BOUNCE FRICTION after their shape
+        float bounce = COLLIDER_BOUNCE, friction = COLLIDER_FRICTION;
+        int shape = strcmp(kind, "collide_sphere") == 0 || strcmp(kind, "player_sphere") == 0 ? 4 :
+                    (strcmp(kind, "collide_plane") == 0 || strcmp(kind, "collide_box") == 0 ? 6 : 0);
+        if (shape && got == shape + 2){
+            bounce = a[shape];
+            friction = a[shape + 1];
+        }
+        if (shape && (got == shape || got == shape + 2)){
+            collider_t c;
+            if (strcmp(kind, "collide_plane") == 0)
+                c = collider_plane(a[0], a[1], a[2], a[3], a[4], a[5], bounce, friction);
+            else if (strcmp(kind, "collide_sphere") == 0)
+                c = collider_sphere(a[0], a[1], a[2], a[3], bounce, friction);
+            else if (strcmp(kind, "collide_box") == 0)
+                c = collider_box(a[0], a[1], a[2], a[3], a[4], a[5], bounce, friction);
+            else
+                c = collider_player_sphere(a[0], a[1], a[2], a[3], bounce, friction);
+            ret = collider_add(&fields, c);
+            continue;
+        }
+        force_field_t f;
+        if (strcmp(kind, "attractor") == 0 && (got == 4 || got == 5 || got == 8)){
+            f = force_field_attractor(a[0], a[1], a[2], a[3], got > 4 ? a[4] : 0.0f);
+            if (got == 8){
+                f.fx = a[5]; f.fy = a[6]; f.fz = a[7];
+            }
+        } else if (strcmp(kind, "vortex") == 0 && (got == 7 || got == 8)){
+            f = force_field_vortex(a[0], a[1], a[2], a[3], a[4], a[5], a[6], got > 7 ? a[7] : 1.0f);
+        } else if (strcmp(kind, "drag") == 0 && got == 1){
+            f = force_field_drag(a[0]);
+        } else if (strcmp(kind, "plane") == 0 && got == 8){
+            f = force_field_plane(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+        } else if (strcmp(kind, "noise") == 0 && (got == 2 || got == 5)){
+            f = force_field_noise(a[0], a[1], got > 2 ? a[2] : 0.0f, got > 2 ? a[3] : 0.0f,
+                                  got > 2 ? a[4] : 0.0f);
+        } else {
+            printf("%s:%d: can't make a field of \"%s\" with %d numbers.\n", path, line_no, kind,
+                got < 0 ? 0 : got);
+            ret = -1;
+            break;
+        }
+        ret = force_field_add(&fields, f);
+    }
+    fclose(fp);
+    if (ret)
+        return -1;
+    *list = fields;
+    return 0;
+}
+
+static void normalize(float & x, float & y, float & z){
+    float len = sqrtf(x*x + y*y + z*z);
+    if (len > 0.0f){
+        x /= len; y /= len; z /= len;
+    } else {
+        x = 0.0f; y = 1.0f; z = 0.0f;
+    }
+}
@@ -0,0 +1,360 @@
+/* #########################################################################
+        force_field: composable forces acting on the swirl
+   Header!
+
+   Whatever pushes the particles around is a short list of fields, each
+   adding its own velocity change per fixed step:
+        attractor   pull toward a point, strength / distance^2
+        vortex      spin about an axis, strength / distance from it
+        drag        lose a fraction of velocity every step
+        plane       push out along a plane's normal, fading to nothing
+                    `scale` in front of it
+        noise       swirly divergence-free flow (an ABC flow -- the curl
+                    of a periodic potential), so it stirs without
+                    bunching the particles up
+   Every integrator walks the whole list per particle (group) per step
+   while the particle is in registers, so another field costs another
+   term in the inner loop, not another trip through the streams.
+
+   The list also carries colliders: signed distance functions the
+   particles can't get inside of, checked right after every position
+   update:
+        plane       everything behind it is solid (the ground)
+        sphere      solid ball; can follow the player around
+        box         solid axis-aligned box
+   A particle found inside is moved out to the surface along the
+   distance field's gradient, the part of its velocity heading into the
+   surface is reflected and scaled by `bounce`, and the part along it
+   is scaled by `keep` (1 - friction). The list keeps a box around
+   every collider's solid part (open on the sides a plane that isn't
+   axis-aligned leaves open), and collider_apply skips the colliders
+   for any particle, or group of particles, entirely outside it -- for the ground
+   and the player, one compare on y -- so a swirl mostly up in the air
+   barely pays for them.
+
+   force_field_apply and collider_apply are written once, usable from
+   both nvcc and the host compiler, as templates on the lane type the
+   math is done in (see particle_lane.h): float is what the kernel and
+   the scalar host path run, the SSE / AVX host paths run the same code
+   on 4 or 8 particles at a time, and double gives a host reference to
+   measure float's drift against (see particle_integrate.h). Results
+   stay bit-identical across instruction sets as long as float rounds
+   after every op, which is what the Makefile's FPFLAGS (/arch:SSE2
+   /fp:precise) are for. x87 code keeps extended intermediates and
+   drifts from the SIMD lanes.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  SDF colliders: plane, sphere, box
+     agent  20261017  Field / collider math templated on precision
+     agent  20261017  One copy of the field / collider math for every lane type
+   ######################################################################### */
+
+#ifndef __XEN_FORCE_FIELD_H
+#define __XEN_FORCE_FIELD_H
+
+// Base system stuff
+#include <stdio.h>
+#include <math.h>
+
+#include "particle_lane.h"
+
+namespace xen_rift {
+	// Most fields a list can hold (and the CUDA constant copy has room for)
+	#define MAX_FORCE_FIELDS 16
+	// Same for colliders
+	#define MAX_COLLIDERS 8
+
+	typedef enum _force_field_type_t {
+		FORCE_FIELD_ATTRACTOR = 0,
+		FORCE_FIELD_VORTEX = 1,
+		FORCE_FIELD_DRAG = 2,
+		FORCE_FIELD_PLANE = 3,
+		FORCE_FIELD_NOISE = 4
+	} force_field_type_t;
+
+	typedef struct _force_field_t {
+		int type;
+		// velocity change per step at unit distance (attractor, vortex),
+		// fraction of velocity lost per step (drag), push right at the
+		// plane (plane), or flow speed (noise)
+		float strength;
+		// attractor / vortex center, a point on the plane, or the noise
+		// phase per axis
+		float px, py, pz;
+		// vortex axis or plane normal; unit length
+		float ax, ay, az;
+		// where the attractor measures distance from for its falloff;
+		// usually the center itself
+		float fx, fy, fz;
+		// attractor / vortex softening radius, plane range, or noise
+		// spatial frequency
+		float scale;
+	} force_field_t;
+
+	typedef enum _collider_type_t {
+		COLLIDER_PLANE = 0,
+		COLLIDER_SPHERE = 1,
+		COLLIDER_BOX = 2
+	} collider_type_t;
+
+	typedef struct _collider_t {
+		int type;
+		// nonzero if it sits at an offset from the player and moves
+		// with them (see force_field_follow_player)
+		int follow;
+		// a point on the plane, or the sphere / box center
+		float px, py, pz;
+		// plane normal (unit length) or box half-extents
+		float ax, ay, az;
+		// sphere radius
+		float radius;
+		// into-surface speed bounced back, and along-surface speed kept,
+		// per contact
+		float bounce;
+		float keep;
+		// a follower's offset from the player
+		float ox, oy, oz;
+	} collider_t;
+
+	typedef struct _force_field_list_t {
+		int count;
+		force_field_t field[MAX_FORCE_FIELDS];
+		int num_colliders;
+		collider_t collider[MAX_COLLIDERS];
+		// box around the colliders (see collider_bounds); -+COLLIDER_FAR
+		// on open sides
+		float collide_lo[3];
+		float collide_hi[3];
+	} force_field_list_t;
+
+	// Field constructors. Axes / normals get normalized.
+	force_field_t force_field_attractor( float cx, float cy, float cz, float strength,
+										 float softening = 0.0f );
+	force_field_t force_field_vortex( float cx, float cy, float cz, float ax, float ay, float az,
+									  float strength, float softening = 1.0f );
+	force_field_t force_field_drag( float fraction );
+	force_field_t force_field_plane( float px, float py, float pz, float nx, float ny, float nz,
+									 float strength, float range );
+	force_field_t force_field_noise( float frequency, float strength, float phase_x = 0.0f,
+									 float phase_y = 0.0f, float phase_z = 0.0f );
+
+	// Collider constructors; friction is the fraction of along-surface
+	// speed lost per contact. Normals get normalized.
+	collider_t collider_plane( float px, float py, float pz, float nx, float ny, float nz,
+							   float bounce, float friction );
+	collider_t collider_sphere( float cx, float cy, float cz, float radius, float bounce,
+								float friction );
+	collider_t collider_box( float cx, float cy, float cz, float hx, float hy, float hz,
+							 float bounce, float friction );
+	// A sphere that stays at (ox, oy, oz) from the player
+	collider_t collider_player_sphere( float ox, float oy, float oz, float radius, float bounce,
+									   float friction );
+
+	// Append a field / collider. Return -1 if the list is full, 0 if
+	// success.
+	int force_field_add( force_field_list_t * list, const force_field_t & f );
+	int collider_add( force_field_list_t * list, const collider_t & c );
+	const char * force_field_name( int type );
+	const char * collider_name( int type );
+	// Move every following collider to its spot around the player at
+	// (px, py, pz); returns how many there are.
+	int force_field_follow_player( force_field_list_t * list, float px, float py, float pz );
+	// Recompute collide_lo / hi, padded out far enough that a particle
+	// outside it can't test as inside any collider even with rounding.
+	// collider_add and force_field_follow_player call it; call it
+	// again after changing a collider in place.
+	void collider_bounds( force_field_list_t * list );
+
+	// Built-in field setups, for flipping through at runtime. Preset 0 is
+	// the classic swirl: one attractor at (0,30,0), strength 10, with its
+	// falloff measured from the world origin. Every preset also has the
+	// ground (y = -0.1) and a head and body sphere on the player as
+	// colliders. Return -1 if there's no such preset, 0 if success.
+	#define NUM_FORCE_FIELD_PRESETS 4
+	int force_field_preset( int which, force_field_list_t * list );
+	// Read a list from a text file, one field per line:
+	//     attractor CX CY CZ STRENGTH [SOFTENING [FX FY FZ]]
+	//     vortex CX CY CZ AX AY AZ STRENGTH [SOFTENING]
+	//     drag FRACTION
+	//     plane PX PY PZ NX NY NZ STRENGTH RANGE
+	//     noise FREQUENCY STRENGTH [PHASE_X PHASE_Y PHASE_Z]
+	//     collide_plane PX PY PZ NX NY NZ [BOUNCE FRICTION]
+	//     collide_sphere CX CY CZ RADIUS [BOUNCE FRICTION]
+	//     collide_box CX CY CZ HX HY HZ [BOUNCE FRICTION]
+	//     player_sphere OX OY OZ RADIUS [BOUNCE FRICTION]
+	// (colliders default to COLLIDER_BOUNCE / COLLIDER_FRICTION)
+	// Blank lines and lines starting with # are skipped.
+	// Return -1 if fail (list untouched), 0 if success.
+	int load_force_fields( const char * path, force_field_list_t * list );
+
+	#define COLLIDER_BOUNCE 0.3f
+	#define COLLIDER_FRICTION 0.1f
+	// "no bound on this side"
+	#define COLLIDER_FAR 1e30f
+
+	// 2 pi, 1 / (2 pi), pi / 2, and the coefficients of force_field_sin
+	#define FORCE_FIELD_2PI (6.28318531f)
+	#define FORCE_FIELD_INV_2PI (0.159154943f)
+	#define FORCE_FIELD_HALF_PI (1.57079633f)
+	#define FORCE_FIELD_SIN_B (1.27323954f)
+	#define FORCE_FIELD_SIN_C (-0.405284735f)
+	#define FORCE_FIELD_SIN_P (0.225f)
+
+	// sin to about 1e-3: wrap to [-pi, pi), then a parabola and one
+	// correction term. Plain float ops only, so every lane type gives
+	// the same bits (sinf wouldn't be reproducible across them).
+	template <typename real>
+	XEN_HOST_DEVICE XEN_LANE_INLINE real force_field_sin( real a ){
+		real q = a * FORCE_FIELD_INV_2PI + 0.5f;
+		real k = lane_floor(q);
+		real r = a - k * FORCE_FIELD_2PI;
+		real y = FORCE_FIELD_SIN_B * r + FORCE_FIELD_SIN_C * r * lane_abs(r);
+		return FORCE_FIELD_SIN_P * (y * lane_abs(y) - y) + y;
+	}
+
+	// Add one step's worth of every field in the list to the velocity of
+	// a particle (group) at (x, y, z), in list order.
+	template <typename real>
+	XEN_HOST_DEVICE XEN_LANE_INLINE void force_field_apply( const force_field_list_t & fields,
+			real x, real y, real z, real & vx, real & vy, real & vz ){
+		for (int i = 0; i < fields.count; i++){
+			const force_field_t & f = fields.field[i];
+			switch (f.type){
+				case FORCE_FIELD_ATTRACTOR: {
+					real ox = x - f.fx, oy = y - f.fy, oz = z - f.fz;
+					real r2 = ox*ox + oy*oy + oz*oz + f.scale*f.scale;
+					// right at the falloff origin, k = 0 instead of inf
+					real k = lane_select(r2 != 0.0f, f.strength / r2, (real)0.0f);
+					vx += (f.px - x) * k;
+					vy += (f.py - y) * k;
+					vz += (f.pz - z) * k;
+					break;
+				}
+				case FORCE_FIELD_VORTEX: {
+					real rx = x - f.px, ry = y - f.py, rz = z - f.pz;
+					real along = rx*f.ax + ry*f.ay + rz*f.az;
+					real qx = rx - along*f.ax, qy = ry - along*f.ay, qz = rz - along*f.az;
+					real r2 = qx*qx + qy*qy + qz*qz + f.scale*f.scale;
+					real k = lane_select(r2 != 0.0f, f.strength / r2, (real)0.0f);
+					vx += (f.ay*rz - f.az*ry) * k;
+					vy += (f.az*rx - f.ax*rz) * k;
+					vz += (f.ax*ry - f.ay*rx) * k;
+					break;
+				}
+				case FORCE_FIELD_DRAG:
+					vx -= vx * f.strength;
+					vy -= vy * f.strength;
+					vz -= vz * f.strength;
+					break;
+				case FORCE_FIELD_PLANE: {
+					real d = (x - f.px)*f.ax + (y - f.py)*f.ay + (z - f.pz)*f.az;
+					real w = 1.0f - d / f.scale;
+					w = lane_max(lane_min(w, (real)1.0f), (real)0.0f);
+					real k = f.strength * w;
+					vx += f.ax * k;
+					vy += f.ay * k;
+					vz += f.az * k;
+					break;
+				}
+				case FORCE_FIELD_NOISE: {
+					real qx = x * f.scale + f.px, qy = y * f.scale + f.py, qz = z * f.scale + f.pz;
+					vx += f.strength * (force_field_sin(qz) + force_field_sin(qy + FORCE_FIELD_HALF_PI));
+					vy += f.strength * (force_field_sin(qx) + force_field_sin(qz + FORCE_FIELD_HALF_PI));
+					vz += f.strength * (force_field_sin(qy) + force_field_sin(qx + FORCE_FIELD_HALF_PI));
+					break;
+				}
+				default:
+					break;
+			}
+		}
+	}
+
+	// Which of p is inside [lo, hi] (open sides cost nothing), and'ed
+	// into near
+	template <typename real>
+	XEN_HOST_DEVICE XEN_LANE_INLINE typename lane_mask<real>::type collider_near_axis(
+			typename lane_mask<real>::type near, real p, float lo, float hi ){
+		if (lo > -COLLIDER_FAR)
+			near = near & (p >= lo);
+		if (hi < COLLIDER_FAR)
+			near = near & (p <= hi);
+		return near;
+	}
+
+	// Push a particle (group) at (x, y, z), moving at (vx, vy, vz), out
+	// of every collider in the list it's inside of, in list order. A
+	// group nowhere near the colliders' box skips them all; a group with
+	// nobody inside a collider skips everything past its distance test.
+	template <typename real>
+	XEN_HOST_DEVICE XEN_LANE_INLINE void collider_apply( const force_field_list_t & fields,
+			real & x, real & y, real & z, real & vx, real & vy, real & vz ){
+		typedef typename lane_mask<real>::type mask;
+		if (fields.num_colliders == 0)
+			return;
+		mask near = true;
+		near = collider_near_axis(near, x, fields.collide_lo[0], fields.collide_hi[0]);
+		near = collider_near_axis(near, y, fields.collide_lo[1], fields.collide_hi[1]);
+		near = collider_near_axis(near, z, fields.collide_lo[2], fields.collide_hi[2]);
+		if (!lane_any(near))
+			return;
+		for (int i = 0; i < fields.num_colliders; i++){
+			const collider_t & c = fields.collider[i];
+			real rx = x - c.px, ry = y - c.py, rz = z - c.pz;
+			// who's inside, their depth (negative) and outward normal
+			mask inside;
+			real d, nx, ny, nz;
+			switch (c.type){
+				case COLLIDER_PLANE:
+					nx = c.ax; ny = c.ay; nz = c.az;
+					d = rx*nx + ry*ny + rz*nz;
+					inside = d < 0.0f;
+					if (!lane_any(inside))
+						continue;
+					break;
+				case COLLIDER_SPHERE: {
+					real r2 = rx*rx + ry*ry + rz*rz;
+					inside = r2 < c.radius*c.radius;
+					if (!lane_any(inside))
+						continue;
+					real len = lane_sqrt(r2);
+					d = len - c.radius;
+					// dead center goes out the top
+					mask away = len > 0.0f;
+					real inv = lane_select(away, 1.0f / len, (real)0.0f);
+					nx = rx*inv;
+					ny = lane_select(away, ry*inv, (real)1.0f);
+					nz = rz*inv;
+					break;
+				}
+				case COLLIDER_BOX: {
+					real qx = lane_abs(rx) - c.ax, qy = lane_abs(ry) - c.ay, qz = lane_abs(rz) - c.az;
+					d = lane_max(lane_max(qx, qy), qz);
+					inside = d < 0.0f;
+					if (!lane_any(inside))
+						continue;
+					// out through the nearest face
+					mask on_x = (qx >= qy) & (qx >= qz);
+					mask on_y = (!on_x) & (qy >= qz);
+					mask on_z = !(on_x | on_y);
+					nx = lane_select(on_x, lane_select(rx < 0.0f, (real)-1.0f, (real)1.0f), (real)0.0f);
+					ny = lane_select(on_y, lane_select(ry < 0.0f, (real)-1.0f, (real)1.0f), (real)0.0f);
+					nz = lane_select(on_z, lane_select(rz < 0.0f, (real)-1.0f, (real)1.0f), (real)0.0f);
+					break;
+				}
+				default:
+					continue;
+			}
+			real vn = vx*nx + vy*ny + vz*nz;
+			real out = lane_select(vn < 0.0f, -(vn * c.bounce), vn);
+			x = lane_select(inside, x - nx*d, x);
+			y = lane_select(inside, y - ny*d, y);
+			z = lane_select(inside, z - nz*d, z);
+			vx = lane_select(inside, (vx - nx*vn) * c.keep + nx*out, vx);
+			vy = lane_select(inside, (vy - ny*vn) * c.keep + ny*out, vy);
+			vz = lane_select(inside, (vz - nz*vn) * c.keep + nz*out, vz);
+		}
+	}
+};
+
+#endif //__XEN_FORCE_FIELD_H
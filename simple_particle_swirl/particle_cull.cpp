@@ -0,0 +1,291 @@
+/* #########################################################################
+        particle_cull: per-eye view frustum culling of the particle store
+
+   cull() is two parallel_for passes over the pool around a serial scan
+   of the per-chunk counts. Every pass owns a disjoint range of
+   particles (or of the output), so there are no shared writes at all.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Lists know whether they're still current
+   ######################################################################### */
+
+#include "particle_cull.h"
+#include "particle_init.h"
+#include <malloc.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+// Particles per parallel chunk in each cull pass
+#define CULL_CHUNK 16384
+
+Particle_Culler::Particle_Culler( float guard_band ) :
+        _guard_band(guard_band),
+        _capacity(0),
+        _num_chunks(0),
+        _last_cull_ms(0.0),
+        _valid(false),
+        _store(NULL),
+        _alpha(1.0f)
+{
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        _has_view[v] = false;
+        _visible[v] = 0;
+        _scratch[v] = NULL;
+        _indices[v] = NULL;
+        _chunk_counts[v] = NULL;
+    }
+}
+
+Particle_Culler::~Particle_Culler(){
+    reserve(0);
+}
+
+// Size every list for n particles (0 frees everything)
+void Particle_Culler::reserve( unsigned int n ){
+    if (n != 0 && n <= _capacity)
+        return;
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        _aligned_free(_scratch[v]);
+        _aligned_free(_indices[v]);
+        _aligned_free(_chunk_counts[v]);
+        _scratch[v] = _indices[v] = _chunk_counts[v] = NULL;
+        _visible[v] = 0;
+    }
+    _capacity = 0;
+    if (n == 0)
+        return;
+
+    unsigned int chunks = (n + CULL_CHUNK - 1) / CULL_CHUNK;
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        _scratch[v] = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+        _indices[v] = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+        _chunk_counts[v] = (unsigned int *)_aligned_malloc(chunks*sizeof(unsigned int), 64);
+        if (!_scratch[v] || !_indices[v] || !_chunk_counts[v]){
+            printf("Memory alloc error.\n");
+            exit(1);
+        }
+    }
+    _capacity = n;
+}
+
+/* #########################################################################
+
+                                  set_view
+        -Clip space is inside when -w <= x, y, z <= w, so with rows
+            r0..r3 of the matrix the planes are r3 +- r0, r3 +- r1,
+            r3 +- r2. The guard band scales w up for the x and y ones.
+
+   ######################################################################### */
+void Particle_Culler::set_view( int v, const float * view_proj ){
+    if (v < 0 || v >= CULL_MAX_VIEWS)
+        return;
+    if (!view_proj){
+        _has_view[v] = false;
+        return;
+    }
+    memcpy(_view_proj[v], view_proj, 16*sizeof(float));
+    // column-major: row r is m[r], m[4+r], m[8+r], m[12+r]
+    const float * m = view_proj;
+    float w = 1.0f + _guard_band;
+    for (int k = 0; k < 4; k++){
+        float r0 = m[4*k], r1 = m[4*k+1], r2 = m[4*k+2], r3 = m[4*k+3];
+        _planes[v][0][k] = r3*w + r0;
+        _planes[v][1][k] = r3*w - r0;
+        _planes[v][2][k] = r3*w + r1;
+        _planes[v][3][k] = r3*w - r1;
+        _planes[v][4][k] = r3 + r2;
+        _planes[v][5][k] = r3 - r2;
+    }
+    _has_view[v] = true;
+}
+
+/* #########################################################################
+
+                                    cull
+
+   ######################################################################### */
+void Particle_Culler::cull( const particle_store_t & s, float alpha, Thread_Pool * pool ){
+    LARGE_INTEGER start, stop, freq;
+    QueryPerformanceCounter(&start);
+
+    reserve(s.n);
+    _store = &s;
+    _alpha = alpha;
+    _num_chunks = (s.n + CULL_CHUNK - 1) / CULL_CHUNK;
+
+    if (pool)
+        pool->parallel_for(s.n, CULL_CHUNK, test_range, this);
+    else
+        for (unsigned int i = 0; i < s.n; i += CULL_CHUNK)
+            test_range(i, min(i + CULL_CHUNK, s.n), 0, this);
+    // chunk counts -> output offsets
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        if (!_has_view[v])
+            continue;
+        unsigned int total = 0;
+        for (unsigned int c = 0; c < _num_chunks; c++){
+            unsigned int count = _chunk_counts[v][c];
+            _chunk_counts[v][c] = total;
+            total += count;
+        }
+        _visible[v] = total;
+    }
+    if (pool)
+        pool->parallel_for(s.n, CULL_CHUNK, compact_range, this);
+    else
+        for (unsigned int i = 0; i < s.n; i += CULL_CHUNK)
+            compact_range(i, min(i + CULL_CHUNK, s.n), 0, this);
+    _store = NULL;
+    _valid = true;
+
+    QueryPerformanceCounter(&stop);
+    QueryPerformanceFrequency(&freq);
+    _last_cull_ms = ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+}
+
+// 1. every view's passing indices into the chunk's stretch of scratch.
+//  The index is always written and the count only bumped if it passed,
+//  so the loop doesn't branch on the test.
+void Particle_Culler::test_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Particle_Culler * c = (Particle_Culler *)user;
+    const particle_store_t & s = *c->_store;
+    const float alpha = c->_alpha;
+    // just the views that are on
+    int views[CULL_MAX_VIEWS];
+    unsigned int count[CULL_MAX_VIEWS];
+    int num_views = 0;
+    for (int v = 0; v < CULL_MAX_VIEWS; v++)
+        if (c->_has_view[v]){
+            views[num_views] = v;
+            count[num_views++] = 0;
+        }
+    if (num_views == 0)
+        return;
+
+    for (unsigned int i = begin; i < end; i++){
+        float x = s.x[i], y = s.y[i], z = s.z[i];
+        if (s.prev_x){
+            x = s.prev_x[i] + (x - s.prev_x[i]) * alpha;
+            y = s.prev_y[i] + (y - s.prev_y[i]) * alpha;
+            z = s.prev_z[i] + (z - s.prev_z[i]) * alpha;
+        }
+        for (int k = 0; k < num_views; k++){
+            const float (*p)[4] = c->_planes[views[k]];
+            bool inside = true;
+            for (int j = 0; j < 6; j++)
+                inside &= (p[j][0]*x + p[j][1]*y + p[j][2]*z + p[j][3] >= 0.0f);
+            c->_scratch[views[k]][begin + count[k]] = i;
+            count[k] += inside ? 1 : 0;
+        }
+    }
+    for (int k = 0; k < num_views; k++)
+        c->_chunk_counts[views[k]][begin / CULL_CHUNK] = count[k];
+}
+
+// 3. the chunk's run, down to where the scan put it
+void Particle_Culler::compact_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Particle_Culler * c = (Particle_Culler *)user;
+    unsigned int chunk = begin / CULL_CHUNK;
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        if (!c->_has_view[v])
+            continue;
+        unsigned int offset = c->_chunk_counts[v][chunk];
+        unsigned int next = chunk + 1 < c->_num_chunks ? c->_chunk_counts[v][chunk + 1] : c->_visible[v];
+        memcpy(c->_indices[v] + offset, c->_scratch[v] + begin, (next - offset)*sizeof(unsigned int));
+    }
+}
+
+/* #########################################################################
+
+                           particle_cull_benchmark
+        -Culls the starting swirl for a stereo pair at the swirl's
+            center, turned to 8 headings in turn, at 64K, 128K, ...
+            max_n particles; prints the median cull time and the mean
+            fraction of particles each eye still has to draw.
+        -A cull reads the six position streams once and writes one
+            index per particle per eye, so expect it to flatten out
+            against memory bandwidth with threads.
+
+   ######################################################################### */
+// Column-major perspective * view for an eye at (ex, ey, ez) turned
+//  `yaw` radians from looking down -z: 90 degrees vertical field of
+//  view at a Rift-like 0.8 aspect
+static void bench_view_proj( float ex, float ey, float ez, float yaw, float * m ){
+    const float near_z = 0.1f, far_z = 1000.0f, aspect = 0.8f;
+    float f = 1.0f / tanf(0.25f*(float)M_PI);
+    float p[4][4] = {
+        { f/aspect, 0.0f, 0.0f, 0.0f },
+        { 0.0f, f, 0.0f, 0.0f },
+        { 0.0f, 0.0f, (far_z + near_z)/(near_z - far_z), 2.0f*far_z*near_z/(near_z - far_z) },
+        { 0.0f, 0.0f, -1.0f, 0.0f } };
+    // world -> eye: undo the translation, then the yaw about y
+    float c = cosf(yaw), s = sinf(yaw);
+    float v[4][4] = {
+        { c, 0.0f, -s, -(c*ex - s*ez) },
+        { 0.0f, 1.0f, 0.0f, -ey },
+        { s, 0.0f, c, -(s*ex + c*ez) },
+        { 0.0f, 0.0f, 0.0f, 1.0f } };
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++){
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++)
+                sum += p[i][k] * v[k][j];
+            m[j*4+i] = sum;
+        }
+}
+
+void xen_rift::particle_cull_benchmark( unsigned int max_n, int threads ){
+    const int headings = 8;
+    const int reps = 3;
+    if (threads <= 0)
+        threads = Thread_Pool::num_processors();
+    Thread_Pool pool(threads);
+    printf("Particle frustum cull, stereo pair: %d threads\n", threads);
+
+    unsigned int n = 65536;
+    if (n > max_n)
+        n = max_n;
+    while (n <= max_n){
+        particle_store_t s;
+        if (particle_store_alloc(&s, n, true, true)){
+            printf("Memory alloc error.\n");
+            return;
+        }
+        unsigned long long key = particle_init_key(1);
+        for (unsigned int i = 0; i < n; i++)
+            swirl_init_particle(s, i, key);
+
+        Particle_Culler culler;
+        std::vector<double> times;
+        double visible = 0.0;
+        for (int h = 0; h < headings; h++){
+            float yaw = h * 2.0f*(float)M_PI / headings;
+            float left[16], right[16];
+            bench_view_proj(-0.032f*cosf(yaw), 30.0f, 0.032f*sinf(yaw), yaw, left);
+            bench_view_proj(0.032f*cosf(yaw), 30.0f, -0.032f*sinf(yaw), yaw, right);
+            culler.set_view(0, left);
+            culler.set_view(1, right);
+            culler.cull(s, 1.0f, &pool);
+            for (int r = 0; r < reps; r++){
+                culler.cull(s, 1.0f, &pool);
+                times.push_back(culler.last_cull_ms());
+            }
+            visible += (double)(culler.visible(0) + culler.visible(1)) / (2.0 * n);
+        }
+        std::sort(times.begin(), times.end());
+        double ms = times[times.size()/2];
+
+        printf("    %9u particles: %8.3f ms/cull  %8.1f M particles/s  %5.1f%% drawn per eye\n",
+            n, ms, n / ms / 1000.0, 100.0 * visible / headings);
+        particle_store_free(&s);
+        if (n == max_n)
+            break;
+        n = (n*2 > max_n || n*2 < n) ? max_n : n*2;
+    }
+}
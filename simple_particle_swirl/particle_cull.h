@@ -0,0 +1,119 @@
+/* #########################################################################
+        particle_cull: per-eye view frustum culling of the particle store
+   Header!
+
+	Every eye's view frustum comes straight out of the projection *
+	modelview matrix it's drawn with (the six clip-space planes
+	w +- x, w +- y, w +- z, read off its rows). cull() tests each
+	particle -- at the position the shader will actually draw it,
+	prev + (current - prev) * alpha -- against every view in one pass
+	over the streams, and leaves each view a compacted, increasing list
+	of the particle indices inside it, ready for glDrawElements:
+		1. per chunk of particles, in parallel: write the indices that
+		   pass into that chunk's own stretch of a scratch list, and
+		   count them
+		2. exclusive prefix sum of the chunk counts (serial; a few
+		   hundred entries)
+		3. per chunk, in parallel: copy its run down to its offset
+	The result only depends on the positions and matrices, not on how
+	the chunks landed on the workers.
+
+	The x / y planes can be pushed out by a guard band (as a fraction
+	of w), so a list culled with last frame's matrices still covers
+	this frame's view after a bit of head motion, and points whose
+	centers are just off screen still get drawn.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Lists know whether they're still current
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_CULL_H
+#define __XEN_PARTICLE_CULL_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Windows
+#include <windows.h>
+
+#include "particle_store.h"
+#include "../common/thread_pool.h"
+
+namespace xen_rift {
+	// Most views one cull() handles: left, right, and no-stereo center
+	#define CULL_MAX_VIEWS 3
+
+	class Particle_Culler {
+		public:
+			Particle_Culler( float guard_band = 0.0f );
+			~Particle_Culler();
+
+			// Takes effect at the next cull()
+			void set_guard_band( float guard_band ) { _guard_band = guard_band; }
+			float guard_band( void ) { return _guard_band; }
+			// Set view v's frustum from a column-major (glLoadMatrixf
+			// order) projection * modelview, or switch the view off with
+			// NULL. Views that are off get no list.
+			void set_view( int v, const float * view_proj );
+			bool has_view( int v ) { return v >= 0 && v < CULL_MAX_VIEWS && _has_view[v]; }
+			// The matrix view v was last set from
+			const float * view_proj( int v ) { return has_view(v) ? _view_proj[v] : NULL; }
+
+			// Cull particles [0, s.n), drawn at prev + (cur - prev) *
+			// alpha, against every view that's on; in parallel on the
+			// pool if there is one. The store must not change meanwhile.
+			void cull( const particle_store_t & s, float alpha, Thread_Pool * pool );
+			double last_cull_ms( void ) { return _last_cull_ms; }
+
+			// View v's visible particles as of the last cull(), in
+			// increasing index order; 0 / NULL if the view is off.
+			unsigned int visible( int v ) { return has_view(v) ? _visible[v] : 0; }
+			const unsigned int * indices( int v ) { return has_view(v) ? _indices[v] : NULL; }
+			// Whether those lists still go with the particles: cull()
+			// makes them so, invalidate() is for when the particles
+			// they index have changed since (or nothing culls them)
+			bool valid( void ) { return _valid; }
+			void invalidate( void ) { _valid = false; }
+
+		protected:
+			void reserve( unsigned int n );
+			// cull() phases; user is the Particle_Culler
+			static void test_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void compact_range( unsigned int begin, unsigned int end, int worker, void * user );
+
+			float _guard_band;
+			// frustum planes (a, b, c, d) per view: inside is
+			// a*x + b*y + c*z + d >= 0 for all six
+			float _planes[CULL_MAX_VIEWS][6][4];
+			float _view_proj[CULL_MAX_VIEWS][16];
+			bool _has_view[CULL_MAX_VIEWS];
+			unsigned int _visible[CULL_MAX_VIEWS];
+			unsigned int _capacity;
+			unsigned int _num_chunks;
+			double _last_cull_ms;
+			bool _valid;
+
+			// current cull
+			const particle_store_t * _store;
+			float _alpha;
+			// per view: every chunk's passes at its own offset, then the
+			// compacted list
+			unsigned int * _scratch[CULL_MAX_VIEWS];
+			unsigned int * _indices[CULL_MAX_VIEWS];
+			// per view, per chunk: count, then output offset
+			unsigned int * _chunk_counts[CULL_MAX_VIEWS];
+
+		private:
+	};
+
+	// Time Particle_Culler::cull for a stereo pair looking out from the
+	// middle of the swirl, at doubling particle counts up to max_n on a
+	// pool of `threads` workers, and print cull time, throughput and the
+	// fraction left to draw.
+	void particle_cull_benchmark( unsigned int max_n, int threads );
+};
+
+#endif //__XEN_PARTICLE_CULL_H
@@ -0,0 +1,84 @@
+/* #########################################################################
+        particle_init: stateless per-particle starting state
+   Header!
+
+   Initial particle state comes from a counter-based RNG (Widynski's
+   "Squares"): random number j of particle i is just a hash of the
+   counter (i, j) under a key, with no state carried from one particle
+   to the next. So any particle can be set up on its own, in any order,
+   on any thread or CUDA core, straight into whatever buffer it lives
+   in -- and the same key always gives the same swirl.
+
+   Inline and usable from both nvcc and the host compiler, like
+   particle_store.h.
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_INIT_H
+#define __XEN_PARTICLE_INIT_H
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "particle_store.h"
+
+namespace xen_rift {
+	// Packed RGBA every swirl particle is drawn with
+	#define SWIRL_PARTICLE_COLOR (150u | (50u << 8) | (10u << 16) | (150u << 24))
+
+	// Random numbers drawn per particle; counters are i * this + j.
+	#define SWIRL_INIT_DRAWS 8
+
+	// Squares: four rounds of square-and-rotate on counter * key.
+	XEN_HOST_DEVICE inline unsigned int squares32( unsigned long long ctr, unsigned long long key ){
+		unsigned long long x, y, z;
+		x = y = ctr * key;
+		z = y + key;
+		x = x*x + y; x = (x >> 32) | (x << 32);
+		x = x*x + z; x = (x >> 32) | (x << 32);
+		x = x*x + y; x = (x >> 32) | (x << 32);
+		return (unsigned int)((x*x + z) >> 32);
+	}
+
+	// Squares wants keys with well-mixed bits, which small seeds aren't;
+	// run them through splitmix64 first. Keys must be odd.
+	inline unsigned long long particle_init_key( unsigned long long seed ){
+		unsigned long long z = seed + 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return (z ^ (z >> 31)) | 1ULL;
+	}
+
+	// Uniform float in [0, 1) from draw j of particle i
+	XEN_HOST_DEVICE inline float particle_rand( unsigned int i, unsigned int j, unsigned long long key ){
+		unsigned long long ctr = (unsigned long long)i * SWIRL_INIT_DRAWS + j;
+		return (float)(squares32(ctr, key) >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// Starting state of particle i: a ring of radius 3-30 at y=30,
+	// orbiting about the attractor. Also sets prev == current and the
+	// color, for whichever of those streams the store has.
+	XEN_HOST_DEVICE inline void swirl_init_particle( particle_store_t & s, unsigned int i,
+			unsigned long long key ){
+		/* Initial position in 30-radius ring at y=30 */
+		float radius = particle_rand(i, 0, key)*27.0f + 3.0f;
+		float theta = particle_rand(i, 1, key)*2.0f*(float)M_PI/8.0f;
+		float x = radius*cosf(theta);
+		float y = particle_rand(i, 2, key) * 1.0f + 29.5f;
+		float z = radius*sinf(theta);
+		/* Initial velocity around origin at 0, 30, 0 */
+		float vx = particle_rand(i, 3, key) * 2.0f - 1.0f + z;
+		float vy = particle_rand(i, 4, key) * 1.0f - 0.5f;
+		float vz = particle_rand(i, 5, key) * 2.0f - 1.0f - x;
+		particle_set(s, i, x, y, z, vx, vy, vz);
+		if (s.prev_x){
+			s.prev_x[i] = x; s.prev_y[i] = y; s.prev_z[i] = z;
+		}
+		if (s.color)
+			s.color[i] = SWIRL_PARTICLE_COLOR;
+	}
+};
+
+#endif //__XEN_PARTICLE_INIT_H
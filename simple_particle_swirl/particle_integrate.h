@@ -0,0 +1,143 @@
+/* #########################################################################
+        particle_integrate: the swirl's per-particle update, written once
+   Header!
+
+   One particle's fixed steps, for every backend: load its state, take
+   `steps` steps of dt_s seconds -- every force field, then the
+   position update, then the colliders -- leaving the position from
+   before the last step in the prev streams if there are any, and
+   store it back. Header-only and XEN_HOST_DEVICE, so the CUDA kernel,
+   the host scalar, SSE and AVX paths and the AoS benchmark layout all
+   compile this same code, and none of them can drift from the others.
+
+   Two compile-time parameters:
+        Layout  where a particle's state lives, and how to get at it:
+                    swirl_soa_layout   a particle_store_t
+                    swirl_aos_layout   float4 pos + vel, no prev
+        real    what the math is done in, and on how many particles at
+                once (see particle_lane.h): float is what every backend
+                runs, one particle at a time or as SSE / AVX lanes of 4
+                or 8 (sse_lane / avx_lane, which step particles i to
+                i+3 or i+7); double is a host reference to measure
+                float's drift against. State is stored as float either
+                way.
+
+   particle_swirl_bench checks the SSE / AVX instantiations against
+   swirl_step<float> bit for bit before it times anything. That holds
+   with float built for SSE2 math (FPFLAGS in the Makefile), not x87.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  One template for every lane type; the SIMD copies are gone
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_INTEGRATE_H
+#define __XEN_PARTICLE_INTEGRATE_H
+
+#include "particle_store.h"
+#include "particle_lane.h"
+#include "force_field.h"
+
+namespace xen_rift {
+	// The float4 pos + vel layout from before the store (w unused)
+	typedef struct _swirl_float4_t {
+		float x, y, z, w;
+	} swirl_float4_t;
+
+	// x / y / z of float4 p (for a lane type, of as many float4s from p
+	// as it has lanes); out again, leaving w alone
+	template <typename real>
+	XEN_HOST_DEVICE inline void lane_load_float4( const swirl_float4_t * p, real & x, real & y, real & z ){
+		x = p->x; y = p->y; z = p->z;
+	}
+	template <typename real>
+	XEN_HOST_DEVICE inline void lane_store_float4( swirl_float4_t * p, real x, real y, real z ){
+		p->x = (float)x; p->y = (float)y; p->z = (float)z;
+	}
+
+	// Layout: particle i of a particle_store_t
+	struct swirl_soa_layout {
+		particle_store_t s;
+
+		XEN_HOST_DEVICE swirl_soa_layout( const particle_store_t & store ) : s(store) {}
+		XEN_HOST_DEVICE bool has_prev( void ) const { return s.prev_x != NULL; }
+		template <typename real>
+		XEN_HOST_DEVICE void load( unsigned int i, real & x, real & y, real & z,
+				real & vx, real & vy, real & vz ) const {
+			lane_load(s.x + i, x); lane_load(s.y + i, y); lane_load(s.z + i, z);
+			lane_load(s.vx + i, vx); lane_load(s.vy + i, vy); lane_load(s.vz + i, vz);
+		}
+		template <typename real>
+		XEN_HOST_DEVICE void store( unsigned int i, real x, real y, real z,
+				real vx, real vy, real vz ){
+			lane_store(s.x + i, x); lane_store(s.y + i, y); lane_store(s.z + i, z);
+			lane_store(s.vx + i, vx); lane_store(s.vy + i, vy); lane_store(s.vz + i, vz);
+		}
+		template <typename real>
+		XEN_HOST_DEVICE void store_prev( unsigned int i, real x, real y, real z ){
+			lane_store(s.prev_x + i, x); lane_store(s.prev_y + i, y); lane_store(s.prev_z + i, z);
+		}
+	};
+
+	// Layout: particle i of float4 pos / vel arrays; w is left alone
+	struct swirl_aos_layout {
+		swirl_float4_t * pos;
+		swirl_float4_t * vel;
+
+		XEN_HOST_DEVICE swirl_aos_layout( swirl_float4_t * p, swirl_float4_t * v ) : pos(p), vel(v) {}
+		XEN_HOST_DEVICE bool has_prev( void ) const { return false; }
+		template <typename real>
+		XEN_HOST_DEVICE void load( unsigned int i, real & x, real & y, real & z,
+				real & vx, real & vy, real & vz ) const {
+			lane_load_float4(pos + i, x, y, z);
+			lane_load_float4(vel + i, vx, vy, vz);
+		}
+		template <typename real>
+		XEN_HOST_DEVICE void store( unsigned int i, real x, real y, real z,
+				real vx, real vy, real vz ){
+			lane_store_float4(pos + i, x, y, z);
+			lane_store_float4(vel + i, vx, vy, vz);
+		}
+		template <typename real>
+		XEN_HOST_DEVICE void store_prev( unsigned int i, real x, real y, real z ){}
+	};
+
+	// One fixed step of one particle, dt_s seconds long
+	template <typename real>
+	XEN_HOST_DEVICE XEN_LANE_INLINE void swirl_step( const force_field_list_t & fields, real & x, real & y,
+			real & z, real & vx, real & vy, real & vz, real dt_s ){
+		force_field_apply(fields, x, y, z, vx, vy, vz);
+		/* And update position based on velocity */
+		x += vx * dt_s;
+		y += vy * dt_s;
+		z += vz * dt_s;
+		collider_apply(fields, x, y, z, vx, vy, vz);
+	}
+
+	// `steps` fused fixed steps of particle (group) i, kept in registers
+	// throughout; prev gets the position from before the last one
+	template <class Layout, typename real>
+	XEN_HOST_DEVICE XEN_LANE_INLINE void swirl_integrate( Layout & l, unsigned int i,
+			const force_field_list_t & fields, real dt_s, int steps ){
+		if (steps < 1)
+			return;
+		real x, y, z, vx, vy, vz;
+		l.load(i, x, y, z, vx, vy, vz);
+		for (int k = 1; k < steps; k++)
+			swirl_step(fields, x, y, z, vx, vy, vz, dt_s);
+		if (l.has_prev())
+			l.store_prev(i, x, y, z);
+		swirl_step(fields, x, y, z, vx, vy, vz, dt_s);
+		l.store(i, x, y, z, vx, vy, vz);
+	}
+
+	// Particles [begin, end), one at a time
+	template <class Layout, typename real>
+	XEN_HOST_DEVICE inline void swirl_integrate_range( Layout & l, unsigned int begin, unsigned int end,
+			const force_field_list_t & fields, real dt_s, int steps ){
+		for (unsigned int i = begin; i < end; i++)
+			swirl_integrate(l, i, fields, dt_s, steps);
+	}
+};
+
+#endif //__XEN_PARTICLE_INTEGRATE_H
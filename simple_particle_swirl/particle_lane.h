@@ -0,0 +1,80 @@
+/* #########################################################################
+        particle_lane: what the swirl's per-particle math runs on
+   Header!
+
+   force_field_apply, collider_apply and swirl_integrate are written
+   once, templated on `real`, the type one particle's (or one group of
+   particles') numbers live in:
+        float, double   one particle (host, and the CUDA kernel)
+        sse_lane        4 particles in an __m128 (particle_lane_simd.h)
+        avx_lane        8 particles in an __m256 (particle_lane_simd.h)
+   Arithmetic is plain operators. Anything that would be a branch on a
+   particle's value is a compare giving a lane_mask<real>::type (bool
+   here, one bit pattern per lane for the vector types) and one of the
+   helpers below, so every type runs the same operations in the same
+   order, and the vector paths match float bit for bit (given the
+   Makefile's FPFLAGS float model).
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_LANE_H
+#define __XEN_PARTICLE_LANE_H
+
+#include <math.h>
+
+#include "particle_store.h"
+
+// The step templates have to inline all the way down for lane values to
+// stay in registers, further than the compilers' own heuristics go
+#if defined(__CUDACC__)
+	#define XEN_LANE_INLINE __forceinline__
+#elif defined(_MSC_VER)
+	#define XEN_LANE_INLINE __forceinline
+#else
+	#define XEN_LANE_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace xen_rift {
+	// What a compare on `real` gives
+	template <typename real>
+	struct lane_mask {
+		typedef bool type;
+	};
+
+	// a where m is set, b elsewhere
+	template <typename real>
+	XEN_HOST_DEVICE inline real lane_select( bool m, real a, real b ){ return m ? a : b; }
+	// Whether m is set for any lane
+	XEN_HOST_DEVICE inline bool lane_any( bool m ){ return m; }
+
+	// min / max spelled as _mm_min_ps / _mm_max_ps compute them (b when
+	// either is NaN)
+	template <typename real>
+	XEN_HOST_DEVICE inline real lane_min( real a, real b ){ return a < b ? a : b; }
+	template <typename real>
+	XEN_HOST_DEVICE inline real lane_max( real a, real b ){ return a > b ? a : b; }
+
+	// floor, as truncation stepped down where that rounded up
+	template <typename real>
+	XEN_HOST_DEVICE inline real lane_floor( real a ){
+		real k = (real)(int)a;
+		return k - lane_select(a < k, (real)1.0f, (real)0.0f);
+	}
+
+	// |a| and sqrt(a) in the precision of a
+	XEN_HOST_DEVICE inline float lane_abs( float a ){ return fabsf(a); }
+	XEN_HOST_DEVICE inline double lane_abs( double a ){ return fabs(a); }
+	XEN_HOST_DEVICE inline float lane_sqrt( float a ){ return sqrtf(a); }
+	XEN_HOST_DEVICE inline double lane_sqrt( double a ){ return sqrt(a); }
+
+	// One lane's worth of a float stream at p, and back (state is stored
+	// as float whatever the math is done in)
+	template <typename real>
+	XEN_HOST_DEVICE inline void lane_load( const float * p, real & a ){ a = *p; }
+	template <typename real>
+	XEN_HOST_DEVICE inline void lane_store( float * p, real a ){ *p = (float)a; }
+};
+
+#endif //__XEN_PARTICLE_LANE_H
@@ -0,0 +1,216 @@
+/* #########################################################################
+        particle_lane_simd: SSE / AVX lane types for the swirl's math
+   Header!
+
+   Host only. sse_lane and avx_lane hold 4 / 8 particles' worth of one
+   number, with the operators and particle_lane.h helpers the shared
+   templates (force_field_apply, collider_apply, swirl_integrate) use,
+   each a single intrinsic or two; compares give sse_mask / avx_mask.
+   A float converts to a lane by broadcast, so field constants mix in
+   as they do in the scalar code.
+
+   Rev history:
+     agent  20261017  Init revision
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_LANE_SIMD_H
+#define __XEN_PARTICLE_LANE_SIMD_H
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+// AVX intrinsics arrived with VS2010 SP1; detect_swirl_simd keeps us off
+// that path on CPUs / OSes that can't run it.
+#if (defined(_MSC_VER) && _MSC_VER >= 1600) || defined(__AVX__)
+	#define SWIRL_HAVE_AVX 1
+	#include <immintrin.h>
+#else
+	#define SWIRL_HAVE_AVX 0
+#endif
+
+#include "particle_integrate.h"
+
+namespace xen_rift {
+	// ---------------------------------------------------------------- SSE
+	struct sse_mask {
+		__m128 m;
+
+		sse_mask( void ) {}
+		explicit sse_mask( __m128 a ) : m(a) {}
+		sse_mask( bool b ) : m(_mm_castsi128_ps(_mm_set1_epi32(b ? -1 : 0))) {}
+	};
+
+	struct sse_lane {
+		enum { width = 4 };
+		__m128 v;
+
+		sse_lane( void ) {}
+		explicit sse_lane( __m128 a ) : v(a) {}
+		sse_lane( float a ) : v(_mm_set1_ps(a)) {}
+
+		sse_lane & operator+=( sse_lane b ){ v = _mm_add_ps(v, b.v); return *this; }
+		sse_lane & operator-=( sse_lane b ){ v = _mm_sub_ps(v, b.v); return *this; }
+	};
+
+	template <>
+	struct lane_mask<sse_lane> {
+		typedef sse_mask type;
+	};
+
+	inline sse_lane operator+( sse_lane a, sse_lane b ){ return sse_lane(_mm_add_ps(a.v, b.v)); }
+	inline sse_lane operator-( sse_lane a, sse_lane b ){ return sse_lane(_mm_sub_ps(a.v, b.v)); }
+	inline sse_lane operator*( sse_lane a, sse_lane b ){ return sse_lane(_mm_mul_ps(a.v, b.v)); }
+	inline sse_lane operator/( sse_lane a, sse_lane b ){ return sse_lane(_mm_div_ps(a.v, b.v)); }
+	inline sse_lane operator-( sse_lane a ){ return sse_lane(_mm_xor_ps(_mm_set1_ps(-0.0f), a.v)); }
+
+	inline sse_mask operator<( sse_lane a, sse_lane b ){ return sse_mask(_mm_cmplt_ps(a.v, b.v)); }
+	inline sse_mask operator<=( sse_lane a, sse_lane b ){ return sse_mask(_mm_cmple_ps(a.v, b.v)); }
+	inline sse_mask operator>( sse_lane a, sse_lane b ){ return sse_mask(_mm_cmpgt_ps(a.v, b.v)); }
+	inline sse_mask operator>=( sse_lane a, sse_lane b ){ return sse_mask(_mm_cmpge_ps(a.v, b.v)); }
+	inline sse_mask operator!=( sse_lane a, sse_lane b ){ return sse_mask(_mm_cmpneq_ps(a.v, b.v)); }
+
+	inline sse_mask operator&( sse_mask a, sse_mask b ){ return sse_mask(_mm_and_ps(a.m, b.m)); }
+	inline sse_mask operator|( sse_mask a, sse_mask b ){ return sse_mask(_mm_or_ps(a.m, b.m)); }
+	inline sse_mask operator!( sse_mask a ){
+		return sse_mask(_mm_andnot_ps(a.m, _mm_castsi128_ps(_mm_set1_epi32(-1))));
+	}
+
+	inline sse_lane lane_select( sse_mask m, sse_lane a, sse_lane b ){
+		return sse_lane(_mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)));
+	}
+	inline bool lane_any( sse_mask m ){ return _mm_movemask_ps(m.m) != 0; }
+	inline sse_lane lane_min( sse_lane a, sse_lane b ){ return sse_lane(_mm_min_ps(a.v, b.v)); }
+	inline sse_lane lane_max( sse_lane a, sse_lane b ){ return sse_lane(_mm_max_ps(a.v, b.v)); }
+	inline sse_lane lane_floor( sse_lane a ){
+		sse_lane k(_mm_cvtepi32_ps(_mm_cvttps_epi32(a.v)));
+		return k - lane_select(a < k, 1.0f, 0.0f);
+	}
+	inline sse_lane lane_abs( sse_lane a ){ return sse_lane(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+	inline sse_lane lane_sqrt( sse_lane a ){ return sse_lane(_mm_sqrt_ps(a.v)); }
+
+	// 4 particles of a 16-byte aligned stream
+	inline void lane_load( const float * p, sse_lane & a ){ a.v = _mm_load_ps(p); }
+	inline void lane_store( float * p, sse_lane a ){ _mm_store_ps(p, a.v); }
+
+	// x / y / z of 4 float4s, transposed in; out again, leaving w alone
+	inline void lane_load_float4( const swirl_float4_t * p, sse_lane & x, sse_lane & y, sse_lane & z ){
+		__m128 r0 = _mm_load_ps(&p[0].x), r1 = _mm_load_ps(&p[1].x);
+		__m128 r2 = _mm_load_ps(&p[2].x), r3 = _mm_load_ps(&p[3].x);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		x.v = r0; y.v = r1; z.v = r2;
+	}
+	inline void lane_store_float4( swirl_float4_t * p, sse_lane x, sse_lane y, sse_lane z ){
+		const __m128 w = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+		__m128 r0 = x.v, r1 = y.v, r2 = z.v, r3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		__m128 * q = (__m128 *)p;
+		q[0] = _mm_or_ps(_mm_andnot_ps(w, r0), _mm_and_ps(w, q[0]));
+		q[1] = _mm_or_ps(_mm_andnot_ps(w, r1), _mm_and_ps(w, q[1]));
+		q[2] = _mm_or_ps(_mm_andnot_ps(w, r2), _mm_and_ps(w, q[2]));
+		q[3] = _mm_or_ps(_mm_andnot_ps(w, r3), _mm_and_ps(w, q[3]));
+	}
+
+#if SWIRL_HAVE_AVX
+	// ---------------------------------------------------------------- AVX
+	struct avx_mask {
+		__m256 m;
+
+		avx_mask( void ) {}
+		explicit avx_mask( __m256 a ) : m(a) {}
+		avx_mask( bool b ) : m(_mm256_castsi256_ps(_mm256_set1_epi32(b ? -1 : 0))) {}
+	};
+
+	struct avx_lane {
+		enum { width = 8 };
+		__m256 v;
+
+		avx_lane( void ) {}
+		explicit avx_lane( __m256 a ) : v(a) {}
+		avx_lane( float a ) : v(_mm256_set1_ps(a)) {}
+
+		avx_lane & operator+=( avx_lane b ){ v = _mm256_add_ps(v, b.v); return *this; }
+		avx_lane & operator-=( avx_lane b ){ v = _mm256_sub_ps(v, b.v); return *this; }
+	};
+
+	template <>
+	struct lane_mask<avx_lane> {
+		typedef avx_mask type;
+	};
+
+	inline avx_lane operator+( avx_lane a, avx_lane b ){ return avx_lane(_mm256_add_ps(a.v, b.v)); }
+	inline avx_lane operator-( avx_lane a, avx_lane b ){ return avx_lane(_mm256_sub_ps(a.v, b.v)); }
+	inline avx_lane operator*( avx_lane a, avx_lane b ){ return avx_lane(_mm256_mul_ps(a.v, b.v)); }
+	inline avx_lane operator/( avx_lane a, avx_lane b ){ return avx_lane(_mm256_div_ps(a.v, b.v)); }
+	inline avx_lane operator-( avx_lane a ){ return avx_lane(_mm256_xor_ps(_mm256_set1_ps(-0.0f), a.v)); }
+
+	inline avx_mask operator<( avx_lane a, avx_lane b ){ return avx_mask(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+	inline avx_mask operator<=( avx_lane a, avx_lane b ){ return avx_mask(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+	inline avx_mask operator>( avx_lane a, avx_lane b ){ return avx_mask(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)); }
+	inline avx_mask operator>=( avx_lane a, avx_lane b ){ return avx_mask(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)); }
+	inline avx_mask operator!=( avx_lane a, avx_lane b ){ return avx_mask(_mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ)); }
+
+	inline avx_mask operator&( avx_mask a, avx_mask b ){ return avx_mask(_mm256_and_ps(a.m, b.m)); }
+	inline avx_mask operator|( avx_mask a, avx_mask b ){ return avx_mask(_mm256_or_ps(a.m, b.m)); }
+	inline avx_mask operator!( avx_mask a ){
+		return avx_mask(_mm256_andnot_ps(a.m, _mm256_castsi256_ps(_mm256_set1_epi32(-1))));
+	}
+
+	inline avx_lane lane_select( avx_mask m, avx_lane a, avx_lane b ){
+		return avx_lane(_mm256_blendv_ps(b.v, a.v, m.m));
+	}
+	inline bool lane_any( avx_mask m ){ return _mm256_movemask_ps(m.m) != 0; }
+	inline avx_lane lane_min( avx_lane a, avx_lane b ){ return avx_lane(_mm256_min_ps(a.v, b.v)); }
+	inline avx_lane lane_max( avx_lane a, avx_lane b ){ return avx_lane(_mm256_max_ps(a.v, b.v)); }
+	inline avx_lane lane_floor( avx_lane a ){
+		avx_lane k(_mm256_cvtepi32_ps(_mm256_cvttps_epi32(a.v)));
+		return k - lane_select(a < k, 1.0f, 0.0f);
+	}
+	inline avx_lane lane_abs( avx_lane a ){ return avx_lane(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)); }
+	inline avx_lane lane_sqrt( avx_lane a ){ return avx_lane(_mm256_sqrt_ps(a.v)); }
+
+	// 8 particles of a 32-byte aligned stream
+	inline void lane_load( const float * p, avx_lane & a ){ a.v = _mm256_load_ps(p); }
+	inline void lane_store( float * p, avx_lane a ){ _mm256_store_ps(p, a.v); }
+
+	// 4x4 transpose within each 128-bit half: rows p, p+4 in, x / y / z
+	//  / w for 8 particles out (and back again)
+	inline void lane_transpose_avx( __m256 & r0, __m256 & r1, __m256 & r2, __m256 & r3 ){
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+		__m256 t1 = _mm256_unpackhi_ps(r0, r1);
+		__m256 t2 = _mm256_unpacklo_ps(r2, r3);
+		__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+		r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	inline __m256 lane_load_float4_pair( const swirl_float4_t * p ){
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(&p[0].x)), _mm_load_ps(&p[4].x), 1);
+	}
+
+	inline void lane_store_float4_pair( swirl_float4_t * p, __m256 r ){
+		_mm_store_ps(&p[0].x, _mm256_castps256_ps128(r));
+		_mm_store_ps(&p[4].x, _mm256_extractf128_ps(r, 1));
+	}
+
+	// x / y / z of 8 float4s, transposed in; out again, leaving w alone
+	inline void lane_load_float4( const swirl_float4_t * p, avx_lane & x, avx_lane & y, avx_lane & z ){
+		__m256 r0 = lane_load_float4_pair(p), r1 = lane_load_float4_pair(p + 1);
+		__m256 r2 = lane_load_float4_pair(p + 2), r3 = lane_load_float4_pair(p + 3);
+		lane_transpose_avx(r0, r1, r2, r3);
+		x.v = r0; y.v = r1; z.v = r2;
+	}
+	inline void lane_store_float4( swirl_float4_t * p, avx_lane x, avx_lane y, avx_lane z ){
+		const __m256 w = _mm256_castsi256_ps(_mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0));
+		__m256 r0 = x.v, r1 = y.v, r2 = z.v, r3 = _mm256_setzero_ps();
+		lane_transpose_avx(r0, r1, r2, r3);
+		lane_store_float4_pair(p, _mm256_blendv_ps(r0, lane_load_float4_pair(p), w));
+		lane_store_float4_pair(p + 1, _mm256_blendv_ps(r1, lane_load_float4_pair(p + 1), w));
+		lane_store_float4_pair(p + 2, _mm256_blendv_ps(r2, lane_load_float4_pair(p + 2), w));
+		lane_store_float4_pair(p + 3, _mm256_blendv_ps(r3, lane_load_float4_pair(p + 3), w));
+	}
+#endif
+};
+
+#endif //__XEN_PARTICLE_LANE_SIMD_H
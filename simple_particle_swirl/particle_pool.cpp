@@ -0,0 +1,162 @@
+/* #########################################################################
+        particle_pool: lifetimes and emitters over a fixed particle store
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  live_view hands out a view the pool keeps
+   ######################################################################### */
+
+#include "particle_pool.h"
+#include <malloc.h>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+Particle_Pool::Particle_Pool() :
+        _store(NULL),
+        _live(0),
+        _life(NULL),
+        _key(0),
+        _serial(0),
+        _last_spawned(0),
+        _last_retired(0)
+{
+    memset(&_view, 0, sizeof(_view));
+}
+
+Particle_Pool::~Particle_Pool(){
+    _aligned_free(_life);
+}
+
+/* #########################################################################
+
+                                   attach
+
+   ######################################################################### */
+void Particle_Pool::attach( particle_store_t * s, unsigned int live, float life_min, float life_max,
+                            unsigned long long key ){
+    if (!_store || _store->n != s->n || !_life){
+        _aligned_free(_life);
+        _life = (float *)_aligned_malloc(particle_store_stride(s->n)*sizeof(float), 64);
+        if (!_life){
+            printf("Memory alloc error.\n");
+            exit(1);
+        }
+    }
+    _store = s;
+    _live = live < s->n ? live : s->n;
+    _key = key;
+    _serial = 0;
+    _last_spawned = _last_retired = 0;
+    for (unsigned int i = 0; i < _live; i++){
+        if (life_min >= PARTICLE_IMMORTAL)
+            _life[i] = PARTICLE_IMMORTAL;
+        else
+            _life[i] = life_min + (life_max - life_min) * particle_rand(i, 0, key ^ 0x5DEECE66DULL);
+    }
+    for (size_t e = 0; e < _emitters.size(); e++){
+        _owed[e] = 0.0;
+        _bursts[e] = 0;
+    }
+}
+
+int Particle_Pool::add_emitter( const particle_emitter_t & e ){
+    _emitters.push_back(e);
+    _owed.push_back(0.0);
+    _bursts.push_back(0);
+    return (int)_emitters.size() - 1;
+}
+
+void Particle_Pool::burst( int i, unsigned int count ){
+    if (i >= 0 && i < (int)_emitters.size())
+        _bursts[i] += count;
+}
+
+particle_store_t * Particle_Pool::live_view(){
+    _view = *_store;
+    _view.n = _live;
+    return &_view;
+}
+
+/* #########################################################################
+
+                                   update
+        -One pass over the live slots: age, and retire in place. A slot
+            that just got refilled from the end is looked at again,
+            since that particle hasn't been aged yet.
+        -Then spawns, appended at the end. Anything an emitter owes
+            once the pool is full is forgotten, so a long-full pool
+            doesn't spray out a backlog the moment room opens up.
+
+   ######################################################################### */
+void Particle_Pool::update( float dt_s ){
+    if (!_store)
+        return;
+    _last_retired = 0;
+    _last_spawned = 0;
+    unsigned int i = 0;
+    while (i < _live){
+        _life[i] -= dt_s;
+        if (_life[i] <= 0.0f){
+            retire(i);
+            _last_retired++;
+        } else {
+            i++;
+        }
+    }
+
+    for (size_t e = 0; e < _emitters.size(); e++){
+        const particle_emitter_t & em = _emitters[e];
+        if (em.active)
+            _owed[e] += em.rate * dt_s;
+        unsigned int count = (unsigned int)_owed[e];
+        _owed[e] -= count;
+        count += _bursts[e];
+        _bursts[e] = 0;
+        for (unsigned int k = 0; k < count && _live < _store->n; k++){
+            spawn(em);
+            _last_spawned++;
+        }
+        if (_live == _store->n)
+            _owed[e] = 0.0;
+    }
+    if (_last_retired || _last_spawned)
+        _store->color_dirty = true;
+}
+
+// Move the last live particle into slot i
+void Particle_Pool::retire( unsigned int i ){
+    particle_store_t & s = *_store;
+    unsigned int last = --_live;
+    if (i == last)
+        return;
+    s.x[i] = s.x[last]; s.y[i] = s.y[last]; s.z[i] = s.z[last];
+    s.vx[i] = s.vx[last]; s.vy[i] = s.vy[last]; s.vz[i] = s.vz[last];
+    if (s.prev_x){
+        s.prev_x[i] = s.prev_x[last]; s.prev_y[i] = s.prev_y[last]; s.prev_z[i] = s.prev_z[last];
+    }
+    if (s.color)
+        s.color[i] = s.color[last];
+    _life[i] = _life[last];
+}
+
+// New particle from e in slot live
+void Particle_Pool::spawn( const particle_emitter_t & e ){
+    particle_store_t & s = *_store;
+    unsigned int i = _live++;
+    unsigned int u = _serial++;
+    float x = e.x + e.radius * (particle_rand(u, 0, _key) * 2.0f - 1.0f);
+    float y = e.y + e.radius * (particle_rand(u, 1, _key) * 2.0f - 1.0f);
+    float z = e.z + e.radius * (particle_rand(u, 2, _key) * 2.0f - 1.0f);
+    float vx = e.vx + e.spread * (particle_rand(u, 3, _key) * 2.0f - 1.0f);
+    float vy = e.vy + e.spread * (particle_rand(u, 4, _key) * 2.0f - 1.0f);
+    float vz = e.vz + e.spread * (particle_rand(u, 5, _key) * 2.0f - 1.0f);
+    particle_set(s, i, x, y, z, vx, vy, vz);
+    if (s.prev_x){
+        s.prev_x[i] = x; s.prev_y[i] = y; s.prev_z[i] = z;
+    }
+    if (s.color)
+        s.color[i] = e.color;
+    _life[i] = e.life_min + (e.life_max - e.life_min) * particle_rand(u, 6, _key);
+}
@@ -0,0 +1,119 @@
+/* #########################################################################
+        particle_pool: lifetimes and emitters over a fixed particle store
+   Header!
+
+	The store's n slots are the pool's whole capacity; nothing is ever
+	(re)allocated after attach(). Live particles are always packed into
+	slots [0, live), so steps, uploads and draws only ever need to cover
+	that prefix:
+		- retiring particle i moves the last live particle into slot i
+		  (all of its streams) and shrinks live by one
+		- spawning writes slot live and grows it by one, until the pool
+		  is full; spawns past that are dropped
+	update() does both in one pass on the calling thread, after the
+	step that aged the particles has finished.
+
+	Spawned particles draw their randomness from the same counter RNG
+	as the initial swirl, keyed by the pool and counted by a running
+	spawn serial, so a run with the same key and inputs always spawns
+	the same particles.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  live_view hands out a view the pool keeps
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_POOL_H
+#define __XEN_PARTICLE_POOL_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <vector>
+
+#include "particle_store.h"
+#include "particle_init.h"
+
+namespace xen_rift {
+	// Lifetime for particles that never expire
+	#define PARTICLE_IMMORTAL FLT_MAX
+
+	typedef struct _particle_emitter_t {
+		// spawn point, and half-size of the cube around it they appear in
+		float x, y, z;
+		float radius;
+		// mean launch velocity, and +- this on each axis
+		float vx, vy, vz;
+		float spread;
+		// continuous particles per second (0 = only on burst())
+		float rate;
+		// seconds each one lives, uniformly in [life_min, life_max]
+		float life_min, life_max;
+		unsigned int color;
+		bool active;
+	} particle_emitter_t;
+
+	class Particle_Pool {
+		public:
+			Particle_Pool();
+			~Particle_Pool();
+
+			// Take over a store: its n slots are the capacity, and the
+			// first `live` of them are alive, with lifetimes drawn from
+			// [life_min, life_max] (PARTICLE_IMMORTAL for both to keep
+			// them forever). key seeds spawning. Forgets any pending
+			// bursts but keeps the emitters.
+			void attach( particle_store_t * s, unsigned int live, float life_min, float life_max,
+						 unsigned long long key );
+
+			// Return the emitter's index (they're numbered in the order
+			// added; there's no limit on how many).
+			int add_emitter( const particle_emitter_t & e );
+			particle_emitter_t * emitter( int i ) { return (i >= 0 && i < (int)_emitters.size()) ? &_emitters[i] : NULL; }
+			int num_emitters( void ) { return (int)_emitters.size(); }
+			// Spawn `count` particles from emitter i at the next update().
+			void burst( int i, unsigned int count );
+
+			// Age every live particle by dt_s seconds and retire those
+			// whose time is up, then spawn whatever the emitters owe.
+			// The store must not be in use by anything else meanwhile.
+			void update( float dt_s );
+
+			unsigned int live( void ) { return _live; }
+			unsigned int capacity( void ) { return _store ? _store->n : 0; }
+			// The store, cut down to its live particles: same streams,
+			// n = live. Don't use its n for stride / offset math. The
+			// pool keeps it, as of this call, until the next one, so a
+			// job can hold on to it.
+			particle_store_t * live_view( void );
+			unsigned int last_spawned( void ) { return _last_spawned; }
+			unsigned int last_retired( void ) { return _last_retired; }
+			// Seconds each slot has left (valid for [0, live))
+			const float * life( void ) { return _life; }
+
+		protected:
+			void retire( unsigned int i );
+			void spawn( const particle_emitter_t & e );
+
+			particle_store_t * _store;
+			particle_store_t _view;
+			unsigned int _live;
+			float * _life;
+			unsigned long long _key;
+			unsigned int _serial;
+			unsigned int _last_spawned;
+			unsigned int _last_retired;
+
+			std::vector<particle_emitter_t> _emitters;
+			// fractional particles carried between updates, and pending
+			// bursts, per emitter
+			std::vector<double> _owed;
+			std::vector<unsigned int> _bursts;
+
+		private:
+	};
+};
+
+#endif //__XEN_PARTICLE_POOL_H
@@ -0,0 +1,356 @@
+/* #########################################################################
+        particle_quant: compact 16-bit particle state
+
+   Everything works a block (QUANT_BLOCK particles, one bounding box) at
+   a time, and the parallel versions hand each worker whole blocks, so
+   no two workers ever touch the same box or the same cache line.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Step stays float; compact is the upload format
+     agent  20261017  Dropped the unused half-velocity block
+   ######################################################################### */
+
+#include "particle_quant.h"
+#include "particle_init.h"
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <vector>
+#include <algorithm>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+// Largest fixed-point value
+#define QUANT_MAX 65535.0f
+// Blocks per parallel chunk
+#define QUANT_CHUNK (4*QUANT_BLOCK)
+
+/* #########################################################################
+
+                                  alloc / free
+        -All six streams in one aligned allocation, boxes in another.
+
+   ######################################################################### */
+int xen_rift::particle_quant_alloc( particle_quant_t * q, unsigned int n ){
+    size_t stride = particle_quant_stride(n);
+    unsigned short * p = (unsigned short *)_aligned_malloc(6 * stride * sizeof(unsigned short), 64);
+    float * box = (float *)_aligned_malloc(particle_quant_box_size(n), 64);
+    if (!p || !box){
+        _aligned_free(p);
+        _aligned_free(box);
+        return -1;
+    }
+    memset(p, 0, 6 * stride * sizeof(unsigned short));
+    memset(box, 0, particle_quant_box_size(n));
+    q->n = n;
+    q->qx = p;
+    q->qy = p + stride;
+    q->qz = p + 2*stride;
+    q->prev_qx = p + 3*stride;
+    q->prev_qy = p + 4*stride;
+    q->prev_qz = p + 5*stride;
+    q->box = box;
+    return 0;
+}
+
+void xen_rift::particle_quant_free( particle_quant_t * q ){
+    _aligned_free(q->qx);
+    _aligned_free(q->box);
+    memset(q, 0, sizeof(particle_quant_t));
+}
+
+/* #########################################################################
+
+                             stream encode / decode
+        -count is rounded up to 8; every stream has room for that
+            (padding is never read back as a particle).
+
+   ######################################################################### */
+static void decode_positions(const unsigned short * q, float min, float scale, float * out, unsigned int count){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 vmin = _mm_set1_ps(min), vscale = _mm_set1_ps(scale);
+    for (unsigned int i = 0; i < count; i += 8){
+        __m128i v = _mm_load_si128((const __m128i *)(q + i));
+        __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+        __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero));
+        _mm_store_ps(out + i, _mm_add_ps(vmin, _mm_mul_ps(lo, vscale)));
+        _mm_store_ps(out + i + 4, _mm_add_ps(vmin, _mm_mul_ps(hi, vscale)));
+    }
+}
+
+static void encode_positions(const float * p, float min, float inv_scale, unsigned short * q, unsigned int count){
+    const __m128 vmin = _mm_set1_ps(min), vinv = _mm_set1_ps(inv_scale);
+    const __m128 zero = _mm_setzero_ps(), top = _mm_set1_ps(QUANT_MAX);
+    const __m128i bias = _mm_set1_epi32(32768);
+    for (unsigned int i = 0; i < count; i += 8){
+        // max first: it returns the 0 for NaN lanes (padding)
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(p + i), vmin), vinv), zero), top);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(p + i + 4), vmin), vinv), zero), top);
+        // round to nearest, then shift into signed range for the pack
+        __m128i ia = _mm_sub_epi32(_mm_cvtps_epi32(a), bias);
+        __m128i ib = _mm_sub_epi32(_mm_cvtps_epi32(b), bias);
+        __m128i packed = _mm_xor_si128(_mm_packs_epi32(ia, ib), _mm_set1_epi16((short)0x8000));
+        _mm_store_si128((__m128i *)(q + i), packed);
+    }
+}
+
+// min / max of the first count entries of a and b
+static void stream_bounds(const float * a, const float * b, unsigned int count, float * lo, float * hi){
+    __m128 vlo = _mm_set1_ps(a[0]), vhi = vlo;
+    unsigned int i = 0;
+    for (; i + 4 <= count; i += 4){
+        __m128 va = _mm_load_ps(a + i), vb = _mm_load_ps(b + i);
+        vlo = _mm_min_ps(vlo, _mm_min_ps(va, vb));
+        vhi = _mm_max_ps(vhi, _mm_max_ps(va, vb));
+    }
+    float l[4], h[4];
+    _mm_storeu_ps(l, vlo);
+    _mm_storeu_ps(h, vhi);
+    float mn = min(min(l[0], l[1]), min(l[2], l[3]));
+    float mx = max(max(h[0], h[1]), max(h[2], h[3]));
+    for (; i < count; i++){
+        mn = min(mn, min(a[i], b[i]));
+        mx = max(mx, max(a[i], b[i]));
+    }
+    *lo = mn;
+    *hi = mx;
+}
+
+/* #########################################################################
+
+                          pack_block / unpack_block
+        -Block b of q from / to the float streams of `s`, which start
+            at that block's first particle (a view into a full store)
+            and hold `count` particles.
+        -Positions only: velocities aren't part of the compact state,
+            and unpack_block leaves the store's alone.
+        -Prev streams only get unpacked if they're there.
+
+   ######################################################################### */
+static void pack_block(particle_quant_t & q, unsigned int b, const particle_store_t & s, unsigned int count){
+    const size_t first = (size_t)b * QUANT_BLOCK;
+    const float * cur[3] = { s.x, s.y, s.z };
+    const float * prev[3] = { s.prev_x ? s.prev_x : s.x, s.prev_y ? s.prev_y : s.y,
+                              s.prev_z ? s.prev_z : s.z };
+    unsigned short * qcur[3] = { q.qx + first, q.qy + first, q.qz + first };
+    unsigned short * qprev[3] = { q.prev_qx + first, q.prev_qy + first, q.prev_qz + first };
+    float * box = q.box + (size_t)b * QUANT_BOX_FLOATS;
+    for (int a = 0; a < 3; a++){
+        float lo, hi;
+        stream_bounds(cur[a], prev[a], count, &lo, &hi);
+        float extent = hi - lo;
+        box[a] = lo;
+        box[4 + a] = extent / QUANT_MAX;
+        float inv = extent > 0.0f ? QUANT_MAX / extent : 0.0f;
+        encode_positions(cur[a], lo, inv, qcur[a], count);
+        encode_positions(prev[a], lo, inv, qprev[a], count);
+    }
+    box[3] = box[7] = 0.0f;
+}
+
+static void unpack_block(const particle_quant_t & q, unsigned int b, particle_store_t & s, unsigned int count){
+    const size_t first = (size_t)b * QUANT_BLOCK;
+    const float * box = q.box + (size_t)b * QUANT_BOX_FLOATS;
+    decode_positions(q.qx + first, box[0], box[4], s.x, count);
+    decode_positions(q.qy + first, box[1], box[5], s.y, count);
+    decode_positions(q.qz + first, box[2], box[6], s.z, count);
+    if (s.prev_x){
+        decode_positions(q.prev_qx + first, box[0], box[4], s.prev_x, count);
+        decode_positions(q.prev_qy + first, box[1], box[5], s.prev_y, count);
+        decode_positions(q.prev_qz + first, box[2], box[6], s.prev_z, count);
+    }
+}
+
+// Block b's particles of a full store
+static particle_store_t block_view(const particle_store_t & s, unsigned int b, unsigned int count){
+    const size_t first = (size_t)b * QUANT_BLOCK;
+    particle_store_t v = s;
+    v.n = count;
+    v.x = s.x + first; v.y = s.y + first; v.z = s.z + first;
+    v.vx = s.vx + first; v.vy = s.vy + first; v.vz = s.vz + first;
+    v.color = s.color ? s.color + first : NULL;
+    if (s.prev_x){
+        v.prev_x = s.prev_x + first; v.prev_y = s.prev_y + first; v.prev_z = s.prev_z + first;
+    }
+    return v;
+}
+
+static unsigned int block_count(unsigned int n, unsigned int b){
+    unsigned int first = b * QUANT_BLOCK;
+    return min((unsigned int)QUANT_BLOCK, n - first);
+}
+
+/* #########################################################################
+
+                       particle_quant_encode / _decode
+
+   ######################################################################### */
+typedef struct _convert_job_t {
+    particle_store_t * s;
+    particle_quant_t * q;
+} convert_job_t;
+
+static void encode_chunk(unsigned int begin, unsigned int end, int worker, void * user){
+    convert_job_t * job = (convert_job_t *)user;
+    for (unsigned int b = begin / QUANT_BLOCK; b * QUANT_BLOCK < end; b++){
+        unsigned int count = block_count(job->q->n, b);
+        pack_block(*job->q, b, block_view(*job->s, b, count), count);
+    }
+}
+
+static void decode_chunk(unsigned int begin, unsigned int end, int worker, void * user){
+    convert_job_t * job = (convert_job_t *)user;
+    for (unsigned int b = begin / QUANT_BLOCK; b * QUANT_BLOCK < end; b++){
+        unsigned int count = block_count(job->q->n, b);
+        particle_store_t v = block_view(*job->s, b, count);
+        unpack_block(*job->q, b, v, count);
+    }
+}
+
+void xen_rift::particle_quant_encode( Thread_Pool * pool, const particle_store_t & s, particle_quant_t & q ){
+    convert_job_t job = { (particle_store_t *)&s, &q };
+    if (pool)
+        pool->parallel_for(q.n, QUANT_CHUNK, encode_chunk, &job);
+    else
+        encode_chunk(0, q.n, 0, &job);
+}
+
+void xen_rift::particle_quant_decode( Thread_Pool * pool, const particle_quant_t & q, particle_store_t & s ){
+    convert_job_t job = { &s, (particle_quant_t *)&q };
+    if (pool)
+        pool->parallel_for(q.n, QUANT_CHUNK, decode_chunk, &job);
+    else
+        decode_chunk(0, q.n, 0, &job);
+}
+
+/* #########################################################################
+
+                             h_quant_swirl_async
+        -Per block: step it in place with the regular host step, then
+            pack its positions around their new bounding box while
+            they're still in cache.
+
+   ######################################################################### */
+static void quant_swirl_chunk(unsigned int begin, unsigned int end, int worker, void * user){
+    quant_job_t * job = (quant_job_t *)user;
+    for (unsigned int b = begin / QUANT_BLOCK; b * QUANT_BLOCK < end; b++){
+        unsigned int count = block_count(job->q->n, b);
+        h_simple_particle_swirl_range(*job->s, job->fields, b * QUANT_BLOCK, b * QUANT_BLOCK + count,
+            job->dt, job->steps, job->simd);
+        pack_block(*job->q, b, block_view(*job->s, b, count), count);
+    }
+}
+
+void xen_rift::h_quant_swirl_async( Thread_Pool * pool, quant_job_t * job ){
+    pool->parallel_for_async(job->q->n, QUANT_CHUNK, quant_swirl_chunk, job);
+}
+
+/* #########################################################################
+
+                          particle_quant_benchmark
+        -The float step alone, then the same step with the packing,
+            one step per job, two copies of the same swirl.
+        -Then, after a second (120 steps) of the packed one, how far
+            the packed positions are from the floats they came from.
+
+   ######################################################################### */
+void xen_rift::particle_quant_benchmark( unsigned int max_n, int threads ){
+    const int reps = 20;
+    const float dt = 1000.0f/120.0f;
+    if (threads <= 0)
+        threads = Thread_Pool::num_processors();
+    Thread_Pool pool(threads);
+    swirl_simd_t simd = detect_swirl_simd();
+    force_field_list_t fields;
+    force_field_preset(0, &fields);
+    unsigned long long key = particle_init_key(1);
+    printf("Compact particle uploads: %d threads, %s, blocks of %d\n", threads, swirl_simd_name(simd),
+        QUANT_BLOCK);
+    printf("    positions uploaded per particle: float %u bytes, compact %u bytes\n",
+        (unsigned int)(6*sizeof(float)), (unsigned int)(6*sizeof(unsigned short)));
+
+    unsigned int n = 65536;
+    if (n > max_n)
+        n = max_n;
+    std::vector<double> ft(reps), qt(reps);
+    while (n <= max_n){
+        particle_store_t s, t;
+        particle_quant_t q;
+        if (particle_store_alloc(&s, n, false, true) || particle_store_alloc(&t, n, false, true) ||
+            particle_quant_alloc(&q, n)){
+            printf("Memory alloc error.\n");
+            return;
+        }
+        h_init_swirl_particles(&pool, s, key);
+        h_init_swirl_particles(&pool, t, key);
+
+        swirl_job_t fjob;
+        fjob.s = &s; fjob.dt = dt; fjob.steps = 1;
+        fjob.simd = simd; fjob.fields = fields; fjob.trail.x = NULL;
+        quant_job_t qjob;
+        qjob.s = &t; qjob.q = &q; qjob.dt = dt; qjob.steps = 1; qjob.simd = simd; qjob.fields = fields;
+        for (int i = -3; i < reps; i++){
+            h_simple_particle_swirl_async(&pool, &fjob);
+            pool.wait();
+            if (i >= 0)
+                ft[i] = pool.last_job_ms();
+            h_quant_swirl_async(&pool, &qjob);
+            pool.wait();
+            if (i >= 0)
+                qt[i] = pool.last_job_ms();
+        }
+        std::sort(ft.begin(), ft.end());
+        std::sort(qt.begin(), qt.end());
+        double fms = ft[reps/2], qms = qt[reps/2];
+        printf("    %9u particles: float step %8.3f ms  step + pack %8.3f ms (+%5.1f%%)  "
+            "upload %6.2f MB less\n", n, fms, qms, 100.0 * (qms - fms) / fms,
+            (double)n * 6 * (sizeof(float) - sizeof(unsigned short)) / 1e6);
+
+        particle_quant_free(&q);
+        particle_store_free(&t);
+        particle_store_free(&s);
+        if (n == max_n)
+            break;
+        n = (n*2 > max_n || n*2 < n) ? max_n : n*2;
+    }
+
+    // error: a second of the packed step, then decode next to the floats
+    n = min(max_n, 262144u);
+    particle_store_t ref, out;
+    particle_quant_t q;
+    if (particle_store_alloc(&ref, n, false, true) || particle_store_alloc(&out, n, false, true) ||
+        particle_quant_alloc(&q, n)){
+        printf("Memory alloc error.\n");
+        return;
+    }
+    h_init_swirl_particles(&pool, ref, key);
+    quant_job_t qjob;
+    qjob.s = &ref; qjob.q = &q; qjob.dt = dt; qjob.steps = 1; qjob.simd = simd; qjob.fields = fields;
+    for (int k = 0; k < 120; k++){
+        h_quant_swirl_async(&pool, &qjob);
+        pool.wait();
+    }
+    particle_quant_decode(&pool, q, out);
+    // half a quantization step of the widest box
+    double bound = 0.0;
+    for (unsigned int b = 0; b < particle_quant_blocks(n); b++)
+        for (int a = 0; a < 3; a++)
+            bound = max(bound, 0.5 * q.box[b*QUANT_BOX_FLOATS + 4 + a]);
+    double max_err = 0.0, sum2 = 0.0;
+    for (unsigned int i = 0; i < n; i++){
+        double d[6] = { out.x[i] - ref.x[i], out.y[i] - ref.y[i], out.z[i] - ref.z[i],
+                        out.prev_x[i] - ref.prev_x[i], out.prev_y[i] - ref.prev_y[i],
+                        out.prev_z[i] - ref.prev_z[i] };
+        for (int a = 0; a < 6; a++){
+            max_err = max(max_err, fabs(d[a]));
+            sum2 += d[a]*d[a];
+        }
+    }
+    printf("    after 120 steps, %u particles: packed position error max %.2e, rms %.2e "
+        "(per-encode bound %.2e)\n", n, max_err, sqrt(sum2 / (6.0 * n)), bound);
+    particle_quant_free(&q);
+    particle_store_free(&out);
+    particle_store_free(&ref);
+}
@@ -0,0 +1,136 @@
+/* #########################################################################
+        particle_quant: compact 16-bit particle state
+   Header!
+
+	An optional smaller copy of the particle store for when the swirl is
+	big enough that moving its state around is what costs:
+		positions   16-bit unsigned fixed point, relative to the bounding
+		            box of their block of QUANT_BLOCK particles (one box
+		            covers both the current and previous positions)
+	and nothing else: velocities only matter to the step, which never
+	reads this.
+	Laid out like the store -- one stream per component, each padded to
+	a 64-byte multiple -- with the position block ordered
+		[ qx ][ qy ][ qz ][ color ][ prev qx ][ prev qy ][ prev qz ]
+	so it can go into the VBO as is (the color stream is the float
+	store's, uploaded on its own), plus one QUANT_BOX_FLOATS box per
+	block: min x / y / z, 0, scale x / y / z, 0, where a position is
+	min + q * scale. The boxes go to the shader as a buffer texture.
+
+	That's 12 bytes of positions uploaded per particle instead of 24,
+	and 16 bytes fetched per vertex when drawing instead of 28.
+
+	It's an upload and draw format only: the live state stays the float
+	store, stepped by the regular float step, and h_quant_swirl_async
+	packs each block's positions as soon as its step is done, while
+	they're still in cache. Stepping the compact state itself (decode a
+	block, step, re-encode) came out ~3x slower than the float step on
+	a compute-bound host, and its error piled up step after step; this
+	way there's only ever one encode's worth, up to half a quantization
+	step (box extent / 131070) per axis. So it doesn't cut the step's
+	own memory traffic, and isn't meant to: the step reads and writes
+	the float store either way.
+
+	Encode / decode are SSE2, 8 particles at a time.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Step stays float; compact is the upload format
+     agent  20261017  Dropped the unused half-velocity block
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_QUANT_H
+#define __XEN_PARTICLE_QUANT_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include "particle_store.h"
+#include "simple_particle_swirl_cpu.h"
+#include "../common/thread_pool.h"
+
+namespace xen_rift {
+	// Particles sharing one bounding box; a multiple of 32 so every
+	// block starts 64-byte aligned in every stream
+	#define QUANT_BLOCK 1024
+	// Floats per block box: min x / y / z, pad, scale x / y / z, pad
+	// (two RGBA32F texels)
+	#define QUANT_BOX_FLOATS 8
+
+	typedef struct _particle_quant_t {
+		unsigned int n;
+		// position block; color is a gap for the float store's stream
+		unsigned short * qx;
+		unsigned short * qy;
+		unsigned short * qz;
+		unsigned short * prev_qx;
+		unsigned short * prev_qy;
+		unsigned short * prev_qz;
+		// QUANT_BOX_FLOATS per block
+		float * box;
+	} particle_quant_t;
+
+	// Entries per stream: whole blocks of 16-bit entries stay 64-byte
+	// aligned, so pad to 32
+	inline size_t particle_quant_stride( unsigned int n ){
+		return ((size_t)n + 31) & ~(size_t)31;
+	}
+	inline unsigned int particle_quant_blocks( unsigned int n ){
+		return (n + QUANT_BLOCK - 1) / QUANT_BLOCK;
+	}
+	// Byte offset of a stream (particle_stream_t) within the position
+	// block (and VBO): 2 bytes per entry, except 4 for color
+	inline size_t particle_quant_offset( unsigned int n, particle_stream_t which ){
+		size_t stride = particle_quant_stride(n);
+		size_t shorts = (size_t)which + (which > PARTICLE_STREAM_COLOR ? 1 : 0);
+		return shorts * stride * sizeof(unsigned short);
+	}
+	// Bytes of qx / qy / qz (prev is the same), the whole position
+	// block and the boxes
+	inline size_t particle_quant_xyz_size( unsigned int n ){
+		return 3 * particle_quant_stride(n) * sizeof(unsigned short);
+	}
+	inline size_t particle_quant_pos_size( unsigned int n ){
+		return 8 * particle_quant_stride(n) * sizeof(unsigned short);
+	}
+	inline size_t particle_quant_box_size( unsigned int n ){
+		return (size_t)particle_quant_blocks(n) * QUANT_BOX_FLOATS * sizeof(float);
+	}
+
+	// Return -1 if fail, 0 if success
+	int particle_quant_alloc( particle_quant_t * q, unsigned int n );
+	void particle_quant_free( particle_quant_t * q );
+
+	// Float store -> compact (s.n == q.n; prev is taken as the current
+	// position if the store has no prev streams), and back, which
+	// leaves s's velocities as they were. In parallel on the pool if
+	// there is one.
+	void particle_quant_encode( Thread_Pool * pool, const particle_store_t & s, particle_quant_t & q );
+	void particle_quant_decode( Thread_Pool * pool, const particle_quant_t & q, particle_store_t & s );
+
+	// The regular float step of s, with each block's positions (current
+	// and prev) packed into q as it's finished. Has
+	// to outlive the job, like swirl_job_t.
+	typedef struct _quant_job_t {
+		particle_store_t * s;
+		particle_quant_t * q;
+		float dt;
+		int steps;
+		swirl_simd_t simd;
+		force_field_list_t fields;
+	} quant_job_t;
+	// Start it across the pool and return; pool->wait() before touching
+	// either state again
+	void h_quant_swirl_async( Thread_Pool * pool, quant_job_t * job );
+
+	// Time the float step alone and with the packing at doubling counts
+	// up to max_n on `threads` workers, next to the upload bytes it
+	// saves; then print the packed positions' error against the floats,
+	// next to the per-encode bound.
+	void particle_quant_benchmark( unsigned int max_n, int threads );
+};
+
+#endif //__XEN_PARTICLE_QUANT_H
@@ -0,0 +1,244 @@
+/* #########################################################################
+        particle_snapshot: memory-mapped particle state files
+
+   Saving is a plain sequential write of the header and both blocks.
+   Loading maps the whole file with FILE_MAP_COPY: the particle store
+   ends up backed by the page cache, private to this process, and
+   nothing is read until something touches it.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Bound n before sizing streams from it; own header size message
+     agent  20261017  Snapshot_Recorder / Snapshot_Player: series state
+   ######################################################################### */
+
+#include "particle_snapshot.h"
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+// Blocks start on this boundary within the file (and so the mapping,
+//  which is page aligned)
+#define SNAPSHOT_ALIGN 64
+
+/* #########################################################################
+
+                           save_particle_snapshot
+
+   ######################################################################### */
+int xen_rift::save_particle_snapshot( const char * path, const particle_store_t & s,
+                                      unsigned int steps, float step_ms, unsigned long long key ){
+    if (!s.color || !s.prev_x){
+        printf("Snapshot of %s needs color and prev streams.\n", path);
+        return -1;
+    }
+    particle_snapshot_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PARTICLE_SNAPSHOT_MAGIC, sizeof(PARTICLE_SNAPSHOT_MAGIC));
+    h.version = PARTICLE_SNAPSHOT_VERSION;
+    h.header_bytes = sizeof(particle_snapshot_header_t);
+    h.n = s.n;
+    h.stride = (unsigned int)particle_store_stride(s.n);
+    h.steps = steps;
+    h.step_ms = step_ms;
+    h.key = key;
+    h.pos_offset = (sizeof(h) + SNAPSHOT_ALIGN - 1) & ~(unsigned long long)(SNAPSHOT_ALIGN - 1);
+    h.vel_offset = h.pos_offset + particle_store_pos_size(s.n);
+
+    FILE * f = fopen(path, "wb");
+    if (!f){
+        printf("Couldn't open %s for writing.\n", path);
+        return -1;
+    }
+    static const char zeros[SNAPSHOT_ALIGN] = { 0 };
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(zeros, 1, (size_t)(h.pos_offset - sizeof(h)), f) == (size_t)(h.pos_offset - sizeof(h)) &&
+              fwrite(s.x, particle_store_pos_size(s.n), 1, f) == 1 &&
+              fwrite(s.vx, particle_store_vel_size(s.n), 1, f) == 1;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok){
+        printf("Couldn't write %s.\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/* #########################################################################
+
+                           open_particle_snapshot
+        -Maps the file, and refuses anything whose magic, version or
+            sizes don't add up before pointing the store into it.
+
+   ######################################################################### */
+int xen_rift::open_particle_snapshot( const char * path, particle_snapshot_t * snap ){
+    memset(snap, 0, sizeof(particle_snapshot_t));
+    snap->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+    if (snap->file == INVALID_HANDLE_VALUE){
+        snap->file = NULL;
+        return -1;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(snap->file, &size) || size.QuadPart < (LONGLONG)sizeof(particle_snapshot_header_t)){
+        printf("%s is too small to be a snapshot.\n", path);
+        close_particle_snapshot(snap);
+        return -1;
+    }
+    snap->mapping = CreateFileMappingA(snap->file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (snap->mapping)
+        snap->view = MapViewOfFile(snap->mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (!snap->view){
+        printf("Couldn't map %s (error %lu).\n", path, GetLastError());
+        close_particle_snapshot(snap);
+        return -1;
+    }
+
+    const particle_snapshot_header_t * h = (const particle_snapshot_header_t *)snap->view;
+    unsigned long long file_bytes = (unsigned long long)size.QuadPart;
+    if (memcmp(h->magic, PARTICLE_SNAPSHOT_MAGIC, sizeof(PARTICLE_SNAPSHOT_MAGIC)) != 0){
+        printf("%s isn't a particle snapshot.\n", path);
+    } else if (h->version != PARTICLE_SNAPSHOT_VERSION){
+        printf("%s is snapshot version %u; this build reads version %u.\n", path, h->version,
+            PARTICLE_SNAPSHOT_VERSION);
+    } else if (h->header_bytes != sizeof(particle_snapshot_header_t)){
+        printf("%s has a %u-byte header; version %u headers are %u bytes.\n", path, h->header_bytes,
+            PARTICLE_SNAPSHOT_VERSION, (unsigned int)sizeof(particle_snapshot_header_t));
+    // n is bounded by the file (10 floats a particle) before any size is
+    //  worked out from it: size_t is 32 bits here, and the stream sizes
+    //  of a garbage n wrap around to something that fits
+    } else if (h->n == 0 || h->n > file_bytes / (10 * sizeof(float)) ||
+               h->stride != particle_store_stride(h->n) ||
+               (h->pos_offset % SNAPSHOT_ALIGN) != 0 || (h->vel_offset % SNAPSHOT_ALIGN) != 0 ||
+               h->pos_offset > file_bytes || h->vel_offset > file_bytes ||
+               (unsigned long long)particle_store_pos_size(h->n) > file_bytes - h->pos_offset ||
+               (unsigned long long)particle_store_vel_size(h->n) > file_bytes - h->vel_offset){
+        printf("%s is truncated or corrupt.\n", path);
+    } else {
+        snap->header = h;
+        particle_store_bind(&snap->store, h->n, (char *)snap->view + h->pos_offset,
+            (char *)snap->view + h->vel_offset, true, true);
+        snap->store.color_dirty = true;
+        return 0;
+    }
+    close_particle_snapshot(snap);
+    return -1;
+}
+
+void xen_rift::close_particle_snapshot( particle_snapshot_t * snap ){
+    if (snap->view)
+        UnmapViewOfFile(snap->view);
+    if (snap->mapping)
+        CloseHandle(snap->mapping);
+    if (snap->file)
+        CloseHandle(snap->file);
+    memset(snap, 0, sizeof(particle_snapshot_t));
+}
+
+int xen_rift::particle_snapshot_series_path( char * path, const char * prefix, unsigned int index ){
+    if (strlen(prefix) + 16 > MAX_PATH)
+        return -1;
+    sprintf(path, "%s_%06u.swirl", prefix, index);
+    return 0;
+}
+
+/* #########################################################################
+
+                              Snapshot_Recorder
+
+   ######################################################################### */
+Snapshot_Recorder::Snapshot_Recorder() :
+        _every(0),
+        _index(0),
+        _next_step(0)
+{
+    _prefix[0] = '\0';
+}
+
+void Snapshot_Recorder::start( const char * prefix, unsigned int every, unsigned int steps ){
+    _every = 0;
+    if (every == 0 || strlen(prefix) + 16 > MAX_PATH)
+        return;
+    strcpy(_prefix, prefix);
+    _every = every;
+    _index = 0;
+    _next_step = steps;
+}
+
+bool Snapshot_Recorder::due( unsigned int steps, char * path ){
+    if (!_every || steps < _next_step)
+        return false;
+    particle_snapshot_series_path(path, _prefix, _index++);
+    _next_step = steps + _every;
+    return true;
+}
+
+void Snapshot_Recorder::record( const particle_store_t & s, unsigned int steps, float step_ms,
+                                unsigned long long key ){
+    char path[MAX_PATH];
+    if (due(steps, path) && save_particle_snapshot(path, s, steps, step_ms, key))
+        stop();
+}
+
+/* #########################################################################
+
+                               Snapshot_Player
+        -A snapshot is due at its steps * step_ms, less the first's.
+
+   ######################################################################### */
+Snapshot_Player::Snapshot_Player() :
+        _index(0),
+        _have_next(false),
+        _ms(0.0),
+        _origin_ms(0.0)
+{
+    _prefix[0] = '\0';
+    memset(&_next, 0, sizeof(_next));
+}
+
+Snapshot_Player::~Snapshot_Player(){
+    if (_have_next)
+        close_particle_snapshot(&_next);
+}
+
+int Snapshot_Player::set_series( const char * prefix ){
+    if (strlen(prefix) + 16 > MAX_PATH)
+        return -1;
+    strcpy(_prefix, prefix);
+    _index = 0;
+    return 0;
+}
+
+void Snapshot_Player::open_next(){
+    char path[MAX_PATH];
+    _have_next = particle_snapshot_series_path(path, _prefix, _index) == 0 &&
+                 open_particle_snapshot(path, &_next) == 0;
+    if (_have_next)
+        _index++;
+}
+
+int Snapshot_Player::open( particle_snapshot_t * first ){
+    open_next();
+    if (!_have_next)
+        return -1;
+    *first = _next;
+    _origin_ms = first->header->steps * (double)first->header->step_ms;
+    _ms = 0.0;
+    open_next();
+    return 0;
+}
+
+bool Snapshot_Player::advance( double ms, particle_snapshot_t * snap ){
+    _ms += ms;
+    // if we've fallen behind, skip straight to the latest snapshot that's due
+    bool due = false;
+    while (_have_next && _next.header->steps * (double)_next.header->step_ms - _origin_ms <= _ms){
+        if (due)
+            close_particle_snapshot(snap);
+        *snap = _next;
+        due = true;
+        open_next();
+    }
+    return due;
+}
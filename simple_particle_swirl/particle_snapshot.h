@@ -0,0 +1,153 @@
+/* #########################################################################
+        particle_snapshot: memory-mapped particle state files
+   Header!
+
+   A snapshot is a 64-byte header followed by a particle store's two
+   blocks exactly as they sit in memory:
+        [ header ][ position block ][ velocity block ]
+   with both blocks starting on a 64-byte boundary. Opening one maps
+   the file copy-on-write and points a particle_store_t straight into
+   the mapping, so a store of any size is "loaded" in the time it
+   takes to map a view -- pages only come in off disk as they're
+   touched, and writes to the store never go back to the file.
+
+   A series of snapshots (prefix_000000.swirl, prefix_000001.swirl, ...)
+   taken while running can be played back at the rate it was recorded,
+   using each file's step count and step length.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Snapshot_Recorder / Snapshot_Player: series state
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_SNAPSHOT_H
+#define __XEN_PARTICLE_SNAPSHOT_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Windows
+#include <windows.h>
+
+#include "particle_store.h"
+
+namespace xen_rift {
+	#define PARTICLE_SNAPSHOT_MAGIC "XRSWIRL"
+	// Bump whenever the header or block layout changes; older files are
+	// refused rather than misread.
+	#define PARTICLE_SNAPSHOT_VERSION 1
+
+	typedef struct _particle_snapshot_header_t {
+		char magic[8];
+		unsigned int version;
+		unsigned int header_bytes;
+		unsigned int n;
+		// entries per stream, i.e. particle_store_stride(n) when written
+		unsigned int stride;
+		// fixed steps the state had been advanced when it was saved, and
+		// how long each of them was
+		unsigned int steps;
+		float step_ms;
+		// counter-RNG key the swirl was initialized from
+		unsigned long long key;
+		// byte offsets of the two blocks from the start of the file
+		unsigned long long pos_offset;
+		unsigned long long vel_offset;
+		char pad[8];
+	} particle_snapshot_header_t;
+
+	// An open, mapped snapshot. `store` points into the mapping (with color
+	// and prev streams) and stays valid until close_particle_snapshot.
+	typedef struct _particle_snapshot_t {
+		HANDLE file;
+		HANDLE mapping;
+		void * view;
+		const particle_snapshot_header_t * header;
+		particle_store_t store;
+	} particle_snapshot_t;
+
+	// Write a store (which needs its color and prev streams) to path.
+	// Return -1 if fail, 0 if success.
+	int save_particle_snapshot( const char * path, const particle_store_t & s,
+								unsigned int steps, float step_ms, unsigned long long key );
+	// Map a snapshot copy-on-write and check its header.
+	// Return -1 if fail, 0 if success.
+	int open_particle_snapshot( const char * path, particle_snapshot_t * snap );
+	void close_particle_snapshot( particle_snapshot_t * snap );
+
+	// Name of snapshot `index` in the series `prefix` (into a MAX_PATH
+	// buffer). Return -1 if the prefix is too long, 0 if success.
+	int particle_snapshot_series_path( char * path, const char * prefix, unsigned int index );
+
+	// Where a series being recorded is up to: a snapshot every `every`
+	// steps, the next one due at next_step()
+	class Snapshot_Recorder {
+		public:
+			Snapshot_Recorder();
+
+			// Record the series `prefix` from step `steps` on, every
+			// `every` steps; 0 (or a prefix too long for the names)
+			// stops recording.
+			void start( const char * prefix, unsigned int every, unsigned int steps );
+			void stop( void ) { _every = 0; }
+			bool recording( void ) { return _every != 0; }
+			unsigned int next_step( void ) { return _next_step; }
+			// If a snapshot is due at `steps`, its name (into a MAX_PATH
+			// buffer), and the one after is due `every` steps on; false
+			// if none is. A snapshot that doesn't save should stop().
+			bool due( unsigned int steps, char * path );
+			// due() and save_particle_snapshot of s in one, stopping
+			// if the save fails
+			void record( const particle_store_t & s, unsigned int steps, float step_ms,
+						 unsigned long long key );
+
+		protected:
+			char _prefix[MAX_PATH];
+			unsigned int _every;
+			unsigned int _index;
+			unsigned int _next_step;
+
+		private:
+	};
+
+	// Plays a series back at the rate it was recorded: each snapshot is
+	// due once as much time has gone by as sim time had between it and
+	// the first. The next one is kept mapped ahead of time.
+	class Snapshot_Player {
+		public:
+			Snapshot_Player();
+			~Snapshot_Player();
+
+			// Play the series `prefix`. Return -1 if the prefix is too
+			// long, 0 if success.
+			int set_series( const char * prefix );
+			const char * series( void ) { return _prefix; }
+			// Map the series' first snapshot into `first` (the caller's
+			// to close) and start the clock at it. Return -1 if there is
+			// no first snapshot, 0 if success.
+			int open( particle_snapshot_t * first );
+			// Move the clock on by ms. If any snapshots have come due,
+			// the latest of them into `snap` (the caller's to close; any
+			// it skipped are closed) and true.
+			bool advance( double ms, particle_snapshot_t * snap );
+			bool finished( void ) { return !_have_next; }
+			// Snapshots mapped so far, the one ahead included
+			unsigned int opened( void ) { return _index; }
+
+		protected:
+			void open_next( void );
+
+			char _prefix[MAX_PATH];
+			unsigned int _index;
+			particle_snapshot_t _next;
+			bool _have_next;
+			double _ms;
+			double _origin_ms;
+
+		private:
+	};
+};
+
+#endif //__XEN_PARTICLE_SNAPSHOT_H
@@ -0,0 +1,575 @@
+/* #########################################################################
+        particle_sort: back-to-front ordering of each eye's particles
+
+   sort() is a string of parallel_for passes over disjoint chunks of the
+   list, with serial scans over the per-chunk counts in between. The
+   only writes that aren't to a pass's own chunk are the per-particle
+   keys, and every particle appears in a list at most once.
+
+   A list entry is the particle's key and index in one 64-bit word, so
+   the insertion pass and the radix scatter move one thing per entry,
+   and the scatter writes one stream per digit instead of two.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  sort_within: the limit check, and which views it skipped
+     agent  20261017  Packed entries, MSD-then-bucket radix, step 2 backs off after a miss
+   ######################################################################### */
+
+#include "particle_sort.h"
+#include "particle_init.h"
+#include <malloc.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+// List entries per parallel chunk in each pass
+#define SORT_CHUNK 16384
+// High-byte buckets per parallel chunk in the low-byte pass
+#define SORT_BUCKET_CHUNK 16
+// Radix sort digit: the key's high byte, then its low one
+#define SORT_RADIX_BITS 8
+#define SORT_RADIX (1u << SORT_RADIX_BITS)
+// Largest quantized depth
+#define SORT_KEY_MAX 65535u
+// _key_of: the generation tag over the kept flag over the key
+#define SORT_KEPT (1u << 16)
+#define SORT_TAG_SHIFT 17
+#define SORT_TAG_MASK 0x7FFFu
+// A list entry: key in the high half, particle index in the low
+#define SORT_ENTRY(key, i) (((sort_entry_t)(key) << 32) | (i))
+#define SORT_ENTRY_KEY(e) ((unsigned int)((e) >> 32))
+// Insertion-sort moves a chunk may spend, per entry, before the radix
+//  sort takes over
+#define SORT_MOVE_BUDGET 1
+// Sorts of a view that go straight to the radix sort after its last
+//  order didn't get there
+#define SORT_RETRY 32
+// Particles depth_sort_calibrate starts and stops sorting at, and how
+//  many times it sorts each count
+#define SORT_CALIBRATE_MIN 65536
+#define SORT_CALIBRATE_MAX 4194304
+#define SORT_CALIBRATE_REPS 3
+
+Depth_Sorter::Depth_Sorter() :
+        _capacity(0),
+        _last_sort_ms(0.0),
+        _last_presorted(false),
+        _pool(NULL),
+        _presort(false),
+        _key_of(NULL),
+        _generation(0),
+        _store(NULL),
+        _out(NULL),
+        _bucket_start(NULL),
+        _entries(NULL),
+        _entries_tmp(NULL),
+        _depth(NULL),
+        _chunk_counts(NULL),
+        _chunk_hist(NULL),
+        _chunk_min(NULL),
+        _chunk_max(NULL),
+        _chunk_sorted(NULL)
+{
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        _order[v] = NULL;
+        _count[v] = 0;
+        _skipped[v] = false;
+        _cold_left[v] = 0;
+    }
+}
+
+Depth_Sorter::~Depth_Sorter(){
+    reserve(0);
+}
+
+// Size everything for lists of up to n particles, indexed below n (0
+//  frees everything). Growing forgets the old orders.
+void Depth_Sorter::reserve( unsigned int n ){
+    if (n != 0 && n <= _capacity)
+        return;
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        _aligned_free(_order[v]);
+        _order[v] = NULL;
+        _count[v] = 0;
+    }
+    _aligned_free(_key_of);
+    _aligned_free(_entries);
+    _aligned_free(_entries_tmp);
+    _aligned_free(_depth);
+    _aligned_free(_bucket_start);
+    _aligned_free(_chunk_counts);
+    _aligned_free(_chunk_hist);
+    _aligned_free(_chunk_min);
+    _aligned_free(_chunk_max);
+    _aligned_free(_chunk_sorted);
+    _capacity = 0;
+    if (n == 0)
+        return;
+
+    unsigned int chunks = (n + SORT_CHUNK - 1) / SORT_CHUNK;
+    bool ok = true;
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        _order[v] = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+        ok = ok && _order[v];
+    }
+    _key_of = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+    _entries = (sort_entry_t *)_aligned_malloc(n*sizeof(sort_entry_t), 64);
+    _entries_tmp = (sort_entry_t *)_aligned_malloc(n*sizeof(sort_entry_t), 64);
+    _depth = (float *)_aligned_malloc(n*sizeof(float), 64);
+    _bucket_start = (unsigned int *)_aligned_malloc((SORT_RADIX + 1)*sizeof(unsigned int), 64);
+    _chunk_counts = (unsigned int *)_aligned_malloc(chunks*sizeof(unsigned int), 64);
+    _chunk_hist = (unsigned int *)_aligned_malloc(chunks*SORT_RADIX*sizeof(unsigned int), 64);
+    _chunk_min = (float *)_aligned_malloc(chunks*sizeof(float), 64);
+    _chunk_max = (float *)_aligned_malloc(chunks*sizeof(float), 64);
+    _chunk_sorted = (unsigned char *)_aligned_malloc(chunks, 64);
+    if (!ok || !_key_of || !_entries || !_entries_tmp || !_depth || !_bucket_start || !_chunk_counts || !_chunk_hist || !_chunk_min || !_chunk_max || !_chunk_sorted){
+        printf("Memory alloc error.\n");
+        exit(1);
+    }
+    memset(_key_of, 0, n*sizeof(unsigned int));
+    _generation = 0;
+    _capacity = n;
+}
+
+void Depth_Sorter::forget( void ){
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        _count[v] = 0;
+        _cold_left[v] = 0;
+    }
+}
+
+// One pass over [0, n) in SORT_CHUNK chunks, on the pool if there is one
+void Depth_Sorter::run( unsigned int n, range_func_t fn ){
+    if (_pool)
+        _pool->parallel_for(n, SORT_CHUNK, fn, this);
+    else
+        for (unsigned int i = 0; i < n; i += SORT_CHUNK)
+            fn(i, min(i + SORT_CHUNK, n), 0, this);
+}
+
+unsigned int Depth_Sorter::scan_chunks( unsigned int chunks ){
+    unsigned int total = 0;
+    for (unsigned int c = 0; c < chunks; c++){
+        unsigned int count = _chunk_counts[c];
+        _chunk_counts[c] = total;
+        total += count;
+    }
+    return total;
+}
+
+/* #########################################################################
+
+                                 sort_within
+
+   ######################################################################### */
+const unsigned int * Depth_Sorter::sort_within( int v, const particle_store_t & s, float alpha,
+                                                const float * view_proj, const unsigned int * visible,
+                                                unsigned int count, unsigned int limit, Thread_Pool * pool ){
+    if (v < 0 || v >= CULL_MAX_VIEWS)
+        return visible;
+    _skipped[v] = limit && count > limit;
+    if (_skipped[v])
+        return visible;
+    sort(v, s, alpha, view_proj, visible, count, pool);
+    return _order[v];
+}
+
+/* #########################################################################
+
+                                    sort
+
+   ######################################################################### */
+void Depth_Sorter::sort( int v, const particle_store_t & s, float alpha, const float * view_proj,
+                         const unsigned int * visible, unsigned int count, Thread_Pool * pool ){
+    LARGE_INTEGER start, stop, freq;
+    QueryPerformanceCounter(&start);
+    if (v < 0 || v >= CULL_MAX_VIEWS)
+        return;
+
+    reserve(s.n);
+    _pool = pool;
+    _store = &s;
+    _alpha = alpha;
+    // w is the bottom row of the (column-major) matrix
+    _w[0] = view_proj[3]; _w[1] = view_proj[7]; _w[2] = view_proj[11]; _w[3] = view_proj[15];
+    _visible = visible;
+    _prev = _order[v];
+    _num_prev = _count[v];
+    // step 2 only pays while the last order is nearly right; once it
+    //  wasn't, skip it for a while
+    _presort = _num_prev > 0 && _cold_left[v] == 0;
+    if (_cold_left[v] > 0)
+        _cold_left[v]--;
+    // the low bits of the generation tag this sort's keys
+    if (_presort && (++_generation & SORT_TAG_MASK) == 0){
+        memset(_key_of, 0, _capacity*sizeof(unsigned int));
+        ++_generation;
+    }
+
+    // 1. depth span, and every visible particle's key (straight to the
+    //  list, without step 2). Both passes go through the particles in
+    //  index order, so they stream.
+    unsigned int chunks = (count + SORT_CHUNK - 1) / SORT_CHUNK;
+    run(count, depth_range);
+    float lo = FLT_MAX, hi = -FLT_MAX;
+    for (unsigned int c = 0; c < chunks; c++){
+        lo = min(lo, _chunk_min[c]);
+        hi = max(hi, _chunk_max[c]);
+    }
+    _depth_min = lo;
+    _depth_scale = hi > lo ? (float)SORT_KEY_MAX / (hi - lo) : 0.0f;
+    run(count, key_range);
+
+    bool sorted = false;
+    if (_presort){
+        // 2. the old order, cut down to what's still visible, then the
+        //  rest, keys alongside
+        run(_num_prev, keep_range);
+        _gather_chunks = (_num_prev + SORT_CHUNK - 1) / SORT_CHUNK;
+        _gather_base = 0;
+        _gather_total = scan_chunks(_gather_chunks);
+        run(_num_prev, gather_range);
+        run(count, add_range);
+        _gather_chunks = chunks;
+        _gather_base = _gather_total;
+        _gather_total = scan_chunks(chunks);
+        run(count, gather_range);
+        run(count, insertion_range);
+
+        // 3. already in order?
+        sorted = true;
+        for (unsigned int c = 0; c < chunks && sorted; c++){
+            sorted = _chunk_sorted[c] != 0;
+            if (sorted && c + 1 < chunks)
+                sorted = SORT_ENTRY_KEY(_entries[(c+1)*SORT_CHUNK - 1]) <=
+                         SORT_ENTRY_KEY(_entries[(c+1)*SORT_CHUNK]);
+        }
+        if (!sorted)
+            _cold_left[v] = SORT_RETRY;
+    }
+    _last_presorted = sorted;
+    // the old order's been read by now: the result goes over it
+    _out = _order[v];
+    if (sorted)
+        run(count, order_range);
+    else {
+        // 3a. by the high byte: digit-major scan (every chunk's 0s, then
+        //  every chunk's 1s...) and scatter to _entries_tmp
+        run(count, histogram_range);
+        unsigned int total = 0;
+        for (unsigned int d = 0; d < SORT_RADIX; d++){
+            _bucket_start[d] = total;
+            for (unsigned int c = 0; c < chunks; c++){
+                unsigned int n_d = _chunk_hist[c*SORT_RADIX + d];
+                _chunk_hist[c*SORT_RADIX + d] = total;
+                total += n_d;
+            }
+        }
+        _bucket_start[SORT_RADIX] = total;
+        run(count, scatter_range);
+        // 3b. each bucket by the low byte, on its own, while it's in
+        //  cache, straight to the order
+        if (_pool)
+            _pool->parallel_for(SORT_RADIX, SORT_BUCKET_CHUNK, bucket_range, this);
+        else
+            bucket_range(0, SORT_RADIX, 0, this);
+    }
+    _count[v] = count;
+    _out = NULL;
+    _store = NULL;
+    _pool = NULL;
+
+    QueryPerformanceCounter(&stop);
+    QueryPerformanceFrequency(&freq);
+    _last_sort_ms = ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+}
+
+// 1a. view depth of every visible particle, and the chunk's span
+void Depth_Sorter::depth_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Depth_Sorter * d = (Depth_Sorter *)user;
+    const particle_store_t & s = *d->_store;
+    const float alpha = d->_alpha;
+    const float * w = d->_w;
+    float lo = FLT_MAX, hi = -FLT_MAX;
+    for (unsigned int k = begin; k < end; k++){
+        unsigned int i = d->_visible[k];
+        float x = s.x[i], y = s.y[i], z = s.z[i];
+        if (s.prev_x){
+            x = s.prev_x[i] + (x - s.prev_x[i]) * alpha;
+            y = s.prev_y[i] + (y - s.prev_y[i]) * alpha;
+            z = s.prev_z[i] + (z - s.prev_z[i]) * alpha;
+        }
+        float depth = w[0]*x + w[1]*y + w[2]*z + w[3];
+        d->_depth[k] = depth;
+        lo = min(lo, depth);
+        hi = max(hi, depth);
+    }
+    d->_chunk_min[begin / SORT_CHUNK] = lo;
+    d->_chunk_max[begin / SORT_CHUNK] = hi;
+}
+
+// 1b. farthest gets the smallest key. For step 2 it's tagged with the
+//  generation, which also marks the particle visible (and not kept
+//  yet); without it, it goes straight into the list.
+void Depth_Sorter::key_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Depth_Sorter * d = (Depth_Sorter *)user;
+    unsigned int tag = (d->_generation & SORT_TAG_MASK) << SORT_TAG_SHIFT;
+    for (unsigned int k = begin; k < end; k++){
+        float q = (d->_depth[k] - d->_depth_min) * d->_depth_scale;
+        unsigned int key = (unsigned int)(q + 0.5f);
+        key = SORT_KEY_MAX - (key < SORT_KEY_MAX ? key : SORT_KEY_MAX);
+        if (d->_presort)
+            d->_key_of[d->_visible[k]] = tag | key;
+        else
+            d->_entries[k] = SORT_ENTRY(key, d->_visible[k]);
+    }
+}
+
+// 2a. old order entries that are still visible, to the chunk's stretch
+//  of _entries_tmp, marking them kept (in the same word as the key, so
+//  it's one cache miss per entry)
+void Depth_Sorter::keep_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Depth_Sorter * d = (Depth_Sorter *)user;
+    unsigned int n = d->_store->n;
+    unsigned int tag = d->_generation & SORT_TAG_MASK;
+    unsigned int count = 0;
+    for (unsigned int k = begin; k < end; k++){
+        unsigned int i = d->_prev[k];
+        // (the live count may have shrunk since)
+        if (i >= n)
+            continue;
+        unsigned int key = d->_key_of[i];
+        if ((key >> SORT_TAG_SHIFT) == tag){
+            d->_key_of[i] = key | SORT_KEPT;
+            d->_entries_tmp[begin + count++] = SORT_ENTRY(key & SORT_KEY_MAX, i);
+        }
+    }
+    d->_chunk_counts[begin / SORT_CHUNK] = count;
+}
+
+// 2b. visible particles that weren't kept, likewise
+void Depth_Sorter::add_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Depth_Sorter * d = (Depth_Sorter *)user;
+    unsigned int count = 0;
+    for (unsigned int k = begin; k < end; k++){
+        unsigned int i = d->_visible[k];
+        unsigned int key = d->_key_of[i];
+        if (!(key & SORT_KEPT))
+            d->_entries_tmp[begin + count++] = SORT_ENTRY(key & SORT_KEY_MAX, i);
+    }
+    d->_chunk_counts[begin / SORT_CHUNK] = count;
+}
+
+// 2c. a chunk's run from _entries_tmp to its place in _entries,
+//  past _gather_base (so kept entries come first, added ones after)
+void Depth_Sorter::gather_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Depth_Sorter * d = (Depth_Sorter *)user;
+    unsigned int c = begin / SORT_CHUNK;
+    unsigned int offset = d->_chunk_counts[c];
+    unsigned int next = c + 1 < d->_gather_chunks ? d->_chunk_counts[c+1] : d->_gather_total;
+    unsigned int to = d->_gather_base + offset;
+    memcpy(d->_entries + to, d->_entries_tmp + begin, (next - offset)*sizeof(sort_entry_t));
+}
+
+// 2d. insertion-sort the chunk until it's sorted or out of moves
+void Depth_Sorter::insertion_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Depth_Sorter * d = (Depth_Sorter *)user;
+    sort_entry_t * e = d->_entries;
+    unsigned int budget = (end - begin) * SORT_MOVE_BUDGET;
+    unsigned int moves = 0;
+    bool sorted = true;
+    for (unsigned int k = begin + 1; k < end; k++){
+        sort_entry_t x = e[k];
+        unsigned int key = SORT_ENTRY_KEY(x);
+        if (SORT_ENTRY_KEY(e[k-1]) <= key)
+            continue;
+        unsigned int m = k;
+        while (m > begin && SORT_ENTRY_KEY(e[m-1]) > key){
+            e[m] = e[m-1];
+            m--;
+        }
+        e[m] = x;
+        moves += k - m;
+        if (moves > budget){
+            sorted = false;
+            break;
+        }
+    }
+    d->_chunk_sorted[begin / SORT_CHUNK] = sorted ? 1 : 0;
+}
+
+// 3a. high-byte counts per chunk
+void Depth_Sorter::histogram_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Depth_Sorter * d = (Depth_Sorter *)user;
+    unsigned int * hist = d->_chunk_hist + (begin / SORT_CHUNK) * SORT_RADIX;
+    memset(hist, 0, SORT_RADIX*sizeof(unsigned int));
+    for (unsigned int k = begin; k < end; k++)
+        hist[SORT_ENTRY_KEY(d->_entries[k]) >> SORT_RADIX_BITS]++;
+}
+
+// 3a. every entry to the next slot of its high byte, in order within
+//  the chunk, so the sort stays stable
+void Depth_Sorter::scatter_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Depth_Sorter * d = (Depth_Sorter *)user;
+    unsigned int * slot = d->_chunk_hist + (begin / SORT_CHUNK) * SORT_RADIX;
+    for (unsigned int k = begin; k < end; k++){
+        sort_entry_t e = d->_entries[k];
+        d->_entries_tmp[slot[SORT_ENTRY_KEY(e) >> SORT_RADIX_BITS]++] = e;
+    }
+}
+
+// 3b. a counting sort of each high-byte bucket by the low byte, stable,
+//  its indices to the same stretch of the order; `begin` and `end` are
+//  buckets
+void Depth_Sorter::bucket_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Depth_Sorter * d = (Depth_Sorter *)user;
+    unsigned int slot[SORT_RADIX];
+    for (unsigned int b = begin; b < end; b++){
+        unsigned int lo = d->_bucket_start[b], hi = d->_bucket_start[b+1];
+        memset(slot, 0, sizeof(slot));
+        for (unsigned int k = lo; k < hi; k++)
+            slot[SORT_ENTRY_KEY(d->_entries_tmp[k]) & (SORT_RADIX - 1)]++;
+        unsigned int total = lo;
+        for (unsigned int digit = 0; digit < SORT_RADIX; digit++){
+            unsigned int n_d = slot[digit];
+            slot[digit] = total;
+            total += n_d;
+        }
+        for (unsigned int k = lo; k < hi; k++){
+            sort_entry_t e = d->_entries_tmp[k];
+            d->_out[slot[SORT_ENTRY_KEY(e) & (SORT_RADIX - 1)]++] = (unsigned int)e;
+        }
+    }
+}
+
+// 3. already sorted: the particle indices, out of the entries
+void Depth_Sorter::order_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Depth_Sorter * d = (Depth_Sorter *)user;
+    for (unsigned int k = begin; k < end; k++)
+        d->_out[k] = (unsigned int)d->_entries[k];
+}
+
+/* #########################################################################
+
+                    depth_sort_calibrate / particle_sort_benchmark
+        -Both sort the starting swirl for an eye 60 units off to its
+            side.
+        -The calibration scales the best of a few cold sorts on the
+            pool to the budget, starting at SORT_CALIBRATE_MIN
+            particles and doubling while that says it could sort more
+            than twice as many: a particle costs more once the list
+            is out of cache (~11 ns at 256K on one core, ~20 ns at 1M),
+            so it's timed near the count it settles on.
+        -The benchmark goes through 64K, 128K, ... max_n particles and
+            prints the median time of: a cold sort (no last order), a
+            re-sort from the same spot, and a re-sort after the eye
+            turns by a degree.
+        -The swirl starts out as a wedge, so a degree's turn reshuffles
+            depths along the whole list, and step 2 gives up; a moving
+            swirl does the same (and the sorts after that are cold).
+
+   ######################################################################### */
+// Enough of a column-major view-projection for the sorter: w is the
+//  distance along (cos yaw, 0, sin yaw) from (ex, ey, ez)
+static void bench_depth_row( float ex, float ey, float ez, float yaw, float * m ){
+    float fx = cosf(yaw), fz = sinf(yaw);
+    memset(m, 0, 16*sizeof(float));
+    m[0] = m[5] = m[10] = 1.0f;
+    m[3] = fx; m[7] = 0.0f; m[11] = fz;
+    m[15] = -(fx*ex + fz*ez);
+}
+
+// The starting swirl, and a visible list of all of it
+static int bench_swirl( particle_store_t * s, std::vector<unsigned int> & all, unsigned int n ){
+    if (particle_store_alloc(s, n, true, true)){
+        printf("Memory alloc error.\n");
+        return -1;
+    }
+    unsigned long long key = particle_init_key(1);
+    for (unsigned int i = 0; i < n; i++)
+        swirl_init_particle(*s, i, key);
+    all.resize(n);
+    for (unsigned int i = 0; i < n; i++)
+        all[i] = i;
+    return 0;
+}
+
+unsigned int xen_rift::depth_sort_calibrate( Thread_Pool * pool, double budget_ms ){
+    double limit = 0.0;
+    for (unsigned int n = SORT_CALIBRATE_MIN; n <= SORT_CALIBRATE_MAX; n *= 2){
+        particle_store_t s;
+        std::vector<unsigned int> all;
+        if (bench_swirl(&s, all, n))
+            break;
+        Depth_Sorter sorter;
+        double best = DBL_MAX;
+        for (int r = 0; r < SORT_CALIBRATE_REPS; r++){
+            float m[16];
+            bench_depth_row(-60.0f, 30.0f, 10.0f, 0.1f * r, m);
+            sorter.forget();
+            sorter.sort(0, s, 1.0f, m, &all[0], n, pool);
+            best = min(best, sorter.last_sort_ms());
+        }
+        particle_store_free(&s);
+        limit = budget_ms * n / max(best, 1e-3);
+        if (limit < 2.0 * n)
+            break;
+    }
+    return limit < (double)0xFFFFFFF0u ? (unsigned int)limit : 0xFFFFFFF0u;
+}
+
+void xen_rift::particle_sort_benchmark( unsigned int max_n, int threads ){
+    const int reps = 5;
+    if (threads <= 0)
+        threads = Thread_Pool::num_processors();
+    Thread_Pool pool(threads);
+    printf("Particle depth sort, every particle: %d threads\n", threads);
+
+    unsigned int n = 65536;
+    if (n > max_n)
+        n = max_n;
+    while (n <= max_n){
+        particle_store_t s;
+        std::vector<unsigned int> all;
+        if (bench_swirl(&s, all, n))
+            return;
+
+        Depth_Sorter sorter;
+        std::vector<double> cold, still, turned;
+        int still_presorted = 0, turned_presorted = 0;
+        for (int r = 0; r < reps; r++){
+            float m[16];
+            float yaw = 0.1f * r;
+            bench_depth_row(-60.0f, 30.0f, 10.0f, yaw, m);
+            sorter.forget();
+            sorter.sort(0, s, 1.0f, m, &all[0], n, &pool);
+            cold.push_back(sorter.last_sort_ms());
+            sorter.sort(0, s, 1.0f, m, &all[0], n, &pool);
+            still.push_back(sorter.last_sort_ms());
+            still_presorted += sorter.last_presorted() ? 1 : 0;
+            bench_depth_row(-60.0f, 30.0f, 10.0f, yaw + (float)M_PI/180.0f, m);
+            sorter.sort(0, s, 1.0f, m, &all[0], n, &pool);
+            turned.push_back(sorter.last_sort_ms());
+            turned_presorted += sorter.last_presorted() ? 1 : 0;
+        }
+        std::sort(cold.begin(), cold.end());
+        std::sort(still.begin(), still.end());
+        std::sort(turned.begin(), turned.end());
+
+        printf("    %9u particles: %8.3f ms cold  %8.3f ms still (%d/%d presorted)  "
+            "%8.3f ms turned (%d/%d presorted)\n", n, cold[reps/2], still[reps/2], still_presorted, reps,
+            turned[reps/2], turned_presorted, reps);
+        particle_store_free(&s);
+        if (n == max_n)
+            break;
+        n = (n*2 > max_n || n*2 < n) ? max_n : n*2;
+    }
+    printf("    default -sortlimit on this pool (%.1f ms of cold sort): %u particles\n",
+        DEPTH_SORT_BUDGET_MS, depth_sort_calibrate(&pool, DEPTH_SORT_BUDGET_MS));
+}
@@ -0,0 +1,187 @@
+/* #########################################################################
+        particle_sort: back-to-front ordering of each eye's particles
+   Header!
+
+	Alpha-blended points only blend right if they're drawn farthest
+	first. sort() takes an eye's visible list (see particle_cull.h) and
+	orders it by distance along that eye's view axis -- the clip-space
+	w the eye's projection * modelview gives each particle -- farthest
+	first, quantized to 16 bits over the nearest-to-farthest span:
+		1. key every visible particle, going through them in index
+		   order
+		2. start from the eye's order from the last sort: the
+		   particles still visible, in the order they were, then the
+		   newly visible ones; then insertion-sort each chunk of that
+		   in place, giving up on a chunk after a fixed budget of moves
+		   (skipped for a while after it gives up)
+		3. if every chunk finished and the chunks meet in order, that's
+		   the answer; otherwise a stable radix sort: the high byte
+		   first, a per-chunk histogram / scan / scatter over the whole
+		   list, then a counting sort of each high-byte bucket by the
+		   low byte, which stays in cache
+	Step 2 finishes the job when the eye and the particles hold still,
+	but a moving swirl (or a degree's head turn) reorders keys along
+	the whole list, and then it's the radix sort plus the (bounded)
+	insertion pass. So after step 2 gives up, the view's next sorts go
+	straight from step 1 to the radix sort, and only try it again later.
+
+	Every pass is a parallel_for over disjoint chunks; ties keep the
+	starting order, so the result doesn't depend on the thread count.
+
+	The sort is a few ms only up to a point: on one core it's about
+	11 ns a particle cold at 256K, 20 ns at 1M (out of cache), so 1M
+	visible particles is ~20 ms, divided by however well the passes
+	scale over the pool. So the swirl draws
+	an eye unsorted when its list is longer than what the pool sorts in
+	DEPTH_SORT_BUDGET_MS, which depth_sort_calibrate measures at start
+	up (-sortlimit sets a count instead), rather than blow the frame.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  DEPTH_SORT_MAX_PARTICLES: the default -sortlimit
+     agent  20261017  sort_within: the limit check, and which views it skipped
+     agent  20261017  Packed entries, MSD-then-bucket radix; default limit calibrated
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_SORT_H
+#define __XEN_PARTICLE_SORT_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Windows
+#include <windows.h>
+
+#include "particle_store.h"
+#include "particle_cull.h"
+#include "../common/thread_pool.h"
+
+// Longest one eye's sort may take by default: both eyes' come to well
+//  under half a 90 Hz frame
+#define DEPTH_SORT_BUDGET_MS 2.0
+// The -sortlimit that means "what depth_sort_calibrate says"
+#define DEPTH_SORT_AUTO_LIMIT 0xFFFFFFFFu
+
+namespace xen_rift {
+	// A sort list entry: 16-bit key in the high half, index in the low
+	typedef unsigned long long sort_entry_t;
+
+	class Depth_Sorter {
+		public:
+			Depth_Sorter();
+			~Depth_Sorter();
+
+			// Order the `count` particle indices in `visible` farthest
+			// first for view v, whose column-major projection * modelview
+			// is view_proj. Positions are taken as prev + (cur - prev) *
+			// alpha, like the culler does. In parallel on the pool if
+			// there is one; the store must not change meanwhile.
+			void sort( int v, const particle_store_t & s, float alpha, const float * view_proj,
+					   const unsigned int * visible, unsigned int count, Thread_Pool * pool );
+			// sort() if count is at most limit (0: no limit). Either way,
+			// the list to draw view v with: visible itself, unsorted, if
+			// it was over.
+			const unsigned int * sort_within( int v, const particle_store_t & s, float alpha,
+											  const float * view_proj, const unsigned int * visible,
+											  unsigned int count, unsigned int limit, Thread_Pool * pool );
+			// Drop every view's last order (the particles were replaced,
+			// so it means nothing any more)
+			void forget( void );
+
+			// View v's sorted list as of its last sort()
+			unsigned int count( int v ) { return (v >= 0 && v < CULL_MAX_VIEWS) ? _count[v] : 0; }
+			const unsigned int * order( int v ) { return (v >= 0 && v < CULL_MAX_VIEWS) ? _order[v] : NULL; }
+			double last_sort_ms( void ) { return _last_sort_ms; }
+			// Whether the last sort() got away without the radix sort
+			bool last_presorted( void ) { return _last_presorted; }
+			// Whether view v's last sort_within() left it unsorted
+			bool skipped( int v ) { return v >= 0 && v < CULL_MAX_VIEWS && _skipped[v]; }
+
+		protected:
+			void reserve( unsigned int n );
+			void run( unsigned int n, range_func_t fn );
+			// sort() phases; user is the Depth_Sorter
+			static void depth_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void key_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void keep_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void add_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void gather_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void insertion_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void histogram_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void scatter_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void bucket_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void order_range( unsigned int begin, unsigned int end, int worker, void * user );
+			// exclusive scan of _chunk_counts over `chunks` chunks
+			unsigned int scan_chunks( unsigned int chunks );
+
+			unsigned int _capacity;
+			double _last_sort_ms;
+			bool _last_presorted;
+			Thread_Pool * _pool;
+			// whether the current sort goes through step 2
+			bool _presort;
+
+			// per view: last result
+			unsigned int * _order[CULL_MAX_VIEWS];
+			unsigned int _count[CULL_MAX_VIEWS];
+			bool _skipped[CULL_MAX_VIEWS];
+			// sorts left that skip step 2, since it last gave up
+			unsigned int _cold_left[CULL_MAX_VIEWS];
+			// per particle: key from the last sort it was visible in, under
+			// whether that sort kept it from the old order, under the low
+			// 15 bits of that sort's generation
+			unsigned int * _key_of;
+			unsigned int _generation;
+
+			// current sort
+			const particle_store_t * _store;
+			float _alpha;
+			// row of the matrix that gives w
+			float _w[4];
+			const unsigned int * _visible;
+			const unsigned int * _prev;
+			unsigned int _num_prev;
+			// where gather_range puts each chunk's run: past _gather_base,
+			// at the scanned chunk counts, _gather_total in all
+			unsigned int _gather_base;
+			unsigned int _gather_total;
+			unsigned int _gather_chunks;
+			float _depth_min;
+			float _depth_scale;
+			// where the indices go
+			unsigned int * _out;
+			// where each high-byte bucket starts in _entries_tmp, and
+			// past the last one, the list length
+			unsigned int * _bucket_start;
+			// per list entry: key << 32 | particle index, and the other
+			// half of the radix sort's ping-pong; per visible particle,
+			// depths
+			sort_entry_t * _entries;
+			sort_entry_t * _entries_tmp;
+			float * _depth;
+			// per chunk
+			unsigned int * _chunk_counts;
+			unsigned int * _chunk_hist;
+			float * _chunk_min;
+			float * _chunk_max;
+			unsigned char * _chunk_sorted;
+
+		private:
+	};
+
+	// How many particles a cold sort on the pool gets through in
+	// budget_ms, from timing a few of them at counts near that (0 if
+	// it couldn't: no limit)
+	unsigned int depth_sort_calibrate( Thread_Pool * pool, double budget_ms );
+
+	// Time Depth_Sorter::sort over every particle of the starting swirl,
+	// seen from beside it, at doubling particle counts up to max_n on a
+	// pool of `threads` workers: a cold sort, a re-sort from the same
+	// view, and a re-sort after the view turns a degree; then the
+	// default limit depth_sort_calibrate gives that pool.
+	void particle_sort_benchmark( unsigned int max_n, int threads );
+};
+
+#endif //__XEN_PARTICLE_SORT_H
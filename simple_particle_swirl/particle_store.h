@@ -0,0 +1,173 @@
+/* #########################################################################
+        particle_store: structure-of-arrays particle storage
+   Header!
+
+   Particles live in two blocks of separate streams:
+        position block:  [ x ][ y ][ z ][ color ][ prev_x ][ prev_y ][ prev_z ]
+                                                            (this is the VBO)
+        velocity block:  [ vx ][ vy ][ vz ]
+   Each stream is padded out to a multiple of 16 entries, so every
+   stream starts 64-byte aligned if its block does. The color stream
+   is optional and only rewritten when colors actually change; the
+   step itself only touches x/y/z and vx/vy/vz (24 bytes each way per
+   particle, down from the 32 of the old float4 pos + vel layout).
+   The prev streams are also optional: when bound, a multi-step update
+   leaves the position from before its last step in them, so the
+   renderer can interpolate between the two fixed steps it straddles.
+
+   That 25% is as far as a layout change goes. Full-precision state is
+   six floats, so reading and writing it is 48 bytes a particle per
+   step at the least, and a 40% cut from 64 would need 38.4; only a
+   narrower encoding gets there (the compact mode, particle_quant.h).
+   The prev streams put 12 more bytes of writes on interpolated steps.
+   They're in the VBO because the vertex shader reads them, and moving
+   them out wouldn't help: the write is the same wherever they live.
+
+   Everything here is inline and usable from both nvcc and the host
+   compiler, so initCuda, the CUDA kernel and the host backends all
+   go through the same accessors.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Previous-step position streams for render interpolation
+     agent  20261017  Where the step's traffic floor is
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_STORE_H
+#define __XEN_PARTICLE_STORE_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#ifdef __CUDACC__
+	#define XEN_HOST_DEVICE __host__ __device__
+#else
+	#define XEN_HOST_DEVICE
+#endif
+
+namespace xen_rift {
+	// Which stream of the position block, for VBO attribute offsets
+	typedef enum _particle_stream_t {
+		PARTICLE_STREAM_X = 0,
+		PARTICLE_STREAM_Y = 1,
+		PARTICLE_STREAM_Z = 2,
+		PARTICLE_STREAM_COLOR = 3,
+		PARTICLE_STREAM_PREV_X = 4,
+		PARTICLE_STREAM_PREV_Y = 5,
+		PARTICLE_STREAM_PREV_Z = 6
+	} particle_stream_t;
+
+	typedef struct _particle_store_t {
+		unsigned int n;
+		float * x;
+		float * y;
+		float * z;
+		float * vx;
+		float * vy;
+		float * vz;
+		// packed RGBA per particle; NULL if this store doesn't track color
+		unsigned int * color;
+		// position before the last step; NULL if not interpolating
+		float * prev_x;
+		float * prev_y;
+		float * prev_z;
+		// set whenever color has been written but not yet uploaded
+		bool color_dirty;
+	} particle_store_t;
+
+	// Entries per stream, padded so each stream stays 64-byte aligned.
+	XEN_HOST_DEVICE inline size_t particle_store_stride( unsigned int n ){
+		return ((size_t)n + 15) & ~(size_t)15;
+	}
+	// Byte offset of a stream within the position block (and VBO).
+	XEN_HOST_DEVICE inline size_t particle_store_offset( unsigned int n, particle_stream_t which ){
+		return (size_t)which * particle_store_stride(n) * sizeof(float);
+	}
+	// Bytes of x/y/z (what the step writes; prev_x/y/z are the same size)
+	// and of the whole position block.
+	XEN_HOST_DEVICE inline size_t particle_store_xyz_size( unsigned int n ){
+		return 3 * particle_store_stride(n) * sizeof(float);
+	}
+	XEN_HOST_DEVICE inline size_t particle_store_pos_size( unsigned int n ){
+		return 7 * particle_store_stride(n) * sizeof(float);
+	}
+	XEN_HOST_DEVICE inline size_t particle_store_vel_size( unsigned int n ){
+		return 3 * particle_store_stride(n) * sizeof(float);
+	}
+
+	// Point a store's streams into existing position / velocity blocks
+	// (mapped VBO, device allocations, host allocations...).
+	XEN_HOST_DEVICE inline void particle_store_bind( particle_store_t * s, unsigned int n,
+			void * pos_block, void * vel_block, bool with_color, bool with_prev ){
+		size_t stride = particle_store_stride(n);
+		float * p = (float *)pos_block;
+		float * v = (float *)vel_block;
+		s->n = n;
+		s->x = p;
+		s->y = p + stride;
+		s->z = p + 2*stride;
+		s->color = with_color ? (unsigned int *)(p + 3*stride) : NULL;
+		s->prev_x = with_prev ? p + 4*stride : NULL;
+		s->prev_y = with_prev ? p + 5*stride : NULL;
+		s->prev_z = with_prev ? p + 6*stride : NULL;
+		s->vx = v;
+		s->vy = v + stride;
+		s->vz = v + 2*stride;
+	}
+
+	// Host-side allocation of both blocks. Returns -1 if fail, 0 if success.
+	inline int particle_store_alloc( particle_store_t * s, unsigned int n, bool with_color,
+			bool with_prev ){
+		void * pos = _aligned_malloc(particle_store_pos_size(n), 64);
+		void * vel = _aligned_malloc(particle_store_vel_size(n), 64);
+		if (!pos || !vel){
+			_aligned_free(pos);
+			_aligned_free(vel);
+			return -1;
+		}
+		// zero the padding so uploads of whole streams are deterministic
+		memset(pos, 0, particle_store_pos_size(n));
+		memset(vel, 0, particle_store_vel_size(n));
+		particle_store_bind(s, n, pos, vel, with_color, with_prev);
+		s->color_dirty = with_color;
+		return 0;
+	}
+	inline void particle_store_free( particle_store_t * s ){
+		_aligned_free(s->x);
+		_aligned_free(s->vx);
+		memset(s, 0, sizeof(particle_store_t));
+	}
+
+	// Per-particle accessors
+	XEN_HOST_DEVICE inline void particle_set( particle_store_t & s, unsigned int i,
+			float x, float y, float z, float vx, float vy, float vz ){
+		s.x[i] = x; s.y[i] = y; s.z[i] = z;
+		s.vx[i] = vx; s.vy[i] = vy; s.vz[i] = vz;
+	}
+	XEN_HOST_DEVICE inline void particle_get_pos( const particle_store_t & s, unsigned int i,
+			float & x, float & y, float & z ){
+		x = s.x[i]; y = s.y[i]; z = s.z[i];
+	}
+	XEN_HOST_DEVICE inline void particle_get_vel( const particle_store_t & s, unsigned int i,
+			float & vx, float & vy, float & vz ){
+		vx = s.vx[i]; vy = s.vy[i]; vz = s.vz[i];
+	}
+	// Only touches memory if the color actually changed.
+	XEN_HOST_DEVICE inline void particle_set_color( particle_store_t & s, unsigned int i,
+			unsigned int rgba ){
+		if (s.color && s.color[i] != rgba){
+			s.color[i] = rgba;
+			s.color_dirty = true;
+		}
+	}
+	inline unsigned int particle_pack_color( unsigned char r, unsigned char g,
+			unsigned char b, unsigned char a ){
+		return (unsigned int)r | ((unsigned int)g << 8) | ((unsigned int)b << 16) |
+				((unsigned int)a << 24);
+	}
+};
+
+#endif //__XEN_PARTICLE_STORE_H
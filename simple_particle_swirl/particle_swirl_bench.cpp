@@ -0,0 +1,557 @@
+/* #########################################################################
+        particle_swirl_bench: step benchmark suite for the swirl integrator
+
+   Its own executable, with no GL, CUDA, Rift or Hydra: times the host
+   particle step over every combination of
+        particle count      64K, 128K, ... -particles N
+        thread count        1, 2, 4, ... -threads N
+        layout              SoA particle_store, or the old AoS float4
+                            pos + vel
+        instruction set     scalar, SSE, AVX (whatever this CPU has)
+   and reports, per configuration, the median and 99th percentile step
+   time, particles per second, and the effective memory bandwidth --
+   the particle state each step has to read and write (48 bytes per
+   particle for SoA, 64 for AoS), over the median time. The same table
+   goes to a CSV and / or JSON file for comparing runs on the same
+   machine; -label tags every row so runs of different versions can be
+   concatenated.
+
+   Before timing anything, checks that every layout and instruction
+   set gives the same state after a few steps, since the numbers don't
+   mean much otherwise, and reports how far a second of float steps
+   drifts from the same steps done in double (particle_integrate.h).
+
+   The fields are the demo's preset 0, colliders included, with the
+   player standing at the origin; -nocollide drops the colliders, to
+   see what they cost.
+
+   -benchthreads, -benchgrid, -benchnbody, -benchcull, -benchsort,
+   -benchquant, -benchtrail and -benchwarp run one of the swirl's other
+   subsystems' own benchmarks instead of the sweep (first one given
+   wins); -particles and -threads still apply.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Colliders on by default, -nocollide
+     agent  20261017  Float vs double drift report
+     agent  20261017  Reject unknown -simd / -layout and unsafe -label text
+     agent  20261017  Subsystem benchmarks, moved over from the demo
+   ######################################################################### */
+
+#include "simple_particle_swirl_cpu.h"
+#include "particle_init.h"
+#include "spatial_hash.h"
+#include "barnes_hut.h"
+#include "particle_cull.h"
+#include "particle_sort.h"
+#include "particle_quant.h"
+#include "particle_trail.h"
+#include "../common/stereo_warp_cpu.h"
+#include <vector>
+#include <algorithm>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+// Defaults: up to 4M particles, 50 timed steps per configuration
+#define BENCH_MAX_PARTICLES (4096u*1024u)
+#define BENCH_REPS 50
+// Fixed step length, same as the demo's default
+#define BENCH_STEP_MS (1000.0f/120.0f)
+// Where the demo's player's eyes start out
+#define BENCH_EYE_HEIGHT 2.5f
+// Steps of the float vs double drift report: one second of the demo's
+#define BENCH_DRIFT_STEPS 120
+// Subsystem benchmark settings, same as the demo's defaults
+#define BENCH_GRID_CELL_SIZE 0.25f
+#define BENCH_NBODY_THETA 0.7f
+#define BENCH_TRAIL_LENGTH 16
+// Their largest particle counts; N-body and trails are a lot slower
+#define BENCH_SUBSYSTEM_PARTICLES (4096u*1024u)
+#define BENCH_SLOW_PARTICLES (1024u*1024u)
+
+typedef enum _bench_subsystem_t {
+    BENCH_SWEEP = 0,
+    BENCH_THREADS,
+    BENCH_GRID,
+    BENCH_NBODY,
+    BENCH_CULL,
+    BENCH_SORT,
+    BENCH_QUANT,
+    BENCH_TRAIL,
+    BENCH_WARP
+} bench_subsystem_t;
+
+typedef enum _bench_layout_t {
+    BENCH_SOA = 0,
+    BENCH_AOS = 1
+} bench_layout_t;
+
+static const char * layout_name(int layout){
+    return layout == BENCH_AOS ? "aos" : "soa";
+}
+
+// Bytes of particle state one step reads + writes per particle
+static double layout_bytes(int layout){
+    return layout == BENCH_AOS ? 2.0 * 2 * sizeof(swirl_float4_t) : 2.0 * 6 * sizeof(float);
+}
+
+typedef struct _bench_result_t {
+    int layout;
+    swirl_simd_t simd;
+    int threads;
+    unsigned int n;
+    double median_ms;
+    double p99_ms;
+    double mparticles_s;
+    double gbytes_s;
+} bench_result_t;
+
+/* #########################################################################
+
+                                 bench_state
+        -One starting swirl in both layouts, so every configuration
+            starts from (and does) exactly the same work.
+
+   ######################################################################### */
+typedef struct _bench_state_t {
+    particle_store_t soa;
+    swirl_float4_t * pos;
+    swirl_float4_t * vel;
+} bench_state_t;
+
+static int bench_alloc(bench_state_t * b, unsigned int n){
+    b->pos = (swirl_float4_t *)_aligned_malloc(n*sizeof(swirl_float4_t), 64);
+    b->vel = (swirl_float4_t *)_aligned_malloc(n*sizeof(swirl_float4_t), 64);
+    if (!b->pos || !b->vel || particle_store_alloc(&b->soa, n, false, false)){
+        printf("Memory alloc error (%u particles).\n", n);
+        return -1;
+    }
+    return 0;
+}
+
+static void bench_free(bench_state_t * b){
+    particle_store_free(&b->soa);
+    _aligned_free(b->pos);
+    _aligned_free(b->vel);
+}
+
+static void bench_reset(bench_state_t * b, Thread_Pool * pool){
+    particle_store_t & s = b->soa;
+    h_init_swirl_particles(pool, s, particle_init_key(1));
+    for (unsigned int i = 0; i < s.n; i++){
+        b->pos[i].x = s.x[i]; b->pos[i].y = s.y[i]; b->pos[i].z = s.z[i]; b->pos[i].w = 1.0f;
+        b->vel[i].x = s.vx[i]; b->vel[i].y = s.vy[i]; b->vel[i].z = s.vz[i]; b->vel[i].w = 0.0f;
+    }
+}
+
+// One step of the chosen layout on the pool; returns its wall time
+static double bench_step(bench_state_t * b, int layout, swirl_simd_t simd, int substeps,
+        const force_field_list_t & fields, Thread_Pool * pool){
+    if (layout == BENCH_AOS){
+        swirl_aos_job_t job;
+        job.pos = b->pos; job.vel = b->vel; job.n = b->soa.n;
+        job.dt = BENCH_STEP_MS; job.steps = substeps; job.simd = simd; job.fields = fields;
+        h_simple_particle_swirl_aos_async(pool, &job);
+        pool->wait();
+    } else {
+        swirl_job_t job;
+        job.s = &b->soa; job.dt = BENCH_STEP_MS; job.steps = substeps;
+        job.simd = simd; job.fields = fields; job.trail.x = NULL;
+        h_simple_particle_swirl_async(pool, &job);
+        pool->wait();
+    }
+    return pool->last_job_ms();
+}
+
+/* #########################################################################
+
+                                 bench_check
+        -A few steps of every layout / instruction set on an odd-sized
+            swirl (so the scalar tails run too), compared bit for bit
+            against SoA scalar. Return -1 on any mismatch.
+
+   ######################################################################### */
+static int bench_check(swirl_simd_t best, const force_field_list_t & fields, Thread_Pool * pool){
+    const unsigned int n = 100003;
+    const int steps = 4;
+    bench_state_t ref;
+    if (bench_alloc(&ref, n))
+        return -1;
+    bench_reset(&ref, pool);
+    for (int k = 0; k < steps; k++)
+        bench_step(&ref, BENCH_SOA, SWIRL_SIMD_SCALAR, 1, fields, pool);
+
+    int ret = 0;
+    bench_state_t b;
+    if (bench_alloc(&b, n)){
+        bench_free(&ref);
+        return -1;
+    }
+    for (int layout = BENCH_SOA; layout <= BENCH_AOS; layout++)
+        for (int simd = SWIRL_SIMD_SCALAR; simd <= best; simd++){
+            bench_reset(&b, pool);
+            for (int k = 0; k < steps; k++)
+                bench_step(&b, layout, (swirl_simd_t)simd, 1, fields, pool);
+            unsigned int bad = 0;
+            for (unsigned int i = 0; i < n; i++){
+                float x = b.soa.x[i], y = b.soa.y[i], z = b.soa.z[i];
+                float vx = b.soa.vx[i], vy = b.soa.vy[i], vz = b.soa.vz[i];
+                if (layout == BENCH_AOS){
+                    x = b.pos[i].x; y = b.pos[i].y; z = b.pos[i].z;
+                    vx = b.vel[i].x; vy = b.vel[i].y; vz = b.vel[i].z;
+                }
+                if (x != ref.soa.x[i] || y != ref.soa.y[i] || z != ref.soa.z[i] ||
+                    vx != ref.soa.vx[i] || vy != ref.soa.vy[i] || vz != ref.soa.vz[i])
+                    bad++;
+            }
+            if (bad){
+                printf("%s %s disagrees with SoA scalar on %u of %u particles.\n",
+                    layout_name(layout), swirl_simd_name((swirl_simd_t)simd), bad, n);
+                ret = -1;
+            }
+        }
+    bench_free(&b);
+    bench_free(&ref);
+    return ret;
+}
+
+/* #########################################################################
+
+                                 bench_drift
+        -BENCH_DRIFT_STEPS steps of SoA scalar, and the same steps with
+            the math in double, from the same start; prints the largest
+            and mean distance between the two. Informational only --
+            float is what ships.
+
+   ######################################################################### */
+static void bench_drift(const force_field_list_t & fields, Thread_Pool * pool){
+    const unsigned int n = 100003;
+    bench_state_t a, b;
+    if (bench_alloc(&a, n))
+        return;
+    if (bench_alloc(&b, n)){
+        bench_free(&a);
+        return;
+    }
+    bench_reset(&a, pool);
+    bench_reset(&b, pool);
+    for (int k = 0; k < BENCH_DRIFT_STEPS; k++){
+        bench_step(&a, BENCH_SOA, SWIRL_SIMD_SCALAR, 1, fields, pool);
+        h_simple_particle_swirl_reference(b.soa, fields, BENCH_STEP_MS, 1);
+    }
+    double worst = 0.0, total = 0.0;
+    for (unsigned int i = 0; i < n; i++){
+        double dx = (double)a.soa.x[i] - b.soa.x[i];
+        double dy = (double)a.soa.y[i] - b.soa.y[i];
+        double dz = (double)a.soa.z[i] - b.soa.z[i];
+        double d = sqrt(dx*dx + dy*dy + dz*dz);
+        total += d;
+        if (d > worst)
+            worst = d;
+    }
+    printf("Float vs double after %d steps: max %g m, mean %g m over %u particles\n",
+        BENCH_DRIFT_STEPS, worst, total / n, n);
+    bench_free(&b);
+    bench_free(&a);
+}
+
+/* #########################################################################
+
+                               bench_subsystem
+        -Runs one subsystem's own benchmark: up to n particles (0 for
+            its default), on up to `threads` workers (0 for all
+            cores). Returns the exit code.
+
+   ######################################################################### */
+static int bench_subsystem(bench_subsystem_t which, unsigned int n, int threads, float theta,
+                           int trail_length){
+    unsigned int big = n ? n : BENCH_SUBSYSTEM_PARTICLES;
+    unsigned int slow = n ? n : BENCH_SLOW_PARTICLES;
+    switch (which){
+    case BENCH_THREADS:
+        h_particle_swirl_thread_benchmark(big, threads > 0 ? threads : Thread_Pool::num_processors(), 50);
+        return 0;
+    case BENCH_GRID:
+        spatial_hash_benchmark(big, threads, BENCH_GRID_CELL_SIZE);
+        return 0;
+    case BENCH_NBODY:
+        barnes_hut_benchmark(slow, threads, theta);
+        return 0;
+    case BENCH_CULL:
+        particle_cull_benchmark(big, threads);
+        return 0;
+    case BENCH_SORT:
+        particle_sort_benchmark(big, threads);
+        return 0;
+    case BENCH_QUANT:
+        particle_quant_benchmark(big, threads);
+        return 0;
+    case BENCH_TRAIL:
+        particle_trail_benchmark(slow, threads, trail_length);
+        return 0;
+    case BENCH_WARP:
+        // DK1 panel; half, default and double the grid
+        for (int k = 1; k <= 4; k *= 2)
+            distortion_mesh_check(1280, 800, k * DISTORTION_MESH_CELLS_X / 2, k * DISTORTION_MESH_CELLS_Y / 2);
+        return stereo_warp_benchmark(1280, 800, threads) ? 1 : 0;
+    default:
+        return 0;
+    }
+}
+
+/* #########################################################################
+
+                                 write_csv / write_json
+        -One row / object per configuration. Return -1 if the file
+            can't be written, 0 if success.
+
+   ######################################################################### */
+static int write_csv(const char * path, const char * label, int substeps, int reps,
+        const std::vector<bench_result_t> & results){
+    FILE * f = fopen(path, "w");
+    if (!f){
+        printf("Couldn't write %s.\n", path);
+        return -1;
+    }
+    fprintf(f, "label,layout,simd,threads,particles,substeps,reps,median_ms,p99_ms,"
+        "mparticles_per_s,gbytes_per_s\n");
+    for (size_t i = 0; i < results.size(); i++){
+        const bench_result_t & r = results[i];
+        fprintf(f, "%s,%s,%s,%d,%u,%d,%d,%.4f,%.4f,%.2f,%.3f\n", label, layout_name(r.layout),
+            swirl_simd_name(r.simd), r.threads, r.n, substeps, reps, r.median_ms, r.p99_ms,
+            r.mparticles_s, r.gbytes_s);
+    }
+    fclose(f);
+    return 0;
+}
+
+static int write_json(const char * path, const char * label, int substeps, int reps,
+        swirl_simd_t best, const std::vector<bench_result_t> & results){
+    FILE * f = fopen(path, "w");
+    if (!f){
+        printf("Couldn't write %s.\n", path);
+        return -1;
+    }
+    fprintf(f, "{\n  \"label\": \"%s\",\n  \"best_simd\": \"%s\",\n  \"processors\": %d,\n"
+        "  \"step_ms\": %.4f,\n  \"substeps\": %d,\n  \"reps\": %d,\n  \"results\": [\n",
+        label, swirl_simd_name(best), Thread_Pool::num_processors(), BENCH_STEP_MS, substeps, reps);
+    for (size_t i = 0; i < results.size(); i++){
+        const bench_result_t & r = results[i];
+        fprintf(f, "    { \"layout\": \"%s\", \"simd\": \"%s\", \"threads\": %d, \"particles\": %u, "
+            "\"median_ms\": %.4f, \"p99_ms\": %.4f, \"mparticles_per_s\": %.2f, \"gbytes_per_s\": %.3f }%s\n",
+            layout_name(r.layout), swirl_simd_name(r.simd), r.threads, r.n, r.median_ms, r.p99_ms,
+            r.mparticles_s, r.gbytes_s, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return 0;
+}
+
+/* #########################################################################
+
+                                    MAIN
+        -Parses the sweep from the command line, checks the backends
+            agree, then runs every configuration and prints / writes
+            the table.
+
+   ######################################################################### */
+int main(int argc, char* argv[]) {
+    unsigned int max_n = BENCH_MAX_PARTICLES;
+    unsigned int min_n = 65536;
+    int max_threads = 0;
+    int reps = BENCH_REPS;
+    int substeps = 1;
+    int only_layout = -1;
+    int only_simd = -1;
+    const char * csv_path = NULL;
+    const char * json_path = NULL;
+    const char * label = "swirl";
+    bool collide = true;
+    bool particles_set = false;
+    bench_subsystem_t subsystem = BENCH_SWEEP;
+    float theta = BENCH_NBODY_THETA;
+    int trail_length = BENCH_TRAIL_LENGTH;
+    static const char * subsystem_flags[] = { "", "-benchthreads", "-benchgrid", "-benchnbody",
+        "-benchcull", "-benchsort", "-benchquant", "-benchtrail", "-benchwarp" };
+    for (int i = 1; i < argc; i++) {
+        int k = BENCH_THREADS;
+        while (k <= BENCH_WARP && strcmp(argv[i], subsystem_flags[k]) != 0)
+            k++;
+        if (k <= BENCH_WARP){
+            if (subsystem == BENCH_SWEEP)
+                subsystem = (bench_subsystem_t)k;
+            continue;
+        }
+        if (strcmp(argv[i],"-particles") == 0 && i+1 < argc) {
+            max_n = (unsigned int)atof(argv[++i]);
+            particles_set = true; }
+        else if (strcmp(argv[i],"-minparticles") == 0 && i+1 < argc) {
+            min_n = (unsigned int)atof(argv[++i]); }
+        else if (strcmp(argv[i],"-threads") == 0 && i+1 < argc) {
+            max_threads = atoi(argv[++i]); }
+        else if (strcmp(argv[i],"-reps") == 0 && i+1 < argc) {
+            reps = atoi(argv[++i]); }
+        else if (strcmp(argv[i],"-substeps") == 0 && i+1 < argc) {
+            substeps = atoi(argv[++i]); }
+        else if (strcmp(argv[i],"-layout") == 0 && i+1 < argc) {
+            ++i;
+            only_layout = strcmp(argv[i], "aos") == 0 ? BENCH_AOS : (strcmp(argv[i], "soa") == 0 ? BENCH_SOA : -1);
+            if (only_layout < 0){
+                printf("Unknown layout %s (soa or aos).\n", argv[i]);
+                return 1;
+            } }
+        else if (strcmp(argv[i],"-simd") == 0 && i+1 < argc) {
+            ++i;
+            for (int k = SWIRL_SIMD_SCALAR; k <= SWIRL_SIMD_AVX; k++)
+                if (_stricmp(argv[i], swirl_simd_name((swirl_simd_t)k)) == 0)
+                    only_simd = k;
+            if (only_simd < 0){
+                printf("Unknown instruction set %s (scalar, sse or avx).\n", argv[i]);
+                return 1;
+            } }
+        else if (strcmp(argv[i],"-csv") == 0 && i+1 < argc) {
+            csv_path = argv[++i]; }
+        else if (strcmp(argv[i],"-json") == 0 && i+1 < argc) {
+            json_path = argv[++i]; }
+        else if (strcmp(argv[i],"-label") == 0 && i+1 < argc) {
+            label = argv[++i];
+            // goes into CSV fields and JSON strings unescaped
+            for (const char * c = label; *c; c++){
+                if (*c == '"' || *c == '\\' || *c == ',' || (unsigned char)*c < 0x20){
+                    printf("Labels can't have quotes, backslashes, commas or control characters.\n");
+                    return 1;
+                }
+            } }
+        else if (strcmp(argv[i],"-nocollide") == 0) {
+            collide = false; }
+        else if (strcmp(argv[i],"-theta") == 0 && i+1 < argc) {
+            theta = (float)atof(argv[++i]); }
+        else if (strcmp(argv[i],"-trails") == 0 && i+1 < argc) {
+            trail_length = atoi(argv[++i]); }
+        else {
+            printf("Usage:\n");
+            printf("    * -particles N | Largest particle count (default %u).\n", BENCH_MAX_PARTICLES);
+            printf("    * -minparticles N | Smallest particle count; doubles up from there (default 65536).\n");
+            printf("    * -threads N | Most worker threads (default all cores).\n");
+            printf("    * -reps N | Timed steps per configuration (default %d).\n", BENCH_REPS);
+            printf("    * -substeps N | Fused steps per job (default 1).\n");
+            printf("    * -layout soa|aos | Just one layout.\n");
+            printf("    * -simd scalar|sse|avx | Just one instruction set.\n");
+            printf("    * -csv FILE | Write the results as CSV.\n");
+            printf("    * -json FILE | Write the results as JSON.\n");
+            printf("    * -label TEXT | Tag the results (say, with a version; no quotes, backslashes or "
+                "commas); default \"swirl\".\n");
+            printf("    * -nocollide | Step without the ground / player colliders.\n");
+            printf("    * -benchthreads | Time the particle step across thread counts instead.\n");
+            printf("    * -benchgrid | Time spatial hash rebuilds and separation across particle counts instead.\n");
+            printf("    * -benchnbody | Time N-body gravity across particle counts instead (default %u).\n",
+                BENCH_SLOW_PARTICLES);
+            printf("    * -theta X | N-body opening angle (default %.2f).\n", BENCH_NBODY_THETA);
+            printf("    * -benchcull | Time per-eye frustum culling across particle counts instead.\n");
+            printf("    * -benchsort | Time per-eye depth sorting across particle counts instead.\n");
+            printf("    * -benchquant | Time and measure the error of compact particle uploads instead.\n");
+            printf("    * -benchtrail | Time what recording particle trails adds to a step instead "
+                "(default %u).\n", BENCH_SLOW_PARTICLES);
+            printf("    * -trails K | Trail length for -benchtrail (default %d).\n", BENCH_TRAIL_LENGTH);
+            printf("    * -benchwarp | Check the Rift distortion mesh and CPU warp against the per-pixel warp, "
+                "and time the CPU warp instead.\n");
+            return 0;
+        }
+    }
+    if (subsystem != BENCH_SWEEP)
+        return bench_subsystem(subsystem, particles_set ? max_n : 0, max_threads, theta,
+                               trail_length > 0 ? trail_length : BENCH_TRAIL_LENGTH);
+    if (max_threads <= 0)
+        max_threads = Thread_Pool::num_processors();
+    if (reps < 1)
+        reps = 1;
+    if (substeps < 1)
+        substeps = 1;
+    if (min_n < 1)
+        min_n = 1;
+    if (min_n > max_n)
+        min_n = max_n;
+
+    swirl_simd_t best = detect_swirl_simd();
+    if (only_simd > best){
+        printf("This CPU can't run %s.\n", swirl_simd_name((swirl_simd_t)only_simd));
+        return 1;
+    }
+    force_field_list_t fields;
+    force_field_preset(0, &fields);
+    if (!collide){
+        fields.num_colliders = 0;
+        collider_bounds(&fields);
+    }
+    force_field_follow_player(&fields, 0.0f, BENCH_EYE_HEIGHT, 0.0f);
+
+    std::vector<int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2)
+        thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    printf("Particle step benchmark: %s, best %s, %d processors, %d reps, %d steps per job, %d colliders\n",
+        label, swirl_simd_name(best), Thread_Pool::num_processors(), reps, substeps, fields.num_colliders);
+    {
+        Thread_Pool pool(max_threads);
+        if (bench_check(best, fields, &pool)){
+            printf("Backends disagree; not timing them.\n");
+            return 1;
+        }
+        bench_drift(fields, &pool);
+    }
+
+    std::vector<bench_result_t> results;
+    std::vector<double> times(reps);
+    bench_state_t b;
+    unsigned int n = min_n;
+    while (n <= max_n){
+        if (bench_alloc(&b, n))
+            return 1;
+        for (size_t t = 0; t < thread_counts.size(); t++){
+            Thread_Pool pool(thread_counts[t]);
+            for (int layout = BENCH_SOA; layout <= BENCH_AOS; layout++){
+                if (only_layout >= 0 && layout != only_layout)
+                    continue;
+                for (int simd = SWIRL_SIMD_SCALAR; simd <= best; simd++){
+                    if (only_simd >= 0 && simd != only_simd)
+                        continue;
+                    bench_reset(&b, &pool);
+                    // warm up caches / wake the workers
+                    for (int i = 0; i < 3; i++)
+                        bench_step(&b, layout, (swirl_simd_t)simd, substeps, fields, &pool);
+                    for (int i = 0; i < reps; i++)
+                        times[i] = bench_step(&b, layout, (swirl_simd_t)simd, substeps, fields, &pool);
+                    std::sort(times.begin(), times.end());
+
+                    bench_result_t r;
+                    r.layout = layout;
+                    r.simd = (swirl_simd_t)simd;
+                    r.threads = thread_counts[t];
+                    r.n = n;
+                    r.median_ms = times[reps/2];
+                    r.p99_ms = times[(reps - 1) * 99 / 100];
+                    r.mparticles_s = (double)n * substeps / r.median_ms / 1000.0;
+                    r.gbytes_s = layout_bytes(layout) * n / r.median_ms / 1e6;
+                    results.push_back(r);
+                    printf("    %9u particles  %3d threads  %s %-6s: %8.3f ms median  %8.3f ms p99  "
+                        "%8.1f M particles/s  %6.2f GB/s\n", n, r.threads, layout_name(layout),
+                        swirl_simd_name(r.simd), r.median_ms, r.p99_ms, r.mparticles_s, r.gbytes_s);
+                }
+            }
+        }
+        bench_free(&b);
+        if (n == max_n)
+            break;
+        n = (n*2 > max_n || n*2 < n) ? max_n : n*2;
+    }
+
+    int ret = 0;
+    if (csv_path && write_csv(csv_path, label, substeps, reps, results))
+        ret = 1;
+    if (json_path && write_json(json_path, label, substeps, reps, best, results))
+        ret = 1;
+    return ret;
+}
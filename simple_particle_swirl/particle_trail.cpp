@@ -0,0 +1,228 @@
+/* #########################################################################
+        particle_trail: ring buffer of every particle's last few positions
+
+   The ring is one aligned allocation. Slots start 64-byte aligned and
+   so does every stream in them, so a write is aligned _mm_stream_ps
+   all the way through whenever its range starts on a multiple of 4 --
+   which every SWIRL_CHUNK_PARTICLES chunk does.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  claim: the next slot, for a job that writes it later
+   ######################################################################### */
+
+#include "particle_trail.h"
+#include "particle_init.h"
+#include "simple_particle_swirl_cpu.h"
+#include <xmmintrin.h>
+#include <vector>
+#include <algorithm>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+// Particles per parallel chunk of a record() pass
+#define TRAIL_CHUNK 16384
+
+/* #########################################################################
+
+                             particle_trail_write
+        -Scalar up to the first multiple of 4, streaming stores from
+            there, scalar for the last few; fenced so the stores are
+            out before whoever waits on this thread looks.
+
+   ######################################################################### */
+void xen_rift::particle_trail_write( const particle_store_t & s, trail_slot_t slot, unsigned int begin,
+                                     unsigned int end ){
+    unsigned int i = begin;
+    for (; i < end && (i & 3); i++){
+        slot.x[i] = s.x[i]; slot.y[i] = s.y[i]; slot.z[i] = s.z[i];
+    }
+    for (; i + 4 <= end; i += 4){
+        _mm_stream_ps(slot.x + i, _mm_load_ps(s.x + i));
+        _mm_stream_ps(slot.y + i, _mm_load_ps(s.y + i));
+        _mm_stream_ps(slot.z + i, _mm_load_ps(s.z + i));
+    }
+    for (; i < end; i++){
+        slot.x[i] = s.x[i]; slot.y[i] = s.y[i]; slot.z[i] = s.z[i];
+    }
+    _mm_sfence();
+}
+
+Particle_Trail::Particle_Trail( int length ) :
+        _n(0),
+        _ring(NULL),
+        _head(0),
+        _filled(0),
+        _claimed(false),
+        _store(NULL)
+{
+    _length = length < 2 ? 2 : (length > TRAIL_MAX_LENGTH ? TRAIL_MAX_LENGTH : length);
+    memset(&_slot, 0, sizeof(_slot));
+}
+
+Particle_Trail::~Particle_Trail(){
+    _aligned_free(_ring);
+}
+
+int Particle_Trail::resize( unsigned int n ){
+    _aligned_free(_ring);
+    _n = n;
+    _head = 0;
+    _filled = 0;
+    _claimed = false;
+    _ring = (float *)_aligned_malloc(ring_bytes(), 64);
+    if (!_ring){
+        _n = 0;
+        return -1;
+    }
+    // zero the padding, so uploads of whole slots are deterministic
+    memset(_ring, 0, ring_bytes());
+    return 0;
+}
+
+trail_slot_t Particle_Trail::slot( int k ){
+    trail_slot_t t;
+    size_t stride = particle_store_stride(_n);
+    t.x = _ring + k * 3 * stride;
+    t.y = t.x + stride;
+    t.z = t.x + 2 * stride;
+    return t;
+}
+
+void Particle_Trail::advance(){
+    _head = (_head + 1) % _length;
+    if (_filled < _length)
+        _filled++;
+    _claimed = false;
+}
+
+void Particle_Trail::write_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Particle_Trail * t = (Particle_Trail *)user;
+    particle_trail_write(*t->_store, t->_slot, begin, end);
+}
+
+void Particle_Trail::record( const particle_store_t & s, Thread_Pool * pool ){
+    _store = &s;
+    _slot = next_slot();
+    unsigned int n = s.n < _n ? s.n : _n;
+    if (pool)
+        pool->parallel_for(n, TRAIL_CHUNK, write_range, this);
+    else
+        write_range(0, n, 0, this);
+    advance();
+}
+
+/* #########################################################################
+
+                              indices / segment
+        -Segment pattern 0 joins each particle's vertex in one slot to
+            its vertex in the next; pattern 1 joins the last slot's to
+            the first's. The segment `age` steps back runs from slot
+            head - age - 1 to head - age (mod length).
+
+   ######################################################################### */
+void Particle_Trail::indices( unsigned int * out ){
+    const unsigned int sv = slot_vertices();
+    const unsigned int last = (_length - 1) * sv;
+    for (unsigned int i = 0; i < _n; i++){
+        out[2*i] = i;
+        out[2*i + 1] = sv + i;
+        out[2*_n + 2*i] = last + i;
+        out[2*_n + 2*i + 1] = i;
+    }
+}
+
+bool Particle_Trail::segment( int age, unsigned int * first, int * base_vertex ){
+    if (age < 0 || age + 1 >= _filled)
+        return false;
+    int from = (_head - age - 1 + _length) % _length;
+    if (from == _length - 1){
+        *first = 2 * _n;
+        *base_vertex = 0;
+    } else {
+        *first = 0;
+        *base_vertex = from * (int)slot_vertices();
+    }
+    return true;
+}
+
+/* #########################################################################
+
+                           particle_trail_benchmark
+        -Per count, the same starting swirl stepped three ways, medians
+            of `reps` steps each: plain, with the job streaming its
+            chunks into a trail slot, and plain plus a record() pass.
+            The streamed slot adds 12 bytes written per particle to
+            the step's 48 read + written, and no reads; the separate
+            pass reads the 12 bytes back in as well.
+
+   ######################################################################### */
+void xen_rift::particle_trail_benchmark( unsigned int max_n, int threads, int length ){
+    const int reps = 50;
+    const float dt = 1000.0f / 120.0f;
+    if (threads <= 0)
+        threads = Thread_Pool::num_processors();
+    Thread_Pool pool(threads);
+    swirl_simd_t simd = detect_swirl_simd();
+    force_field_list_t fields;
+    force_field_preset(0, &fields);
+    printf("Particle trails: %s, %d threads, %d slots\n", swirl_simd_name(simd), threads, length);
+
+    unsigned int n = 262144;
+    if (n > max_n)
+        n = max_n;
+    std::vector<double> plain(reps), streamed(reps), separate(reps);
+    while (n <= max_n){
+        particle_store_t s;
+        Particle_Trail trail(length);
+        if (particle_store_alloc(&s, n, false, true) || trail.resize(n)){
+            printf("Memory alloc error.\n");
+            return;
+        }
+        h_init_swirl_particles(&pool, s, particle_init_key(1));
+
+        swirl_job_t job;
+        job.s = &s; job.dt = dt; job.steps = 1;
+        job.simd = simd; job.fields = fields;
+        LARGE_INTEGER freq, start, stop;
+        QueryPerformanceFrequency(&freq);
+        for (int i = -3; i < reps; i++){
+            job.trail.x = NULL;
+            h_simple_particle_swirl_async(&pool, &job);
+            pool.wait();
+            if (i >= 0)
+                plain[i] = pool.last_job_ms();
+
+            job.trail = trail.next_slot();
+            h_simple_particle_swirl_async(&pool, &job);
+            pool.wait();
+            trail.advance();
+            if (i >= 0)
+                streamed[i] = pool.last_job_ms();
+
+            job.trail.x = NULL;
+            QueryPerformanceCounter(&start);
+            h_simple_particle_swirl_async(&pool, &job);
+            pool.wait();
+            trail.record(s, &pool);
+            QueryPerformanceCounter(&stop);
+            if (i >= 0)
+                separate[i] = ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+        }
+        std::sort(plain.begin(), plain.end());
+        std::sort(streamed.begin(), streamed.end());
+        std::sort(separate.begin(), separate.end());
+        double pms = plain[reps/2], sms = streamed[reps/2], rms = separate[reps/2];
+        printf("    %9u particles: step %8.3f ms  + streamed slot %8.3f ms (%+5.1f%%)  "
+            "+ record pass %8.3f ms (%+5.1f%%)  ring %7.1f MB\n",
+            n, pms, sms, 100.0 * (sms - pms) / pms, rms, 100.0 * (rms - pms) / pms,
+            trail.ring_bytes() / (1024.0 * 1024.0));
+
+        particle_store_free(&s);
+        if (n == max_n)
+            break;
+        n = (n*4 > max_n || n*4 < n) ? max_n : n*4;
+    }
+}
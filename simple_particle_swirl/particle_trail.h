@@ -0,0 +1,154 @@
+/* #########################################################################
+        particle_trail: ring buffer of every particle's last few positions
+   Header!
+
+	For motion streaks: the last `length` positions of every particle,
+	kept in a ring of `length` history slots. Each slot is laid out like
+	the store's x / y / z -- three streams, each padded to a multiple of
+	16 entries -- so a slot is one contiguous block of 3 * stride floats
+	and the whole ring is length of them back to back:
+		[ slot 0: x | y | z ][ slot 1: x | y | z ] ... [ slot K-1 ]
+	Memory is bounded at length * 12 bytes per particle (plus padding),
+	and nothing is ever moved around: recording a step just overwrites
+	the oldest slot with the current positions, as non-temporal stores
+	(one 4-particle streaming store per stream, so 12 bytes per particle
+	that never pass through the cache), and moves the head onto it. The
+	step job can do that itself, chunk by chunk, right after stepping
+	the chunk (see swirl_job_t::trail), while the positions are still in
+	cache; record() is the same as its own pass over the store.
+
+	Drawing: the whole ring goes into one GL buffer as is. With the x
+	attribute pointed at the ring's start, y one stream in and z two,
+	vertex k * slot_vertices() + i is particle i as of slot k, so a
+	streak segment -- particle i from slot k to slot k + 1 -- is just
+	two vertex indices. indices() builds the two patterns every segment
+	is drawn from: (i, slot_vertices() + i) for every i, drawn with a
+	base vertex of k * slot_vertices() for slots k -> k + 1, and (last
+	slot + i, i) for the segment that wraps around the end of the ring.
+	segment() says which pattern and base vertex give the segment a
+	given number of steps back from the newest, so a streak is drawn a
+	segment age at a time (each can get its own fade) as GL_LINES, and
+	nothing but the newest slot ever has to be uploaded again.
+
+	Particles are tracked by index, so a ring only makes sense while
+	indices stay put: the swirl forgets it whenever the particles are
+	reset, and emitter mode (which repacks the live particles) doesn't
+	keep trails.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  claim: the next slot, for a job that writes it later
+   ######################################################################### */
+
+#ifndef __XEN_PARTICLE_TRAIL_H
+#define __XEN_PARTICLE_TRAIL_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+//Windows
+#include <windows.h>
+
+#include "particle_store.h"
+#include "../common/thread_pool.h"
+
+namespace xen_rift {
+	// Longest ring Particle_Trail takes
+	#define TRAIL_MAX_LENGTH 64
+
+	// One history slot's streams
+	typedef struct _trail_slot_t {
+		float * x;
+		float * y;
+		float * z;
+	} trail_slot_t;
+
+	// Copy particles [begin, end) of s's current positions into slot with
+	// streaming stores (scalar stores for any unaligned ends), fenced
+	// before returning. Fine from several threads on disjoint ranges.
+	void particle_trail_write( const particle_store_t & s, trail_slot_t slot, unsigned int begin,
+							   unsigned int end );
+
+	class Particle_Trail {
+		public:
+			// length is clamped to [2, TRAIL_MAX_LENGTH]
+			Particle_Trail( int length );
+			~Particle_Trail();
+
+			// Room for n particles; forgets the history. Return -1 if
+			// fail, 0 if success.
+			int resize( unsigned int n );
+			// No history yet (the next record is the first)
+			void forget( void ) { _filled = 0; _claimed = false; }
+
+			// The slot the next record goes to (the oldest, once the
+			// ring is full), and marking it written: it becomes the
+			// newest. Between the two, whatever writes the slot owns it.
+			trail_slot_t next_slot( void ) { return slot((_head + 1) % _length); }
+			void advance( void );
+			// next_slot, handed to a job that writes it later: claimed()
+			// says it's out until advance() (or forget / resize)
+			trail_slot_t claim( void ) { _claimed = true; return next_slot(); }
+			bool claimed( void ) { return _claimed; }
+			// next_slot + particle_trail_write of all of s + advance, in
+			// parallel on the pool if there is one
+			void record( const particle_store_t & s, Thread_Pool * pool );
+
+			int length( void ) { return _length; }
+			unsigned int size( void ) { return _n; }
+			// Slots recorded since the last forget, up to length()
+			int filled( void ) { return _filled; }
+			// The newest slot, and slot k's streams
+			int head( void ) { return _head; }
+			trail_slot_t slot( int k );
+
+			// Vertex / byte layout of the ring, for the GL buffer
+			// holding it: floats per stream, vertex indices per slot,
+			// bytes of one slot and of the whole ring, byte offset of
+			// slot k and of stream c (0-2 for x / y / z) within the ring
+			size_t stride( void ) { return particle_store_stride(_n); }
+			unsigned int slot_vertices( void ) { return (unsigned int)(3 * stride()); }
+			size_t slot_bytes( void ) { return 3 * stride() * sizeof(float); }
+			size_t ring_bytes( void ) { return _length * slot_bytes(); }
+			size_t slot_offset( int k ) { return k * slot_bytes(); }
+			size_t stream_offset( int c ) { return c * stride() * sizeof(float); }
+			const float * ring( void ) { return _ring; }
+
+			// The two segment index patterns, 2 * size() indices each,
+			// back to back into out (4 * size() entries)
+			void indices( unsigned int * out );
+			// Segment `age` steps back (0 = from the slot before the
+			// newest to the newest) as the first index into indices()'
+			// output and the base vertex to draw it with; false if the
+			// history doesn't go back that far. Each segment is 2 *
+			// (particles) indices long.
+			bool segment( int age, unsigned int * first, int * base_vertex );
+
+		protected:
+			static void write_range( unsigned int begin, unsigned int end, int worker, void * user );
+
+			int _length;
+			unsigned int _n;
+			float * _ring;
+			int _head;
+			int _filled;
+			bool _claimed;
+
+			// current record()
+			const particle_store_t * _store;
+			trail_slot_t _slot;
+
+		private:
+	};
+
+	// Time the pooled step on `threads` workers at 256K particles and
+	// quadrupling counts up to max_n: on its own, with a trail slot
+	// streamed out by the step job, and with record() as its own pass
+	// after it; print each and the ring's memory at `length` slots.
+	void particle_trail_benchmark( unsigned int max_n, int threads, int length );
+};
+
+#endif //__XEN_PARTICLE_TRAIL_H
@@ -14,6 +14,27 @@
 
    Rev history:
      Gregory Izatt  20130717  Init revision
+     agent  20261017  Barnes-Hut N-body mode
+     agent  20261017  Force-field presets and files
+     agent  20261017  Emitter mode; draw only live particles
+     agent  20261017  Draw each eye's frustum-culled particle list
+     agent  20261017  Depth-sorted particle mode
+     agent  20261017  Headless simulation runs (-headless N)
+     agent  20261017  Compact 16-bit particle state (-compact)
+     agent  20261017  Collider counts in the force-field printouts
+     agent  20261017  Async simulation thread (-asyncsim), sim / frame rates in -stats
+     agent  20261017  Particle motion trails (-trails K, t toggles, -benchtrail)
+     agent  20261017  -benchwarp checks the Rift's distortion mesh
+     agent  20261017  CPU stereo warp: -warpimage, -warpcheck, timed by -benchwarp
+     agent  20261017  Scene recorded once a frame, replayed per eye (-norecord)
+     agent  20261017  Unculled particles drawn through the recording (instanced in F4)
+     agent  20261017  Profiler: -profile zones, frame-time percentiles in -stats
+     agent  20261017  -sortlimit: eyes over it are drawn unsorted
+     agent  20261017  -compact packs float steps for upload, isn't a step mode
+     agent  20261017  -sortlimit defaults to a measured 2 ms of sorting
+     agent  20261017  -separation: the neighbor grid pushes particles apart every step
+     agent  20261017  Subsystem benchmarks moved to particle_swirl_bench; .cu API from simple_particle_swirl_cu.h
+     agent  20261017  -stats counts -norecord's draws
    ######################################################################### */    
 
 #include "Eigen/Dense"
@@ -21,6 +42,12 @@
 
 // Us!
 #include "simple_particle_swirl.h"
+#include "simple_particle_swirl_cu.h"
+#include "simple_particle_swirl_cpu.h"
+#include "force_field.h"
+#include "particle_cull.h"
+#include "particle_sort.h"
+#include "particle_trail.h"
 
 // And a helper player class
 #include "../common/player.h"
@@ -41,7 +68,8 @@ using namespace xen_rift;
 
 typedef enum _get_elapsed_indices{
     GET_ELAPSED_IDLE=0,
-    GET_ELAPSED_FRAMERATE=1
+    GET_ELAPSED_FRAMERATE=1,
+    GET_ELAPSED_STATS=2
 } get_elapsed_indices;
 
 //GLUT:
@@ -53,6 +81,86 @@ double currFrameRate = 0;
 
 // particle vbo
 GLuint vbo[1];
+// and the shader that reads its x / y / z / color streams
+GLuint particle_program;
+GLuint particle_vshader;
+GLuint particle_fshader;
+typedef enum _particle_attribs{
+    PARTICLE_ATTRIB_X=0,
+    PARTICLE_ATTRIB_Y=1,
+    PARTICLE_ATTRIB_Z=2,
+    PARTICLE_ATTRIB_COLOR=3,
+    PARTICLE_ATTRIB_PREV_X=4,
+    PARTICLE_ATTRIB_PREV_Y=5,
+    PARTICLE_ATTRIB_PREV_Z=6
+} particle_attribs;
+GLint particle_alpha_uniform;
+// same, for the compact state's 16-bit streams and box texture
+GLuint particle_quant_program;
+GLuint particle_quant_vshader;
+GLuint particle_quant_fshader;
+GLint particle_quant_alpha_uniform;
+GLint particle_quant_boxes_uniform;
+// and the one drawing trail segments out of the trail ring's x / y / z
+//  streams, in the same slots as the particles'
+GLuint trail_program;
+GLuint trail_vshader;
+GLuint trail_fshader;
+GLint trail_fade_uniform;
+// run the particle step on the host even if there's a CUDA device
+bool force_cpu = false;
+// worker threads for the host particle step (0 = all cores)
+int num_threads = 0;
+// particles to start with; [ and ] halve / double the live count
+unsigned int start_particles = DEFAULT_NUM_PARTICLES;
+// fixed step length (ms) and max steps per frame
+float step_ms = DEFAULT_STEP_MS;
+int max_substeps = DEFAULT_MAX_SUBSTEPS;
+// -seed S: deterministic run; with -steps N, print a state checksum
+//  after N steps and exit
+bool deterministic = false;
+unsigned int det_seed = 0;
+unsigned int det_steps = 0;
+// particle snapshots: start from one, record a series, or replay one
+const char * load_snapshot = NULL;
+const char * record_prefix = NULL;
+unsigned int record_every = 0;
+const char * replay_prefix = NULL;
+// -nbody: mutual gravity between the particles (host backend only)
+bool nbody = false;
+float nbody_theta = DEFAULT_NBODY_THETA;
+// -separation [R]: particles closer than R push apart (host backend only)
+bool separation = false;
+float separation_radius = DEFAULT_SEPARATION_RADIUS;
+// -fields FILE: force fields to start with; f flips through the presets
+const char * fields_file = NULL;
+int field_preset = 0;
+// -emitters: particles with lifetimes, fed by emitters; b sets off a burst
+bool emitters = false;
+// -nocull: draw every particle for both eyes; v toggles culling
+bool culling = true;
+// -depthsort: draw each eye's particles back to front; z toggles it.
+//  -sortlimit N: not for eyes seeing more than N (0: no limit; by
+//  default, what the pool sorts in DEPTH_SORT_BUDGET_MS)
+bool depth_sort = false;
+unsigned int sort_limit = DEPTH_SORT_AUTO_LIMIT;
+// -headless N: just N particle steps, no window, Rift or Hydra
+unsigned int headless_steps = 0;
+// -compact: upload and draw 16-bit particle positions
+bool compact = false;
+// -asyncsim: particle steps on their own thread, decoupled from frames
+bool async_sim = false;
+// -trails K: keep K steps of history per particle and draw it as
+//  streaks; t hides / shows them
+int trail_length = 0;
+bool draw_trails = true;
+// -norecord: issue the scene for each eye instead of recording it once
+bool record_scene = true;
+// -profile: time zones from the start (J toggles / writes them anyway)
+bool profile = false;
+// print particle update timing once a second
+bool show_stats = false;
+unsigned long stats_elapsed = 0;
 
 // ground and sky tex
 GLuint ground_tex;
@@ -82,18 +190,29 @@ Ironman_HUD * hud_manager;
    ######################################################################### */        
 // opengl initialization
 void initOpenGL(int w, int h, void*d);
+// Hand the particle settings from the command line to the swirl
+void configure_particle_swirl();
 //    GLUT display callback -- updates screen
 void glut_display();
 // Helper to set up lighting
-void draw_setup_lighting();
+void draw_setup_lighting(GL_Command_Buffer * cb);
 // Helper to draw the skybox
-void draw_demo_skybox();
+void draw_demo_skybox(GL_Command_Buffer * cb);
 // Helper to draw the demo room itself
-void draw_demo_room();
+void draw_demo_room(GL_Command_Buffer * cb);
 // and shared between eyes rendering core
-void render_core();
+void render_core(GL_Command_Buffer * cb);
+// The per-eye parts of it: this eye's particles, Hydra pointer and HUD
+void draw_particle_list(void * user);
+void draw_hydra_and_hud(void * user);
+// Helper to draw the particles' motion trails, if there are any
+void draw_particle_trails(GL_Command_Buffer * cb);
+// CPU barrel warp of a side-by-side PPM into out, or checked against golden
+int warp_particle_swirl_image(const char * in, const char * out, const char * golden);
 // GLUT idle callback -- launches a CUDA analysis cycle
 void glut_idle();
+// Culling view slot for Rift eye 'l', 'r' or 'n'
+int eye_view_index(char eye);
 //GLUT resize callback
 void resize(int width, int height);
 //Key handlers and mouse handlers; all callbacks for GLUT
@@ -109,12 +228,6 @@ double get_framerate();
 // Return curr time in ms since last call to this func (high res)
 double get_elapsed();
 
-// Set up CUDA; mainly makes and initializes shared buffers
-extern  int initCuda(GLuint * vbo);
-// Call kernel and advance particle swirl in time; pass in player eye pos
-//  to do rough lighting (WIP)
-extern void advance_particle_swirl(GLuint * vbo, float px, float py, float pz);
-
 
 /* #########################################################################
     
@@ -177,6 +290,10 @@ int main(int argc, char* argv[]) {
     //printf("argc = %d, argv[0] = %s, argv[1] = %s\n",argc, argv[0], argv[1]);
     bool use_hydra = true;
     bool verbose = false;
+    bool validate = false;
+    const char * warp_in = NULL;
+    const char * warp_out = NULL;
+    const char * warp_golden = NULL;
     for (int i = 1; i < argc; i++) { //Iterate over argv[] to get the parameters stored inside.
         if (strcmp(argv[i],"-nohydra") == 0) {
             use_hydra = false;
@@ -184,10 +301,135 @@ int main(int argc, char* argv[]) {
         else if (strcmp(argv[i],"-verbose") == 0) {
             verbose = false;
             printf("Verbose printouts.\n"); } 
+        else if (strcmp(argv[i],"-cpu") == 0) {
+            force_cpu = true;
+            printf("Particles on the CPU.\n"); } 
+        else if (strcmp(argv[i],"-validate") == 0) {
+            validate = true;
+            printf("Validating CPU particle backend.\n"); } 
+        else if (strcmp(argv[i],"-threads") == 0 && i+1 < argc) {
+            num_threads = atoi(argv[++i]);
+            printf("%d particle threads.\n", num_threads); } 
+        else if (strcmp(argv[i],"-particles") == 0 && i+1 < argc) {
+            start_particles = (unsigned int)atof(argv[++i]);
+            printf("%u particles.\n", start_particles); } 
+        else if (strcmp(argv[i],"-step") == 0 && i+1 < argc) {
+            step_ms = (float)atof(argv[++i]);
+            printf("%.3f ms particle steps.\n", step_ms); } 
+        else if (strcmp(argv[i],"-substeps") == 0 && i+1 < argc) {
+            max_substeps = atoi(argv[++i]);
+            printf("Up to %d particle steps per frame.\n", max_substeps); } 
+        else if (strcmp(argv[i],"-seed") == 0 && i+1 < argc) {
+            deterministic = true;
+            det_seed = (unsigned int)strtoul(argv[++i], NULL, 0);
+            printf("Deterministic particles, seed %u.\n", det_seed); } 
+        else if (strcmp(argv[i],"-steps") == 0 && i+1 < argc) {
+            det_steps = (unsigned int)strtoul(argv[++i], NULL, 0); } 
+        else if (strcmp(argv[i],"-load") == 0 && i+1 < argc) {
+            load_snapshot = argv[++i]; } 
+        else if (strcmp(argv[i],"-record") == 0 && i+2 < argc) {
+            record_prefix = argv[++i];
+            record_every = (unsigned int)strtoul(argv[++i], NULL, 0);
+            printf("Recording a snapshot every %u steps to %s_*.swirl.\n", record_every,
+                record_prefix); } 
+        else if (strcmp(argv[i],"-replay") == 0 && i+1 < argc) {
+            replay_prefix = argv[++i];
+            printf("Replaying %s_*.swirl.\n", replay_prefix); } 
+        else if (strcmp(argv[i],"-nbody") == 0) {
+            nbody = true;
+            printf("N-body particle gravity.\n"); } 
+        else if (strcmp(argv[i],"-theta") == 0 && i+1 < argc) {
+            nbody_theta = (float)atof(argv[++i]); } 
+        else if (strcmp(argv[i],"-separation") == 0) {
+            separation = true;
+            if (i+1 < argc && argv[i+1][0] >= '0' && argv[i+1][0] <= '9')
+                separation_radius = (float)atof(argv[++i]);
+            printf("Particle separation, radius %.3f.\n", separation_radius); } 
+        else if (strcmp(argv[i],"-emitters") == 0) {
+            emitters = true;
+            printf("Particle emitters.\n"); } 
+        else if (strcmp(argv[i],"-nocull") == 0) {
+            culling = false;
+            printf("No particle culling.\n"); } 
+        else if (strcmp(argv[i],"-depthsort") == 0) {
+            depth_sort = true;
+            printf("Depth-sorted particles.\n"); } 
+        else if (strcmp(argv[i],"-sortlimit") == 0 && i+1 < argc) {
+            sort_limit = (unsigned int)atof(argv[++i]); } 
+        else if (strcmp(argv[i],"-fields") == 0 && i+1 < argc) {
+            fields_file = argv[++i]; } 
+        else if (strcmp(argv[i],"-warpimage") == 0 && i+2 < argc) {
+            warp_in = argv[++i];
+            warp_out = argv[++i]; } 
+        else if (strcmp(argv[i],"-warpcheck") == 0 && i+2 < argc) {
+            warp_in = argv[++i];
+            warp_golden = argv[++i]; } 
+        else if (strcmp(argv[i],"-trails") == 0) {
+            trail_length = DEFAULT_TRAIL_LENGTH;
+            if (i+1 < argc && argv[i+1][0] >= '0' && argv[i+1][0] <= '9')
+                trail_length = atoi(argv[++i]);
+            printf("Particle trails, %d steps.\n", trail_length); } 
+        else if (strcmp(argv[i],"-compact") == 0) {
+            compact = true;
+            printf("Compact particle state.\n"); } 
+        else if (strcmp(argv[i],"-asyncsim") == 0) {
+            async_sim = true;
+            printf("Particle simulation on its own thread.\n"); } 
+        else if (strcmp(argv[i],"-headless") == 0 && i+1 < argc) {
+            headless_steps = (unsigned int)atof(argv[++i]);
+            printf("Headless: %u particle steps.\n", headless_steps); } 
+        else if (strcmp(argv[i],"-norecord") == 0) {
+            record_scene = false;
+            printf("Scene drawn per eye, not recorded.\n"); } 
+        else if (strcmp(argv[i],"-stats") == 0) {
+            show_stats = true; } 
+        else if (strcmp(argv[i],"-profile") == 0) {
+            profile = true;
+            printf("Profiler zones on.\n"); } 
         else {
             printf("Usage:\n");
             printf("    * -nohydra | Don't wait for a Razer Hydra to show up.\n");
             printf("    * -verbose | Verbose printouts system-wide.\n");
+            printf("    * -cpu | Run the particle step on the CPU even with a CUDA device.\n");
+            printf("    * -validate | Check the CPU particle step against CUDA and exit.\n");
+            printf("    * -threads N | Worker threads for the CPU particle step (0 = all cores).\n");
+            printf("    * -particles N | Start with N particles (default %u; 5e6 style is fine).\n",
+                DEFAULT_NUM_PARTICLES);
+            printf("    * -step MS | Fixed particle step length (default %.3f ms).\n", DEFAULT_STEP_MS);
+            printf("    * -substeps N | Max particle steps per frame (default %d).\n",
+                DEFAULT_MAX_SUBSTEPS);
+            printf("    * -seed S | Deterministic particles: seeded start, -substeps steps every frame.\n");
+            printf("    * -steps N | With -seed, print a particle state checksum after N steps and exit.\n");
+            printf("    * -load FILE | Start from a particle snapshot (o saves one to %s).\n",
+                SNAPSHOT_FILE);
+            printf("    * -record PREFIX N | Save a snapshot to PREFIX_000000.swirl, ... every N steps.\n");
+            printf("    * -replay PREFIX | Play back a recorded snapshot series instead of simulating.\n");
+            printf("    * -nbody | Particles also attract each other (Barnes-Hut, CPU only).\n");
+            printf("    * -theta X | N-body opening angle (default %.2f; smaller is slower, more exact).\n",
+                DEFAULT_NBODY_THETA);
+            printf("    * -separation [R] | Particles closer than R push each other apart (default %.2f; a\n"
+                   "        neighbor grid rebuilt every step, CPU only).\n", DEFAULT_SEPARATION_RADIUS);
+            printf("    * -emitters | Particles live 2-12 s; emitters replace them (b for a burst; CPU only).\n");
+            printf("    * -nocull | Draw every particle for both eyes (v toggles culling; CPU only).\n");
+            printf("    * -depthsort | Draw each eye's particles back to front (z toggles; needs culling).\n");
+            printf("    * -sortlimit N | Don't sort an eye that sees more than N particles (default: what the\n"
+                   "        threads sort in %.1f ms, timed at start up; ~11-20 ns a particle on one core). 0 sorts\n"
+                   "        every eye.\n", DEPTH_SORT_BUDGET_MS);
+            printf("    * -compact | Upload and draw 16-bit particle positions; the step stays float, and\n"
+                   "        packing roughly doubles its time (CPU only).\n");
+            printf("    * -asyncsim | Step particles on their own thread, apart from frames (CPU only, no culling).\n");
+            printf("    * -trails [K] | Draw each particle's last K steps as a streak (default %d; t toggles; "
+                "CPU only, no emitters).\n", DEFAULT_TRAIL_LENGTH);
+            printf("    * -fields FILE | Force fields to start with (f flips through the presets).\n");
+            printf("    * -warpimage IN OUT | Barrel-warp a side-by-side PPM on the CPU into OUT and exit.\n");
+            printf("    * -warpcheck IN GOLDEN | Warp IN on the CPU, compare to GOLDEN (PPMs), exit 1 if they differ.\n");
+            printf("    * -headless N | Run N particle steps with no window or devices, print timing, exit.\n");
+            printf("    * -norecord | Issue the scene to GL for each eye instead of recording it once a frame "
+                "and replaying it (X dumps a recorded frame).\n");
+            printf("    * -stats | Print particle update time (and sim / frame rates, frame-time "
+                "percentiles) once a second.\n");
+            printf("    * -profile | Time profiler zones from the start, per zone in -stats "
+                "(J starts them / writes profile_trace.json).\n");
             return 0;
         }
     }
@@ -197,6 +439,27 @@ int main(int argc, char* argv[]) {
     // set up timer
     if (init_get_elapsed())
         exit(1);
+    if (profiler_init(profile))
+        exit(1);
+
+    // the CPU warp of a captured frame, with the default (DK1) lens
+    if (warp_in)
+        return warp_particle_swirl_image(warp_in, warp_out, warp_golden);
+    // the simulation by itself: CPU backend, no GL, Rift or Hydra
+    if (headless_steps){
+        configure_particle_swirl();
+        set_particle_swirl_headless(true);
+        if (initCuda(vbo, true, num_threads, start_particles, load_snapshot))
+            return 1;
+        if (record_prefix)
+            set_particle_swirl_recording(record_prefix, record_every);
+        if (run_particle_swirl_headless(headless_steps))
+            return 1;
+        if (deterministic)
+            printf("Seed %u, %u particles, %u steps of %.3f ms: checksum %016llx\n", det_seed,
+                get_particle_count(), particle_swirl_steps(), step_ms, particle_swirl_checksum());
+        return 0;
+    }
 
     /*
     pManager = *DeviceManager::Create();
@@ -219,6 +482,9 @@ int main(int argc, char* argv[]) {
     //Go get openGL set up / get the critical glob. variables set up
     initOpenGL(1280, 720, NULL);
 
+    if (validate)
+        return validate_particle_swirl(vbo) ? 1 : 0;
+
     //Gotta register our callbacks
     glutIdleFunc( glut_idle );
     glutDisplayFunc( glut_display );
@@ -236,6 +502,7 @@ int main(int argc, char* argv[]) {
     player_manager = new Player(zeropos, zerorot, 2.5, 5.0, 4.0, 20.0, 0.95);
     //Rift
     rift_manager = new Rift(1280, 720, true);
+    rift_manager->set_scene_recording(record_scene);
     hydra_manager = new Hydra(use_hydra, verbose);
     hud_manager = new Ironman_HUD( 0.0, 0.95, 0.5, 0.4, 0.5 );
     hud_manager->add_textbox(std::string("P_Left!"), Eigen::Vector3f(-0.3f, -0.3f, -0.2f), 
@@ -251,6 +518,55 @@ int main(int argc, char* argv[]) {
     return(1);
 }
 
+/* #########################################################################
+    
+                          warp_particle_swirl_image
+                                            
+        -What the Rift's warp pass would make of a frame, with no GL:
+            for capturing headless, or holding a known input to a
+            golden output. Exact match only; the reference is
+            deterministic, so any difference is a change.
+        
+   ######################################################################### */
+int warp_particle_swirl_image(const char * in, const char * out, const char * golden) {
+    rgb_image_t src, warped, expect;
+    if (rgb_image_read_ppm(in, &src))
+        return 1;
+    if (rgb_image_alloc(&warped, src.width, src.height)){
+        printf("Memory alloc error.\n");
+        rgb_image_free(&src);
+        return 1;
+    }
+    distortion_params_t p;
+    distortion_params_default(&p);
+    Thread_Pool pool(num_threads);
+    stereo_warp_cpu(p, src, &warped, &pool);
+    rgb_image_free(&src);
+
+    int ret = 0;
+    if (out){
+        ret = rgb_image_write_ppm(out, warped) ? 1 : 0;
+        if (!ret)
+            printf("Warped %s into %s.\n", in, out);
+    } else if (rgb_image_read_ppm(golden, &expect)){
+        ret = 1;
+    } else {
+        warp_diff_t d;
+        if (stereo_warp_compare(warped, expect, 0, &d)){
+            ret = 1;
+        } else if (d.over){
+            printf("Warp of %s doesn't match %s: %u pixels differ, max diff %d, mean %.4f\n",
+                in, golden, d.over, d.max_diff, d.mean_diff);
+            ret = 1;
+        } else {
+            printf("Warp of %s matches %s.\n", in, golden);
+        }
+        rgb_image_free(&expect);
+    }
+    rgb_image_free(&warped);
+    return ret;
+}
+
 
 /* #########################################################################
     
@@ -332,7 +648,63 @@ void initOpenGL(int w, int h, void*d = NULL) {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  
     
     // Set up CUDA
-    initCuda(vbo);
+    configure_particle_swirl();
+    set_particle_swirl_culling(culling);
+    set_particle_swirl_depth_sort(depth_sort);
+    set_particle_swirl_sort_limit(sort_limit);
+    if (replay_prefix)
+        set_particle_swirl_replay(replay_prefix);
+    initCuda(vbo, force_cpu, num_threads, start_particles, load_snapshot);
+    if (record_prefix)
+        set_particle_swirl_recording(record_prefix, record_every);
+
+    // Particle shader; attribute slots match the particle store streams
+    particle_program = glCreateProgram();
+    load_shaders("../shaders/particle.vert", &particle_vshader,
+                "../shaders/rift_frag_shader.frag", &particle_fshader);
+    glAttachShader(particle_program, particle_vshader);
+    glAttachShader(particle_program, particle_fshader);
+    glBindAttribLocation(particle_program, PARTICLE_ATTRIB_X, "px");
+    glBindAttribLocation(particle_program, PARTICLE_ATTRIB_Y, "py");
+    glBindAttribLocation(particle_program, PARTICLE_ATTRIB_Z, "pz");
+    glBindAttribLocation(particle_program, PARTICLE_ATTRIB_COLOR, "color");
+    glBindAttribLocation(particle_program, PARTICLE_ATTRIB_PREV_X, "prev_px");
+    glBindAttribLocation(particle_program, PARTICLE_ATTRIB_PREV_Y, "prev_py");
+    glBindAttribLocation(particle_program, PARTICLE_ATTRIB_PREV_Z, "prev_pz");
+    glLinkProgram(particle_program);
+    particle_alpha_uniform = glGetUniformLocation(particle_program, "alpha");
+    // and its compact twin, same slots
+    if (particle_swirl_compact()){
+        particle_quant_program = glCreateProgram();
+        load_shaders("../shaders/particle_quant.vert", &particle_quant_vshader,
+                    "../shaders/rift_frag_shader.frag", &particle_quant_fshader);
+        glAttachShader(particle_quant_program, particle_quant_vshader);
+        glAttachShader(particle_quant_program, particle_quant_fshader);
+        glBindAttribLocation(particle_quant_program, PARTICLE_ATTRIB_X, "px");
+        glBindAttribLocation(particle_quant_program, PARTICLE_ATTRIB_Y, "py");
+        glBindAttribLocation(particle_quant_program, PARTICLE_ATTRIB_Z, "pz");
+        glBindAttribLocation(particle_quant_program, PARTICLE_ATTRIB_COLOR, "color");
+        glBindAttribLocation(particle_quant_program, PARTICLE_ATTRIB_PREV_X, "prev_px");
+        glBindAttribLocation(particle_quant_program, PARTICLE_ATTRIB_PREV_Y, "prev_py");
+        glBindAttribLocation(particle_quant_program, PARTICLE_ATTRIB_PREV_Z, "prev_pz");
+        glLinkProgram(particle_quant_program);
+        particle_quant_alpha_uniform = glGetUniformLocation(particle_quant_program, "alpha");
+        particle_quant_boxes_uniform = glGetUniformLocation(particle_quant_program, "boxes");
+    }
+    // and the trails', if there are any
+    GLuint trail_vbo, trail_ibo;
+    if (particle_swirl_trail(&trail_vbo, &trail_ibo)){
+        trail_program = glCreateProgram();
+        load_shaders("../shaders/trail.vert", &trail_vshader,
+                    "../shaders/rift_frag_shader.frag", &trail_fshader);
+        glAttachShader(trail_program, trail_vshader);
+        glAttachShader(trail_program, trail_fshader);
+        glBindAttribLocation(trail_program, PARTICLE_ATTRIB_X, "px");
+        glBindAttribLocation(trail_program, PARTICLE_ATTRIB_Y, "py");
+        glBindAttribLocation(trail_program, PARTICLE_ATTRIB_Z, "pz");
+        glLinkProgram(trail_program);
+        trail_fade_uniform = glGetUniformLocation(trail_program, "fade");
+    }
 
     //store our screen sizing information
     screenX = glutGet(GLUT_WINDOW_WIDTH);
@@ -350,6 +722,40 @@ void resize(int width, int height){
 }
 
 
+/* #########################################################################
+    
+                          configure_particle_swirl
+        -Step, seed, N-body, emitter and force-field settings from the
+            command line, for initCuda to pick up; shared by the
+            windowed and headless paths.
+
+   ######################################################################### */
+void configure_particle_swirl() {
+    set_particle_swirl_timestep(step_ms, max_substeps);
+    if (deterministic)
+        set_particle_swirl_deterministic(det_seed, det_steps);
+    if (nbody)
+        set_particle_swirl_nbody(true, nbody_theta);
+    if (separation)
+        set_particle_swirl_separation(true, separation_radius);
+    if (emitters)
+        set_particle_swirl_emitters(true);
+    if (compact)
+        set_particle_swirl_compact(true);
+    if (async_sim)
+        set_particle_swirl_async(true);
+    if (trail_length > 0)
+        set_particle_swirl_trails(trail_length);
+    if (fields_file){
+        force_field_list_t fields;
+        if (load_force_fields(fields_file, &fields) == 0){
+            set_particle_swirl_fields(&fields);
+            printf("%d force fields and %d colliders from %s.\n", fields.count, fields.num_colliders,
+                fields_file);
+        }
+    }
+}
+
 /* #########################################################################
     
                                 glut_display
@@ -380,7 +786,7 @@ void glut_display(){
     Vector3f curr_ro_vec(curr_offset_rpy.y(), curr_offset_rpy.x(), curr_offset_rpy.z());
     curr_ro_vec = Vector3f();
     // Go do Rift rendering! not using eye offset
-    rift_manager->render(curr_t_vec, curr_r_vec+curr_ro_vec, curr_o_vec, false, render_core);
+    rift_manager->render_recorded(curr_t_vec, curr_r_vec+curr_ro_vec, curr_o_vec, false, render_core);
 
     // free vbo for CUDA
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -393,9 +799,43 @@ void glut_display(){
 
     //output useful framerate and status info:
     //printf ("framerate: %3.1f / %4.1f\n", curr, currFrameRate);
+    if (show_stats){
+        stats_elapsed += get_elapsed(GET_ELAPSED_STATS);
+        if (stats_elapsed >= 1000){
+            printf("particle update: %.3f ms, %u / %u particles live\n", particle_swirl_update_ms(),
+                get_live_particle_count(), get_particle_count());
+            const char eyes[CULL_MAX_VIEWS] = { 'l', 'r', 'n' };
+            for (int v = 0; v < CULL_MAX_VIEWS; v++){
+                GLuint ibo;
+                unsigned int drawn;
+                if (particle_swirl_draw_list(v, &ibo, &drawn))
+                    printf("particle cull: %.3f ms, eye %c draws %u\n", particle_swirl_cull_ms(),
+                        eyes[v], drawn);
+            }
+            if (get_particle_swirl_depth_sort())
+                printf("particle depth sort: %.3f ms (last eye)%s\n", particle_swirl_sort_ms(),
+                    particle_swirl_sort_skipped() ? ", eyes over -sortlimit drawn unsorted" : "");
+            double steps_per_s, states_per_s;
+            GL_Command_Buffer & scene = rift_manager->scene_commands();
+            if (rift_manager->scene_recording())
+                printf("scene submit: %.3f ms, %u draws %s (recorded once: %u commands, %u draws, "
+                    "%u vertices)\n", rift_manager->scene_submit_ms(), rift_manager->scene_draws(),
+                    rift_manager->single_pass() ? "single-pass" : "multipass", scene.num_commands(),
+                    scene.num_draws(), scene.num_vertices());
+            else
+                printf("scene submit: %.3f ms, %u draws (issued per eye)\n", rift_manager->scene_submit_ms(),
+                    rift_manager->scene_draws());
+            if (particle_swirl_sim_rates(&steps_per_s, &states_per_s))
+                printf("particle sim: %.1f steps/s in %.1f states/s; rendering %.1f frames/s\n",
+                    steps_per_s, states_per_s, currFrameRate);
+            profiler_print_stats();
+            stats_elapsed = 0;
+        }
+    }
     // frame was rendered, give the player handler a tick
 
     totalFrames++;
+    profiler_frame();
 }
 
 /* #########################################################################
@@ -404,20 +844,20 @@ void glut_display(){
                                             
         -Helper to setup demo lighting each frame.
    ######################################################################### */
-void draw_setup_lighting(){
-    glDisable(GL_LIGHT0);
+void draw_setup_lighting(GL_Command_Buffer * cb){
+    cb->disable(GL_LIGHT0);
     //Define lighting
     GLfloat amb[]= { 0.7f, 0.7f, 0.8f, 1.0f };
     GLfloat diff[]= { 0.8f, 0.8f, 1.0f, 1.0f };
     GLfloat spec[]= { 0.1f, 0.1f, 0.1f, 1.0f };
     GLfloat lightpos[]= { 10.0f, 5.0f, 10.0f, 1.0f };
     GLfloat linearatten[] = {0.001f};
-    glLightfv(GL_LIGHT1, GL_AMBIENT, amb);
-    glLightfv(GL_LIGHT1, GL_DIFFUSE, diff);
-    glLightfv(GL_LIGHT1, GL_SPECULAR, spec);
-    glLightfv(GL_LIGHT1, GL_POSITION, lightpos);
-    glLightfv(GL_LIGHT1, GL_LINEAR_ATTENUATION, linearatten);
-    glEnable(GL_LIGHT1);
+    cb->light(GL_LIGHT1, GL_AMBIENT, amb);
+    cb->light(GL_LIGHT1, GL_DIFFUSE, diff);
+    cb->light(GL_LIGHT1, GL_SPECULAR, spec);
+    cb->light(GL_LIGHT1, GL_POSITION, lightpos);
+    cb->light(GL_LIGHT1, GL_LINEAR_ATTENUATION, linearatten);
+    cb->enable(GL_LIGHT1);
 }
 
 /* #########################################################################
@@ -429,11 +869,11 @@ void draw_setup_lighting(){
             http://stackoverflow.com/questions/2859722/
             opengl-how-can-i-put-the-skybox-in-the-infinity
    ######################################################################### */
-void draw_demo_skybox(){
-    glPushMatrix();
-    glEnable(GL_TEXTURE_2D);
-    glDisable(GL_LIGHTING);
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+void draw_demo_skybox(GL_Command_Buffer * cb){
+    cb->push_matrix();
+    cb->enable(GL_TEXTURE_2D);
+    cb->disable(GL_LIGHTING);
+    cb->tex_env(GL_REPLACE);
 
     float cxl = -500.0;
     float cxu = 500.0;
@@ -443,85 +883,85 @@ void draw_demo_skybox(){
     float czu = 500.0;
 
     // ceiling (-y)
-    glBindTexture(GL_TEXTURE_2D, sky_tex[3]);
-    glBegin(GL_QUADS);
-    glTexCoord2f (0., 0.);
-    glVertex3f(cxl,cyl,czl);
-    glTexCoord2f (1., 0.);
-    glVertex3f(cxu,cyl,czl);
-    glTexCoord2f (1., 1.);
-    glVertex3f(cxu,cyl,czu);
-    glTexCoord2f (0., 1.);
-    glVertex3f(cxl,cyl,czu);
-    glEnd();
+    cb->bind_texture(GL_TEXTURE_2D, sky_tex[3]);
+    cb->begin(GL_QUADS);
+    cb->tex_coord(0., 0.);
+    cb->vertex(cxl,cyl,czl);
+    cb->tex_coord(1., 0.);
+    cb->vertex(cxu,cyl,czl);
+    cb->tex_coord(1., 1.);
+    cb->vertex(cxu,cyl,czu);
+    cb->tex_coord(0., 1.);
+    cb->vertex(cxl,cyl,czu);
+    cb->end();
 
     // ceiling (+y)
-    glBindTexture(GL_TEXTURE_2D, sky_tex[2]);
-    glBegin(GL_QUADS);
-    glTexCoord2f (0., 1.);
-    glVertex3f(cxl,cyu,czl);
-    glTexCoord2f (1., 1.);
-    glVertex3f(cxu,cyu,czl);
-    glTexCoord2f (1., 0.);
-    glVertex3f(cxu,cyu,czu);
-    glTexCoord2f (0., 0.);
-    glVertex3f(cxl,cyu,czu);
-    glEnd();
+    cb->bind_texture(GL_TEXTURE_2D, sky_tex[2]);
+    cb->begin(GL_QUADS);
+    cb->tex_coord(0., 1.);
+    cb->vertex(cxl,cyu,czl);
+    cb->tex_coord(1., 1.);
+    cb->vertex(cxu,cyu,czl);
+    cb->tex_coord(1., 0.);
+    cb->vertex(cxu,cyu,czu);
+    cb->tex_coord(0., 0.);
+    cb->vertex(cxl,cyu,czu);
+    cb->end();
 
     // -x wall
-    glBindTexture(GL_TEXTURE_2D, sky_tex[1]);
-    glBegin(GL_QUADS);
-    glTexCoord2f (0., 0.);
-    glVertex3f(cxl,cyu,czu);
-    glTexCoord2f (1., 0.);
-    glVertex3f(cxl,cyu,czl);
-    glTexCoord2f (1., 1.);
-    glVertex3f(cxl,cyl,czl);
-    glTexCoord2f (0., 1.);
-    glVertex3f(cxl,cyl,czu);
-    glEnd();
+    cb->bind_texture(GL_TEXTURE_2D, sky_tex[1]);
+    cb->begin(GL_QUADS);
+    cb->tex_coord(0., 0.);
+    cb->vertex(cxl,cyu,czu);
+    cb->tex_coord(1., 0.);
+    cb->vertex(cxl,cyu,czl);
+    cb->tex_coord(1., 1.);
+    cb->vertex(cxl,cyl,czl);
+    cb->tex_coord(0., 1.);
+    cb->vertex(cxl,cyl,czu);
+    cb->end();
     
     // +x wall
-    glBindTexture(GL_TEXTURE_2D, sky_tex[0]);
-    glBegin(GL_QUADS);
-    glTexCoord2f (0., 1.);
-    glVertex3f(cxu,cyl,czl);
-    glTexCoord2f (1., 1.);
-    glVertex3f(cxu,cyl,czu);
-    glTexCoord2f (1., 0.);
-    glVertex3f(cxu,cyu,czu);
-    glTexCoord2f (0., 0.);
-    glVertex3f(cxu,cyu,czl);
-    glEnd();
+    cb->bind_texture(GL_TEXTURE_2D, sky_tex[0]);
+    cb->begin(GL_QUADS);
+    cb->tex_coord(0., 1.);
+    cb->vertex(cxu,cyl,czl);
+    cb->tex_coord(1., 1.);
+    cb->vertex(cxu,cyl,czu);
+    cb->tex_coord(1., 0.);
+    cb->vertex(cxu,cyu,czu);
+    cb->tex_coord(0., 0.);
+    cb->vertex(cxu,cyu,czl);
+    cb->end();
 
     // -z wall
-    glBindTexture(GL_TEXTURE_2D, sky_tex[4]);
-    glBegin(GL_QUADS);
-    glTexCoord2f (0., 0.);
-    glVertex3f(cxl,cyu,czl);
-    glTexCoord2f (1., 0.);
-    glVertex3f(cxu,cyu,czl);
-    glTexCoord2f (1., 1.);
-    glVertex3f(cxu,cyl,czl);
-    glTexCoord2f (0., 1.);
-    glVertex3f(cxl,cyl,czl);
-    glEnd();
+    cb->bind_texture(GL_TEXTURE_2D, sky_tex[4]);
+    cb->begin(GL_QUADS);
+    cb->tex_coord(0., 0.);
+    cb->vertex(cxl,cyu,czl);
+    cb->tex_coord(1., 0.);
+    cb->vertex(cxu,cyu,czl);
+    cb->tex_coord(1., 1.);
+    cb->vertex(cxu,cyl,czl);
+    cb->tex_coord(0., 1.);
+    cb->vertex(cxl,cyl,czl);
+    cb->end();
     // +z wall
-    glBindTexture(GL_TEXTURE_2D, sky_tex[5]);
-    glBegin(GL_QUADS);
-    glTexCoord2f (0., 0.);
-    glVertex3f(cxu,cyu,czu);
-    glTexCoord2f (0., 1.);
-    glVertex3f(cxu,cyl,czu);
-    glTexCoord2f (1., 1.);
-    glVertex3f(cxl,cyl,czu);
-    glTexCoord2f (1., 0.);
-    glVertex3f(cxl,cyu,czu);
-    glEnd();
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glDisable(GL_TEXTURE_2D);
-    glPopMatrix();
+    cb->bind_texture(GL_TEXTURE_2D, sky_tex[5]);
+    cb->begin(GL_QUADS);
+    cb->tex_coord(0., 0.);
+    cb->vertex(cxu,cyu,czu);
+    cb->tex_coord(0., 1.);
+    cb->vertex(cxu,cyl,czu);
+    cb->tex_coord(1., 1.);
+    cb->vertex(cxl,cyl,czu);
+    cb->tex_coord(1., 0.);
+    cb->vertex(cxl,cyu,czu);
+    cb->end();
+
+    cb->bind_texture(GL_TEXTURE_2D, 0);
+    cb->disable(GL_TEXTURE_2D);
+    cb->pop_matrix();
 }
 
 /* #########################################################################
@@ -533,97 +973,203 @@ void draw_demo_skybox(){
             its own file.
 
    ######################################################################### */
-void draw_demo_room(){
+void draw_demo_room(GL_Command_Buffer * cb){
     const float groundColor[]     = {0.7f, 0.7f, 0.7f, 1.0f};
     const float groundSpecular[]  = {0.1f, 0.1f, 0.1f, 1.0f};
     const float groundShininess[] = {0.2f};
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, ground_tex);
-    glEnable(GL_TEXTURE_2D);
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, groundColor);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, groundSpecular);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, groundShininess);
-
-    glEnable(GL_LIGHTING);
-    // Floor; tesselate this nicely so lighting affects it
+    cb->active_texture(GL_TEXTURE0);
+    cb->bind_texture(GL_TEXTURE_2D, ground_tex);
+    cb->enable(GL_TEXTURE_2D);
+    cb->tex_env(GL_MODULATE);
+    cb->material(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, groundColor);
+    cb->material(GL_FRONT_AND_BACK, GL_SPECULAR, groundSpecular);
+    cb->material(GL_FRONT_AND_BACK, GL_SHININESS, groundShininess);
+
+    cb->enable(GL_LIGHTING);
+    // Floor; tesselate this nicely so lighting affects it (recorded, the
+    //  quads all end up in one draw)
     for (float i=-10.; i<10.; i+=1.){
         for (float j=-10.; j<10.; j+=1.){
-            glBegin(GL_QUADS);
-            glNormal3f(0., 1.0, 0.);
-            glTexCoord2f (-1., -1.);
-            glVertex3f(3.*i,-0.1,3.*j);
-            glTexCoord2f (1., -1.);
-            glVertex3f(3.*i+3.,-0.1,3.*j);
-            glTexCoord2f (1., 1.);
-            glVertex3f(3.*i+3.,-0.1,3.*j+3.);
-            glTexCoord2f (-1., 1.);
-            glVertex3f(3.*i,-0.1,3.*j+3.);
-            glEnd();
+            cb->begin(GL_QUADS);
+            cb->normal(0., 1.0, 0.);
+            cb->tex_coord(-1., -1.);
+            cb->vertex(3.*i,-0.1,3.*j);
+            cb->tex_coord(1., -1.);
+            cb->vertex(3.*i+3.,-0.1,3.*j);
+            cb->tex_coord(1., 1.);
+            cb->vertex(3.*i+3.,-0.1,3.*j+3.);
+            cb->tex_coord(-1., 1.);
+            cb->vertex(3.*i,-0.1,3.*j+3.);
+            cb->end();
         }
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glDisable(GL_TEXTURE_2D);
+    cb->bind_texture(GL_TEXTURE_2D, 0);
+    cb->disable(GL_TEXTURE_2D);
 }
 
 /* #########################################################################
     
                                 render_core
-        Render functionality shared between eyes.
+        Render functionality shared between eyes: recorded once a frame
+        and replayed for each (or issued per eye with -norecord). Only
+        the particle draw list and the Hydra / HUD drawing are left to
+        run per eye, as calls.
 
    ######################################################################### */
-void render_core(){
+void render_core(GL_Command_Buffer * cb){
 
     // first draw skybox
-    draw_demo_skybox();
+    draw_demo_skybox(cb);
 
     // then rest
-    draw_setup_lighting();
-    glEnable(GL_LIGHTING);
+    draw_setup_lighting(cb);
+    cb->enable(GL_LIGHTING);
 
     const float partColor[]     = {0.4f, 0.1f, 0.3f, 1.0f};
     const float partSpecular[]  = {0.1f, 0.1f, 0.1f, 1.0f};
     const float partShininess[] = {0.1f};
 
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, partColor);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, partSpecular);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, partShininess);
+    cb->tex_env(GL_MODULATE);
+    cb->material(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, partColor);
+    cb->material(GL_FRONT_AND_BACK, GL_SPECULAR, partSpecular);
+    cb->material(GL_FRONT_AND_BACK, GL_SHININESS, partShininess);
     // render from the vbo
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_COLOR_ARRAY);
-    // Each 8-byte vertex in that buffer includes coodinate information
-    //  and color information:
-    //  byte index [ 0  1  2  3  4  5  6  7  8  9  10  11  12  13  14  15  ]
-    //  info       [ <x, float>  <y, float>  <z, float >   <r   g   b   a> ]
-    // These cmds instruct opengl to expect that:
-    glColorPointer(4,GL_UNSIGNED_BYTE,16,(void*)12);
-    glVertexPointer(3,GL_FLOAT,16,(void*)0);
-    glDrawArrays(GL_POINTS,0, NUM_PARTICLES);
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_COLOR_ARRAY);
+    // The buffer is the particle store's position block, one stream
+    //  after another:
+    //  [ x, float * N ][ y, float * N ][ z, float * N ][ <r g b a> * N ]
+    //  [ prev x, float * N ][ prev y, float * N ][ prev z, float * N ]
+    // so each component gets its own attribute pointer into it, and the
+    // shader blends prev -> current by alpha. In compact mode the
+    //  position streams are unsigned shorts instead, and the shader
+    //  scales them by their block's box:
+    bool compact_state = particle_swirl_compact();
+    GLenum pos_type = compact_state ? GL_UNSIGNED_SHORT : GL_FLOAT;
+    if (compact_state){
+        cb->use_program(particle_quant_program);
+        cb->uniform1f(particle_quant_alpha_uniform, particle_swirl_alpha());
+        cb->active_texture(GL_TEXTURE1);
+        cb->bind_texture(GL_TEXTURE_BUFFER, particle_swirl_box_texture());
+        cb->active_texture(GL_TEXTURE0);
+        cb->uniform1i(particle_quant_boxes_uniform, 1);
+    } else {
+        cb->use_program(particle_program);
+        cb->uniform1f(particle_alpha_uniform, particle_swirl_alpha());
+    }
+    for (int i = PARTICLE_ATTRIB_X; i <= PARTICLE_ATTRIB_PREV_Z; i++)
+        cb->enable_attrib(i);
+    cb->attrib_pointer(PARTICLE_ATTRIB_X, 1, pos_type, false, 0,
+        particle_swirl_stream_offset(PARTICLE_ATTRIB_X));
+    cb->attrib_pointer(PARTICLE_ATTRIB_Y, 1, pos_type, false, 0,
+        particle_swirl_stream_offset(PARTICLE_ATTRIB_Y));
+    cb->attrib_pointer(PARTICLE_ATTRIB_Z, 1, pos_type, false, 0,
+        particle_swirl_stream_offset(PARTICLE_ATTRIB_Z));
+    cb->attrib_pointer(PARTICLE_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, true, 0,
+        particle_swirl_stream_offset(PARTICLE_ATTRIB_COLOR));
+    for (int i = PARTICLE_ATTRIB_PREV_X; i <= PARTICLE_ATTRIB_PREV_Z; i++)
+        cb->attrib_pointer(i, 1, pos_type, false, 0, particle_swirl_stream_offset(i));
+    // just what's in this eye's frustum -- which eye that is is only
+    //  known at replay; unculled, it's the same draw for both (and
+    //  one instanced draw in single-pass stereo)
+    if (get_particle_swirl_culling())
+        cb->call(draw_particle_list, NULL);
+    else
+        cb->draw_arrays(GL_POINTS, 0, get_live_particle_count());
+    for (int i = PARTICLE_ATTRIB_X; i <= PARTICLE_ATTRIB_PREV_Z; i++)
+        cb->disable_attrib(i);
+    if (compact_state){
+        cb->active_texture(GL_TEXTURE1);
+        cb->bind_texture(GL_TEXTURE_BUFFER, 0);
+        cb->active_texture(GL_TEXTURE0);
+    }
+    cb->use_program(0);
+    if (draw_trails)
+        draw_particle_trails(cb);
 
-    glPushMatrix();
-    draw_demo_room();
-    glPopMatrix();
+    cb->push_matrix();
+    draw_demo_room(cb);
+    cb->pop_matrix();
 
     // draw in front-guide
-    glPushMatrix();
     //player_manager->draw_HUD();
-    glPopMatrix();
 
-    // and hydra pointer
+    // and hydra pointer and menu
+    cb->call(draw_hydra_and_hud, NULL);
+
+    cb->disable(GL_LIGHTING);
+}
+
+/* #########################################################################
+    
+                              draw_particle_list
+        -The particle draw for the eye being drawn: its frustum-culled
+            list if the particles got culled, all live ones otherwise.
+            Run from render_core's recording, per eye.
+
+   ######################################################################### */
+void draw_particle_list(void * user){
+    GLuint cull_ibo;
+    unsigned int cull_count;
+    if (particle_swirl_draw_list(eye_view_index(rift_manager->which_eye()), &cull_ibo, &cull_count)){
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cull_ibo);
+        glDrawElements(GL_POINTS, cull_count, GL_UNSIGNED_INT, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    } else {
+        glDrawArrays(GL_POINTS,0, get_live_particle_count());
+    }
+}
+
+/* #########################################################################
+    
+                              draw_hydra_and_hud
+        -Hydra pointer and the HUD menu: other classes' immediate-mode
+            drawing (and GLUT stroke text), so they run per eye as a
+            call out of render_core's recording.
+
+   ######################################################################### */
+void draw_hydra_and_hud(void * user){
     glPushMatrix();
     hydra_manager->draw_cursor('r', player_manager->get_position(), player_manager->get_quaternion());
     hydra_manager->draw(player_manager->get_position(), player_manager->get_quaternion());
     glPopMatrix();
 
-    // and menu
     glPushMatrix();
     hud_manager->draw();
     glPopMatrix();
+}
+
+/* #########################################################################
+    
+                             draw_particle_trails
+        -Every live particle's streak, as GL_LINES out of the trail
+            ring (see particle_trail.h): one draw per segment age,
+            newest first, each fainter than the one before. Leaves the
+            particle VBO bound again, for the other eye.
 
-    glDisable(GL_LIGHTING);
+   ######################################################################### */
+void draw_particle_trails(GL_Command_Buffer * cb){
+    GLuint trail_vbo, trail_ibo;
+    Particle_Trail * trail = particle_swirl_trail(&trail_vbo, &trail_ibo);
+    if (!trail || trail->filled() < 2)
+        return;
+    cb->use_program(trail_program);
+    cb->bind_buffer(GL_ARRAY_BUFFER, trail_vbo);
+    cb->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, trail_ibo);
+    for (int c = 0; c < 3; c++){
+        cb->enable_attrib(PARTICLE_ATTRIB_X + c);
+        cb->attrib_pointer(PARTICLE_ATTRIB_X + c, 1, GL_FLOAT, false, 0, trail->stream_offset(c));
+    }
+    unsigned int first;
+    int base_vertex;
+    for (int age = 0; trail->segment(age, &first, &base_vertex); age++){
+        cb->uniform1f(trail_fade_uniform, 1.0f - (float)(age + 1) / trail->filled());
+        cb->draw_elements(GL_LINES, 2*get_live_particle_count(), GL_UNSIGNED_INT,
+            first*sizeof(unsigned int), base_vertex);
+    }
+    for (int c = 0; c < 3; c++)
+        cb->disable_attrib(PARTICLE_ATTRIB_X + c);
+    cb->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    cb->bind_buffer(GL_ARRAY_BUFFER, *vbo);
+    cb->use_program(0);
 }
 
 /* #########################################################################
@@ -632,15 +1178,35 @@ void render_core(){
                                             
         -Callback from GLUT: called as the idle function, as rapidly
             as possible.
-        - Advances particle swarm.
+        - Advances particle swarm, culling it for the eyes the last
+            frame was drawn with.
 
    ######################################################################### */    
+int eye_view_index(char eye){
+    return eye == 'l' ? 0 : (eye == 'r' ? 1 : 2);
+}
+
 void glut_idle(){
     float dt = ((float)get_elapsed( GET_ELAPSED_IDLE )) / 1000.0;
 
     Eigen::Vector3f tpos = player_manager->get_position();
 
-    advance_particle_swirl(vbo, tpos.x(), tpos.y(), tpos.z());
+    // cull against the eyes as they were last drawn
+    const char eyes[CULL_MAX_VIEWS] = { 'l', 'r', 'n' };
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        float view_proj[16];
+        set_particle_swirl_view(v,
+            rift_manager->eye_view_proj(eyes[v], view_proj) ? view_proj : NULL);
+    }
+    {
+        PROFILE_ZONE("simulation");
+        advance_particle_swirl(vbo, tpos.x(), tpos.y(), tpos.z());
+    }
+    if (deterministic && det_steps > 0 && particle_swirl_steps() >= det_steps){
+        printf("Seed %u, %u particles, %u steps of %.3f ms: checksum %016llx\n", det_seed,
+            get_particle_count(), particle_swirl_steps(), step_ms, particle_swirl_checksum());
+        exit(0);
+    }
 
     // and let rift handler update
     player_manager->onIdle(dt);
@@ -665,6 +1231,59 @@ void normal_key_handler(unsigned char key, int x, int y) {
     rift_manager->normal_key_handler(key, x, y);
     hydra_manager->normal_key_handler(key, x, y);
     switch (key) {
+        // halve / double the particle count
+        case '[':
+            set_particle_count(vbo, get_particle_count()/2);
+            printf("%u particles.\n", get_particle_count());
+            break;
+        case ']':
+            set_particle_count(vbo, get_particle_count()*2);
+            printf("%u particles.\n", get_particle_count());
+            break;
+        // next force field preset
+        case 'f': {
+            force_field_list_t fields;
+            field_preset = (field_preset + 1) % NUM_FORCE_FIELD_PRESETS;
+            force_field_preset(field_preset, &fields);
+            set_particle_swirl_fields(&fields);
+            printf("Force field preset %d:", field_preset);
+            for (int i = 0; i < fields.count; i++)
+                printf(" %s", force_field_name(fields.field[i].type));
+            printf(", colliding with");
+            for (int i = 0; i < fields.num_colliders; i++)
+                printf(" %s", collider_name(fields.collider[i].type));
+            printf("\n");
+            break;
+        }
+        // frustum culling on / off
+        case 'v':
+            set_particle_swirl_culling(!get_particle_swirl_culling());
+            printf("Particle culling %s.\n", get_particle_swirl_culling() ? "on" : "off");
+            break;
+        // back-to-front sorting on / off
+        case 'z':
+            set_particle_swirl_depth_sort(!get_particle_swirl_depth_sort());
+            printf("Particle depth sort %s.\n", get_particle_swirl_depth_sort() ? "on" : "off");
+            break;
+        // burst of an eighth of the pool (emitter mode only)
+        case 'b':
+            particle_swirl_burst(get_particle_count()/8);
+            break;
+        // trails on / off (with -trails)
+        case 't': {
+            GLuint trail_vbo, trail_ibo;
+            if (particle_swirl_trail(&trail_vbo, &trail_ibo)){
+                draw_trails = !draw_trails;
+                printf("Particle trails %s.\n", draw_trails ? "on" : "off");
+            }
+            break;
+        }
+        // snapshot the particle state
+        case 'o':
+            if (save_particle_swirl(SNAPSHOT_FILE) == 0)
+                printf("Saved %u particles at step %u to %s.\n", get_particle_count(),
+                    particle_swirl_steps(), SNAPSHOT_FILE);
+            break;
         default:
             break;
     }
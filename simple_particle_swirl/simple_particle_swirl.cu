@@ -4,10 +4,64 @@
    Rev history:
      Gregory Izatt  20130717  Init revision
      Gregory Izatt  20130814  Separating device / host code
+     agent  20261017  Counter-based initialization straight into the live buffers
+     agent  20261017  Memory-mapped snapshots, recording and replay
+     agent  20261017  Barnes-Hut N-body mode
+     agent  20261017  Runtime force-field list
+     agent  20261017  Emitters and particle lifetimes
+     agent  20261017  Per-eye frustum culling on the CPU backend
+     agent  20261017  Optional back-to-front depth sort of the culled lists
+     agent  20261017  Headless runs: no GL, fixed steps, timing report
+     agent  20261017  Compact 16-bit particle state mode
+     agent  20261017  Ground / player / box colliders in the step
+     agent  20261017  Async mode: CPU steps on their own thread, triple-buffered
+     agent  20261017  Kernel step is the shared swirl_integrate template
+     agent  20261017  Particle trail ring, streamed by the CPU step jobs
+     agent  20261017  Kernel drops its unused player position
+     agent  20261017  Eyes seeing more than the sort limit go unsorted
+     agent  20261017  Compact mode steps floats, packs them for upload
+     agent  20261017  Recording and replay state lives in particle_snapshot
+     agent  20261017  Steps run on the emitter pool's own live view
+     agent  20261017  The culler says whether its lists are current
+     agent  20261017  The sorter applies the limit and says which eyes it skipped
+     agent  20261017  A step job claims its trail slot from the ring
+     agent  20261017  Step limit below a loaded snapshot takes no steps
+     agent  20261017  Deterministic runs pin the player to the origin
+     agent  20261017  The default sort limit is measured on the pool at start up
+     agent  20261017  Separation mode: a neighbor grid rebuilt every CPU step
+     agent  20261017  Public API declared in simple_particle_swirl_cu.h
    ######################################################################### */    
 
 // Us!
 #include "simple_particle_swirl_cu.h"
+// Host fallback for when there's no CUDA device
+#include "simple_particle_swirl_cpu.h"
+// Saved / recorded particle state
+#include "particle_snapshot.h"
+// Mutual gravity for N-body mode
+#include "barnes_hut.h"
+// Neighbor grid for separation mode
+#include "spatial_hash.h"
+// What pushes the particles around
+#include "force_field.h"
+// The per-particle step, shared with the host backend
+#include "particle_integrate.h"
+// Lifetimes and emitters
+#include "particle_pool.h"
+// Per-eye visible lists
+#include "particle_cull.h"
+// ...sorted back to front
+#include "particle_sort.h"
+// 16-bit positions for upload
+#include "particle_quant.h"
+// Motion trail history
+#include "particle_trail.h"
+// Async mode's simulation thread and state handoff
+#include "../common/sim_thread.h"
+#include "../common/triple_buffer.h"
+
+#include <vector>
+#include <algorithm>
 
 // use protection guys
 using namespace std;
@@ -23,8 +77,143 @@ static unsigned long perfFreq;
 
 //VBO holder
 cudaGraphicsResource *resources[1];
-// Device buffer variables
-float4* d_velocities;
+// Device buffer variables: velocity block of the particle store
+float* d_velocities;
+// Host-side store; the live state on the CPU backend, only a staging
+//  area for initialization otherwise
+static bool use_cpu = false;
+static swirl_simd_t cpu_simd = SWIRL_SIMD_SCALAR;
+static particle_store_t h_store;
+// CPU backend steps run on these workers, one frame behind the display
+static Thread_Pool * cpu_pool = NULL;
+static swirl_job_t cpu_job;
+static bool cpu_step_in_flight = false;
+// GPU step timing
+static cudaEvent_t step_start, step_stop;
+// Most recent particle update time, ms
+static double update_ms = 0.0;
+// How many particles we're currently simulating
+static unsigned int num_particles = 0;
+// Frames since the particles were (re)initialized
+static int framesRendered = 0;
+// Fixed-step integration: wall time piles up in step_accum and is spent
+//  step_ms at a time, at most max_substeps steps per frame
+static float step_ms = DEFAULT_STEP_MS;
+static int max_substeps = DEFAULT_MAX_SUBSTEPS;
+static double step_accum = 0.0;
+// Fixed steps taken since the particles were (re)initialized
+static unsigned int steps_taken = 0;
+// How far the displayed state is from the previous step to the latest,
+//  [0, 1]; alpha of the step the CPU workers are currently running
+static float render_alpha = 1.0f;
+static float cpu_job_alpha = 1.0f;
+// Deterministic mode: seeded init, and every frame advances exactly
+//  max_substeps steps no matter how long it took (up to det_step_limit
+//  steps total, if that's nonzero)
+static bool deterministic = false;
+static unsigned int det_seed = 0;
+static unsigned int det_step_limit = 0;
+// Whether step_start / step_stop bracket a launched kernel
+static bool gpu_step_timed = false;
+// Counter-RNG key every particle's starting state is derived from
+static unsigned long long init_key = 0;
+// Snapshot the CPU backend's host store is mapped from, if any
+static particle_snapshot_t cpu_snapshot;
+static bool cpu_snapshot_open = false;
+// Recording: a snapshot into a series every so many steps
+static Snapshot_Recorder recorder;
+// Replay: instead of stepping, show a series at the rate it was
+//  recorded
+static bool replaying = false;
+static Snapshot_Player replay;
+// N-body mode: the particles' mutual gravity on top of the attractor,
+//  from an octree rebuilt every step (host backend only)
+static bool nbody = false;
+static float nbody_theta = DEFAULT_NBODY_THETA;
+static Barnes_Hut * nbody_tree = NULL;
+// Separation mode: particles within separation_radius push each other
+//  apart, off a neighbor grid rebuilt every step (host backend only)
+static bool separation = false;
+static float separation_radius = DEFAULT_SEPARATION_RADIUS;
+static Spatial_Hash * separation_grid = NULL;
+// Force fields every step applies; the kernel reads them from constant
+//  memory, which gets refreshed before the next launch once they change
+static force_field_list_t swirl_fields;
+static bool swirl_fields_set = false;
+static bool swirl_fields_dirty = true;
+__constant__ force_field_list_t d_fields;
+// Emitter mode: particles come and go, packed into the front of the
+//  host store (host backend only); steps run on the pool's live view.
+static bool emitters = false;
+static Particle_Pool * particle_pool = NULL;
+// Frustum culling (host backend only): every frame, once the VBO holds
+//  the latest step, the live particles are culled against the eye
+//  matrices of the frame before, and each eye's visible list goes to
+//  its own element buffer. The culler's lists are valid() while they
+//  match the VBO.
+static bool culling = true;
+static Particle_Culler * culler = NULL;
+static GLuint cull_ibo[CULL_MAX_VIEWS];
+// Depth sorting: each eye's list goes farthest first, for blending,
+//  unless it's longer than sort_limit (0: no limit; by default, what
+//  the pool sorts in DEPTH_SORT_BUDGET_MS, measured when it starts)
+static bool depth_sort = false;
+static unsigned int sort_limit = DEPTH_SORT_AUTO_LIMIT;
+static Depth_Sorter * sorter = NULL;
+// Headless runs: no GL context at all, so nothing touches a buffer;
+//  CPU backend only, every frame max_substeps steps
+static bool headless = false;
+// Compact mode: h_store is still the live state, stepped as floats,
+//  but each step job packs its positions into h_quant as it goes (see
+//  particle_quant.h), and the VBO holds h_quant's 16-bit streams plus
+//  the float store's colors; the block boxes go to the shader through
+//  a buffer texture.
+static bool compact = false;
+static particle_quant_t h_quant;
+static quant_job_t quant_job;
+static GLuint quant_box_tbo = 0;
+static GLuint quant_box_tex = 0;
+// Async mode: the CPU backend's steps run on sim_thread, which copies
+//  each finished state into one of three host slots and hands it over
+//  through sim_buffer; advance_particle_swirl only ever uploads the
+//  newest slot it hasn't shown yet, and never waits on a step. The
+//  player position, field changes and bursts go the other way, under
+//  sim_input_mutex. Everything about the simulation itself (h_store,
+//  the pool, steps_taken, ...) belongs to the sim thread while it runs;
+//  pause it to touch any of that from here.
+typedef struct _sim_slot_t {
+    // position block only: x / y / z, color, prev x / y / z
+    particle_store_t s;
+    unsigned int live;
+    unsigned int steps;
+    // colors are only copied in when they've changed since the slot's
+    unsigned int color_gen;
+    // wall time (clock_ms) the state is for
+    double state_ms;
+} sim_slot_t;
+static bool async_sim = false;
+static Sim_Thread * sim_thread = NULL;
+static Triple_Buffer sim_buffer;
+static sim_slot_t sim_slots[3];
+static pthread_mutex_t sim_input_mutex = PTHREAD_MUTEX_INITIALIZER;
+static float sim_px = 0.0f, sim_py = 0.0f, sim_pz = 0.0f;
+static unsigned int sim_burst = 0;
+// bumped by the sim thread whenever the store's colors change
+static unsigned int color_gen = 1;
+// what the VBO is showing
+static unsigned int vbo_color_gen = 0;
+static unsigned int shown_steps = 0;
+static unsigned int shown_live = 0;
+static double shown_state_ms = 0.0;
+// Trails (CPU backend only; not with emitters, compact or async state):
+//  every step job also streams its new positions into the slot it
+//  claimed from `trail` (see particle_trail.h), and once the job is
+//  collected that one slot goes up into trail_vbo, which mirrors the
+//  whole ring. trail_ibo holds the ring's two segment index patterns.
+static int trail_length = 0;
+static Particle_Trail * trail = NULL;
+static GLuint trail_vbo = 0;
+static GLuint trail_ibo = 0;
 
 /* #########################################################################
     
@@ -33,13 +222,47 @@ float4* d_velocities;
    ######################################################################### */        
 
 // The magnificent kernel!
-__global__ void d_simple_particle_swirl( float4* pos, float4* vels, unsigned int N, float dt,
-        float3 player_pos); 
+__global__ void d_simple_particle_swirl( particle_store_t s, float dt, int steps); 
+// Starting state for every particle, straight into the VBO / velocity block
+__global__ void d_init_swirl_particles( particle_store_t s, unsigned long long key );
 
 // Get our framerate
 static double get_framerate();
 // Return curr time in ms since last call to this func (high res)
 static double get_elapsed();
+// Wall time in ms since whenever; fine from any thread
+static double clock_ms();
+// Whether a usable CUDA device is present
+static bool have_cuda_device();
+// (Re)allocate everything for n particles
+static int reset_particles(GLuint * vbo, unsigned int n, particle_snapshot_t * snap);
+static void release_host_store();
+// Swap in an open snapshot (taking ownership of it)
+static int apply_snapshot(GLuint * vbo, particle_snapshot_t * snap);
+static void advance_replay(GLuint * vbo, double frame_ms);
+// How many fixed steps this frame gets; updates the accumulator and alpha
+static int fixed_steps_for_frame(double frame_ms, float * alpha);
+// Run `steps` steps with the particles' interactions (N-body gravity,
+//  separation) on the host store, start to finish
+static void step_interacting(int steps, const force_field_list_t & fields);
+// Copy the force fields to the device if they've changed
+static void upload_fields();
+// The host store's live particles (all of them without emitters)
+static particle_store_t * live_host_store();
+// (Re)start the pool on the host store, and its emitters
+static void reset_particle_pool(unsigned int n);
+// Cull what's in the VBO for every eye and upload the lists
+static void cull_particles();
+// The live front of a store's position streams into the VBO
+static void upload_positions(GLuint * vbo, const particle_store_t & s, unsigned int live,
+                             bool positions, bool colors);
+// The trail's newest slot into trail_vbo
+static void upload_trail_head();
+// Async mode: the sim thread's turn, its slots, and the render side
+static int sim_tick(double frame_ms, double * wait_ms, void * user);
+static void reset_sim_slots();
+static void publish_sim_state(double state_ms);
+static void show_sim_state(GLuint * vbo, float px, float py, float pz);
 
 
 /* #########################################################################
@@ -49,149 +272,1542 @@ static double get_elapsed();
         -Sets up both a CUDA context
         -Initializes the shared vertex buffer that we'll use, and 
             gets it registered with CUDA
+        -If there's no CUDA device (or force_cpu is set), keeps the
+            particle state on the host instead and advances it with
+            the SIMD CPU backend on num_threads workers (0 = all cores).
+        -Starts out with n particles (see set_particle_count), or
+            with the contents of `snapshot` if that isn't NULL, or
+            with the first file of the replay series if one is set.
+        -Call set_particle_swirl_timestep / _deterministic / _nbody /
+            _separation / _emitters / _replay first if the defaults
+            won't do. N-body, separation and emitter modes always run
+            on the CPU.
+        -Frustum culling is only set up on the CPU backend; the GPU
+            one always draws everything.
+        -After set_particle_swirl_headless, there's no VBO: vbo is
+            never touched and the CPU backend is forced.
+        -After set_particle_swirl_compact, the CPU backend is forced.
+        -After set_particle_swirl_async, the CPU backend is forced,
+            there's no culling, and the simulation thread is started
+            once the first state is in.
+        -After set_particle_swirl_trails, the CPU backend is forced.
         
             Return -1 if fail, 0 if success.
    ######################################################################### */
-int initCuda(GLuint * vbo) {
+int initCuda(GLuint * vbo, bool force_cpu, int num_threads, unsigned int n, const char * snapshot) {
 
-    srand(time(0));
     //Set up timer
     LARGE_INTEGER li;
     if(!QueryPerformanceFrequency(&li))
         printf("QueryPerformanceFrequency failed!\n");
     perfFreq = (unsigned long)(li.QuadPart);
+
+    // deterministic runs start from the same swirl every time
+    if (deterministic){
+        init_key = particle_init_key(det_seed);
+    } else {
+        QueryPerformanceCounter(&li);
+        init_key = particle_init_key((unsigned long long)li.QuadPart ^ (unsigned long long)time(0));
+    }
+
+    if (!swirl_fields_set){
+        force_field_preset(0, &swirl_fields);
+        swirl_fields_set = true;
+    }
+    swirl_fields_dirty = true;
+
+    if (compact && (nbody || separation || emitters)){
+        printf("Compact particle state doesn't do N-body, separation or emitters; using floats.\n");
+        compact = false;
+    }
+    if (async_sim && (headless || compact || deterministic || replaying)){
+        printf("Async simulation doesn't do headless, compact, deterministic or replay runs; "
+               "stepping every frame.\n");
+        async_sim = false;
+    }
+    if (trail_length > 0 && (emitters || compact || async_sim || headless || replaying)){
+        printf("Trails don't do emitters, compact, async, headless or replay runs; no trails.\n");
+        trail_length = 0;
+    }
+    use_cpu = force_cpu || nbody || separation || emitters || headless || compact || async_sim || trail_length > 0 ||
+              !have_cuda_device();
+    if (use_cpu){
+        cpu_simd = detect_swirl_simd();
+        cpu_pool = new Thread_Pool(num_threads);
+        printf("Particle swirl running on the CPU (%s, %d threads).\n", swirl_simd_name(cpu_simd),
+            cpu_pool->num_threads());
+        if (nbody){
+            nbody_tree = new Barnes_Hut(nbody_theta);
+            printf("N-body gravity on, theta %.2f.\n", nbody_theta);
+        }
+        if (separation){
+            // cells twice the radius: a neighbor walk covers 8 of them
+            separation_grid = new Spatial_Hash(2.0f * separation_radius);
+            printf("Particle separation on, radius %.3f.\n", separation_radius);
+        }
+        if (emitters)
+            particle_pool = new Particle_Pool();
+        if (compact)
+            printf("Compact particle uploads: 16-bit positions.\n");
+        if (!headless && !async_sim){
+            culler = new Particle_Culler(CULL_GUARD_BAND);
+            sorter = new Depth_Sorter();
+            if (sort_limit == DEPTH_SORT_AUTO_LIMIT){
+                sort_limit = depth_sort_calibrate(cpu_pool, DEPTH_SORT_BUDGET_MS);
+                printf("Depth sorting eyes of up to %u particles (%.1f ms each on this pool).\n",
+                    sort_limit, DEPTH_SORT_BUDGET_MS);
+            }
+            glGenBuffers( CULL_MAX_VIEWS, cull_ibo );
+        }
+        if (trail_length > 0){
+            trail = new Particle_Trail(trail_length);
+            glGenBuffers( 1, &trail_vbo );
+            glGenBuffers( 1, &trail_ibo );
+            printf("Particle trails %d steps long.\n", trail->length());
+        }
+    } else {
+        //Start off by resetting cudaDevice
+        cudaDeviceReset();
+            
+        // first, find a CUDA device and set it to graphic interop
+        cudaDeviceProp  prop;
+        int dev;
+        memset( &prop, 0, sizeof( cudaDeviceProp ) );
+        prop.major = 1;
+        prop.minor = 0;
+        HANDLE_ERROR( cudaChooseDevice( &dev, &prop ) );
+        cudaGLSetGLDevice( dev );
+        CUDA_SAFE_CALL( cudaEventCreate(&step_start) );
+        CUDA_SAFE_CALL( cudaEventCreate(&step_stop) );
+    }
+    
+    if (!headless)
+        glGenBuffers( 1, vbo );
+    if (!headless && compact){
+        glGenBuffers( 1, &quant_box_tbo );
+        glGenTextures( 1, &quant_box_tex );
+    }
+    if (replaying){
+        particle_snapshot_t first;
+        if (replay.open(&first) == 0)
+            return apply_snapshot(vbo, &first);
+        printf("No snapshots to replay at %s; simulating instead.\n", replay.series());
+        replaying = false;
+    }
+    int ret = -1;
+    if (snapshot){
+        ret = load_particle_swirl(vbo, snapshot);
+        if (ret)
+            printf("Starting a fresh swirl instead.\n");
+    }
+    if (ret)
+        ret = set_particle_count(vbo, n);
+    if (ret == 0 && async_sim){
+        sim_thread = new Sim_Thread(sim_tick, NULL);
+        printf("Particle simulation on its own thread.\n");
+    }
+    return ret;
+}
+
+/* #########################################################################
+    
+                             set_particle_count
+                                            
+        -(Re)allocates every particle buffer -- VBO, device velocity
+            block, host store -- for n particles, and restarts the
+            swirl from scratch. Safe to call at any time after
+            initCuda; any step in flight is finished first.
+        -Starting state is computed in place, with no staging copies:
+            by a kernel writing the mapped VBO on the GPU backend, by
+            the worker threads writing the host store on the CPU one.
+        -n is clamped to [1, MAX_PARTICLES].
+        
+            Return -1 if fail, 0 if success.
+   ######################################################################### */
+int set_particle_count(GLuint * vbo, unsigned int n) {
+    if (n < 1) n = 1;
+    if (n > MAX_PARTICLES) n = MAX_PARTICLES;
+    if (sim_thread)
+        sim_thread->pause();
+    int ret = reset_particles(vbo, n, NULL);
+    if (sim_thread)
+        sim_thread->resume();
+    return ret;
+}
+
+/* #########################################################################
     
-    //Start off by resetting cudaDevice
-    cudaDeviceReset();
+                               reset_particles
+                                            
+        -Does the work for set_particle_count and load_particle_swirl:
+            n fresh particles if snap is NULL, otherwise whatever is in
+            the (already open) snapshot, which this takes ownership of.
+        -Buffers are only reallocated if the count changes.
+        -The step count starts over at 0, or at the snapshot's.
+        -In async mode the sim thread has to be paused.
+        -A snapshot's state goes straight from the mapping to where it
+            lives: on the CPU backend the host store *is* the mapping
+            (copy-on-write, so stepping never touches the file); on the
+            GPU the VBO and velocity block are filled from it directly.
         
-    // first, find a CUDA device and set it to graphic interop
-    cudaDeviceProp  prop;
-    int dev;
-    memset( &prop, 0, sizeof( cudaDeviceProp ) );
-    prop.major = 1;
-    prop.minor = 0;
-    HANDLE_ERROR( cudaChooseDevice( &dev, &prop ) );
-    cudaGLSetGLDevice( dev );
-    
-    //And set up shared vertex buffer
-    glGenBuffers( 1, vbo );
-    glBindBuffer( GL_ARRAY_BUFFER, *vbo );
-    float4* temppos = (float4*)malloc(BUFFER_SIZE);
-    if (!temppos){ printf("Memory alloc error.\n"); return -1;}
-    for(int i = 0; i < NUM_PARTICLES; i++)
-    {
-        /* Initial position in 30-radius ring at y=30 */
-        float radius = ((float)rand())/RAND_MAX*27.0+3.0;
-        float theta = ((float)rand())/RAND_MAX*2.0*M_PI/8.0;
-        temppos[i].x = radius*cosf(theta);
-        temppos[i].y = ((float)rand())/RAND_MAX * 1.0 + 29.5;
-        temppos[i].z = radius*sinf(theta);
-        unsigned char * tmp = (unsigned char *)&(temppos[i].w);
-        tmp[0] = (unsigned char) 200;
-        tmp[1] = (unsigned char) 200;
-        tmp[2] = (unsigned char) 200;
-        tmp[3] = 255;
-    }
-    glBufferData( GL_ARRAY_BUFFER, BUFFER_SIZE, temppos, GL_DYNAMIC_DRAW );
-    // (whenever I bind buffer index 0, that's just the way of unbinding
-    //     openGL from any buffer...)
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    if (glGetError()){
-        unsigned char * glErrorBuffer = (unsigned char *) gluErrorString(glGetError());
-        printf("Opengl error: %s\n", glErrorBuffer);
-    }
-    // register, map and unmap to try to cycle it in...
-    CUDA_SAFE_CALL( cudaGraphicsGLRegisterBuffer(resources, *vbo, cudaGraphicsMapFlagsWriteDiscard) );
-
-    // allocate velocity buffer on device side
-    CUDA_SAFE_CALL( cudaMalloc( (void**)&d_velocities, BUFFER_SIZE ) );
-    float4* tempvel = (float4*)malloc(BUFFER_SIZE);
-    if (!tempvel){ printf("Memory alloc error.\n"); return -1;}
-    for(int i = 0; i < NUM_PARTICLES; i++)
-    {
-        /* Initial velocity around origin at 0, 30, 0 */
-        tempvel[i].x = ((float)rand())/RAND_MAX * 2.0 - 1.0 + temppos[i].z;
-        tempvel[i].y = ((float)rand())/RAND_MAX * 1.0 - 0.5;
-        tempvel[i].z = ((float)rand())/RAND_MAX * 2.0 - 1.0 - temppos[i].x;
-        tempvel[i].w = 1.0;
-    }
-    CUDA_SAFE_CALL( cudaMemcpy( d_velocities, tempvel, BUFFER_SIZE, cudaMemcpyHostToDevice ) );
-    free(tempvel);
-    free(temppos);
+            Return -1 if fail, 0 if success.
+   ######################################################################### */
+static int reset_particles(GLuint * vbo, unsigned int n, particle_snapshot_t * snap) {
+    bool realloc = (n != num_particles);
+    // the header lives in the mapping, which may be closed below
+    unsigned int start_steps = snap ? snap->header->steps : 0;
+
+    // tear down whatever we had
+    if (cpu_step_in_flight){
+        cpu_pool->wait();
+        cpu_step_in_flight = false;
+    }
+    if (num_particles > 0 && use_cpu)
+        release_host_store();
+    if (num_particles > 0 && !use_cpu && realloc){
+        CUDA_SAFE_CALL( cudaGraphicsUnregisterResource(resources[0]) );
+        CUDA_SAFE_CALL( cudaFree(d_velocities) );
+    }
+    num_particles = n;
+
+    // On the CPU the host store is the live state: fill it in on the
+    //  workers (or point it at the snapshot), then hand the VBO its
+    //  position block
+    if (use_cpu){
+        if (snap){
+            h_store = snap->store;
+            cpu_snapshot = *snap;
+            cpu_snapshot_open = true;
+        } else {
+            if (particle_store_alloc(&h_store, n, true, true)){
+                printf("Memory alloc error (%u particles).\n", n);
+                num_particles = 0;
+                return -1;
+            }
+            h_init_swirl_particles(cpu_pool, h_store, init_key);
+        }
+        if (compact){
+            if (particle_quant_alloc(&h_quant, n)){
+                printf("Memory alloc error (%u particles).\n", n);
+                release_host_store();
+                num_particles = 0;
+                return -1;
+            }
+            particle_quant_encode(cpu_pool, h_store, h_quant);
+        }
+    }
+
+    //And set up shared vertex buffer: the store's whole position block
+    //  (left uninitialized for CUDA to fill in)
+    if (!headless && compact){
+        // 16-bit streams and the float colors, then the boxes
+        glBindBuffer( GL_ARRAY_BUFFER, *vbo );
+        if (realloc)
+            glBufferData( GL_ARRAY_BUFFER, particle_quant_pos_size(n), NULL, GL_DYNAMIC_DRAW );
+        glBufferSubData( GL_ARRAY_BUFFER, 0, particle_quant_xyz_size(n), h_quant.qx );
+        glBufferSubData( GL_ARRAY_BUFFER, particle_quant_offset(n, PARTICLE_STREAM_COLOR),
+            n*sizeof(unsigned int), h_store.color );
+        glBufferSubData( GL_ARRAY_BUFFER, particle_quant_offset(n, PARTICLE_STREAM_PREV_X),
+            particle_quant_xyz_size(n), h_quant.prev_qx );
+        glBindBuffer( GL_ARRAY_BUFFER, 0 );
+        glBindBuffer( GL_TEXTURE_BUFFER, quant_box_tbo );
+        glBufferData( GL_TEXTURE_BUFFER, particle_quant_box_size(n), h_quant.box, GL_DYNAMIC_DRAW );
+        glBindTexture( GL_TEXTURE_BUFFER, quant_box_tex );
+        glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, quant_box_tbo );
+        glBindTexture( GL_TEXTURE_BUFFER, 0 );
+        glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+        if (glGetError()){
+            unsigned char * glErrorBuffer = (unsigned char *) gluErrorString(glGetError());
+            printf("Opengl error: %s\n", glErrorBuffer);
+        }
+    } else if (!headless){
+        const void * pos_block = use_cpu ? h_store.x : (snap ? snap->store.x : NULL);
+        glBindBuffer( GL_ARRAY_BUFFER, *vbo );
+        if (realloc)
+            glBufferData( GL_ARRAY_BUFFER, particle_store_pos_size(n), pos_block, GL_DYNAMIC_DRAW );
+        else if (pos_block)
+            glBufferSubData( GL_ARRAY_BUFFER, 0, particle_store_pos_size(n), pos_block );
+        // (whenever I bind buffer index 0, that's just the way of unbinding
+        //     openGL from any buffer...)
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (glGetError()){
+            unsigned char * glErrorBuffer = (unsigned char *) gluErrorString(glGetError());
+            printf("Opengl error: %s\n", glErrorBuffer);
+        }
+    }
+    h_store.color_dirty = false;
+
+    // a new ring (and patterns) for a new count; the same one otherwise,
+    //  but the old history doesn't lead up to these particles
+    if (trail && trail->size() != n){
+        if (trail->resize(n)){
+            printf("Memory alloc error (%u particle trails).\n", n);
+            delete trail;
+            trail = NULL;
+        } else {
+            std::vector<unsigned int> patterns(4 * (size_t)n);
+            trail->indices(&patterns[0]);
+            glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, trail_ibo );
+            glBufferData( GL_ELEMENT_ARRAY_BUFFER, patterns.size()*sizeof(unsigned int), &patterns[0],
+                GL_STATIC_DRAW );
+            glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+            glBindBuffer( GL_ARRAY_BUFFER, trail_vbo );
+            glBufferData( GL_ARRAY_BUFFER, trail->ring_bytes(), NULL, GL_DYNAMIC_DRAW );
+            glBindBuffer( GL_ARRAY_BUFFER, 0 );
+        }
+    } else if (trail){
+        trail->forget();
+    }
+
+    // restart timing so the first step doesn't eat the realloc time
+    get_elapsed();
+    framesRendered = 0;
+    step_accum = 0.0;
+    steps_taken = start_steps;
+    render_alpha = cpu_job_alpha = 1.0f;
+    if (culler)
+        culler->invalidate();
+    if (sorter)
+        sorter->forget();
+
+    if (use_cpu){
+        // host store is the live state from here on
+        if (particle_pool)
+            reset_particle_pool(n);
+        if (async_sim)
+            reset_sim_slots();
+        return 0;
+    }
+
+    if (realloc){
+        // register, map and unmap to try to cycle it in... The kernel only
+        //  rewrites x/y/z, so CUDA must not discard the color stream.
+        CUDA_SAFE_CALL( cudaGraphicsGLRegisterBuffer(resources, *vbo, cudaGraphicsMapFlagsNone) );
+
+        // allocate velocity block on device side
+        CUDA_SAFE_CALL( cudaMalloc( (void**)&d_velocities, particle_store_vel_size(n) ) );
+    }
+
+    if (snap){
+        CUDA_SAFE_CALL( cudaMemcpy( d_velocities, snap->store.vx, particle_store_vel_size(n),
+            cudaMemcpyHostToDevice ) );
+        close_particle_snapshot(snap);
+        return 0;
+    }
+
+    // compute the starting state right where it lives
+    float *dptr;
+    size_t size;
+    CUDA_SAFE_CALL( cudaGraphicsMapResources(1, resources) );
+    CUDA_SAFE_CALL( cudaGraphicsResourceGetMappedPointer((void **)(&dptr), &size, resources[0]) );
+    particle_store_t d_store;
+    particle_store_bind(&d_store, n, dptr, d_velocities, true, true);
+    d_init_swirl_particles<<< GRID_SIZE(n), BLOCK_SIZE >>>(d_store, init_key);
+    CUDA_SAFE_CALL( cudaGraphicsUnmapResources(1, resources, 0) );
 
     return 0;
 }
 
+// Host store goes back to wherever it came from (and the compact
+//  copy, if any, goes)
+static void release_host_store(){
+    if (compact)
+        particle_quant_free(&h_quant);
+    if (cpu_snapshot_open){
+        close_particle_snapshot(&cpu_snapshot);
+        cpu_snapshot_open = false;
+        memset(&h_store, 0, sizeof(h_store));
+    } else {
+        particle_store_free(&h_store);
+    }
+}
+
+unsigned int get_particle_count(){
+    return num_particles;
+}
+
+// Particles actually alive, packed at the front of every stream; this
+//  is all that needs drawing (in async mode, as of the state shown)
+unsigned int get_live_particle_count(){
+    if (sim_thread)
+        return shown_live;
+    return particle_pool ? particle_pool->live() : num_particles;
+}
+
+static particle_store_t * live_host_store(){
+    return particle_pool ? particle_pool->live_view() : &h_store;
+}
+
+/* #########################################################################
+    
+                          set_particle_swirl_emitters
+        -Particles get lifetimes, and emitters spawn new ones into the
+            slots they free up (see particle_pool.h). Half the swirl
+            starts out alive, living 2-12 s; a fountain under it keeps
+            spraying, and particle_swirl_burst sets off a burst in the
+            middle. Moves the swirl onto the CPU backend.
+        -Call before initCuda.
+
+   ######################################################################### */
+void set_particle_swirl_emitters(bool enable){
+    emitters = enable;
+}
+
+// Spawn `count` particles from the burst emitter at the next step
+void particle_swirl_burst(unsigned int count){
+    if (sim_thread){
+        pthread_mutex_lock(&sim_input_mutex);
+        sim_burst += count;
+        pthread_mutex_unlock(&sim_input_mutex);
+    } else if (particle_pool){
+        particle_pool->burst(1, count);
+    }
+}
+
+static void reset_particle_pool(unsigned int n){
+    if (particle_pool->num_emitters() == 0){
+        particle_emitter_t fountain = { 0.0f, 22.0f, 0.0f, 0.5f,  0.0f, 12.0f, 0.0f, 3.0f,
+            0.0f, 2.0f, 4.0f, 40u | (90u << 8) | (200u << 16) | (150u << 24), true };
+        particle_emitter_t burst = { 0.0f, 30.0f, 0.0f, 1.0f,  0.0f, 0.0f, 0.0f, 15.0f,
+            0.0f, 1.0f, 2.5f, 255u | (200u << 8) | (80u << 16) | (200u << 24), true };
+        particle_pool->add_emitter(fountain);
+        particle_pool->add_emitter(burst);
+    }
+    // keeps the pool about 3/8 full on its own, leaving room for bursts
+    particle_pool->emitter(0)->rate = n / 8.0f;
+    particle_pool->attach(&h_store, n/2, 2.0f, 12.0f, particle_init_key(init_key + 1));
+}
+
+/* #########################################################################
+    
+                         set_particle_swirl_timestep
+        -Length of one fixed step (ms) and how many of them a single
+            frame may take before the rest of its time is dropped.
+
+   ######################################################################### */
+void set_particle_swirl_timestep(float new_step_ms, int new_max_substeps){
+    step_ms = new_step_ms > 0.0f ? new_step_ms : DEFAULT_STEP_MS;
+    max_substeps = new_max_substeps > 0 ? new_max_substeps : 1;
+}
+
+/* #########################################################################
+    
+                       set_particle_swirl_deterministic
+        -Seeds the initial swirl with `seed` and decouples stepping
+            from wall time: each frame takes exactly max_substeps
+            fixed steps (never going past `steps` total, if nonzero).
+            The same seed, particle count, step and step count then
+            give bit-identical state run to run on a given backend.
+            The host backend also matches itself across SIMD levels
+            and thread counts, but only built with the Makefile's
+            FPFLAGS (SSE2 float math): x87 scalar code rounds the
+            chunk tails differently from the vector lanes. CPU and
+            CUDA do NOT match each other bit for bit.
+        -Call before initCuda.
+
+   ######################################################################### */
+void set_particle_swirl_deterministic(unsigned int seed, unsigned int steps){
+    deterministic = true;
+    det_seed = seed;
+    det_step_limit = steps;
+}
+
+/* #########################################################################
+    
+                           set_particle_swirl_nbody
+        -Adds the particles' mutual gravity (NBODY_GM, Barnes-Hut with
+            opening angle theta) to every step. Moves the swirl onto
+            the CPU backend even if there's a CUDA device.
+        -Call before initCuda.
+
+   ######################################################################### */
+void set_particle_swirl_nbody(bool enable, float theta){
+    nbody = enable;
+    nbody_theta = theta > 0.0f ? theta : DEFAULT_NBODY_THETA;
+}
+
+/* #########################################################################
+    
+                         set_particle_swirl_separation
+        -Every step, particles closer than radius push each other
+            apart (SEPARATION_STRENGTH, see Spatial_Hash::separate),
+            on top of the force fields and any N-body gravity. Moves
+            the swirl onto the CPU backend even if there's a CUDA
+            device.
+        -Call before initCuda.
+
+   ######################################################################### */
+void set_particle_swirl_separation(bool enable, float radius){
+    separation = enable;
+    separation_radius = radius > 0.0f ? radius : DEFAULT_SEPARATION_RADIUS;
+}
+
+/* #########################################################################
+    
+                          set_particle_swirl_fields
+        -Replaces the force-field list from the next step on. Any time
+            is fine: a CPU step already running keeps the fields it
+            started with, and the GPU copy is refreshed before the
+            next kernel launch.
+
+   ######################################################################### */
+void set_particle_swirl_fields(const force_field_list_t * fields){
+    pthread_mutex_lock(&sim_input_mutex);
+    swirl_fields = *fields;
+    swirl_fields_set = true;
+    swirl_fields_dirty = true;
+    pthread_mutex_unlock(&sim_input_mutex);
+}
+
+void get_particle_swirl_fields(force_field_list_t * fields){
+    pthread_mutex_lock(&sim_input_mutex);
+    if (!swirl_fields_set){
+        force_field_preset(0, &swirl_fields);
+        swirl_fields_set = true;
+    }
+    *fields = swirl_fields;
+    pthread_mutex_unlock(&sim_input_mutex);
+}
+
+static void upload_fields(){
+    if (!swirl_fields_dirty)
+        return;
+    CUDA_SAFE_CALL( cudaMemcpyToSymbol(d_fields, &swirl_fields, sizeof(swirl_fields)) );
+    swirl_fields_dirty = false;
+}
+
+/* #########################################################################
+    
+                             load_particle_swirl
+        -Replaces the particle state (and count, step count, step
+            length and RNG key) with a snapshot's. Takes about as long
+            as mapping the file, plus a VBO upload.
+        -Resuming a deterministic run from a snapshot at step k and
+            running to step N gives the same state as running to N
+            from scratch.
+
+            Return -1 if fail, 0 if success.
+   ######################################################################### */
+int load_particle_swirl(GLuint * vbo, const char * path){
+    particle_snapshot_t snap;
+    if (open_particle_snapshot(path, &snap)){
+        printf("Couldn't load snapshot %s.\n", path);
+        return -1;
+    }
+    return apply_snapshot(vbo, &snap);
+}
+
+static int apply_snapshot(GLuint * vbo, particle_snapshot_t * snap){
+    // the header lives in the mapping, which reset_particles may close
+    particle_snapshot_header_t h = *snap->header;
+    if (h.n > MAX_PARTICLES){
+        printf("Snapshot has %u particles; at most %u fit.\n", h.n, MAX_PARTICLES);
+        close_particle_snapshot(snap);
+        return -1;
+    }
+    if (sim_thread)
+        sim_thread->pause();
+    if (h.step_ms != step_ms && !replaying){
+        printf("Snapshot was stepped at %.3f ms; switching to that.\n", h.step_ms);
+        step_ms = h.step_ms;
+    }
+    init_key = h.key;
+    int ret = reset_particles(vbo, h.n, snap);
+    if (sim_thread)
+        sim_thread->resume();
+    return ret;
+}
+
+/* #########################################################################
+    
+                             save_particle_swirl
+        -Writes the current state (as of particle_swirl_steps()) to a
+            snapshot file; finishes the CPU backend's in-flight step
+            first, or copies the state back off the device.
+        -In async mode, pauses the sim thread and saves its latest
+            state, which may be a step or two past the one shown.
+
+            Return -1 if fail, 0 if success.
+   ######################################################################### */
+int save_particle_swirl(const char * path){
+    const unsigned int n = num_particles;
+    if (use_cpu){
+        if (sim_thread)
+            sim_thread->pause();
+        // leaves cpu_step_in_flight set, so the next frame still uploads it
+        if (cpu_step_in_flight)
+            cpu_pool->wait();
+        int ret = save_particle_snapshot(path, h_store, steps_taken, step_ms, init_key);
+        if (sim_thread)
+            sim_thread->resume();
+        return ret;
+    }
+
+    particle_store_t s;
+    if (particle_store_alloc(&s, n, true, true)){
+        printf("Memory alloc error.\n");
+        return -1;
+    }
+    float *dptr;
+    size_t size;
+    CUDA_SAFE_CALL( cudaGraphicsMapResources(1, resources) );
+    CUDA_SAFE_CALL( cudaGraphicsResourceGetMappedPointer((void **)(&dptr), &size, resources[0]) );
+    CUDA_SAFE_CALL( cudaMemcpy( s.x, dptr, particle_store_pos_size(n), cudaMemcpyDeviceToHost ) );
+    CUDA_SAFE_CALL( cudaMemcpy( s.vx, d_velocities, particle_store_vel_size(n),
+        cudaMemcpyDeviceToHost ) );
+    CUDA_SAFE_CALL( cudaGraphicsUnmapResources(1, resources, 0) );
+    int ret = save_particle_snapshot(path, s, steps_taken, step_ms, init_key);
+    particle_store_free(&s);
+    return ret;
+}
+
+/* #########################################################################
+    
+                         set_particle_swirl_recording
+        -Saves prefix_000000.swirl, prefix_000001.swirl, ... every
+            `every` steps from here on (0 turns recording off).
+
+   ######################################################################### */
+void set_particle_swirl_recording(const char * prefix, unsigned int every){
+    recorder.start(prefix, every, steps_taken);
+}
+
+/* #########################################################################
+    
+                          set_particle_swirl_replay
+        -Instead of simulating, play back the series recorded under
+            `prefix`, each snapshot shown when as much wall time has
+            passed as sim time had between it and the first. Call
+            before initCuda.
+
+   ######################################################################### */
+void set_particle_swirl_replay(const char * prefix){
+    if (replay.set_series(prefix) == 0)
+        replaying = true;
+}
+
+static void advance_replay(GLuint * vbo, double frame_ms){
+    // if we've fallen behind, this skips straight to the latest snapshot
+    //  that's due
+    particle_snapshot_t latest;
+    if (replay.advance(frame_ms, &latest)){
+        apply_snapshot(vbo, &latest);
+        if (culler)
+            culler->invalidate();
+        if (replay.finished())
+            printf("Replay finished after %u snapshots.\n", replay.opened());
+    }
+    render_alpha = 1.0f;
+}
+
+// Fixed steps since the last (re)initialization (in async mode, as of
+//  the state shown)
+unsigned int particle_swirl_steps(){
+    return sim_thread ? shown_steps : steps_taken;
+}
+
+// Interpolation factor between the prev and current position streams
+//  for whatever is in the VBO right now
+float particle_swirl_alpha(){
+    return render_alpha;
+}
+
+/* #########################################################################
+    
+                            fixed_steps_for_frame
+        -Adds a frame's worth of wall time to the accumulator and takes
+            as many whole steps out of it as it holds (clamped to
+            max_substeps). What's left over, as a fraction of a step,
+            comes back in alpha.
+        -Deterministic and headless runs ignore the wall time and take
+            max_substeps every frame, up to det_step_limit in all (none
+            at all once steps_taken is there or past it).
+
+   ######################################################################### */
+static int fixed_steps_for_frame(double frame_ms, float * alpha){
+    int steps;
+    if (deterministic || headless){
+        steps = max_substeps;
+        // a loaded snapshot can already be past the limit
+        if (det_step_limit && steps_taken + steps > det_step_limit)
+            steps = steps_taken >= det_step_limit ? 0 : det_step_limit - steps_taken;
+        *alpha = 1.0f;
+    } else {
+        step_accum += frame_ms;
+        steps = (int)(step_accum / step_ms);
+        // can't keep up: slow the swirl down rather than spiral
+        if (steps > max_substeps){
+            steps = max_substeps;
+            step_accum = steps * step_ms;
+        }
+        step_accum -= steps * step_ms;
+        *alpha = (float)(step_accum / step_ms);
+    }
+    steps_taken += steps;
+    return steps;
+}
+
+/* #########################################################################
+    
+                             particle_swirl_stream_offset
+        -Byte offset of one particle stream within the VBO, for
+            setting up attribute pointers when drawing. In compact
+            mode the position streams are unsigned shorts, to be
+            decoded with the boxes in particle_swirl_box_texture.
+
+   ######################################################################### */    
+size_t particle_swirl_stream_offset(int which){
+    if (compact)
+        return particle_quant_offset(num_particles, (particle_stream_t)which);
+    return particle_store_offset(num_particles, (particle_stream_t)which);
+}
+
 /* #########################################################################
     
                              advance_particle_swirl
-        - Grab VBO control for CUDA, run kernel to advance particles,
-            and pass VBO control back when done.
+        - Works out how many fixed steps this frame's wall time buys
+            (see fixed_steps_for_frame), then grabs VBO control for
+            CUDA, runs the kernel for that many steps, and passes VBO
+            control back when done. Frames that don't add up to a
+            whole step leave the VBO alone and just move alpha.
+        - Saves the next snapshot of a recording when it's due, and
+            in replay mode just shows whichever snapshot is due.
+        - On the CPU backend, collect the steps the worker threads
+            ran during the last frame, upload them into the VBO, and
+            start them on the next ones before returning, so the GLUT
+            thread never does particle math itself.
+        - Except in N-body mode: every step's gravity needs all of the
+            previous step's positions, so this frame's steps run (on
+            the workers) before it returns, and get shown right away.
+        - In emitter mode, particles are retired and spawned before
+            the steps go out, and only live ones are stepped and
+            uploaded.
+        - With trails, every step job streams its result into the
+            trail's next slot as well, and collecting it uploads that
+            slot; N-body steps record theirs after the fact.
+        - Between the upload and the next launch, culls what was just
+            uploaded for every eye (see cull_particles).
+        - Colliders that follow the player (see force_field.h) are
+            moved to (px, py, pz) before any of this frame's steps;
+            to the origin in deterministic mode, whatever the head does.
+        - In async mode none of the above happens here: this just
+            picks up the sim thread's newest state, if there's a new
+            one, without ever waiting (see show_sim_state).
 
    ######################################################################### */    
-int framesRendered = 0;
 void advance_particle_swirl(GLuint * vbo, float px, float py, float pz){
-    // map OpenGL buffer object for writing from CUDA
-    float4 *dptr;
-    CUDA_SAFE_CALL( cudaGraphicsMapResources(1, resources) );
-    size_t size;
-    CUDA_SAFE_CALL( cudaGraphicsResourceGetMappedPointer((void **)(&dptr), &size, resources[0]) );
-    float dt = (float) get_elapsed();
+    double frame_ms = get_elapsed();
+    // deterministic runs can't depend on the head: the player stays at
+    //  the origin, as in headless runs
+    if (deterministic)
+        px = py = pz = 0.0f;
+    if (replaying){
+        advance_replay(vbo, frame_ms);
+        return;
+    }
+    if (sim_thread){
+        show_sim_state(vbo, px, py, pz);
+        return;
+    }
+    char path[MAX_PATH];
+    if (recorder.due(steps_taken, path) && save_particle_swirl(path))
+        recorder.stop();
 
-    // execute the kernel
+    float alpha = render_alpha;
+    int steps = 0;
     if ((framesRendered) > 0)
-        d_simple_particle_swirl<<< GRID_SIZE, BLOCK_SIZE >>>(dptr, d_velocities, NUM_PARTICLES, dt,
-            make_float3(px, py, pz));
+        steps = fixed_steps_for_frame(frame_ms, &alpha);
+    // this frame's steps collide with the player where they are now
+    if (force_field_follow_player(&swirl_fields, px, py, pz))
+        swirl_fields_dirty = true;
+
+    if (use_cpu){
+        bool collected = false;
+        if (cpu_step_in_flight){
+            cpu_pool->wait();
+            update_ms = cpu_pool->last_job_ms();
+            cpu_step_in_flight = false;
+            collected = true;
+        }
+        if (trail && trail->claimed()){
+            trail->advance();
+            upload_trail_head();
+        }
+        // retire / spawn for the time this frame's steps cover, before
+        //  they run
+        if (particle_pool && steps > 0){
+            particle_pool->update(steps * step_ms / 1000.0f);
+            collected = true;
+        }
+        if ((nbody || separation) && steps > 0){
+            step_interacting(steps, swirl_fields);
+            if (trail){
+                trail->record(*live_host_store(), cpu_pool);
+                upload_trail_head();
+            }
+            collected = true;
+            cpu_job_alpha = alpha;
+            steps = 0;
+        }
+        // what's in the VBO now is what the last job stepped to
+        render_alpha = cpu_job_alpha;
+        // x/y/z (and prev) after every step, colors only when they've
+        //  changed; with emitters, only the live front of each stream
+        unsigned int live = get_live_particle_count();
+        if (!headless && compact){
+            // half the bytes of the float streams, plus the boxes
+            if (collected){
+                glBindBuffer( GL_ARRAY_BUFFER, *vbo );
+                glBufferSubData( GL_ARRAY_BUFFER, 0, particle_quant_xyz_size(num_particles), h_quant.qx );
+                glBufferSubData( GL_ARRAY_BUFFER, particle_quant_offset(num_particles, PARTICLE_STREAM_PREV_X),
+                    particle_quant_xyz_size(num_particles), h_quant.prev_qx );
+                glBindBuffer( GL_ARRAY_BUFFER, 0 );
+                glBindBuffer( GL_TEXTURE_BUFFER, quant_box_tbo );
+                glBufferSubData( GL_TEXTURE_BUFFER, 0, particle_quant_box_size(num_particles), h_quant.box );
+                glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+            }
+        } else if (!headless){
+            upload_positions(vbo, h_store, live, collected, h_store.color_dirty);
+            h_store.color_dirty = false;
+        }
+        // workers are idle and the host store matches the VBO: the one
+        //  moment a cull can read it
+        cull_particles();
+        cpu_job_alpha = alpha;
+        if (steps > 0 && compact){
+            quant_job.s = live_host_store();
+            quant_job.q = &h_quant;
+            quant_job.dt = step_ms;
+            quant_job.steps = steps;
+            quant_job.simd = cpu_simd;
+            quant_job.fields = swirl_fields;
+            h_quant_swirl_async(cpu_pool, &quant_job);
+            cpu_step_in_flight = true;
+        } else if (steps > 0){
+            cpu_job.s = live_host_store();
+            cpu_job.dt = step_ms;
+            cpu_job.steps = steps;
+                cpu_job.simd = cpu_simd;
+            cpu_job.fields = swirl_fields;
+            cpu_job.trail.x = NULL;
+            if (trail)
+                cpu_job.trail = trail->claim();
+            h_simple_particle_swirl_async(cpu_pool, &cpu_job);
+            cpu_step_in_flight = true;
+        }
+        framesRendered++;
+        return;
+    }
 
-    // unmap buffer object
-    CUDA_SAFE_CALL(cudaGraphicsUnmapResources(1, resources, 0));
+    // pick up the last kernel's time if it's finished (without waiting on it)
+    float kernel_ms;
+    if (gpu_step_timed && cudaEventQuery(step_stop) == cudaSuccess &&
+        cudaEventElapsedTime(&kernel_ms, step_start, step_stop) == cudaSuccess)
+        update_ms = kernel_ms;
+
+    // execute the kernel
+    if (steps > 0){
+        // map OpenGL buffer object for writing from CUDA
+        float *dptr;
+        CUDA_SAFE_CALL( cudaGraphicsMapResources(1, resources) );
+        size_t size;
+        CUDA_SAFE_CALL( cudaGraphicsResourceGetMappedPointer((void **)(&dptr), &size, resources[0]) );
+        particle_store_t d_store;
+        particle_store_bind(&d_store, num_particles, dptr, d_velocities, true, true);
+        upload_fields();
+
+        cudaEventRecord(step_start);
+        d_simple_particle_swirl<<< GRID_SIZE(num_particles), BLOCK_SIZE >>>(d_store, step_ms, steps);
+        cudaEventRecord(step_stop);
+        gpu_step_timed = true;
+
+        // unmap buffer object
+        CUDA_SAFE_CALL(cudaGraphicsUnmapResources(1, resources, 0));
+    }
+    render_alpha = alpha;
+    framesRendered++;
+}
+
+
+/* #########################################################################
+    
+                               step_interacting
+        -One step at a time: kick every velocity with the octree's
+            gravity and / or the neighbor grid's separation, then one
+            attractor step on the workers. The last step leaves its
+            starting positions in the prev streams, same as a fused
+            multi-step job would.
+
+   ######################################################################### */    
+static void step_interacting(int steps, const force_field_list_t & fields){
+    LARGE_INTEGER start, stop;
+    QueryPerformanceCounter(&start);
+    for (int k = 0; k < steps; k++){
+        cpu_job.s = live_host_store();
+        if (nbody_tree)
+            nbody_tree->kick(*cpu_job.s, NBODY_GM, step_ms / 1000.0f, cpu_pool);
+        if (separation_grid)
+            separation_grid->separate(*cpu_job.s, separation_radius, SEPARATION_STRENGTH,
+                step_ms / 1000.0f, cpu_pool);
+        cpu_job.dt = step_ms;
+        cpu_job.steps = 1;
+        cpu_job.simd = cpu_simd;
+        cpu_job.fields = fields;
+        cpu_job.trail.x = NULL;
+        h_simple_particle_swirl_async(cpu_pool, &cpu_job);
+        cpu_pool->wait();
+    }
+    QueryPerformanceCounter(&stop);
+    update_ms = ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)perfFreq);
+}
+
+/* #########################################################################
+    
+                               upload_positions
+        -x / y / z and prev of particles [0, live) of s (a store or a
+            sim slot, with num_particles' layout) into the VBO if
+            `positions`, and their colors if `colors`. All in two
+            calls when every particle is live.
+
+   ######################################################################### */    
+static void upload_positions(GLuint * vbo, const particle_store_t & s, unsigned int live,
+                             bool positions, bool colors){
+    glBindBuffer( GL_ARRAY_BUFFER, *vbo );
+    if (positions && live == num_particles){
+        glBufferSubData( GL_ARRAY_BUFFER, 0, particle_store_xyz_size(num_particles), s.x );
+        glBufferSubData( GL_ARRAY_BUFFER, particle_store_offset(num_particles, PARTICLE_STREAM_PREV_X),
+            particle_store_xyz_size(num_particles), s.prev_x );
+    } else if (positions){
+        const float * streams[6] = { s.x, s.y, s.z, s.prev_x, s.prev_y, s.prev_z };
+        const particle_stream_t which[6] = { PARTICLE_STREAM_X, PARTICLE_STREAM_Y, PARTICLE_STREAM_Z,
+            PARTICLE_STREAM_PREV_X, PARTICLE_STREAM_PREV_Y, PARTICLE_STREAM_PREV_Z };
+        for (int k = 0; k < 6; k++)
+            glBufferSubData( GL_ARRAY_BUFFER, particle_store_offset(num_particles, which[k]),
+                live*sizeof(float), streams[k] );
+    }
+    if (colors)
+        glBufferSubData( GL_ARRAY_BUFFER, particle_store_offset(num_particles, PARTICLE_STREAM_COLOR),
+            live*sizeof(unsigned int), s.color );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+/* #########################################################################
+    
+                           set_particle_swirl_trails
+        -Keep the last `length` positions of every particle (see
+            particle_trail.h) for drawing motion streaks; 0 for none.
+            Moves the swirl onto the CPU backend. Call before
+            initCuda.
+        -particle_swirl_trail hands out the ring and the GL buffers
+            mirroring it (vertices, segment patterns), or NULL if
+            there are no trails.
+
+   ######################################################################### */    
+void set_particle_swirl_trails(int length){
+    trail_length = length > 0 ? length : 0;
+}
+
+Particle_Trail * particle_swirl_trail(GLuint * vbo, GLuint * ibo){
+    if (!trail)
+        return NULL;
+    *vbo = trail_vbo;
+    *ibo = trail_ibo;
+    return trail;
+}
+
+// Just the newest slot changed; one upload of its three streams
+static void upload_trail_head(){
+    if (headless)
+        return;
+    int k = trail->head();
+    glBindBuffer( GL_ARRAY_BUFFER, trail_vbo );
+    glBufferSubData( GL_ARRAY_BUFFER, trail->slot_offset(k), trail->slot_bytes(), trail->slot(k).x );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+/* #########################################################################
+    
+                                  sim_tick
+        -Async mode's simulation, one turn of the sim thread: the same
+            fixed steps advance_particle_swirl would take for frame_ms
+            (with the same pool update / N-body / step job, run to the
+            end on the workers), then the result goes into the back
+            slot and is published. Due recording snapshots are saved
+            from here, since the state is this thread's.
+        -The player position, fields and bursts are read once, under
+            the input mutex, before the steps.
+
+   ######################################################################### */    
+static int sim_tick(double frame_ms, double * wait_ms, void * user){
+    double tick_ms = clock_ms();
+    if (num_particles == 0){
+        *wait_ms = step_ms;
+        return 0;
+    }
+    recorder.record(h_store, steps_taken, step_ms, init_key);
+
+    float alpha;
+    int steps = fixed_steps_for_frame(frame_ms, &alpha);
+    *wait_ms = step_ms * (1.0f - alpha);
+    if (steps == 0)
+        return 0;
+
+    pthread_mutex_lock(&sim_input_mutex);
+    float px = sim_px, py = sim_py, pz = sim_pz;
+    force_field_follow_player(&swirl_fields, px, py, pz);
+    cpu_job.fields = swirl_fields;
+    unsigned int burst = sim_burst;
+    sim_burst = 0;
+    pthread_mutex_unlock(&sim_input_mutex);
+
+    if (particle_pool){
+        if (burst)
+            particle_pool->burst(1, burst);
+        particle_pool->update(steps * step_ms / 1000.0f);
+    }
+    if (nbody || separation){
+        step_interacting(steps, cpu_job.fields);
+    } else {
+        cpu_job.s = live_host_store();
+        cpu_job.dt = step_ms;
+        cpu_job.steps = steps;
+        cpu_job.simd = cpu_simd;
+        cpu_job.trail.x = NULL;
+        h_simple_particle_swirl_async(cpu_pool, &cpu_job);
+        cpu_pool->wait();
+        update_ms = cpu_pool->last_job_ms();
+    }
+    // the steps cover up to alpha of a step short of now
+    publish_sim_state(tick_ms - alpha * step_ms);
+    return steps;
+}
+
+/* #########################################################################
+    
+                               reset_sim_slots
+        -Sizes the three slots for num_particles and starts the
+            handoff over with nothing published; the VBO already has
+            the new state (reset_particles put it there). Sim thread
+            paused, or not started yet.
+
+   ######################################################################### */    
+static void reset_sim_slots(){
+    for (int k = 0; k < 3; k++){
+        _aligned_free(sim_slots[k].s.x);
+        memset(&sim_slots[k], 0, sizeof(sim_slot_t));
+        if (num_particles == 0)
+            continue;
+        void * pos = _aligned_malloc(particle_store_pos_size(num_particles), 64);
+        if (!pos){
+            printf("Memory alloc error.\n");
+            exit(1);
+        }
+        memset(pos, 0, particle_store_pos_size(num_particles));
+        particle_store_bind(&sim_slots[k].s, num_particles, pos, NULL, true, true);
+    }
+    sim_buffer.reset();
+    // slots start at gen 0, so they all take the colors on first use
+    color_gen++;
+    vbo_color_gen = color_gen;
+    shown_steps = steps_taken;
+    shown_live = particle_pool ? particle_pool->live() : num_particles;
+    shown_state_ms = clock_ms();
+}
+
+// Copy the live state into the back slot and hand it over (sim thread)
+static void publish_sim_state(double state_ms){
+    sim_slot_t & slot = sim_slots[sim_buffer.back()];
+    particle_store_t * s = live_host_store();
+    const unsigned int live = s->n;
+    if (live == num_particles){
+        memcpy(slot.s.x, s->x, particle_store_xyz_size(num_particles));
+        memcpy(slot.s.prev_x, s->prev_x, particle_store_xyz_size(num_particles));
+    } else {
+        const float * from[6] = { s->x, s->y, s->z, s->prev_x, s->prev_y, s->prev_z };
+        float * to[6] = { slot.s.x, slot.s.y, slot.s.z, slot.s.prev_x, slot.s.prev_y, slot.s.prev_z };
+        for (int k = 0; k < 6; k++)
+            memcpy(to[k], from[k], live*sizeof(float));
+    }
+    if (h_store.color_dirty){
+        color_gen++;
+        h_store.color_dirty = false;
+    }
+    if (slot.color_gen != color_gen){
+        memcpy(slot.s.color, s->color, live*sizeof(unsigned int));
+        slot.color_gen = color_gen;
+    }
+    slot.live = live;
+    slot.steps = steps_taken;
+    slot.state_ms = state_ms;
+    sim_buffer.publish();
+}
+
+/* #########################################################################
+    
+                                show_sim_state
+        -Async mode's side of advance_particle_swirl: hands the sim
+            thread the player position, and uploads the newest state
+            it has published, if that's one we haven't shown. Never
+            blocks; if the sim thread is slower than the frame rate,
+            frames just go on showing the last state.
+        -alpha is how far past the shown state's time the frame is,
+            in steps, so particles keep moving smoothly between
+            states as long as they come in at least once a step.
+
+   ######################################################################### */    
+static void show_sim_state(GLuint * vbo, float px, float py, float pz){
+    pthread_mutex_lock(&sim_input_mutex);
+    sim_px = px; sim_py = py; sim_pz = pz;
+    pthread_mutex_unlock(&sim_input_mutex);
+
+    if (sim_buffer.acquire()){
+        const sim_slot_t & slot = sim_slots[sim_buffer.front()];
+        upload_positions(vbo, slot.s, slot.live, true, slot.color_gen != vbo_color_gen);
+        vbo_color_gen = slot.color_gen;
+        shown_steps = slot.steps;
+        shown_live = slot.live;
+        shown_state_ms = slot.state_ms;
+    }
+    float alpha = (float)((clock_ms() - shown_state_ms) / step_ms);
+    render_alpha = alpha < 0.0f ? 0.0f : (alpha > 1.0f ? 1.0f : alpha);
     framesRendered++;
 }
 
+/* #########################################################################
+    
+                               cull_particles
+        -Culls the live particles, as the shader will place them
+            (render_alpha of the way from prev to current), against
+            every eye set with set_particle_swirl_view, on the
+            workers, and uploads each eye's visible list to its
+            element buffer.
+        -The eye matrices are the previous frame's, since this runs
+            before that frame's render; CULL_GUARD_BAND widens them to
+            cover the head turning in between.
+        -With depth sorting on, each list is sorted farthest first
+            (see particle_sort.h) before it goes up, unless it's over
+            sort_limit: that eye is drawn in index order instead.
+
+   ######################################################################### */    
+static void cull_particles(){
+    if (!culler)
+        return;
+    culler->invalidate();
+    if (!culling)
+        return;
+    particle_store_t * s = live_host_store();
+    culler->cull(*s, render_alpha, cpu_pool);
+    for (int v = 0; v < CULL_MAX_VIEWS; v++){
+        if (!culler->has_view(v))
+            continue;
+        const unsigned int * list = culler->indices(v);
+        if (depth_sort)
+            list = sorter->sort_within(v, *s, render_alpha, culler->view_proj(v), list,
+                culler->visible(v), sort_limit, cpu_pool);
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, cull_ibo[v] );
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, culler->visible(v)*sizeof(unsigned int),
+            list, GL_STREAM_DRAW );
+    }
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+}
+
+// Frustum culling on / off (it's on by default, and CPU only)
+void set_particle_swirl_culling(bool enable){
+    culling = enable;
+    if (culler)
+        culler->invalidate();
+}
+
+bool get_particle_swirl_culling(){
+    return culling && culler != NULL;
+}
+
+// Eye v's column-major projection * modelview for the next cull, or
+//  NULL if that eye isn't being drawn
+void set_particle_swirl_view(int v, const float * view_proj){
+    if (culler)
+        culler->set_view(v, view_proj);
+}
+
+/* #########################################################################
+    
+                           particle_swirl_draw_list
+        -Element buffer and index count to draw eye v with, if the
+            last cull made a list for it. Return false if there's no
+            list (culling off, GPU backend, first frame, ...), in
+            which case draw all the live particles.
+
+   ######################################################################### */    
+bool particle_swirl_draw_list(int v, GLuint * ibo, unsigned int * count){
+    if (!culler || !culler->valid() || !culler->has_view(v))
+        return false;
+    *ibo = cull_ibo[v];
+    *count = culler->visible(v);
+    return true;
+}
+
+// How long the last cull took, in ms (0 if culling is off)
+double particle_swirl_cull_ms(){
+    return get_particle_swirl_culling() ? culler->last_cull_ms() : 0.0;
+}
+
+// Back-to-front sorting of the culled lists on / off (off by default;
+//  does nothing without culling)
+void set_particle_swirl_depth_sort(bool enable){
+    depth_sort = enable;
+    if (sorter)
+        sorter->forget();
+}
+
+bool get_particle_swirl_depth_sort(){
+    return depth_sort && get_particle_swirl_culling();
+}
+
+// Longest visible list that gets sorted; 0 sorts them all, and
+//  DEPTH_SORT_AUTO_LIMIT measures it when the CPU backend starts
+void set_particle_swirl_sort_limit(unsigned int limit){
+    sort_limit = limit;
+}
+
+// Whether the last cull drew some eye unsorted for being over the limit
+bool particle_swirl_sort_skipped(){
+    if (!get_particle_swirl_depth_sort())
+        return false;
+    for (int v = 0; v < CULL_MAX_VIEWS; v++)
+        if (culler->has_view(v) && sorter->skipped(v))
+            return true;
+    return false;
+}
+
+// How long the last eye's sort took, in ms (0 if sorting is off)
+double particle_swirl_sort_ms(){
+    return get_particle_swirl_depth_sort() ? sorter->last_sort_ms() : 0.0;
+}
 
 /* #########################################################################
     
                            d_simple_particle_swirl
                                     KERNEL!
+        -Takes `steps` fixed steps of dt ms of one particle per thread
+            through swirl_integrate (particle_integrate.h), the same
+            code the host backend runs: each step applies every field
+            in d_fields, in order, moves the particle, then pushes it
+            back out of any collider it ended up inside. The position
+            from before the last step goes to the prev streams for
+            interpolation.
+        -The step length is dt / 1000 in float, as on the host; the
+            position update used to promote to double here.
         
    ######################################################################### */ 
-__global__ void d_simple_particle_swirl(float4* pos, float4* vels, unsigned int N, float dt,
-        float3 player_pos)
+__global__ void d_simple_particle_swirl(particle_store_t s, float dt, int steps)
 {
-    // Indices into the VBO data.
-    unsigned long int i = blockIdx.x*blockDim.x + threadIdx.x;
-    if (i < N) {
-        /* Update vels to orbit <0, 3, 0> */
-        float dist2 = pos[i].x*pos[i].x + pos[i].y*pos[i].y + pos[i].z*pos[i].z;
-        if (dist2 != 0){
-            vels[i].x -= 10.0 * pos[i].x / dist2;
-            vels[i].y -= 10.0 * (pos[i].y - 30.0) / dist2;
-            vels[i].z -= 10.0 * pos[i].z / dist2;
-        }
-        /* And update position based on velocity */
-        pos[i].x += vels[i].x*dt/1000.0;
-        pos[i].y += vels[i].y*dt/1000.0;
-        pos[i].z += vels[i].z*dt/1000.0;
-        /* Assign color as a rough diffuse lighting model */
-        float3 to_our_pos = make_float3(pos[i].x - player_pos.x,
-                                                  pos[i].y - player_pos.y,
-                                                  pos[i].z - player_pos.z);
-        float flen = to_our_pos.x*to_our_pos.x + to_our_pos.y*to_our_pos.y + to_our_pos.z*to_our_pos.z;
-        if (flen != 0.0){
-            to_our_pos.x /= flen;
-            to_our_pos.y /= flen;
-            to_our_pos.z /= flen;
-        }
-
-        float value = 150;
-        unsigned char * tmp = (unsigned char *)&(pos[i]);
-        tmp[12] = (unsigned char)(value);
-        tmp[13] = (unsigned char)(50); 
-        tmp[14] = (unsigned char)(10); 
-        tmp[15] = (unsigned char) 150;
+    // Indices into the particle streams.
+    unsigned int i = blockIdx.x*blockDim.x + threadIdx.x;
+    if (i < s.n) {
+        swirl_soa_layout l(s);
+        swirl_integrate(l, i, d_fields, dt / 1000.0f, steps);
+        /* Color is constant (SWIRL_PARTICLE_COLOR) and lives in its own
+           stream, written once at init; nothing to do for it here. */
     }
 }
 
+/* #########################################################################
+    
+                           d_init_swirl_particles
+                                    KERNEL!
+        -One thread per particle; see swirl_init_particle.
+        
+   ######################################################################### */ 
+__global__ void d_init_swirl_particles(particle_store_t s, unsigned long long key)
+{
+    unsigned int i = blockIdx.x*blockDim.x + threadIdx.x;
+    if (i < s.n)
+        swirl_init_particle(s, i, key);
+}
+
+/* #########################################################################
+    
+                           particle_swirl_update_ms
+        -Time the most recently finished particle step took: worker
+            wall time on the CPU backend, kernel time on the GPU.
+
+   ######################################################################### */    
+double particle_swirl_update_ms(){
+    return update_ms;
+}
+
+/* #########################################################################
+    
+                          set_particle_swirl_headless
+        -No GL context, window or devices: initCuda and friends leave
+            the VBO alone (pass any pointer), the CPU backend is
+            forced, and culling is off. Step with
+            run_particle_swirl_headless.
+        -Call before initCuda.
+
+   ######################################################################### */
+void set_particle_swirl_headless(bool enable){
+    headless = enable;
+}
+
+/* #########################################################################
+    
+                          set_particle_swirl_compact
+        -Upload and draw the particles compact (16-bit positions in
+            per-block boxes; see particle_quant.h): half the position
+            bytes uploaded and fetched per vertex, for a bit of
+            position error and the step jobs' packing time. The step
+            itself stays float. Forces the CPU backend; not with N-body
+            or emitters.
+        -Call before initCuda. particle_swirl_compact says whether it
+            took, in which case draw with the box texture.
+
+   ######################################################################### */
+void set_particle_swirl_compact(bool enable){
+    compact = enable;
+}
+
+bool particle_swirl_compact(){
+    return compact;
+}
+
+// Buffer texture of the compact state's block boxes: two RGBA32F
+//  texels per QUANT_BLOCK particles, min then scale
+GLuint particle_swirl_box_texture(){
+    return quant_box_tex;
+}
+
+/* #########################################################################
+    
+                           set_particle_swirl_async
+        -Run the simulation on its own thread (see sim_thread.h), so
+            a slow step never holds up a frame and the frame rate
+            never holds up the steps: each finished state goes to the
+            render thread through a triple buffer, and every frame
+            draws the newest one there is. Forces the CPU backend and
+            turns culling off; not with headless, compact,
+            deterministic or replay runs.
+        -Call before initCuda.
+
+   ######################################################################### */
+void set_particle_swirl_async(bool enable){
+    async_sim = enable;
+}
+
+// Async mode's rates, each over the last second: fixed steps the sim
+//  thread took, and states it published. False if not in async mode.
+bool particle_swirl_sim_rates(double * steps_per_s, double * states_per_s){
+    if (!sim_thread)
+        return false;
+    *steps_per_s = sim_thread->steps_per_second();
+    *states_per_s = sim_thread->ticks_per_second();
+    return true;
+}
+
+/* #########################################################################
+    
+                         run_particle_swirl_headless
+        -Advances the swirl `steps` fixed steps past wherever it is,
+            max_substeps per frame and as fast as the workers go, then
+            prints the throughput and the per-frame step time spread.
+        -Frames are driven exactly as advance_particle_swirl does for
+            the window (pool update, N-body, async step job), so this
+            times the simulation side of a real frame minus the upload
+            and cull.
+
+            Return -1 if not headless, 0 if success.
+   ######################################################################### */
+int run_particle_swirl_headless(unsigned int steps){
+    if (!headless || !use_cpu || num_particles == 0){
+        printf("Headless run needs set_particle_swirl_headless before initCuda.\n");
+        return -1;
+    }
+    const unsigned int first_step = steps_taken;
+    det_step_limit = first_step + steps;
+
+    // one warm-up frame takes no steps (see advance_particle_swirl)
+    advance_particle_swirl(NULL, 0.0f, 0.0f, 0.0f);
+
+    std::vector<double> frame_ms;
+    unsigned long long particle_steps = 0;
+    LARGE_INTEGER start, stop, freq;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    // each frame collects the job before it, so one more frame after
+    //  the last launch picks that up
+    while (steps_taken < det_step_limit || cpu_step_in_flight){
+        unsigned int before = steps_taken;
+        advance_particle_swirl(NULL, 0.0f, 0.0f, 0.0f);
+        // the live count the new job (or N-body frame) got
+        particle_steps += (unsigned long long)(steps_taken - before) * get_live_particle_count();
+        if (update_ms > 0.0)
+            frame_ms.push_back(update_ms);
+        update_ms = 0.0;
+    }
+    QueryPerformanceCounter(&stop);
+    double wall_ms = ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+    unsigned int taken = steps_taken - first_step;
+
+    printf("Headless: %u particles (%u live), %u steps of %.3f ms, %d per frame, %s, %d threads%s%s%s\n",
+        num_particles, get_live_particle_count(), taken, step_ms, max_substeps,
+        swirl_simd_name(cpu_simd), cpu_pool->num_threads(), nbody ? ", N-body" : "",
+        separation ? ", separation" : "", particle_pool ? ", emitters" : "");
+    printf("    %10.1f ms wall  %10.1f steps/s  %10.2f M particle-steps/s\n",
+        wall_ms, taken * 1000.0 / wall_ms, particle_steps / wall_ms / 1000.0);
+    if (!frame_ms.empty()){
+        double total = 0.0;
+        for (size_t i = 0; i < frame_ms.size(); i++)
+            total += frame_ms[i];
+        std::sort(frame_ms.begin(), frame_ms.end());
+        size_t last = frame_ms.size() - 1;
+        printf("    frame step ms over %u frames: mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+            (unsigned int)frame_ms.size(), total / frame_ms.size(), frame_ms[last/2],
+            frame_ms[(size_t)(last*0.95)], frame_ms[(size_t)(last*0.99)], frame_ms[last]);
+    }
+    return 0;
+}
+
+/* #########################################################################
+    
+                           validate_particle_swirl
+        -Runs one step of the CUDA kernel and of every host backend
+            from the same state and reports the worst disagreement
+            against SWIRL_CPU_TOLERANCE.
+        -Advances the live state by one step as a side effect.
+
+            Return -1 if there's no device or a backend is out of
+            tolerance, 0 if all agree.
+   ######################################################################### */ 
+int validate_particle_swirl(GLuint * vbo){
+    if (use_cpu){
+        printf("No CUDA device to validate the CPU backend against.\n");
+        return -1;
+    }
+    const float dt = 16.0f;
+    const unsigned int n = num_particles;
+    float *dptr;
+    size_t size;
+    particle_store_t start_store, gpu_store, cpu_store;
+    if (particle_store_alloc(&start_store, n, false, false) ||
+        particle_store_alloc(&gpu_store, n, false, false) ||
+        particle_store_alloc(&cpu_store, n, false, false)){
+        printf("Memory alloc error.\n");
+        exit(1);
+    }
+
+    CUDA_SAFE_CALL( cudaGraphicsMapResources(1, resources) );
+    CUDA_SAFE_CALL( cudaGraphicsResourceGetMappedPointer((void **)(&dptr), &size, resources[0]) );
+    particle_store_t d_store;
+    particle_store_bind(&d_store, n, dptr, d_velocities, true, true);
+    upload_fields();
+    CUDA_SAFE_CALL( cudaMemcpy( start_store.x, dptr, particle_store_xyz_size(n), cudaMemcpyDeviceToHost ) );
+    CUDA_SAFE_CALL( cudaMemcpy( start_store.vx, d_velocities, particle_store_vel_size(n),
+        cudaMemcpyDeviceToHost ) );
+    d_simple_particle_swirl<<< GRID_SIZE(n), BLOCK_SIZE >>>(d_store, dt, 1);
+    CUDA_SAFE_CALL( cudaMemcpy( gpu_store.x, dptr, particle_store_xyz_size(n), cudaMemcpyDeviceToHost ) );
+    CUDA_SAFE_CALL( cudaMemcpy( gpu_store.vx, d_velocities, particle_store_vel_size(n),
+        cudaMemcpyDeviceToHost ) );
+    CUDA_SAFE_CALL( cudaGraphicsUnmapResources(1, resources, 0) );
+
+    int ret = 0;
+    swirl_simd_t best = detect_swirl_simd();
+    for (int simd = SWIRL_SIMD_SCALAR; simd <= best; simd++){
+        memcpy(cpu_store.x, start_store.x, particle_store_xyz_size(n));
+        memcpy(cpu_store.vx, start_store.vx, particle_store_vel_size(n));
+        h_simple_particle_swirl(cpu_store, swirl_fields, dt, 1, (swirl_simd_t)simd);
+        float worst = 0.0f;
+        const float * a[6] = { cpu_store.x, cpu_store.y, cpu_store.z,
+                               cpu_store.vx, cpu_store.vy, cpu_store.vz };
+        const float * b[6] = { gpu_store.x, gpu_store.y, gpu_store.z,
+                               gpu_store.vx, gpu_store.vy, gpu_store.vz };
+        for (int c = 0; c < 6; c++){
+            for (unsigned int i = 0; i < n; i++){
+                float scale = fabsf(b[c][i]) > 1.0f ? fabsf(b[c][i]) : 1.0f;
+                float e = fabsf(a[c][i] - b[c][i]) / scale;
+                if (e > worst) worst = e;
+            }
+        }
+        bool ok = worst <= SWIRL_CPU_TOLERANCE;
+        printf("Validate %s vs CUDA: max rel err %g (%s)\n", swirl_simd_name((swirl_simd_t)simd),
+            worst, ok ? "ok" : "OUT OF TOLERANCE");
+        if (!ok) ret = -1;
+    }
+
+    particle_store_free(&start_store);
+    particle_store_free(&gpu_store);
+    particle_store_free(&cpu_store);
+    return ret;
+}
+
+/* #########################################################################
+    
+                           particle_swirl_checksum
+        -64-bit FNV-1a over every particle's x/y/z/vx/vy/vz (stream by
+            stream, padding excluded) as of particle_swirl_steps()
+            steps, for comparing deterministic runs.
+        -On the CPU backend, finishes the in-flight step first (or
+            pauses the sim thread).
+
+   ######################################################################### */ 
+static unsigned long long fnv1a(unsigned long long h, const void * data, size_t bytes){
+    const unsigned char * p = (const unsigned char *)data;
+    for (size_t i = 0; i < bytes; i++){
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+unsigned long long particle_swirl_checksum(){
+    const unsigned int n = num_particles;
+    particle_store_t s;
+    if (use_cpu){
+        if (sim_thread)
+            sim_thread->pause();
+        // leaves cpu_step_in_flight set, so the next frame still uploads it
+        if (cpu_step_in_flight)
+            cpu_pool->wait();
+        s = h_store;
+    } else {
+        if (particle_store_alloc(&s, n, false, false)){
+            printf("Memory alloc error.\n");
+            exit(1);
+        }
+        float *dptr;
+        size_t size;
+        CUDA_SAFE_CALL( cudaGraphicsMapResources(1, resources) );
+        CUDA_SAFE_CALL( cudaGraphicsResourceGetMappedPointer((void **)(&dptr), &size, resources[0]) );
+        CUDA_SAFE_CALL( cudaMemcpy( s.x, dptr, particle_store_xyz_size(n), cudaMemcpyDeviceToHost ) );
+        CUDA_SAFE_CALL( cudaMemcpy( s.vx, d_velocities, particle_store_vel_size(n),
+            cudaMemcpyDeviceToHost ) );
+        CUDA_SAFE_CALL( cudaGraphicsUnmapResources(1, resources, 0) );
+    }
+
+    unsigned long long h = 14695981039346656037ULL;
+    const float * streams[6] = { s.x, s.y, s.z, s.vx, s.vy, s.vz };
+    for (int c = 0; c < 6; c++)
+        h = fnv1a(h, streams[c], n*sizeof(float));
+
+    if (!use_cpu)
+        particle_store_free(&s);
+    if (sim_thread)
+        sim_thread->resume();
+    return h;
+}
+
+/* #########################################################################
+    
+                              have_cuda_device
+                                            
+        -True if the runtime can see at least one CUDA device.
+   ######################################################################### */ 
+static bool have_cuda_device(){
+    int count = 0;
+    if (cudaGetDeviceCount(&count) != cudaSuccess)
+        return false;
+    return count > 0;
+}
+
 /* #########################################################################
     
                                 get_framerate
@@ -233,3 +1849,17 @@ static double get_elapsed(){
     lastTicks_elapsed = currTicks;
     return elapsed;
 }
+
+/* #########################################################################
+    
+                                  clock_ms
+                                            
+        -Milliseconds on the performance counter; unlike get_elapsed
+            it keeps no state, so both threads can use it
+        
+   ######################################################################### */ 
+static double clock_ms(){
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return ((double)li.QuadPart) * 1000.0 / ((double)perfFreq);
+}
@@ -22,8 +22,46 @@
 #include <windows.h>
    
 namespace xen_rift {
-	// Data dimensionality
-	#define NUM_PARTICLES (1024*250)
+	// Data dimensionality: default particle count; the live count is a
+	//  runtime setting (-particles N, or [ / ] to halve / double).
+	#define DEFAULT_NUM_PARTICLES (1024*250)
+	// A 1-D grid of 1024-thread blocks tops out at 65535 blocks on
+	//  older devices.
+	#define MAX_PARTICLES (65535u*1024u)
+
+	// Fixed-step integration: the swirl always advances in steps of
+	//  DEFAULT_STEP_MS (-step MS), at most DEFAULT_MAX_SUBSTEPS of them
+	//  per frame (-substeps N); a frame that would need more drops the
+	//  backlog instead of trying to catch up.
+	#define DEFAULT_STEP_MS (1000.0f/120.0f)
+	#define DEFAULT_MAX_SUBSTEPS (4)
+
+	// Where the o key saves a particle snapshot
+	#define SNAPSHOT_FILE "particle_swirl.swirl"
+
+	// Neighbor grid cell side (and so max interaction radius), world units
+	#define SPATIAL_HASH_CELL_SIZE (0.25f)
+
+	// N-body mode (-nbody): strength of the swirl's mutual gravity (the
+	//  particles share a total mass of 1) and the Barnes-Hut opening
+	//  angle (-theta X); smaller is more accurate and slower.
+	#define NBODY_GM (2000.0f)
+	#define DEFAULT_NBODY_THETA (0.7f)
+
+	// Separation mode (-separation [R]): particles closer than R push
+	//  each other apart, SEPARATION_STRENGTH units/s^2 apiece at zero
+	//  distance, falling off linearly to nothing at R.
+	#define DEFAULT_SEPARATION_RADIUS (0.1f)
+	#define SEPARATION_STRENGTH (50.0f)
+
+	// Frustum culling: how far (as a fraction of w) the eye frustums'
+	//  sides are pushed out, to cover a frame of head turning and the
+	//  width of a point.
+	#define CULL_GUARD_BAND (0.15f)
+
+	// Motion trails (-trails K): history slots per particle when K isn't
+	//  given, i.e. streaks this many steps long.
+	#define DEFAULT_TRAIL_LENGTH (16)
 
 };
 
@@ -0,0 +1,324 @@
+/* #########################################################################
+        simple_particle_swirl: host-side (CPU) particle integrator
+
+   Same force-field / integrate step as d_simple_particle_swirl, for
+   render nodes without a CUDA device. Works straight on the particle_store
+   streams, so each SIMD path is plain contiguous loads and stores:
+        SSE: 4 particles per iteration
+        AVX: 8 particles per iteration
+   Every path is swirl_integrate (particle_integrate.h), the same code
+   the CUDA kernel runs: on float for the scalar path and whatever is
+   left over at the ends of the buffer, on sse_lane / avx_lane
+   (particle_lane_simd.h) for the vector ones.
+   Several fixed steps in one call are fused: each group of particles
+   is loaded once, stepped `steps` times in registers and stored once,
+   and each step runs every field in the list on it before moving on.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Moved onto the SoA particle_store
+     agent  20261017  Chunked multithreaded step + thread scaling benchmark
+     agent  20261017  Fused fixed sub-steps, previous-position output
+     agent  20261017  Parallel counter-based initialization
+     agent  20261017  Force-field list instead of the fixed attractor
+     agent  20261017  AoS float4 step for the benchmark suite
+     agent  20261017  SDF collisions after every position update
+     agent  20261017  Scalar paths are the shared swirl_integrate template
+     agent  20261017  Step chunks stream into a trail slot when asked
+     agent  20261017  Steps drop the unused player position
+     agent  20261017  SSE / AVX paths are swirl_integrate on lane types, not copies
+   ######################################################################### */
+
+#include "simple_particle_swirl_cpu.h"
+
+#include "particle_lane_simd.h"
+
+#include <intrin.h>
+#include <vector>
+#include <algorithm>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+/* #########################################################################
+
+                            forward declarations
+
+   ######################################################################### */
+template <typename lane, class Layout>
+static unsigned int swirl_lanes(Layout & l, const force_field_list_t & fields,
+        unsigned int begin, unsigned int end, float dt_s, int steps);
+static void swirl_chunk(unsigned int begin, unsigned int end, int worker, void * user);
+static void swirl_aos_chunk(unsigned int begin, unsigned int end, int worker, void * user);
+static void init_chunk(unsigned int begin, unsigned int end, int worker, void * user);
+
+/* #########################################################################
+
+                              detect_swirl_simd
+        -Asks cpuid (and xgetbv, for AVX register state) what we may use.
+
+   ######################################################################### */
+swirl_simd_t xen_rift::detect_swirl_simd(){
+    int info[4];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+#if SWIRL_HAVE_AVX
+    // OS has to save the ymm registers on context switch too
+    if (avx && osxsave && ((_xgetbv(0) & 6) == 6))
+        return SWIRL_SIMD_AVX;
+#endif
+    if (sse2)
+        return SWIRL_SIMD_SSE;
+    return SWIRL_SIMD_SCALAR;
+}
+
+const char * xen_rift::swirl_simd_name( swirl_simd_t simd ){
+    switch (simd){
+        case SWIRL_SIMD_AVX:
+            return "AVX";
+        case SWIRL_SIMD_SSE:
+            return "SSE";
+        default:
+            return "scalar";
+    }
+}
+
+/* #########################################################################
+
+                           h_simple_particle_swirl
+        -Advances the store by `steps` steps of dt ms each on the host,
+            using the requested instruction set for the bulk and scalar
+            code for the tail.
+        -If the store has prev streams, they get the positions from
+            just before the last step.
+        -The kernel's player-relative lighting term never fed the
+            output color, so it isn't computed here either.
+
+   ######################################################################### */
+void xen_rift::h_simple_particle_swirl( particle_store_t & s, const force_field_list_t & fields,
+                                        float dt, int steps, swirl_simd_t simd ){
+    h_simple_particle_swirl_range(s, fields, 0, s.n, dt, steps, simd);
+}
+
+void xen_rift::h_simple_particle_swirl_range( particle_store_t & s, const force_field_list_t & fields,
+                                              unsigned int begin, unsigned int end, float dt,
+                                              int steps, swirl_simd_t simd ){
+    if (steps <= 0)
+        return;
+    float dt_s = dt / 1000.0f;
+    swirl_soa_layout l(s);
+    // scalar up to the first 32-byte aligned particle, vector through
+    //  the bulk, scalar again for whatever's left
+    unsigned int head = (begin + 7) & ~7u;
+    if (head > end)
+        head = end;
+    swirl_integrate_range(l, begin, head, fields, dt_s, steps);
+    unsigned int done = head;
+    switch (simd){
+#if SWIRL_HAVE_AVX
+        case SWIRL_SIMD_AVX:
+            done = swirl_lanes<avx_lane>(l, fields, head, end, dt_s, steps);
+            // avoid the SSE/AVX transition penalty in whatever runs next
+            _mm256_zeroupper();
+            break;
+#endif
+        case SWIRL_SIMD_SSE:
+            done = swirl_lanes<sse_lane>(l, fields, head, end, dt_s, steps);
+            break;
+        default:
+            break;
+    }
+    swirl_integrate_range(l, done, end, fields, dt_s, steps);
+}
+
+/* #########################################################################
+
+                        h_simple_particle_swirl_async
+        -Splits the step into SWIRL_CHUNK_PARTICLES chunks across the
+            pool's workers; returns as soon as they've been woken.
+        -A chunk's trail slot write comes right after its step, while
+            its positions are still in L2.
+
+   ######################################################################### */
+static void swirl_chunk(unsigned int begin, unsigned int end, int worker, void * user){
+    swirl_job_t * job = (swirl_job_t *)user;
+    h_simple_particle_swirl_range(*job->s, job->fields, begin, end, job->dt, job->steps, job->simd);
+    if (job->trail.x)
+        particle_trail_write(*job->s, job->trail, begin, end);
+}
+
+void xen_rift::h_simple_particle_swirl_async( Thread_Pool * pool, swirl_job_t * job ){
+    pool->parallel_for_async(job->s->n, SWIRL_CHUNK_PARTICLES, swirl_chunk, job);
+}
+
+/* #########################################################################
+
+                           h_init_swirl_particles
+        -Every particle's start only depends on its index and the key,
+            so chunks go straight into the store from all workers.
+
+   ######################################################################### */
+typedef struct _init_job_t {
+    particle_store_t * s;
+    unsigned long long key;
+} init_job_t;
+
+static void init_chunk(unsigned int begin, unsigned int end, int worker, void * user){
+    init_job_t * job = (init_job_t *)user;
+    for (unsigned int i = begin; i < end; i++)
+        swirl_init_particle(*job->s, i, job->key);
+}
+
+void xen_rift::h_init_swirl_particles( Thread_Pool * pool, particle_store_t & s, unsigned long long key ){
+    init_job_t job = { &s, key };
+    if (pool)
+        pool->parallel_for(s.n, SWIRL_CHUNK_PARTICLES, init_chunk, &job);
+    else
+        init_chunk(0, s.n, 0, &job);
+}
+
+/* #########################################################################
+
+                      h_particle_swirl_thread_benchmark
+        -Runs the pooled step on a ring of n particles at doubling
+            thread counts (plus max_threads itself) and prints the
+            median time per step, throughput, and speedup / parallel
+            efficiency relative to one thread.
+        -Speedup flattens out once the step is bound by memory
+            bandwidth (48 bytes / particle / step) rather than math.
+
+   ######################################################################### */
+void xen_rift::h_particle_swirl_thread_benchmark( unsigned int n, int max_threads, int steps ){
+    if (max_threads <= 0)
+        max_threads = Thread_Pool::num_processors();
+    if (steps <= 0)
+        steps = 1;
+    particle_store_t s;
+    if (particle_store_alloc(&s, n, false, false)){
+        printf("Memory alloc error.\n");
+        return;
+    }
+    swirl_simd_t simd = detect_swirl_simd();
+    printf("Particle step thread scaling: %u particles, %s, %d steps per count\n",
+        n, swirl_simd_name(simd), steps);
+
+    std::vector<int> counts;
+    for (int t = 1; t < max_threads; t *= 2)
+        counts.push_back(t);
+    counts.push_back(max_threads);
+
+    double base_ms = 0.0;
+    std::vector<double> times(steps);
+    for (size_t c = 0; c < counts.size(); c++){
+        // same starting ring every time so each count does identical work
+        for (unsigned int i = 0; i < n; i++){
+            float theta = (float)i / n * 2.0f * (float)M_PI;
+            float radius = 3.0f + 27.0f * (float)(i % 97) / 97.0f;
+            particle_set(s, i, radius*cosf(theta), 30.0f, radius*sinf(theta),
+                sinf(theta), 0.0f, -cosf(theta));
+        }
+        Thread_Pool pool(counts[c]);
+        swirl_job_t job = { &s, 16.0f, 1, simd };
+        force_field_preset(0, &job.fields);
+        // warm up caches / wake the workers
+        for (int i = 0; i < 3; i++){
+            h_simple_particle_swirl_async(&pool, &job);
+            pool.wait();
+        }
+        for (int i = 0; i < steps; i++){
+            h_simple_particle_swirl_async(&pool, &job);
+            pool.wait();
+            times[i] = pool.last_job_ms();
+        }
+        std::sort(times.begin(), times.end());
+        double ms = times[steps/2];
+        if (c == 0)
+            base_ms = ms;
+        double speedup = base_ms / ms;
+        printf("    threads %3d: %8.3f ms/step  %8.1f M particles/s  speedup %5.2fx (%3.0f%%)\n",
+            counts[c], ms, n / ms / 1000.0, speedup, 100.0 * speedup / counts[c]);
+    }
+    particle_store_free(&s);
+}
+
+/* #########################################################################
+
+                      h_simple_particle_swirl_reference
+        -swirl_integrate in double, over the whole store on this
+            thread. Only the arithmetic changes: fields, colliders and
+            the stored state are the same floats.
+
+   ######################################################################### */
+void xen_rift::h_simple_particle_swirl_reference( particle_store_t & s, const force_field_list_t & fields,
+                                                  float dt, int steps ){
+    swirl_soa_layout l(s);
+    swirl_integrate_range(l, 0, s.n, fields, dt / 1000.0, steps);
+}
+
+/* #########################################################################
+
+                                 swirl_lanes
+        -swirl_integrate on `lane`, lane::width particles per iteration
+            from a begin aligned for it. Returns the index it stopped
+            at (a multiple of the width past begin).
+
+   ######################################################################### */
+template <typename lane, class Layout>
+static unsigned int swirl_lanes(Layout & l, const force_field_list_t & fields,
+        unsigned int begin, unsigned int end, float dt_s, int steps){
+    const lane dt = dt_s;
+
+    end = begin + ((end - begin) & ~(lane::width - 1u));
+    for (unsigned int i = begin; i < end; i += lane::width)
+        swirl_integrate(l, i, fields, dt, steps);
+    return end;
+}
+
+/* #########################################################################
+
+                        h_simple_particle_swirl_aos_range
+        -The same step on the float4 pos + vel layout the swirl used
+            before the store: the vector paths load 4 (or 8) float4s
+            and transpose them into x / y / z registers, step, and
+            transpose back, merging into the untouched w. Same
+            swirl_integrate as the SoA paths, so the results match
+            them bit for bit (with the Makefile's SSE2 float model).
+        -Only here so the benchmark can put a number on the layout.
+
+   ######################################################################### */
+void xen_rift::h_simple_particle_swirl_aos_range( swirl_float4_t * pos, swirl_float4_t * vel,
+                                                  const force_field_list_t & fields, unsigned int begin,
+                                                  unsigned int end, float dt, int steps, swirl_simd_t simd ){
+    if (steps <= 0)
+        return;
+    float dt_s = dt / 1000.0f;
+    swirl_aos_layout l(pos, vel);
+    unsigned int done = begin;
+    switch (simd){
+#if SWIRL_HAVE_AVX
+        case SWIRL_SIMD_AVX:
+            done = swirl_lanes<avx_lane>(l, fields, begin, end, dt_s, steps);
+            _mm256_zeroupper();
+            break;
+#endif
+        case SWIRL_SIMD_SSE:
+            done = swirl_lanes<sse_lane>(l, fields, begin, end, dt_s, steps);
+            break;
+        default:
+            break;
+    }
+    swirl_integrate_range(l, done, end, fields, dt_s, steps);
+}
+
+static void swirl_aos_chunk(unsigned int begin, unsigned int end, int worker, void * user){
+    swirl_aos_job_t * job = (swirl_aos_job_t *)user;
+    h_simple_particle_swirl_aos_range(job->pos, job->vel, job->fields, begin, end, job->dt, job->steps,
+        job->simd);
+}
+
+void xen_rift::h_simple_particle_swirl_aos_async( Thread_Pool * pool, swirl_aos_job_t * job ){
+    pool->parallel_for_async(job->n, SWIRL_CHUNK_PARTICLES, swirl_aos_chunk, job);
+}
@@ -0,0 +1,124 @@
+/* #########################################################################
+        simple_particle_swirl: host-side (CPU) particle integrator
+   Header!
+
+   Runs the same per-particle update as d_simple_particle_swirl (see
+   particle_integrate.h) so the demo can run on machines without a
+   CUDA device. Has no GL or CUDA dependencies; the glue that moves
+   results into the shared VBO lives in simple_particle_swirl.cu.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  Fixed sub-steps per call
+     agent  20261017  Parallel counter-based initialization
+     agent  20261017  Force-field list instead of the fixed attractor
+     agent  20261017  AoS float4 step for the benchmark suite
+     agent  20261017  Double-precision reference step
+     agent  20261017  Step jobs can stream positions into a trail slot
+     agent  20261017  Steps drop the unused player position
+   ######################################################################### */
+
+#ifndef __SIMPLE_PARTICLE_SWIRL_CPU_H
+#define __SIMPLE_PARTICLE_SWIRL_CPU_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "particle_store.h"
+#include "particle_init.h"
+#include "force_field.h"
+#include "particle_integrate.h"
+#include "particle_trail.h"
+#include "../common/thread_pool.h"
+
+namespace xen_rift {
+	// Instruction sets the host integrator knows how to use, best last.
+	typedef enum _swirl_simd_t {
+		SWIRL_SIMD_SCALAR,
+		SWIRL_SIMD_SSE,
+		SWIRL_SIMD_AVX
+	} swirl_simd_t;
+
+	// Host results agree with the CUDA kernel to within this relative
+	// error per step (|cpu - gpu| <= tol * max(1, |gpu|)). Both run
+	// swirl_integrate<float>, but the kernel is built with
+	// -use_fast_math (and may fuse multiply-adds), so bit-exact
+	// agreement is not expected.
+	#define SWIRL_CPU_TOLERANCE (1e-4f)
+
+	// Particles per parallel chunk. 4096 particles * 24 bytes of state
+	// is 96KB, which sits comfortably in a core's L2 while it works, and
+	// keeps every chunk start aligned for the vector paths.
+	#define SWIRL_CHUNK_PARTICLES 4096
+
+	// Best instruction set this CPU + OS supports.
+	swirl_simd_t detect_swirl_simd( void );
+	const char * swirl_simd_name( swirl_simd_t simd );
+
+	// Host equivalent of d_simple_particle_swirl: advances every particle
+	// in the store by `steps` steps of dt ms under `fields`, filling the
+	// prev streams (if bound) with the positions before the last one.
+	// Streams must be 32-byte aligned, which particle_store_alloc
+	// guarantees. Never touches the color stream. Results depend only on
+	// the starting state, fields, dt and steps -- not on simd, chunking
+	// or thread count.
+	void h_simple_particle_swirl( particle_store_t & s, const force_field_list_t & fields,
+								  float dt, int steps, swirl_simd_t simd );
+	// Same, over particles [begin, end) only.
+	void h_simple_particle_swirl_range( particle_store_t & s, const force_field_list_t & fields,
+										unsigned int begin, unsigned int end, float dt, int steps,
+										swirl_simd_t simd );
+	// The same steps with the math done in double (state still stored as
+	// float), single-threaded: the yardstick for float's rounding drift.
+	void h_simple_particle_swirl_reference( particle_store_t & s, const force_field_list_t & fields,
+											float dt, int steps );
+
+	// A step handed to a thread pool; has to outlive the job. Carries its
+	// own copy of the fields, so they can change while it runs. If
+	// trail.x isn't NULL, each chunk's new positions also go out to that
+	// trail slot (particle_trail_write) as soon as the chunk is done.
+	typedef struct _swirl_job_t {
+		particle_store_t * s;
+		float dt;
+		int steps;
+		swirl_simd_t simd;
+		force_field_list_t fields;
+		trail_slot_t trail;
+	} swirl_job_t;
+	// Start a step across the pool in SWIRL_CHUNK_PARTICLES chunks and
+	// return right away; pool->wait() before touching the store again.
+	void h_simple_particle_swirl_async( Thread_Pool * pool, swirl_job_t * job );
+
+	// h_simple_particle_swirl_range on the float4 pos + vel layout from
+	// before the store (swirl_float4_t), for the benchmark to hold the
+	// SoA streams up against, with the same results bit for bit (built
+	// with FPFLAGS, as the Makefile does). pos and vel must be 16-byte
+	// aligned; there are no prev streams.
+	void h_simple_particle_swirl_aos_range( swirl_float4_t * pos, swirl_float4_t * vel,
+											const force_field_list_t & fields, unsigned int begin,
+											unsigned int end, float dt, int steps, swirl_simd_t simd );
+	typedef struct _swirl_aos_job_t {
+		swirl_float4_t * pos;
+		swirl_float4_t * vel;
+		unsigned int n;
+		float dt;
+		int steps;
+		swirl_simd_t simd;
+		force_field_list_t fields;
+	} swirl_aos_job_t;
+	void h_simple_particle_swirl_aos_async( Thread_Pool * pool, swirl_aos_job_t * job );
+
+	// Set every particle in the store to its starting state for `key`
+	// (see particle_init.h), in parallel on the pool if there is one.
+	void h_init_swirl_particles( Thread_Pool * pool, particle_store_t & s, unsigned long long key );
+
+	// Time the pooled step on n particles at 1, 2, 4, ... max_threads
+	// threads and print time per step and speedup over one thread.
+	void h_particle_swirl_thread_benchmark( unsigned int n, int max_threads, int steps );
+};
+
+#endif //__SIMPLE_PARTICLE_SWIRL_CPU_H
@@ -1,5 +1,9 @@
 /* simple_particle_swirl: Oculus Rift CUDA-powered demo 
    Header!
+
+   What simple_particle_swirl.cu gives the rest of the demo. The CUDA
+   headers are only pulled in under nvcc, so the host side can include
+   this for the declarations without the toolkit on its include path.
 */
 
 #ifndef __SIMPLE_PARTICLE_SWIRL_CU_H
@@ -17,24 +21,96 @@
 #include <gl/gl.h>
 
 // CUDA and related
+#ifdef __CUDACC__
 #include "../include/GL/cutil.h"
 #include "../include/book.h"
 #include <cuda.h>
 #include <cuda_gl_interop.h>
 #include <vector_types.h>
+#endif
 
 //Windows
 #include <windows.h>
 
 #include "simple_particle_swirl.h"
+#include "particle_store.h"
+#include "force_field.h"
+#include "particle_trail.h"
 
 namespace xen_rift {
-	// buffer size for particle positions or velocities: 
-	#define BUFFER_SIZE (NUM_PARTICLES*sizeof(float4))
-
 	// CUDA block size
 	#define BLOCK_SIZE (1024)
-	#define GRID_SIZE (NUM_PARTICLES/BLOCK_SIZE)
+	// enough blocks to cover all n particles, partial last block included
+	#define GRID_SIZE(n) (((n) + BLOCK_SIZE - 1)/BLOCK_SIZE)
 };
 
+// Set up CUDA; mainly makes and initializes shared buffers. Falls back
+//  to the host SIMD backend if there's no device or force_cpu is set.
+int initCuda(GLuint * vbo, bool force_cpu, int num_threads, unsigned int n,
+			 const char * snapshot);
+// Reallocate every particle buffer for n particles and restart the swirl
+int set_particle_count(GLuint * vbo, unsigned int n);
+unsigned int get_particle_count();
+// Particles alive right now (all of them unless emitters are on)
+unsigned int get_live_particle_count();
+// Compare one step of the CUDA kernel against the host backends
+int validate_particle_swirl(GLuint * vbo);
+// Byte offset of a particle stream (x, y, z, color, prev x/y/z) within the vbo
+size_t particle_swirl_stream_offset(int which);
+// Fixed-step setup; call before initCuda
+void set_particle_swirl_timestep(float step_ms, int max_substeps);
+void set_particle_swirl_deterministic(unsigned int seed, unsigned int steps);
+void set_particle_swirl_nbody(bool enable, float theta);
+void set_particle_swirl_separation(bool enable, float radius);
+// Force fields acting on the particles; can change at any time
+void set_particle_swirl_fields(const xen_rift::force_field_list_t * fields);
+void get_particle_swirl_fields(xen_rift::force_field_list_t * fields);
+// Emitter mode (call before initCuda), and a burst of new particles
+void set_particle_swirl_emitters(bool enable);
+void particle_swirl_burst(unsigned int count);
+// Fixed steps taken so far, and where the frame falls between the last two
+unsigned int particle_swirl_steps();
+float particle_swirl_alpha();
+// Hash of the full particle state, for comparing deterministic runs
+unsigned long long particle_swirl_checksum();
+// Memory-mapped particle state snapshots
+int save_particle_swirl(const char * path);
+int load_particle_swirl(GLuint * vbo, const char * path);
+void set_particle_swirl_recording(const char * prefix, unsigned int every);
+void set_particle_swirl_replay(const char * prefix);
+// How long the last particle step took, in ms
+double particle_swirl_update_ms();
+// Per-eye frustum culling (CPU backend only): the eye matrices to cull
+//  against, and the culled list to draw eye v with, if there is one
+void set_particle_swirl_culling(bool enable);
+bool get_particle_swirl_culling();
+void set_particle_swirl_view(int v, const float * view_proj);
+bool particle_swirl_draw_list(int v, GLuint * ibo, unsigned int * count);
+double particle_swirl_cull_ms();
+// Back-to-front order for the culled lists
+void set_particle_swirl_depth_sort(bool enable);
+bool get_particle_swirl_depth_sort();
+double particle_swirl_sort_ms();
+void set_particle_swirl_sort_limit(unsigned int limit);
+bool particle_swirl_sort_skipped();
+// No GL or devices at all (call before initCuda), and N steps flat out
+void set_particle_swirl_headless(bool enable);
+int run_particle_swirl_headless(unsigned int steps);
+// Compact particle state (call before initCuda), whether it took, and
+//  the block boxes to decode it with
+void set_particle_swirl_compact(bool enable);
+bool particle_swirl_compact();
+GLuint particle_swirl_box_texture();
+// Simulation on its own thread (call before initCuda), and its step and
+//  state rates
+void set_particle_swirl_async(bool enable);
+bool particle_swirl_sim_rates(double * steps_per_s, double * states_per_s);
+// Motion trails (call before initCuda), and the ring + GL buffers to draw
+//  them from, or NULL if there are none
+void set_particle_swirl_trails(int length);
+xen_rift::Particle_Trail * particle_swirl_trail(GLuint * vbo, GLuint * ibo);
+// Call kernel and advance particle swirl in time; pass in player eye pos
+//  to do rough lighting (WIP)
+void advance_particle_swirl(GLuint * vbo, float px, float py, float pz);
+
 #endif //__SIMPLE_PARTICLE_SWIRL_CU_H
\ No newline at end of file
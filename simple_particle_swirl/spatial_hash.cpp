@@ -0,0 +1,346 @@
+/* #########################################################################
+        spatial_hash: uniform-grid neighbor lookup over a particle store
+
+   build() is four parallel_for passes over the pool plus a serial scan
+   over a few hundred chunk sums. The only shared writes are the
+   Interlocked bucket counters in the count and scatter passes; every
+   other pass owns a disjoint range of particles or buckets.
+   separate()'s pass owns a range of slots, and each slot is one
+   particle's velocity; positions come from the build's copies.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  separate(): rebuild and push neighbors apart
+   ######################################################################### */
+
+#include "spatial_hash.h"
+#include "particle_init.h"
+#include <malloc.h>
+#include <vector>
+#include <algorithm>
+
+// use protection guys
+using namespace std;
+using namespace xen_rift;
+
+// Particles / buckets per parallel chunk in each build pass
+#define HASH_CHUNK 16384
+// Slots per parallel chunk in separate()'s pass, which costs a neighbor
+//  walk per particle
+#define SEPARATE_CHUNK 2048
+
+Spatial_Hash::Spatial_Hash( float cell_size ) :
+        _cell_size(cell_size),
+        _inv_cell_size(1.0f / cell_size),
+        _n(0),
+        _capacity(0),
+        _num_buckets(0),
+        _store(NULL),
+        _last_build_ms(0.0),
+        _last_force_ms(0.0),
+        _target(NULL),
+        _radius(0.0f),
+        _push(0.0f),
+        _bucket_of(NULL),
+        _slot_of(NULL),
+        _bucket_start(NULL),
+        _cursor(NULL),
+        _chunk_sums(NULL),
+        _sorted_index(NULL),
+        _sorted_x(NULL),
+        _sorted_y(NULL),
+        _sorted_z(NULL)
+{
+}
+
+Spatial_Hash::~Spatial_Hash(){
+    reserve(0);
+}
+
+// Size every array for n particles (0 frees everything). Buckets are
+//  the next power of two >= n, so the load factor stays at or below 1.
+void Spatial_Hash::reserve( unsigned int n ){
+    if (n != 0 && n <= _capacity)
+        return;
+    _aligned_free(_bucket_of);
+    _aligned_free(_slot_of);
+    _aligned_free((void *)_bucket_start);
+    _aligned_free((void *)_cursor);
+    _aligned_free(_chunk_sums);
+    _aligned_free(_sorted_index);
+    _aligned_free(_sorted_x);
+    _aligned_free(_sorted_y);
+    _aligned_free(_sorted_z);
+    _capacity = 0;
+    _num_buckets = 0;
+    if (n == 0)
+        return;
+
+    unsigned int buckets = 1024;
+    while (buckets < n)
+        buckets <<= 1;
+    unsigned int chunks = (buckets + HASH_CHUNK - 1) / HASH_CHUNK;
+    _bucket_of = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+    _slot_of = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+    _bucket_start = (volatile LONG *)_aligned_malloc((buckets+1)*sizeof(LONG), 64);
+    _cursor = (volatile LONG *)_aligned_malloc(buckets*sizeof(LONG), 64);
+    _chunk_sums = (LONG *)_aligned_malloc(chunks*sizeof(LONG), 64);
+    _sorted_index = (unsigned int *)_aligned_malloc(n*sizeof(unsigned int), 64);
+    _sorted_x = (float *)_aligned_malloc(n*sizeof(float), 64);
+    _sorted_y = (float *)_aligned_malloc(n*sizeof(float), 64);
+    _sorted_z = (float *)_aligned_malloc(n*sizeof(float), 64);
+    if (!_bucket_of || !_slot_of || !_bucket_start || !_cursor || !_chunk_sums ||
+        !_sorted_index || !_sorted_x || !_sorted_y || !_sorted_z){
+        printf("Memory alloc error.\n");
+        exit(1);
+    }
+    _capacity = n;
+    _num_buckets = buckets;
+}
+
+/* #########################################################################
+
+                                    build
+
+   ######################################################################### */
+void Spatial_Hash::build( const particle_store_t & s, Thread_Pool * pool ){
+    LARGE_INTEGER start, stop, freq;
+    QueryPerformanceCounter(&start);
+
+    reserve(s.n);
+    _n = s.n;
+    _store = &s;
+    _inv_cell_size = 1.0f / _cell_size;
+
+    unsigned int chunks = (_num_buckets + HASH_CHUNK - 1) / HASH_CHUNK;
+    if (pool){
+        pool->parallel_for(_num_buckets, HASH_CHUNK, clear_range, this);
+        pool->parallel_for(_n, HASH_CHUNK, hash_range, this);
+        pool->parallel_for(_num_buckets, HASH_CHUNK, sum_range, this);
+    } else {
+        clear_range(0, _num_buckets, 0, this);
+        hash_range(0, _n, 0, this);
+        for (unsigned int b = 0; b < _num_buckets; b += HASH_CHUNK)
+            sum_range(b, min(b + HASH_CHUNK, _num_buckets), 0, this);
+    }
+    // chunk totals -> chunk offsets
+    LONG total = 0;
+    for (unsigned int c = 0; c < chunks; c++){
+        LONG count = _chunk_sums[c];
+        _chunk_sums[c] = total;
+        total += count;
+    }
+    _bucket_start[_num_buckets] = total;
+    if (pool){
+        pool->parallel_for(_num_buckets, HASH_CHUNK, scan_range, this);
+        pool->parallel_for(_n, HASH_CHUNK, scatter_range, this);
+        pool->parallel_for(_num_buckets, HASH_CHUNK, finish_range, this);
+    } else {
+        for (unsigned int b = 0; b < _num_buckets; b += HASH_CHUNK)
+            scan_range(b, min(b + HASH_CHUNK, _num_buckets), 0, this);
+        scatter_range(0, _n, 0, this);
+        finish_range(0, _num_buckets, 0, this);
+    }
+    _store = NULL;
+
+    QueryPerformanceCounter(&stop);
+    QueryPerformanceFrequency(&freq);
+    _last_build_ms = ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+}
+
+void Spatial_Hash::clear_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Spatial_Hash * h = (Spatial_Hash *)user;
+    memset((void *)(h->_bucket_start + begin), 0, (end - begin)*sizeof(LONG));
+}
+
+// 1. bucket of every particle, and bucket sizes
+void Spatial_Hash::hash_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Spatial_Hash * h = (Spatial_Hash *)user;
+    const particle_store_t & s = *h->_store;
+    for (unsigned int i = begin; i < end; i++){
+        unsigned int b = h->bucket_of(s.x[i], s.y[i], s.z[i]);
+        h->_bucket_of[i] = b;
+        InterlockedIncrement(&h->_bucket_start[b]);
+    }
+}
+
+// 2a. total of each chunk of bucket counts
+void Spatial_Hash::sum_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Spatial_Hash * h = (Spatial_Hash *)user;
+    LONG total = 0;
+    for (unsigned int b = begin; b < end; b++)
+        total += h->_bucket_start[b];
+    h->_chunk_sums[begin / HASH_CHUNK] = total;
+}
+
+// 2b. counts -> starts within the chunk, offset by everything before it
+void Spatial_Hash::scan_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Spatial_Hash * h = (Spatial_Hash *)user;
+    LONG total = h->_chunk_sums[begin / HASH_CHUNK];
+    for (unsigned int b = begin; b < end; b++){
+        LONG count = h->_bucket_start[b];
+        h->_bucket_start[b] = total;
+        h->_cursor[b] = total;
+        total += count;
+    }
+}
+
+// 3. drop every particle into the next free slot of its bucket
+void Spatial_Hash::scatter_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Spatial_Hash * h = (Spatial_Hash *)user;
+    for (unsigned int i = begin; i < end; i++){
+        LONG slot = InterlockedIncrement(&h->_cursor[h->_bucket_of[i]]) - 1;
+        h->_sorted_index[slot] = i;
+    }
+}
+
+// 4. scatter order depends on the threads; put each bucket back in index
+//  order (they're ~1 particle long on average) and gather positions
+void Spatial_Hash::finish_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Spatial_Hash * h = (Spatial_Hash *)user;
+    const particle_store_t & s = *h->_store;
+    for (unsigned int b = begin; b < end; b++){
+        unsigned int first = (unsigned int)h->_bucket_start[b];
+        unsigned int last = (unsigned int)h->_bucket_start[b+1];
+        unsigned int * idx = h->_sorted_index;
+        for (unsigned int k = first + 1; k < last; k++){
+            unsigned int v = idx[k];
+            unsigned int m = k;
+            while (m > first && idx[m-1] > v){
+                idx[m] = idx[m-1];
+                m--;
+            }
+            idx[m] = v;
+        }
+        for (unsigned int k = first; k < last; k++){
+            unsigned int i = idx[k];
+            h->_slot_of[i] = k;
+            h->_sorted_x[k] = s.x[i];
+            h->_sorted_y[k] = s.y[i];
+            h->_sorted_z[k] = s.z[i];
+        }
+    }
+}
+
+/* #########################################################################
+
+                                  separate
+        -The build, then one neighbor walk per particle, in slot order.
+
+   ######################################################################### */
+// Sums the push away from each neighbor
+struct Separation_Sum {
+    float inv_radius;
+    float ax, ay, az;
+    void operator()( unsigned int j, float dx, float dy, float dz, float d2 ){
+        // one right on top of this particle doesn't say which way to go
+        if (d2 <= 0.0f)
+            return;
+        float d = sqrtf(d2);
+        float w = (1.0f - d * inv_radius) / d;
+        ax -= dx * w;
+        ay -= dy * w;
+        az -= dz * w;
+    }
+};
+
+void Spatial_Hash::separate( particle_store_t & s, float radius, float strength, float dt_s, Thread_Pool * pool ){
+    build(s, pool);
+    LARGE_INTEGER start, stop, freq;
+    QueryPerformanceCounter(&start);
+
+    _target = &s;
+    _radius = radius < _cell_size ? radius : _cell_size;
+    _push = strength * dt_s;
+    if (pool)
+        pool->parallel_for(_n, SEPARATE_CHUNK, separate_range, this);
+    else
+        separate_range(0, _n, 0, this);
+    _target = NULL;
+
+    QueryPerformanceCounter(&stop);
+    QueryPerformanceFrequency(&freq);
+    _last_force_ms = ((double)(stop.QuadPart - start.QuadPart)) * 1000.0 / ((double)freq.QuadPart);
+}
+
+void Spatial_Hash::separate_range( unsigned int begin, unsigned int end, int worker, void * user ){
+    Spatial_Hash * h = (Spatial_Hash *)user;
+    particle_store_t & s = *h->_target;
+    for (unsigned int slot = begin; slot < end; slot++){
+        unsigned int i = h->_sorted_index[slot];
+        Separation_Sum sum = { 1.0f / h->_radius, 0.0f, 0.0f, 0.0f };
+        h->for_each_neighbor(i, h->_radius, sum);
+        s.vx[i] += h->_push * sum.ax;
+        s.vy[i] += h->_push * sum.ay;
+        s.vz[i] += h->_push * sum.az;
+    }
+}
+
+/* #########################################################################
+
+                           spatial_hash_benchmark
+        -Builds over the starting swirl at 64K, 128K, ... max_n
+            particles and prints the median of 10 rebuilds at each,
+            plus how many neighbors a sample of particles see within
+            one cell, and the median separate() pass at that radius
+            (not counting its build).
+        -Rebuild cost is dominated by the scatter and gather passes,
+            which touch memory at random; expect it to scale with n
+            and flatten out against memory bandwidth with threads.
+
+   ######################################################################### */
+// Counts neighbors for the benchmark's sanity line
+struct Neighbor_Counter {
+    unsigned long long count;
+    void operator()( unsigned int j, float dx, float dy, float dz, float d2 ){ count++; }
+};
+
+void xen_rift::spatial_hash_benchmark( unsigned int max_n, int threads, float cell_size ){
+    const int reps = 10;
+    if (threads <= 0)
+        threads = Thread_Pool::num_processors();
+    Thread_Pool pool(threads);
+    printf("Spatial hash rebuild: %d threads, cell size %.3f\n", threads, cell_size);
+
+    unsigned int n = 65536;
+    if (n > max_n)
+        n = max_n;
+    while (n <= max_n){
+        particle_store_t s;
+        if (particle_store_alloc(&s, n, false, false)){
+            printf("Memory alloc error.\n");
+            return;
+        }
+        unsigned long long key = particle_init_key(1);
+        for (unsigned int i = 0; i < n; i++)
+            swirl_init_particle(s, i, key);
+
+        Spatial_Hash hash(cell_size);
+        std::vector<double> times(reps);
+        hash.build(s, &pool);
+        for (int r = 0; r < reps; r++){
+            hash.build(s, &pool);
+            times[r] = hash.last_build_ms();
+        }
+        std::sort(times.begin(), times.end());
+        double ms = times[reps/2];
+
+        Neighbor_Counter counter = { 0 };
+        unsigned int samples = n < 1000 ? n : 1000;
+        for (unsigned int k = 0; k < samples; k++)
+            hash.for_each_neighbor((unsigned int)(((unsigned long long)k * n) / samples), cell_size, counter);
+
+        for (int r = 0; r < reps; r++){
+            hash.separate(s, cell_size, 1.0f, 1.0f, &pool);
+            times[r] = hash.last_force_ms();
+        }
+        std::sort(times.begin(), times.end());
+
+        printf("    %9u particles: %8.3f ms/rebuild  %8.1f M particles/s  %6.1f neighbors/particle  "
+            "%8.3f ms separation\n", n, ms, n / ms / 1000.0, (double)counter.count / samples, times[reps/2]);
+        particle_store_free(&s);
+        if (n == max_n)
+            break;
+        n = (n*2 > max_n || n*2 < n) ? max_n : n*2;
+    }
+}
@@ -0,0 +1,214 @@
+/* #########################################################################
+        spatial_hash: uniform-grid neighbor lookup over a particle store
+   Header!
+
+	Space is cut into cubic cells of side cell_size, and every cell is
+	hashed into one of a power-of-two number of buckets (>= the particle
+	count). build() counting-sorts the particles by bucket, in parallel
+	on a Thread_Pool:
+		1. hash every particle, counting bucket sizes with Interlocked
+		   increments
+		2. exclusive prefix sum of the counts -> bucket starts
+		3. scatter particle indices into their buckets
+		4. sort each (small) bucket by index, so the result doesn't
+		   depend on thread timing, and gather the positions into
+		   bucket order alongside
+	Neighbor queries then walk the 27 cells around a point, reading
+	positions from contiguous bucket-ordered streams instead of hopping
+	around the particle store.
+
+	separate() is the swirl's use of it (-separation): rebuild, then
+	push every particle away from the others within a radius, visiting
+	particles in bucket order so each chunk of the pool walks the same
+	few cells over and over.
+
+   Rev history:
+     agent  20261017  Init revision
+     agent  20261017  separate(): rebuild and push neighbors apart, for -separation
+   ######################################################################### */
+
+#ifndef __XEN_SPATIAL_HASH_H
+#define __XEN_SPATIAL_HASH_H
+
+// Base system stuff
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+//Windows
+#include <windows.h>
+
+#include "particle_store.h"
+#include "../common/thread_pool.h"
+
+namespace xen_rift {
+	// Set of buckets a neighbor walk has been through: open addressing,
+	// a few times the 27 it can hold
+	#define HASH_SEEN_BITS 6
+	#define HASH_SEEN_SLOTS (1 << HASH_SEEN_BITS)
+
+	class Spatial_Hash {
+		public:
+			Spatial_Hash( float cell_size );
+			~Spatial_Hash();
+
+			// Takes effect at the next build()
+			void set_cell_size( float cell_size ) { _cell_size = cell_size; }
+			float cell_size( void ) { return _cell_size; }
+
+			// Re-bucket the store's current positions; in parallel on the
+			// pool if there is one. The store must not change during the
+			// build, and queries see the positions as of the last build.
+			void build( const particle_store_t & s, Thread_Pool * pool );
+			double last_build_ms( void ) { return _last_build_ms; }
+
+			unsigned int num_particles( void ) const { return _n; }
+			unsigned int num_buckets( void ) const { return _num_buckets; }
+			// Particles in bucket b are slots [bucket_start(b), bucket_start(b+1))
+			// of the bucket-ordered arrays below.
+			unsigned int bucket_start( unsigned int b ) const { return (unsigned int)_bucket_start[b]; }
+			const unsigned int * sorted_index( void ) const { return _sorted_index; }
+			const float * sorted_x( void ) const { return _sorted_x; }
+			const float * sorted_y( void ) const { return _sorted_y; }
+			const float * sorted_z( void ) const { return _sorted_z; }
+
+			// Bucket a point falls in
+			unsigned int bucket_of( float x, float y, float z ) const {
+				return bucket_of_cell(cell_coord(x), cell_coord(y), cell_coord(z));
+			}
+
+			// Call v(j, dx, dy, dz, dist2) for every particle j within
+			// `radius` of (x, y, z), where d = p_j - (x, y, z). radius
+			// can be at most cell_size. Of the 27 cells around the point
+			// only the ones within radius of it are walked: 8 of them
+			// when radius is at most half the cell size. Visit order is
+			// fixed for a given build, so sums over neighbors are
+			// reproducible.
+			template <class Visitor>
+			void for_each_neighbor( float x, float y, float z, float radius, Visitor & v ) const {
+				if (_n == 0)
+					return;
+				float r2 = radius*radius;
+				int cx = cell_coord(x), cy = cell_coord(y), cz = cell_coord(z);
+				int lo[3], hi[3];
+				cell_span(x, cx, radius, &lo[0], &hi[0]);
+				cell_span(y, cy, radius, &lo[1], &hi[1]);
+				cell_span(z, cz, radius, &lo[2], &hi[2]);
+				// neighboring cells can share a bucket; only walk each once
+				unsigned int seen[HASH_SEEN_SLOTS];
+				memset(seen, 0xFF, sizeof(seen));
+				for (int ox = lo[0]; ox <= hi[0]; ox++)
+				for (int oy = lo[1]; oy <= hi[1]; oy++)
+				for (int oz = lo[2]; oz <= hi[2]; oz++){
+					unsigned int b = bucket_of_cell(cx + ox, cy + oy, cz + oz);
+					unsigned int k = (b * 2654435761u) >> (32 - HASH_SEEN_BITS);
+					while (seen[k] != b && seen[k] != 0xFFFFFFFFu)
+						k = (k + 1) & (HASH_SEEN_SLOTS - 1);
+					if (seen[k] == b)
+						continue;
+					seen[k] = b;
+					unsigned int end = (unsigned int)_bucket_start[b+1];
+					for (unsigned int slot = (unsigned int)_bucket_start[b]; slot < end; slot++){
+						float dx = _sorted_x[slot] - x;
+						float dy = _sorted_y[slot] - y;
+						float dz = _sorted_z[slot] - z;
+						float d2 = dx*dx + dy*dy + dz*dz;
+						if (d2 <= r2)
+							v(_sorted_index[slot], dx, dy, dz, d2);
+					}
+				}
+			}
+			// Same, around particle i (as of the last build), skipping i itself.
+			template <class Visitor>
+			void for_each_neighbor( unsigned int i, float radius, Visitor & v ) const {
+				unsigned int slot = _slot_of[i];
+				Skip_Self<Visitor> skip = { i, &v };
+				for_each_neighbor(_sorted_x[slot], _sorted_y[slot], _sorted_z[slot], radius, skip);
+			}
+
+			// build() over the store's current positions, then push every
+			// particle away from its neighbors within radius (at most the
+			// cell size): each one at distance d adds strength * (1 - d /
+			// radius) to the acceleration, pointing away from it, and dt_s
+			// of that goes into the velocity. Neighbors are summed in the
+			// build's fixed order, so the result doesn't depend on the
+			// threads. Parallel on the pool if there is one.
+			void separate( particle_store_t & s, float radius, float strength, float dt_s, Thread_Pool * pool );
+			double last_force_ms( void ) { return _last_force_ms; }
+
+		protected:
+			template <class Visitor>
+			struct Skip_Self {
+				unsigned int self;
+				Visitor * v;
+				void operator()( unsigned int j, float dx, float dy, float dz, float d2 ){
+					if (j != self)
+						(*v)(j, dx, dy, dz, d2);
+				}
+			};
+
+			int cell_coord( float p ) const { return (int)floorf(p * _inv_cell_size); }
+			// Offsets (-1, 0 or 1) of the cells along one axis that come
+			// within radius of p, in cell c; a hair generous, so rounding
+			// can't drop one
+			void cell_span( float p, int c, float radius, int * lo, int * hi ) const {
+				float f = p * _inv_cell_size - (float)c;
+				float r = radius * _inv_cell_size + 1e-4f;
+				*lo = f <= r ? -1 : 0;
+				*hi = 1.0f - f <= r ? 1 : 0;
+			}
+			unsigned int bucket_of_cell( int cx, int cy, int cz ) const {
+				return (((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u) ^
+						((unsigned int)cz * 83492791u)) & (_num_buckets - 1);
+			}
+
+			void reserve( unsigned int n );
+			// build() phases; user is the Spatial_Hash
+			static void clear_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void hash_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void sum_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void scan_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void scatter_range( unsigned int begin, unsigned int end, int worker, void * user );
+			static void finish_range( unsigned int begin, unsigned int end, int worker, void * user );
+			// separate()'s pass, over slots
+			static void separate_range( unsigned int begin, unsigned int end, int worker, void * user );
+
+			float _cell_size;
+			float _inv_cell_size;
+			unsigned int _n;
+			unsigned int _capacity;
+			unsigned int _num_buckets;
+			const particle_store_t * _store;
+			double _last_build_ms;
+			double _last_force_ms;
+			// separate(): the store it kicks, the radius, strength * dt_s
+			particle_store_t * _target;
+			float _radius;
+			float _push;
+
+			// per particle, in store order
+			unsigned int * _bucket_of;
+			unsigned int * _slot_of;
+			// per bucket (+1 for the end); _cursor is the scatter position
+			volatile LONG * _bucket_start;
+			volatile LONG * _cursor;
+			// per prefix-sum chunk of buckets
+			LONG * _chunk_sums;
+			// per slot, in bucket order
+			unsigned int * _sorted_index;
+			float * _sorted_x;
+			float * _sorted_y;
+			float * _sorted_z;
+
+		private:
+	};
+
+	// Time Spatial_Hash::build at doubling particle counts up to max_n on
+	// a pool of `threads` workers, and print rebuild time, throughput,
+	// the mean neighbor count within one cell_size and how long
+	// separate()'s pass takes at that radius.
+	void spatial_hash_benchmark( unsigned int max_n, int threads, float cell_size );
+};
+
+#endif //__XEN_SPATIAL_HASH_H
@@ -6,6 +6,7 @@
 
    Rev history:
      Gregory Izatt  20130901 Init revision
+     agent  20261017  Profiler zones around capture and filters; J writes the trace
    ######################################################################### */    
 
 #include "Eigen/Dense"
@@ -150,6 +151,8 @@ int main(int argc, char* argv[]) {
     // set up timer
     if (init_get_elapsed())
         exit(1);
+    if (profiler_init(false))
+        exit(1);
     get_elapsed(GET_ELAPSED_FRAMERATE);
 
     //Go get openGL set up / get the critical glob. variables set up
@@ -353,6 +356,7 @@ void glut_display(){
     // frame was rendered, give the player handler a tick
 
     totalFrames++;
+    profiler_frame();
 }
 
 /* #########################################################################
@@ -368,10 +372,13 @@ void render_core(){
 
     //capture webcam frame
     IplImage* frame_ipl = NULL;
-    if (rift_manager->which_eye()=='r')
-        frame_ipl = cvQueryFrame( r_capture );
-    else
-        frame_ipl = cvQueryFrame( l_capture );
+    {
+        PROFILE_ZONE("capture");
+        if (rift_manager->which_eye()=='r')
+            frame_ipl = cvQueryFrame( r_capture );
+        else
+            frame_ipl = cvQueryFrame( l_capture );
+    }
 
     // I suspect that frame_ipl should be freed but 
     //  the leak is small enough not to matter if it exists at all.
@@ -379,6 +386,8 @@ void render_core(){
     if ( !frame_ipl ) {
         printf( "ERROR: frame is null...\n" );
     } else {
+        // the texture upload is a zone of its own inside this one
+        PROFILE_ZONE("filters");
         Mat frame(frame_ipl);
         vector<KeyPoint> keypoints;
         vector<vector<Point> > contours;
@@ -446,7 +455,10 @@ void render_core(){
         if (draw_main_image || apply_features || apply_canny_contours ||
                 apply_sobel || apply_threshold || black_and_white ) {
 
-            ConvertMatToTexture(frame, ipl_convert_texture);
+            {
+                PROFILE_ZONE("texture upload");
+                ConvertMatToTexture(frame, ipl_convert_texture);
+            }
             glEnable(GL_TEXTURE_2D);
             glBindTexture(GL_TEXTURE_2D, ipl_convert_texture);
             glPushMatrix();